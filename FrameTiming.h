@@ -0,0 +1,106 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+namespace spectroscope::frame_timing {
+
+// Latest, mean and largest of the recent samples of one measurement, in
+// milliseconds. sampleCount is zero while nothing has been measured.
+struct Summary {
+	float latestMs { 0.0f };
+	float meanMs { 0.0f };
+	float maximumMs { 0.0f };
+	int sampleCount { 0 };
+};
+
+// A frame interval this many times the shortest recent one missed at least
+// one vertical blank.
+constexpr float missedFrameFactor = 1.5f;
+
+// The most recent windowSize samples of one measurement, in a fixed array so
+// adding samples on the render thread never allocates.
+class RollingWindow {
+public:
+	static constexpr int windowSize = 120;
+
+	void add(float milliseconds) noexcept
+	{
+		samples_[static_cast<std::size_t>(next_)] = std::max(0.0f, milliseconds);
+		next_ = (next_ + 1) % windowSize;
+		count_ = std::min(count_ + 1, windowSize);
+	}
+
+	void clear() noexcept
+	{
+		next_ = 0;
+		count_ = 0;
+	}
+
+	Summary summary() const noexcept
+	{
+		Summary result;
+		if (count_ == 0)
+			return result;
+
+		auto sum = 0.0;
+		for (int index = 0; index < count_; ++index) {
+			const auto sample = samples_[static_cast<std::size_t>(index)];
+			sum += static_cast<double>(sample);
+			result.maximumMs = std::max(result.maximumMs, sample);
+		}
+		result.latestMs = samples_[static_cast<std::size_t>((next_ + windowSize - 1) % windowSize)];
+		result.meanMs = static_cast<float>(sum / static_cast<double>(count_));
+		result.sampleCount = count_;
+		return result;
+	}
+
+	// Samples above missedFrameFactor times the smallest positive one. For
+	// frame intervals of continuous redrawing these are the frames that
+	// missed vsync; the shortest interval stands in for the refresh period.
+	int missedFrames() const noexcept
+	{
+		const auto begin = samples_.begin();
+		const auto end = begin + count_;
+		auto shortest = 0.0f;
+		for (auto sample = begin; sample != end; ++sample) {
+			if (*sample > 0.0f && (shortest <= 0.0f || *sample < shortest))
+				shortest = *sample;
+		}
+		if (shortest <= 0.0f)
+			return 0;
+		return static_cast<int>(std::count_if(begin, end,
+			[shortest](float sample) { return sample > shortest * missedFrameFactor; }));
+	}
+
+private:
+	std::array<float, windowSize> samples_ {};
+	int next_ { 0 };
+	int count_ { 0 };
+};
+
+// Rolling statistics of the widget's render loop. The CPU figures are wall
+// clock times on the render thread. The GPU figures come from GL_TIME_ELAPSED
+// queries and stay empty where timer queries are unavailable; a pass that did
+// not run in a frame contributes no sample.
+struct FrameStatistics {
+	Summary frameInterval;
+	Summary renderCpu;
+	Summary pullFramesCpu;
+	Summary uploadsCpu;
+	Summary uploadsGpu;
+	Summary shadeRowsGpu;
+	Summary waterfallGpu;
+	Summary noteOverlayGpu;
+	int missedFrames { 0 };
+	bool gpuTimersAvailable { false };
+};
+
+} // namespace spectroscope::frame_timing
@@ -35,4 +35,75 @@ inline float horizontalScreenPosition(float normalisedFrequency) noexcept
 	return 1.0f - std::clamp(normalisedFrequency, 0.0f, 1.0f);
 }
 
+// Inverse of normalisedPosition(): the frequency at an axis position, as a
+// fraction of Nyquist.
+inline float frequencyAtPosition(
+	float axisPosition, double sampleRate, double minimumFrequencyHz, bool logarithmic) noexcept
+{
+	const auto position = std::clamp(static_cast<double>(axisPosition), 0.0, 1.0);
+	const auto nyquist = sampleRate * 0.5;
+	if (!logarithmic || nyquist <= 0.0)
+		return static_cast<float>(position);
+
+	const auto minimumFrequency = std::clamp(minimumFrequencyHz, 0.001, nyquist);
+	return static_cast<float>(minimumFrequency * std::pow(nyquist / minimumFrequency, position) / nyquist);
+}
+
+struct ColumnParameters {
+	double sampleRate { 0.0 };
+	double minimumFrequencyHz { 1.0 };
+	bool logarithmic { true };
+	float concertAHz { 440.0f };
+	// Range of the tracked-pitch field, see PitchTracker::Layout.
+	int trackedOctavesBelowConcertA { 3 };
+	int trackedOctaveCount { 6 };
+};
+
+// Everything the waterfall shader derives from one frequency-axis pixel.
+struct ColumnMapping {
+	// Texture coordinate into the FFT rows.
+	float frequencyPosition { 0.0f };
+	// Position in the tracked-pitch field, from 0 to 1; negative without a
+	// frequency.
+	float trackedPosition { -1.0f };
+	// Circle-of-fifths hue of the nearest tempered note.
+	float hue { 0.0f };
+	// 1 at a tempered note, falling to 0 halfway to the next one.
+	float tuningSaturation { 0.0f };
+};
+
+inline ColumnMapping columnMapping(float axisPosition, const ColumnParameters& parameters) noexcept
+{
+	ColumnMapping mapping;
+	mapping.frequencyPosition = frequencyAtPosition(axisPosition, parameters.sampleRate,
+		parameters.minimumFrequencyHz, parameters.logarithmic);
+	const auto frequency = static_cast<double>(mapping.frequencyPosition) * parameters.sampleRate * 0.5;
+	if (frequency <= 0.0 || parameters.concertAHz <= 0.0f)
+		return mapping;
+
+	const auto lowestTrackedFrequency = parameters.concertAHz / std::exp2(parameters.trackedOctavesBelowConcertA);
+	mapping.trackedPosition = static_cast<float>(std::log2(frequency / lowestTrackedFrequency)
+		/ std::max(parameters.trackedOctaveCount, 1));
+
+	const auto fractionalMidiNote = 69.0 + 12.0 * std::log2(frequency / parameters.concertAHz);
+	const auto nearestMidiNote = std::floor(fractionalMidiNote + 0.5);
+	const auto centsFromNote = std::abs(100.0 * (fractionalMidiNote - nearestMidiNote));
+	// Multiplication by seven maps chromatic pitch classes onto circle-of-fifths order.
+	const auto pitchClass = nearestMidiNote - 12.0 * std::floor(nearestMidiNote / 12.0);
+	const auto fifthIndex = std::fmod(pitchClass * 7.0, 12.0);
+	mapping.hue = static_cast<float>(fifthIndex / 12.0);
+	mapping.tuningSaturation = static_cast<float>(std::clamp(1.0 - centsFromNote / 50.0, 0.0, 1.0));
+	return mapping;
+}
+
+// Maps pixelCount axis pixels at their centres, as the fragment shader
+// samples them.
+inline void fillColumnMappings(ColumnMapping* destination, int pixelCount, const ColumnParameters& parameters) noexcept
+{
+	for (int pixel = 0; pixel < pixelCount; ++pixel) {
+		const auto axisPosition = (static_cast<float>(pixel) + 0.5f) / static_cast<float>(pixelCount);
+		destination[pixel] = columnMapping(axisPosition, parameters);
+	}
+}
+
 }
@@ -7,10 +7,75 @@
 
 #include "OpenGLFloatTexture.h"
 #include "OpenGLHelpers.h"
+#include "TexelPacking.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	using Format = OpenGLFloatTexture::Format;
+
+	GLenum pixelFormat(int channels)
+	{
+		if (channels == 4)
+			return juce::gl::GL_RGBA;
+		return channels == 2 ? juce::gl::GL_RG : juce::gl::GL_RED;
+	}
+
+	GLint internalFormat(Format format, int channels)
+	{
+		const auto pick = [channels](GLint one, GLint two, GLint four) {
+			return channels == 4 ? four : channels == 2 ? two : one;
+		};
+		switch (format)
+		{
+		case Format::float16: return pick(juce::gl::GL_R16F, juce::gl::GL_RG16F, juce::gl::GL_RGBA16F);
+		case Format::unorm16: return pick(juce::gl::GL_R16, juce::gl::GL_RG16, juce::gl::GL_RGBA16);
+		case Format::unorm8: return pick(juce::gl::GL_R8, juce::gl::GL_RG8, juce::gl::GL_RGBA8);
+		case Format::float32: break;
+		}
+		return pick(juce::gl::GL_R32F, juce::gl::GL_RG32F, juce::gl::GL_RGBA32F);
+	}
+
+	GLenum componentType(Format format)
+	{
+		switch (format)
+		{
+		case Format::float16: return juce::gl::GL_HALF_FLOAT;
+		case Format::unorm16: return juce::gl::GL_UNSIGNED_SHORT;
+		case Format::unorm8: return juce::gl::GL_UNSIGNED_BYTE;
+		case Format::float32: break;
+		}
+		return juce::gl::GL_FLOAT;
+	}
+
+	int bytesPerComponent(Format format)
+	{
+		switch (format)
+		{
+		case Format::float16:
+		case Format::unorm16: return 2;
+		case Format::unorm8: return 1;
+		case Format::float32: break;
+		}
+		return 4;
+	}
+
+	bool supportsPersistentMapping()
+	{
+		GLint majorVersion = 0;
+		GLint minorVersion = 0;
+		juce::gl::glGetIntegerv(juce::gl::GL_MAJOR_VERSION, &majorVersion);
+		juce::gl::glGetIntegerv(juce::gl::GL_MINOR_VERSION, &minorVersion);
+		return majorVersion > 4 || (majorVersion == 4 && minorVersion >= 4)
+			|| juce::OpenGLHelpers::isExtensionSupported("GL_ARB_buffer_storage");
+	}
+}
 
 OpenGLFloatTexture::OpenGLFloatTexture()
-	: textureID_(0), width_(0), height_(0), context_(nullptr)
+	: textureID_(0), width_(0), height_(0), channels_(1), context_(nullptr)
 {
 }
 
@@ -24,6 +89,14 @@ bool OpenGLFloatTexture::isValidSize(int width, int height)
 	return juce::isPowerOfTwo(width) && juce::isPowerOfTwo(height);
 }
 
+void OpenGLFloatTexture::setFormat(Format format, float lowestValue, float highestValue)
+{
+	jassert(highestValue > lowestValue);
+	requestedFormat_ = format;
+	lowestValue_ = lowestValue;
+	highestValue_ = highestValue > lowestValue ? highestValue : lowestValue + 1.0f;
+}
+
 void OpenGLFloatTexture::load(const GLfloat *data, int width, int height, int row) 
 {
 	jassert(data != nullptr);
@@ -36,14 +109,69 @@ void OpenGLFloatTexture::load(const GLfloat *data, int width, int height, int ro
 	bind();
 	JUCE_CHECK_OPENGL_ERROR
 	
-	juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, row, width, height, juce::gl::GL_RED, juce::gl::GL_FLOAT, data);
+	juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, row, width, height, pixelFormat(channels_), componentType(format_),
+		packToScratch(data, width, height, width));
 	JUCE_CHECK_OPENGL_ERROR
 }
 
-void OpenGLFloatTexture::create(const int w, const int h, const GLfloat * pixels)
+void OpenGLFloatTexture::packTexels(const GLfloat* source, int width, int rowCount, int sourceRowWidth,
+	std::uint8_t* destination) const noexcept
+{
+	const auto rowComponents = static_cast<size_t>(width * channels_);
+	const auto sourceStride = static_cast<size_t>(sourceRowWidth * channels_);
+	namespace packing = spectroscope::texel_packing;
+	const packing::UnormRange range(lowestValue_, highestValue_);
+	for (int row = 0; row < rowCount; ++row)
+	{
+		const auto* sourceRow = source + static_cast<size_t>(row) * sourceStride;
+		const auto firstComponent = static_cast<size_t>(row) * rowComponents;
+		for (size_t component = 0; component < rowComponents; ++component)
+		{
+			const auto value = sourceRow[component];
+			switch (format_)
+			{
+			case Format::float32:
+				std::memcpy(destination + (firstComponent + component) * sizeof(GLfloat), &value, sizeof(GLfloat));
+				break;
+			case Format::float16:
+			{
+				const auto half = packing::toHalf(value);
+				std::memcpy(destination + (firstComponent + component) * sizeof(half), &half, sizeof(half));
+				break;
+			}
+			case Format::unorm16:
+			{
+				const auto packed = range.toUnorm16(value);
+				std::memcpy(destination + (firstComponent + component) * sizeof(packed), &packed, sizeof(packed));
+				break;
+			}
+			case Format::unorm8:
+				destination[firstComponent + component] = range.toUnorm8(value);
+				break;
+			}
+		}
+	}
+}
+
+// Float rows are uploaded as they are. Other formats are packed into tightly
+// packed rows of width texels.
+const void* OpenGLFloatTexture::packToScratch(const GLfloat* source, int width, int rowCount, int sourceRowWidth)
+{
+	if (format_ == Format::float32 || source == nullptr)
+		return source;
+
+	const auto bytes = static_cast<size_t>(width * rowCount * getBytesPerTexel());
+	if (packedScratch_.size() < bytes)
+		packedScratch_.resize(bytes);
+	packTexels(source, width, rowCount, sourceRowWidth, packedScratch_.data());
+	return packedScratch_.data();
+}
+
+void OpenGLFloatTexture::create(const int w, const int h, const GLfloat * pixels, const int channels)
 {
 	jassert(w > 0 && h > 0);
-	if (w <= 0 || h <= 0)
+	jassert(channels == 1 || channels == 2 || channels == 4);
+	if (w <= 0 || h <= 0 || (channels != 1 && channels != 2 && channels != 4))
 		return;
 
 	context_ = juce::OpenGLContext::getCurrentContext();
@@ -56,8 +184,6 @@ void OpenGLFloatTexture::create(const int w, const int h, const GLfloat * pixels
 		juce::gl::glBindTexture(juce::gl::GL_TEXTURE_2D, textureID_);
 		juce::gl::glTexParameteri(juce::gl::GL_TEXTURE_2D, juce::gl::GL_TEXTURE_MIN_FILTER, juce::gl::GL_LINEAR);
 		juce::gl::glTexParameteri(juce::gl::GL_TEXTURE_2D, juce::gl::GL_TEXTURE_MAG_FILTER, juce::gl::GL_LINEAR);
-		GLint swizzleMask[] = { juce::gl::GL_RED, juce::gl::GL_RED, juce::gl::GL_RED, juce::gl::GL_RED };
-		juce::gl::glTexParameteriv(juce::gl::GL_TEXTURE_2D, juce::gl::GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 		// Frequency must not wrap between Nyquist and DC. Only the time/history
@@ -72,6 +198,23 @@ void OpenGLFloatTexture::create(const int w, const int h, const GLfloat * pixels
 		JUCE_CHECK_OPENGL_ERROR;
 	}
 
+	channels_ = channels;
+	format_ = requestedFormat_;
+	GLint swizzleMask[] = { juce::gl::GL_RED, juce::gl::GL_RED, juce::gl::GL_RED, juce::gl::GL_RED };
+	if (channels_ == 2)
+	{
+		swizzleMask[1] = juce::gl::GL_GREEN;
+		swizzleMask[2] = juce::gl::GL_ZERO;
+		swizzleMask[3] = juce::gl::GL_ONE;
+	}
+	else if (channels_ == 4)
+	{
+		swizzleMask[1] = juce::gl::GL_GREEN;
+		swizzleMask[2] = juce::gl::GL_BLUE;
+		swizzleMask[3] = juce::gl::GL_ALPHA;
+	}
+	juce::gl::glTexParameteriv(juce::gl::GL_TEXTURE_2D, juce::gl::GL_TEXTURE_SWIZZLE_RGBA, swizzleMask);
+
 	juce::gl::glPixelStorei(juce::gl::GL_UNPACK_ALIGNMENT, 1);
 	JUCE_CHECK_OPENGL_ERROR
 
@@ -80,23 +223,232 @@ void OpenGLFloatTexture::create(const int w, const int h, const GLfloat * pixels
 
 	if (width_ != w || height_ != h)
 	{
-		juce::gl::glTexImage2D(juce::gl::GL_TEXTURE_2D, 0, juce::gl::GL_R32F, width_, height_, 0, juce::gl::GL_RED, juce::gl::GL_FLOAT, nullptr);
-		juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, 0, w, h, juce::gl::GL_RED, juce::gl::GL_FLOAT, pixels);
+		juce::gl::glTexImage2D(juce::gl::GL_TEXTURE_2D, 0, internalFormat(format_, channels_), width_, height_, 0, pixelFormat(channels_), componentType(format_), nullptr);
+		juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, 0, w, h, pixelFormat(channels_), componentType(format_), packToScratch(pixels, w, h, w));
 	}
 	else
 	{
-		juce::gl::glTexImage2D(juce::gl::GL_TEXTURE_2D, 0, juce::gl::GL_R32F, w, h, 0, juce::gl::GL_RED, juce::gl::GL_FLOAT, pixels);
+		juce::gl::glTexImage2D(juce::gl::GL_TEXTURE_2D, 0, internalFormat(format_, channels_), w, h, 0, pixelFormat(channels_), componentType(format_), packToScratch(pixels, w, h, w));
+	}
+	// Large initial images are not kept around for later row uploads.
+	packedScratch_ = std::vector<std::uint8_t>();
+
+	JUCE_CHECK_OPENGL_ERROR
+}
+
+int OpenGLFloatTexture::uploadSegmentBytes() const noexcept
+{
+	return uploadRows_ * uploadRowWidth_ * getBytesPerTexel();
+}
+
+bool OpenGLFloatTexture::createUploadStream(int rowWidth, int maximumRows)
+{
+	jassert(textureID_ != 0 && rowWidth > 0 && rowWidth <= width_ && maximumRows > 0);
+	releaseUploadStream();
+	if (textureID_ == 0 || rowWidth <= 0 || rowWidth > width_ || maximumRows <= 0)
+		return false;
+
+	uploadRows_ = maximumRows;
+	uploadRowWidth_ = rowWidth;
+	const auto segmentBytes = static_cast<GLsizeiptr>(uploadSegmentBytes());
+	juce::gl::glGenBuffers(1, &uploadBuffer_);
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+	if (supportsPersistentMapping())
+	{
+		constexpr GLbitfield flags = juce::gl::GL_MAP_WRITE_BIT | juce::gl::GL_MAP_PERSISTENT_BIT | juce::gl::GL_MAP_COHERENT_BIT;
+		const auto bufferBytes = segmentBytes * uploadSegmentCount;
+		juce::gl::glBufferStorage(juce::gl::GL_PIXEL_UNPACK_BUFFER, bufferBytes, nullptr, flags);
+		persistentUploadMapping_ = static_cast<std::uint8_t*>(
+			juce::gl::glMapBufferRange(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0, bufferBytes, flags));
+	}
+	if (persistentUploadMapping_ == nullptr)
+	{
+		// Immutable storage cannot be respecified, so the orphaning fallback
+		// needs a fresh buffer if persistent mapping failed.
+		juce::gl::glDeleteBuffers(1, &uploadBuffer_);
+		juce::gl::glGenBuffers(1, &uploadBuffer_);
+		juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+		juce::gl::glBufferData(juce::gl::GL_PIXEL_UNPACK_BUFFER, segmentBytes, nullptr, juce::gl::GL_STREAM_DRAW);
+	}
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0);
+	JUCE_CHECK_OPENGL_ERROR
+
+	if (uploadBuffer_ == 0)
+	{
+		uploadRows_ = 0;
+		uploadRowWidth_ = 0;
+	}
+	return uploadBuffer_ != 0;
+}
+
+GLfloat* OpenGLFloatTexture::beginUpload()
+{
+	if (format_ != Format::float32)
+		return nullptr;
+	return reinterpret_cast<GLfloat*>(mapUploadSegment());
+}
+
+std::uint8_t* OpenGLFloatTexture::mapUploadSegment()
+{
+	jassert(mappedUploadSegment_ == nullptr);
+	if (uploadBuffer_ == 0 || mappedUploadSegment_ != nullptr)
+		return nullptr;
+
+	if (persistentUploadMapping_ != nullptr)
+	{
+		// Three segments keep the GPU two frames behind before this waits.
+		auto& fence = uploadFences_[static_cast<size_t>(uploadSegment_)];
+		if (fence != nullptr)
+		{
+			auto status = juce::gl::glClientWaitSync(fence, 0, 0);
+			while (status == juce::gl::GL_TIMEOUT_EXPIRED)
+				status = juce::gl::glClientWaitSync(fence, juce::gl::GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			juce::gl::glDeleteSync(fence);
+			fence = nullptr;
+		}
+		mappedUploadSegment_ = persistentUploadMapping_ + uploadSegment_ * uploadSegmentBytes();
+		return mappedUploadSegment_;
+	}
+
+	const auto segmentBytes = static_cast<GLsizeiptr>(uploadSegmentBytes());
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+	juce::gl::glBufferData(juce::gl::GL_PIXEL_UNPACK_BUFFER, segmentBytes, nullptr, juce::gl::GL_STREAM_DRAW);
+	mappedUploadSegment_ = static_cast<std::uint8_t*>(juce::gl::glMapBufferRange(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0, segmentBytes,
+		juce::gl::GL_MAP_WRITE_BIT | juce::gl::GL_MAP_INVALIDATE_BUFFER_BIT));
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0);
+	JUCE_CHECK_OPENGL_ERROR
+	return mappedUploadSegment_;
+}
+
+void OpenGLFloatTexture::loadRows(const GLfloat* data, int width, int firstRow, int rowCount, int historyRows,
+	int sourceRowWidth)
+{
+	jassert(data != nullptr);
+	jassert(textureID_ != 0);
+	if (data == nullptr || textureID_ == 0 || rowCount <= 0)
+		return;
+
+	if (sourceRowWidth <= 0)
+		sourceRowWidth = width;
+	if (format_ == Format::float32)
+	{
+		bind();
+		uploadRowRange(reinterpret_cast<std::uintptr_t>(data), width, firstRow, rowCount, historyRows, sourceRowWidth);
+		JUCE_CHECK_OPENGL_ERROR
+		return;
+	}
+
+	// Packed rows go through the stream when they fit a segment.
+	if (width == uploadRowWidth_ && rowCount <= uploadRows_ && mappedUploadSegment_ == nullptr)
+	{
+		if (auto* segment = mapUploadSegment())
+		{
+			packTexels(data, width, rowCount, sourceRowWidth, segment);
+			submitUpload(firstRow, rowCount, historyRows);
+			return;
+		}
 	}
 
+	bind();
+	const auto* packed = packToScratch(data, width, rowCount, sourceRowWidth);
+	uploadRowRange(reinterpret_cast<std::uintptr_t>(packed), width, firstRow, rowCount, historyRows, width);
 	JUCE_CHECK_OPENGL_ERROR
 }
 
+// With a pixel unpack buffer bound, source is a byte offset into it.
+void OpenGLFloatTexture::uploadRowRange(std::uintptr_t source, int width, int firstRow, int rowCount, int historyRows,
+	int sourceRowWidth) const
+{
+	jassert(width > 0 && width <= sourceRowWidth && sourceRowWidth <= width_);
+	jassert(historyRows > 0 && historyRows <= height_ && firstRow >= 0 && firstRow < historyRows);
+	jassert(rowCount >= 0 && rowCount <= historyRows);
+	if (width <= 0 || width > sourceRowWidth || historyRows <= 0 || historyRows > height_
+		|| firstRow < 0 || firstRow >= historyRows || rowCount <= 0 || rowCount > historyRows)
+		return;
+
+	if (sourceRowWidth != width)
+		juce::gl::glPixelStorei(juce::gl::GL_UNPACK_ROW_LENGTH, sourceRowWidth);
+	const auto firstRange = std::min(rowCount, historyRows - firstRow);
+	juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, firstRow, width, firstRange, pixelFormat(channels_),
+		componentType(format_), reinterpret_cast<const void*>(source));
+	if (rowCount > firstRange)
+	{
+		const auto wrappedBytes = static_cast<std::uintptr_t>(firstRange) * static_cast<std::uintptr_t>(sourceRowWidth)
+			* static_cast<std::uintptr_t>(getBytesPerTexel());
+		juce::gl::glTexSubImage2D(juce::gl::GL_TEXTURE_2D, 0, 0, 0, width, rowCount - firstRange, pixelFormat(channels_),
+			componentType(format_), reinterpret_cast<const void*>(source + wrappedBytes));
+	}
+	if (sourceRowWidth != width)
+		juce::gl::glPixelStorei(juce::gl::GL_UNPACK_ROW_LENGTH, 0);
+}
+
+// The segment's rows go to the rowCount texture rows from firstRow on, in a
+// circular history of historyRows rows.
+void OpenGLFloatTexture::submitUpload(int firstRow, int rowCount, int historyRows)
+{
+	jassert(mappedUploadSegment_ != nullptr);
+	jassert(rowCount >= 0 && rowCount <= uploadRows_);
+	if (mappedUploadSegment_ == nullptr)
+		return;
+
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+	if (persistentUploadMapping_ == nullptr)
+		juce::gl::glUnmapBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER);
+
+	const auto segmentOffset = persistentUploadMapping_ != nullptr
+		? static_cast<std::uintptr_t>(uploadSegment_ * uploadSegmentBytes()) : std::uintptr_t { 0 };
+	bind();
+	uploadRowRange(segmentOffset, uploadRowWidth_, firstRow, juce::jlimit(0, uploadRows_, rowCount), historyRows,
+		uploadRowWidth_);
+	juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (persistentUploadMapping_ != nullptr)
+	{
+		uploadFences_[static_cast<size_t>(uploadSegment_)] = juce::gl::glFenceSync(juce::gl::GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		uploadSegment_ = (uploadSegment_ + 1) % uploadSegmentCount;
+	}
+	mappedUploadSegment_ = nullptr;
+	JUCE_CHECK_OPENGL_ERROR
+}
+
+bool OpenGLFloatTexture::isUploadStreamPersistent() const noexcept
+{
+	return persistentUploadMapping_ != nullptr;
+}
+
+void OpenGLFloatTexture::releaseUploadStream()
+{
+	for (auto& fence : uploadFences_)
+	{
+		if (fence != nullptr)
+			juce::gl::glDeleteSync(fence);
+		fence = nullptr;
+	}
+	if (uploadBuffer_ != 0)
+	{
+		if (persistentUploadMapping_ != nullptr || mappedUploadSegment_ != nullptr)
+		{
+			juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, uploadBuffer_);
+			juce::gl::glUnmapBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER);
+			juce::gl::glBindBuffer(juce::gl::GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		juce::gl::glDeleteBuffers(1, &uploadBuffer_);
+		uploadBuffer_ = 0;
+	}
+	persistentUploadMapping_ = nullptr;
+	mappedUploadSegment_ = nullptr;
+	uploadSegment_ = 0;
+	uploadRows_ = 0;
+	uploadRowWidth_ = 0;
+}
+
 void OpenGLFloatTexture::release()
 {
 	if (textureID_ != 0)
 	{
 		if (context_ == juce::OpenGLContext::getCurrentContext())
 		{
+			releaseUploadStream();
 			juce::gl::glDeleteTextures(1, &textureID_);
 			textureID_ = 0;
 			width_ = 0;
@@ -134,3 +486,27 @@ int OpenGLFloatTexture::getHeight() const noexcept
 	return height_;
 }
 
+int OpenGLFloatTexture::getChannels() const noexcept
+{
+	return channels_;
+}
+
+OpenGLFloatTexture::Format OpenGLFloatTexture::getFormat() const noexcept
+{
+	return format_;
+}
+
+int OpenGLFloatTexture::getBytesPerTexel() const noexcept
+{
+	return channels_ * bytesPerComponent(format_);
+}
+
+float OpenGLFloatTexture::getValueOffset() const noexcept
+{
+	return format_ == Format::unorm16 || format_ == Format::unorm8 ? lowestValue_ : 0.0f;
+}
+
+float OpenGLFloatTexture::getValueScale() const noexcept
+{
+	return format_ == Format::unorm16 || format_ == Format::unorm8 ? highestValue_ - lowestValue_ : 1.0f;
+}
@@ -8,14 +8,56 @@
 
 #include <juce_opengl/juce_opengl.h>
 
+#include <array>
+#include <cstdint>
+#include <vector>
+
 class OpenGLFloatTexture
 {
 public:
+	// Storage precision of the texels. Half floats keep the values as they
+	// are; the normalized formats store them linearly between the value
+	// range's ends, clamped, and a shader reads them back in [0, 1], so it has
+	// to apply getValueOffset() + getValueScale() * sample. Data is always
+	// passed as floats and packed on the CPU before it is uploaded.
+	enum class Format {
+		float32,
+		float16,
+		unorm16,
+		unorm8
+	};
+
 	OpenGLFloatTexture();
 	~OpenGLFloatTexture();
 
-	void create(int w, int h, const GLfloat *pixels);
+	// Takes effect at the next create().
+	void setFormat(Format format, float lowestValue = 0.0f, float highestValue = 1.0f);
+
+	// One channel textures read as grey; two and four channel textures take
+	// interleaved pairs or quadruples of floats per texel.
+	void create(int w, int h, const GLfloat *pixels, int channels = 1);
 	void load(const GLfloat * data, int width, int height, int row = 0);
+	// Uploads rowCount consecutive rows of a circular history of historyRows
+	// rows, starting at firstRow, with at most two glTexSubImage2D calls: one
+	// up to the end of the history and one from its start. sourceRowWidth is
+	// the texel stride of data when it holds wider rows than are uploaded.
+	void loadRows(const GLfloat* data, int width, int firstRow, int rowCount, int historyRows,
+		int sourceRowWidth = 0);
+
+	// Streaming uploads stage rows in a ring of pixel unpack buffer segments,
+	// one per frame in flight, so glTexSubImage2D returns without copying and
+	// the driver transfers the rows asynchronously. The buffer is persistently
+	// mapped where GL 4.4 or ARB_buffer_storage is available and each segment
+	// is fenced until the GPU has read it; otherwise the buffer is orphaned and
+	// mapped once per frame. A segment holds maximumRows rows of rowWidth
+	// texels. Every beginUpload() that returns a segment must be followed by
+	// submitUpload() before the next frame. beginUpload() hands out float
+	// segments for float32 textures only; loadRows() packs other formats into
+	// the stream itself.
+	bool createUploadStream(int rowWidth, int maximumRows);
+	GLfloat* beginUpload();
+	void submitUpload(int firstRow, int rowCount, int historyRows);
+	bool isUploadStreamPersistent() const noexcept;
 
 	void release();
 	void bind() const;
@@ -26,12 +68,42 @@ public:
 	GLuint getTextureID() const noexcept;
 	int getWidth() const noexcept;
 	int getHeight() const noexcept;
+	int getChannels() const noexcept;
+	Format getFormat() const noexcept;
+	int getBytesPerTexel() const noexcept;
+	float getValueOffset() const noexcept;
+	float getValueScale() const noexcept;
 
 private:
+	static constexpr int uploadSegmentCount = 3;
+
+	void releaseUploadStream();
+	std::uint8_t* mapUploadSegment();
+	void packTexels(const GLfloat* source, int width, int rowCount, int sourceRowWidth,
+		std::uint8_t* destination) const noexcept;
+	const void* packToScratch(const GLfloat* source, int width, int rowCount, int sourceRowWidth);
+	void uploadRowRange(std::uintptr_t source, int width, int firstRow, int rowCount, int historyRows,
+		int sourceRowWidth) const;
+	int uploadSegmentBytes() const noexcept;
+
 	GLuint textureID_;
 	int width_;
 	int height_;
+	int channels_;
 	juce::OpenGLContext* context_;
+	Format format_ { Format::float32 };
+	Format requestedFormat_ { Format::float32 };
+	float lowestValue_ { 0.0f };
+	float highestValue_ { 1.0f };
+	// Packed rows for uploads that do not go through the stream.
+	std::vector<std::uint8_t> packedScratch_;
+	GLuint uploadBuffer_ { 0 };
+	std::uint8_t* persistentUploadMapping_ { nullptr };
+	std::uint8_t* mappedUploadSegment_ { nullptr };
+	std::array<GLsync, uploadSegmentCount> uploadFences_ {};
+	int uploadSegment_ { 0 };
+	int uploadRows_ { 0 };
+	int uploadRowWidth_ { 0 };
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OpenGLFloatTexture)
 };
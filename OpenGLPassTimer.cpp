@@ -0,0 +1,149 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "OpenGLPassTimer.h"
+
+#include <algorithm>
+
+namespace
+{
+	bool supportsTimerQueries()
+	{
+		GLint majorVersion = 0;
+		GLint minorVersion = 0;
+		juce::gl::glGetIntegerv(juce::gl::GL_MAJOR_VERSION, &majorVersion);
+		juce::gl::glGetIntegerv(juce::gl::GL_MINOR_VERSION, &minorVersion);
+		return majorVersion > 3 || (majorVersion == 3 && minorVersion >= 3)
+			|| juce::OpenGLHelpers::isExtensionSupported("GL_ARB_timer_query");
+	}
+}
+
+OpenGLPassTimer::~OpenGLPassTimer()
+{
+	release();
+}
+
+bool OpenGLPassTimer::create(int passCount)
+{
+	release();
+	if (passCount <= 0 || passCount > maximumPasses || !supportsTimerQueries())
+		return false;
+
+	context_ = juce::OpenGLContext::getCurrentContext();
+	passCount_ = passCount;
+	for (auto& set : sets_)
+	{
+		juce::gl::glGenQueries(passCount, set.queries.data());
+		if (std::any_of(set.queries.begin(), set.queries.begin() + passCount,
+			[](GLuint query) { return query == 0; }))
+		{
+			release();
+			return false;
+		}
+	}
+	return true;
+}
+
+void OpenGLPassTimer::release()
+{
+	if (passCount_ == 0)
+		return;
+
+	if (context_ != juce::OpenGLContext::getCurrentContext())
+	{
+		DBG("OpenGLPassTimer must be released while its owning context is current");
+		return;
+	}
+	if (activePass_ >= 0)
+		juce::gl::glEndQuery(juce::gl::GL_TIME_ELAPSED);
+	for (auto& set : sets_)
+	{
+		juce::gl::glDeleteQueries(passCount_, set.queries.data());
+		set = {};
+	}
+	context_ = nullptr;
+	passCount_ = 0;
+	currentSet_ = 0;
+	activePass_ = -1;
+	droppedFrames_ = 0;
+}
+
+bool OpenGLPassTimer::isAvailable() const noexcept
+{
+	return passCount_ > 0;
+}
+
+bool OpenGLPassTimer::beginFrame(float* passMilliseconds)
+{
+	if (passCount_ == 0)
+		return false;
+
+	jassert(activePass_ < 0);
+	currentSet_ = (currentSet_ + 1) % framesInFlight;
+	auto& set = sets_[static_cast<size_t>(currentSet_)];
+	const auto collected = set.pending && collect(set, passMilliseconds);
+	set.issued = {};
+	set.pending = false;
+	return collected;
+}
+
+void OpenGLPassTimer::beginPass(int pass)
+{
+	if (passCount_ == 0 || pass < 0 || pass >= passCount_)
+		return;
+
+	jassert(activePass_ < 0);
+	auto& set = sets_[static_cast<size_t>(currentSet_)];
+	juce::gl::glBeginQuery(juce::gl::GL_TIME_ELAPSED, set.queries[static_cast<size_t>(pass)]);
+	set.issued[static_cast<size_t>(pass)] = true;
+	set.pending = true;
+	activePass_ = pass;
+}
+
+void OpenGLPassTimer::endPass()
+{
+	if (activePass_ < 0)
+		return;
+
+	juce::gl::glEndQuery(juce::gl::GL_TIME_ELAPSED);
+	activePass_ = -1;
+}
+
+int OpenGLPassTimer::getDroppedFrames() const noexcept
+{
+	return droppedFrames_;
+}
+
+// Only reads results the GPU has already written, so a frame that is still
+// in flight is dropped instead of stalling the render thread.
+bool OpenGLPassTimer::collect(QuerySet& set, float* passMilliseconds)
+{
+	for (int pass = 0; pass < passCount_; ++pass)
+	{
+		if (!set.issued[static_cast<size_t>(pass)])
+			continue;
+		GLuint available = 0;
+		juce::gl::glGetQueryObjectuiv(set.queries[static_cast<size_t>(pass)],
+			juce::gl::GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == 0)
+		{
+			++droppedFrames_;
+			return false;
+		}
+	}
+
+	for (int pass = 0; pass < passCount_; ++pass)
+	{
+		passMilliseconds[pass] = -1.0f;
+		if (!set.issued[static_cast<size_t>(pass)])
+			continue;
+		GLuint64 nanoseconds = 0;
+		juce::gl::glGetQueryObjectui64v(set.queries[static_cast<size_t>(pass)],
+			juce::gl::GL_QUERY_RESULT, &nanoseconds);
+		passMilliseconds[pass] = static_cast<float>(static_cast<double>(nanoseconds) * 1.0e-6);
+	}
+	return true;
+}
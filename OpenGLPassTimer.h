@@ -0,0 +1,62 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <juce_opengl/juce_opengl.h>
+
+#include <array>
+
+// Measures the GPU time of up to maximumPasses consecutive render passes per
+// frame with GL_TIME_ELAPSED queries. Queries are double-buffered: a frame's
+// results are collected when its query set comes round again two frames
+// later, and only if the GPU has already finished them, so reading never
+// waits for the GPU. Results that are not ready in time are dropped.
+// Requires GL 3.3 or ARB_timer_query; create() returns false without it and
+// every other call then does nothing. Passes may not overlap, since only one
+// GL_TIME_ELAPSED query can be active at a time.
+class OpenGLPassTimer
+{
+public:
+	static constexpr int maximumPasses = 8;
+
+	OpenGLPassTimer() = default;
+	~OpenGLPassTimer();
+
+	bool create(int passCount);
+	void release();
+	bool isAvailable() const noexcept;
+
+	// Starts a frame and collects the results of the frame that last used
+	// this query set. Returns true and writes passCount times in
+	// milliseconds, negative for passes that did not run, if there were any.
+	bool beginFrame(float* passMilliseconds);
+	void beginPass(int pass);
+	void endPass();
+
+	int getDroppedFrames() const noexcept;
+
+private:
+	static constexpr int framesInFlight = 2;
+
+	struct QuerySet
+	{
+		std::array<GLuint, maximumPasses> queries {};
+		std::array<bool, maximumPasses> issued {};
+		bool pending { false };
+	};
+
+	bool collect(QuerySet& set, float* passMilliseconds);
+
+	std::array<QuerySet, framesInFlight> sets_ {};
+	juce::OpenGLContext* context_ { nullptr };
+	int passCount_ { 0 };
+	int currentSet_ { 0 };
+	int activePass_ { -1 };
+	int droppedFrames_ { 0 };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OpenGLPassTimer)
+};
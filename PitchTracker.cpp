@@ -6,9 +6,14 @@
 
 #include "PitchTracker.h"
 
+#include "SpectroscopeTrace.h"
+
+#include <juce_core/juce_core.h>
+
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <limits>
 
 namespace {
 constexpr float minimumConcertAHz = 400.0f;
@@ -16,24 +21,83 @@ constexpr float maximumConcertAHz = 480.0f;
 constexpr float levelAttack = 0.35f;
 constexpr float levelRelease = 0.015f;
 constexpr float noteRemovalStrength = 0.01f;
+// Retuning and preset changes glide the resonator coefficients to their new
+// values over 512 samples at 48 kHz, in steps of crossfadeStepSamples.
+constexpr double crossfadeSamples = 512.0;
+constexpr double crossfadeSampleRate = 48000.0;
+constexpr int crossfadeStepSamples = 64;
+// Recursive state decays exponentially during silence. Clearing it long
+// before it becomes subnormal keeps silent hops as cheap as loud ones even
+// when the host has not enabled flush-to-zero. The level is far below
+// anything the tracker can detect.
+constexpr float stateFlushThreshold = 1.0e-15f;
 
 float clamp01(float value)
 {
 	return std::clamp(value, 0.0f, 1.0f);
 }
 
+float flushSmall(float value)
+{
+	return std::abs(value) < stateFlushThreshold ? 0.0f : value;
+}
+
+float followForSteps(float coefficient, float steps)
+{
+	return 1.0f - std::pow(1.0f - coefficient, steps);
+}
+
 float smoothStep(float lower, float upper, float value)
 {
 	const auto normalised = clamp01((value - lower) / (upper - lower));
 	return normalised * normalised * (3.0f - 2.0f * normalised);
 }
 
+PitchTracker::Layout validatedLayout(const PitchTracker::Layout& layout)
+{
+	return { std::clamp(layout.binsPerOctave, 12, 96), std::clamp(layout.octaveCount, 1, 10),
+		std::clamp(layout.outputBinCount, 16, 4096), std::clamp(layout.octavesBelowConcertA, 0, 5),
+		std::clamp(layout.polyphony, 1, 128) };
+}
+
+}
+
+PitchTracker::PitchTracker()
+	: PitchTracker(Layout {})
+{
+}
+
+PitchTracker::PitchTracker(const Layout& layout)
+	: layout_(validatedLayout(layout))
+	, analysisBinCount_(layout_.binsPerOctave * layout_.octaveCount)
+	, silenceSkipDecay_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, silenceSkipCosine_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, silenceSkipSine_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, analysisBins_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, smoothedBins_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, sortedBins_(static_cast<std::size_t>(analysisBinCount_), 0.0f)
+	, candidatePeaks_(static_cast<std::size_t>(analysisBinCount_))
+	, fundamentalPeaks_(static_cast<std::size_t>(layout_.polyphony))
+	, trackedNotes_(static_cast<std::size_t>(layout_.polyphony))
+	, fieldNotes_(static_cast<std::size_t>(layout_.polyphony))
+{
+	trackOrder_.reserve(static_cast<std::size_t>(layout_.polyphony));
+	freeTracks_.reserve(static_cast<std::size_t>(layout_.polyphony));
+	for (auto* coefficients : { &resonators_.cosineStep, &resonators_.sineStep, &resonators_.cosinePhase,
+			 &resonators_.sinePhase, &resonators_.decay, &resonators_.inPhase, &resonators_.quadrature }) {
+		coefficients->assign(static_cast<std::size_t>(analysisBinCount_), 0.0f);
+	}
+	rebuildResonators();
+	reset();
 }
 
 void PitchTracker::prepare(double newSampleRate, float newConcertAHz)
 {
 	sampleRate_ = std::max(0.0, newSampleRate);
 	concertAHz_ = std::clamp(newConcertAHz, minimumConcertAHz, maximumConcertAHz);
+	// Resonators at or above Nyquist are silenced, so the layout loses its
+	// top instead of reporting aliased notes.
+	jassert(sampleRate_ <= 0.0 || highestFrequencyHz() < 0.5 * sampleRate_);
 	rebuildResonators();
 	reset();
 }
@@ -44,18 +108,18 @@ void PitchTracker::reset()
 	dcBlockerOutput_ = 0.0f;
 	currentInputPeak_ = 0.0f;
 	adaptiveSignalLevel_ = 0.0f;
+	samplesSinceCalculate_ = 0;
+	inputPeakSamples_ = 0;
 	std::fill(analysisBins_.begin(), analysisBins_.end(), 0.0f);
 	std::fill(smoothedBins_.begin(), smoothedBins_.end(), 0.0f);
 	std::fill(sortedBins_.begin(), sortedBins_.end(), 0.0f);
 	candidatePeakCount_ = 0;
 	fundamentalPeakCount_ = 0;
 
-	for (auto& resonator : resonators_) {
-		resonator.cosinePhase = 1.0f;
-		resonator.sinePhase = 0.0f;
-		resonator.inPhase = 0.0f;
-		resonator.quadrature = 0.0f;
-	}
+	std::fill(resonators_.cosinePhase.begin(), resonators_.cosinePhase.end(), 1.0f);
+	std::fill(resonators_.sinePhase.begin(), resonators_.sinePhase.end(), 0.0f);
+	std::fill(resonators_.inPhase.begin(), resonators_.inPhase.end(), 0.0f);
+	std::fill(resonators_.quadrature.begin(), resonators_.quadrature.end(), 0.0f);
 	for (auto& note : trackedNotes_)
 		note = {};
 }
@@ -66,9 +130,39 @@ void PitchTracker::setConcertAHz(float frequencyHz)
 	if (std::abs(clampedFrequency - concertAHz_) < 0.001f)
 		return;
 
+	// Tracked notes keep their absolute pitch, so they move against the grid
+	// that is anchored Layout::octavesBelowConcertA octaves below concert A.
+	const auto shift = static_cast<float>(layout_.binsPerOctave) * std::log2(clampedFrequency / concertAHz_);
 	concertAHz_ = clampedFrequency;
-	rebuildResonators();
-	reset();
+	for (auto& note : trackedNotes_) {
+		if (!note.active)
+			continue;
+		note.position -= shift;
+		if (note.position < 0.0f || note.position > static_cast<float>(analysisBinCount_ - 1))
+			note = {};
+	}
+	startCoefficientCrossfade();
+}
+
+void PitchTracker::setSampleRate(double newSampleRate)
+{
+	const auto clampedSampleRate = std::max(0.0, newSampleRate);
+	if (std::abs(clampedSampleRate - sampleRate_) < 0.001)
+		return;
+	if (sampleRate_ <= 0.0 || clampedSampleRate <= 0.0) {
+		prepare(clampedSampleRate, concertAHz_);
+		return;
+	}
+
+	// Tracked notes are positioned in analysis bins, which do not depend on
+	// the rate.
+	if (crossfadeRemainingSamples_ > 0) {
+		crossfadeRemainingSamples_ = std::max(1, static_cast<int>(std::lround(
+			static_cast<double>(crossfadeRemainingSamples_) * clampedSampleRate / sampleRate_)));
+	}
+	sampleRate_ = clampedSampleRate;
+	writeDcBlockerCoefficient();
+	writeResonatorCoefficients(true);
 }
 
 void PitchTracker::setPreset(Preset newPreset)
@@ -76,8 +170,7 @@ void PitchTracker::setPreset(Preset newPreset)
 	if (newPreset == preset_)
 		return;
 	preset_ = newPreset;
-	rebuildResonators();
-	reset();
+	startCoefficientCrossfade();
 }
 
 void PitchTracker::process(const float* samples, int numSamples)
@@ -85,66 +178,174 @@ void PitchTracker::process(const float* samples, int numSamples)
 	if (samples == nullptr || numSamples <= 0 || sampleRate_ <= 0.0)
 		return;
 
-	currentInputPeak_ = 0.0f;
-	for (int sampleIndex = 0; sampleIndex < numSamples; ++sampleIndex) {
-		const auto input = samples[sampleIndex];
-		currentInputPeak_ = std::max(currentInputPeak_, std::abs(input));
-		const auto filteredInput = input - previousInput_ + dcBlockerCoefficient_ * dcBlockerOutput_;
-		previousInput_ = input;
-		dcBlockerOutput_ = filteredInput;
-
-		for (auto& resonator : resonators_) {
-			resonator.inPhase = resonator.decay * resonator.inPhase
-				+ filteredInput * resonator.cosinePhase;
-			resonator.quadrature = resonator.decay * resonator.quadrature
-				+ filteredInput * resonator.sinePhase;
-
-			const auto nextCosine = resonator.cosinePhase * resonator.cosineStep
-				- resonator.sinePhase * resonator.sineStep;
-			const auto nextSine = resonator.sinePhase * resonator.cosineStep
-				+ resonator.cosinePhase * resonator.sineStep;
-			resonator.cosinePhase = nextCosine;
-			resonator.sinePhase = nextSine;
+	SPECTROSCOPE_TRACE_SCOPE("PitchTracker::process");
+	const auto& kernels = spectroscope::simd::kernels();
+	const auto bank = resonatorBank();
+	samplesSinceCalculate_ += numSamples;
+	for (int chunkStart = 0; chunkStart < numSamples;) {
+		auto chunkSize = std::min(inputChunkSize, numSamples - chunkStart);
+		if (crossfadeRemainingSamples_ > 0) {
+			chunkSize = std::min(chunkSize, crossfadeStepSamples);
+			advanceCoefficientCrossfade(chunkSize);
+		}
+		for (int sampleIndex = 0; sampleIndex < chunkSize; ++sampleIndex) {
+			const auto input = samples[chunkStart + sampleIndex];
+			currentInputPeak_ = std::max(currentInputPeak_, std::abs(input));
+			const auto filteredInput = input - previousInput_ + dcBlockerCoefficient_ * dcBlockerOutput_;
+			previousInput_ = input;
+			dcBlockerOutput_ = filteredInput;
+			filteredInput_[static_cast<std::size_t>(sampleIndex)] = filteredInput;
 		}
+		kernels.updateResonators(bank, filteredInput_.data(), chunkSize);
+		chunkStart += chunkSize;
 	}
 
-	for (auto& resonator : resonators_) {
-		const auto magnitude = std::hypot(resonator.cosinePhase, resonator.sinePhase);
+	dcBlockerOutput_ = flushSmall(dcBlockerOutput_);
+	for (std::size_t bin = 0; bin < static_cast<std::size_t>(analysisBinCount_); ++bin) {
+		auto& cosinePhase = resonators_.cosinePhase[bin];
+		auto& sinePhase = resonators_.sinePhase[bin];
+		const auto magnitude = std::hypot(cosinePhase, sinePhase);
 		if (magnitude > 0.0f) {
-			resonator.cosinePhase /= magnitude;
-			resonator.sinePhase /= magnitude;
+			cosinePhase /= magnitude;
+			sinePhase /= magnitude;
 		}
+		resonators_.inPhase[bin] = flushSmall(resonators_.inPhase[bin]);
+		resonators_.quadrature[bin] = flushSmall(resonators_.quadrature[bin]);
+	}
+}
+
+void PitchTracker::skipSilence(int numSamples) noexcept
+{
+	if (numSamples <= 0 || sampleRate_ <= 0.0)
+		return;
+
+	SPECTROSCOPE_TRACE_SCOPE("PitchTracker::skipSilence");
+	// Silence carries nothing a gradual retune would preserve.
+	if (crossfadeRemainingSamples_ > 0)
+		advanceCoefficientCrossfade(crossfadeRemainingSamples_);
+	if (numSamples != silenceSkipSamples_)
+		rebuildSilenceSkip(numSamples);
+
+	// With zero input the DC blocker sees -previousInput_ once and then only
+	// decays.
+	dcBlockerOutput_ = flushSmall(silenceSkipDcBlockerDecay_
+		* (dcBlockerCoefficient_ * dcBlockerOutput_ - previousInput_));
+	previousInput_ = 0.0f;
+	samplesSinceCalculate_ += numSamples;
+	for (std::size_t bin = 0; bin < static_cast<std::size_t>(analysisBinCount_); ++bin) {
+		const auto cosinePhase = resonators_.cosinePhase[bin];
+		const auto sinePhase = resonators_.sinePhase[bin];
+		resonators_.cosinePhase[bin] = cosinePhase * silenceSkipCosine_[bin] - sinePhase * silenceSkipSine_[bin];
+		resonators_.sinePhase[bin] = sinePhase * silenceSkipCosine_[bin] + cosinePhase * silenceSkipSine_[bin];
+		resonators_.inPhase[bin] = flushSmall(resonators_.inPhase[bin] * silenceSkipDecay_[bin]);
+		resonators_.quadrature[bin] = flushSmall(resonators_.quadrature[bin] * silenceSkipDecay_[bin]);
 	}
 }
 
 void PitchTracker::calculate(float* destination, int destinationSize)
 {
-	if (destination == nullptr || destinationSize < outputBinCount)
+	if (destination == nullptr || destinationSize < layout_.outputBinCount)
 		return;
 
 	if (sampleRate_ <= 0.0) {
-		std::fill_n(destination, outputBinCount, 0.0f);
+		std::fill_n(destination, layout_.outputBinCount, 0.0f);
 		return;
 	}
 
-	for (int bin = 0; bin < analysisBinCount; ++bin) {
-		const auto& resonator = resonators_[static_cast<std::size_t>(bin)];
-		analysisBins_[static_cast<std::size_t>(bin)] = 2.0f * (1.0f - resonator.decay)
-			* std::hypot(resonator.inPhase, resonator.quadrature);
-	}
+	analyse();
+	const auto noteCount = copyFieldNotes(fieldNotes_.data(), layout_.polyphony);
+	renderField(fieldNotes_.data(), noteCount, fieldSigma(), destination);
+}
+
+void PitchTracker::calculate()
+{
+	if (sampleRate_ > 0.0)
+		analyse();
+}
+
+void PitchTracker::analyse()
+{
+	SPECTROSCOPE_TRACE_SCOPE("PitchTracker::calculate");
+	spectroscope::simd::kernels().resonatorMagnitudes(resonatorBank(), analysisBins_.data());
+	std::fill(analysisBins_.begin() + audibleBinCount_, analysisBins_.end(), 0.0f);
 
-	for (int bin = 0; bin < analysisBinCount; ++bin) {
+	for (int bin = 0; bin < analysisBinCount_; ++bin) {
 		const auto left = std::max(0, bin - 1);
-		const auto right = std::min(analysisBinCount - 1, bin + 1);
+		const auto right = std::min(analysisBinCount_ - 1, bin + 1);
 		smoothedBins_[static_cast<std::size_t>(bin)] =
 			0.25f * analysisBins_[static_cast<std::size_t>(left)]
 			+ 0.5f * analysisBins_[static_cast<std::size_t>(bin)]
 			+ 0.25f * analysisBins_[static_cast<std::size_t>(right)];
 	}
 
+	updateSteps_ = static_cast<float>(static_cast<double>(samplesSinceCalculate_) / referenceUpdateSamples_);
 	findFundamentalPeaks();
 	updateTrackedNotes();
-	renderTrackedField(destination);
+
+	// The input peak always spans at least one reference update.
+	inputPeakSamples_ += samplesSinceCalculate_;
+	samplesSinceCalculate_ = 0;
+	if (static_cast<double>(inputPeakSamples_) >= referenceUpdateSamples_) {
+		currentInputPeak_ = 0.0f;
+		inputPeakSamples_ = 0;
+	}
+}
+
+void PitchTracker::setReferenceUpdateSamples(double samples) noexcept
+{
+	referenceUpdateSamples_ = std::max(1.0, samples);
+}
+
+double PitchTracker::referenceUpdateSamples() const noexcept
+{
+	return referenceUpdateSamples_;
+}
+
+int PitchTracker::copyNotes(Note* destination, int destinationCapacity) const noexcept
+{
+	if (destination == nullptr)
+		return 0;
+
+	const auto lowestFrequency = lowestFrequencyHz();
+	const auto binsPerOctave = static_cast<float>(layout_.binsPerOctave);
+	auto count = 0;
+	for (const auto& note : trackedNotes_) {
+		if (!note.active || count >= destinationCapacity)
+			continue;
+		destination[count++] = { note.id, lowestFrequency * std::exp2(note.position / binsPerOctave),
+			note.strength };
+	}
+	return count;
+}
+
+const PitchTracker::Layout& PitchTracker::layout() const noexcept
+{
+	return layout_;
+}
+
+int PitchTracker::analysisBinCount() const noexcept
+{
+	return analysisBinCount_;
+}
+
+int PitchTracker::outputBinCount() const noexcept
+{
+	return layout_.outputBinCount;
+}
+
+int PitchTracker::polyphony() const noexcept
+{
+	return layout_.polyphony;
+}
+
+float PitchTracker::lowestFrequencyHz() const noexcept
+{
+	return std::ldexp(concertAHz_, -layout_.octavesBelowConcertA);
+}
+
+float PitchTracker::highestFrequencyHz() const noexcept
+{
+	return std::ldexp(lowestFrequencyHz(), layout_.octaveCount);
 }
 
 double PitchTracker::sampleRate() const noexcept
@@ -162,46 +363,139 @@ PitchTracker::Preset PitchTracker::preset() const noexcept
 	return preset_;
 }
 
+spectroscope::simd::ResonatorBank PitchTracker::resonatorBank() noexcept
+{
+	return { resonators_.cosineStep.data(), resonators_.sineStep.data(), resonators_.decay.data(),
+		resonators_.cosinePhase.data(), resonators_.sinePhase.data(),
+		resonators_.inPhase.data(), resonators_.quadrature.data(), audibleBinCount_ };
+}
+
 PitchTracker::PresetParameters PitchTracker::parameters() const noexcept
 {
+	PresetParameters presetParameters {};
 	switch (preset_) {
 	case Preset::fast:
-		return { 4.0f, 0.80f, 0.75f, 0.60f, 3.0f, 1.10f,
+		presetParameters = { 4.0f, 0.80f, 0.75f, 0.60f, 3.0f, 1.10f,
 			0.004f, 0.10f, 0.12f, 0.45f, 1.00f };
+		break;
 	case Preset::stable:
-		return { 12.0f, 0.45f, 0.93f, 0.25f, 1.5f, 0.65f,
+		presetParameters = { 12.0f, 0.45f, 0.93f, 0.25f, 1.5f, 0.65f,
 			0.03f, 0.25f, 0.05f, 0.25f, 0.50f };
+		break;
 	case Preset::balanced:
 	default:
-		return { 6.0f, 0.65f, 0.86f, 0.35f, 2.0f, 0.82f,
+		presetParameters = { 6.0f, 0.65f, 0.86f, 0.35f, 2.0f, 0.82f,
 			0.01f, 0.15f, 0.08f, 0.35f, 0.65f };
+		break;
 	}
+
+	// Distances and widths are tuned in 50-cent bins.
+	const auto binScale = static_cast<float>(layout_.binsPerOctave) / 24.0f;
+	presetParameters.noteMatchDistance *= binScale;
+	presetParameters.fieldSigma *= binScale;
+	presetParameters.harmonicTolerance *= binScale;
+	return presetParameters;
 }
 
 void PitchTracker::rebuildResonators()
+{
+	resonatorConcertAHz_ = concertAHz_;
+	resonatorCycles_ = parameters().resonatorCycles;
+	crossfadeRemainingSamples_ = 0;
+	writeDcBlockerCoefficient();
+	writeResonatorCoefficients(false);
+}
+
+void PitchTracker::writeDcBlockerCoefficient() noexcept
+{
+	dcBlockerCoefficient_ = sampleRate_ > 0.0
+		? static_cast<float>(std::exp(-2.0 * std::acos(-1.0) * 20.0 / sampleRate_)) : 0.0f;
+}
+
+void PitchTracker::startCoefficientCrossfade() noexcept
 {
 	if (sampleRate_ <= 0.0) {
-		for (auto& resonator : resonators_)
-			resonator = {};
-		dcBlockerCoefficient_ = 0.0f;
+		rebuildResonators();
 		return;
 	}
+	crossfadeRemainingSamples_ = std::max(1, static_cast<int>(std::lround(
+		crossfadeSamples * sampleRate_ / crossfadeSampleRate)));
+}
 
-	const auto presetParameters = parameters();
-	const auto lowestA = static_cast<double>(concertAHz_) / 8.0;
+// Moves the coefficients the share of the remaining distance that numSamples
+// represents, so the glide is linear in time however process() is called.
+void PitchTracker::advanceCoefficientCrossfade(int numSamples) noexcept
+{
+	const auto fraction = std::min(1.0f,
+		static_cast<float>(numSamples) / static_cast<float>(crossfadeRemainingSamples_));
+	resonatorConcertAHz_ += fraction * (concertAHz_ - resonatorConcertAHz_);
+	resonatorCycles_ += fraction * (parameters().resonatorCycles - resonatorCycles_);
+	crossfadeRemainingSamples_ = std::max(0, crossfadeRemainingSamples_ - numSamples);
+	if (crossfadeRemainingSamples_ == 0) {
+		resonatorConcertAHz_ = concertAHz_;
+		resonatorCycles_ = parameters().resonatorCycles;
+	}
+	writeResonatorCoefficients(true);
+}
+
+// A resonator's magnitude is its state scaled by 2 (1 - decay). Rescaling the
+// state with the decay keeps the magnitudes continuous while memory changes.
+// Resonators at or above Nyquist would rotate at an aliased frequency; they
+// get zero decay and state and are left out of the bank, so their magnitude
+// stays zero.
+void PitchTracker::writeResonatorCoefficients(bool keepMagnitudes) noexcept
+{
+	silenceSkipSamples_ = 0;
+	audibleBinCount_ = 0;
+	if (sampleRate_ <= 0.0) {
+		std::fill(resonators_.cosineStep.begin(), resonators_.cosineStep.end(), 1.0f);
+		std::fill(resonators_.sineStep.begin(), resonators_.sineStep.end(), 0.0f);
+		std::fill(resonators_.decay.begin(), resonators_.decay.end(), 0.0f);
+		return;
+	}
+
+	const auto lowestA = std::ldexp(static_cast<double>(resonatorConcertAHz_), -layout_.octavesBelowConcertA);
 	const auto twoPi = 2.0 * std::acos(-1.0);
-	for (int bin = 0; bin < analysisBinCount; ++bin) {
+	for (int bin = 0; bin < analysisBinCount_; ++bin) {
 		const auto frequency = lowestA * std::pow(2.0,
-			static_cast<double>(bin) / static_cast<double>(binsPerOctave));
+			static_cast<double>(bin) / static_cast<double>(layout_.binsPerOctave));
+		const auto index = static_cast<std::size_t>(bin);
+		if (frequency >= 0.5 * sampleRate_) {
+			resonators_.cosineStep[index] = 1.0f;
+			resonators_.sineStep[index] = 0.0f;
+			resonators_.decay[index] = 0.0f;
+			resonators_.inPhase[index] = 0.0f;
+			resonators_.quadrature[index] = 0.0f;
+			continue;
+		}
+		audibleBinCount_ = bin + 1;
 		const auto radians = twoPi * frequency / sampleRate_;
-		auto& resonator = resonators_[static_cast<std::size_t>(bin)];
-		resonator.cosineStep = static_cast<float>(std::cos(radians));
-		resonator.sineStep = static_cast<float>(std::sin(radians));
-		resonator.decay = static_cast<float>(std::exp(
-			-frequency / (static_cast<double>(presetParameters.resonatorCycles) * sampleRate_)));
+		resonators_.cosineStep[index] = static_cast<float>(std::cos(radians));
+		resonators_.sineStep[index] = static_cast<float>(std::sin(radians));
+		const auto decay = static_cast<float>(std::exp(
+			-frequency / (static_cast<double>(resonatorCycles_) * sampleRate_)));
+		if (keepMagnitudes) {
+			const auto stateScale = (1.0f - resonators_.decay[index]) / (1.0f - decay);
+			resonators_.inPhase[index] *= stateScale;
+			resonators_.quadrature[index] *= stateScale;
+		}
+		resonators_.decay[index] = decay;
 	}
+}
 
-	dcBlockerCoefficient_ = static_cast<float>(std::exp(-twoPi * 20.0 / sampleRate_));
+void PitchTracker::rebuildSilenceSkip(int numSamples) noexcept
+{
+	const auto samples = static_cast<double>(numSamples);
+	for (std::size_t bin = 0; bin < static_cast<std::size_t>(analysisBinCount_); ++bin) {
+		const auto radians = std::atan2(static_cast<double>(resonators_.sineStep[bin]),
+			static_cast<double>(resonators_.cosineStep[bin]));
+		silenceSkipDecay_[bin] = static_cast<float>(std::pow(static_cast<double>(resonators_.decay[bin]), samples));
+		silenceSkipCosine_[bin] = static_cast<float>(std::cos(radians * samples));
+		silenceSkipSine_[bin] = static_cast<float>(std::sin(radians * samples));
+	}
+	silenceSkipDcBlockerDecay_ = static_cast<float>(std::pow(
+		static_cast<double>(dcBlockerCoefficient_), samples - 1.0));
+	silenceSkipSamples_ = numSamples;
 }
 
 void PitchTracker::findFundamentalPeaks()
@@ -210,8 +504,10 @@ void PitchTracker::findFundamentalPeaks()
 	candidatePeakCount_ = 0;
 	fundamentalPeakCount_ = 0;
 	const auto maximumBin = *std::max_element(smoothedBins_.begin(), smoothedBins_.end());
-	const auto levelCoefficient = maximumBin > adaptiveSignalLevel_ ? levelAttack : levelRelease;
-	adaptiveSignalLevel_ += levelCoefficient * (maximumBin - adaptiveSignalLevel_);
+	const auto levelCoefficient = followForSteps(
+		maximumBin > adaptiveSignalLevel_ ? levelAttack : levelRelease, updateSteps_);
+	adaptiveSignalLevel_ = flushSmall(adaptiveSignalLevel_
+		+ levelCoefficient * (maximumBin - adaptiveSignalLevel_));
 	if (currentInputPeak_ <= 0.00001f || maximumBin <= 0.000001f
 		|| adaptiveSignalLevel_ <= 0.000001f
 		|| maximumBin < adaptiveSignalLevel_ * 0.02f) {
@@ -219,19 +515,27 @@ void PitchTracker::findFundamentalPeaks()
 	}
 
 	std::copy(smoothedBins_.begin(), smoothedBins_.end(), sortedBins_.begin());
-	std::sort(sortedBins_.begin(), sortedBins_.end());
-	const auto noiseFloor = sortedBins_[static_cast<std::size_t>(analysisBinCount / 2)];
-
-	for (int bin = 0; bin < analysisBinCount; ++bin) {
+	const auto median = sortedBins_.begin() + analysisBinCount_ / 2;
+	std::nth_element(sortedBins_.begin(), median, sortedBins_.end());
+	const auto noiseFloor = *median;
+	// Prominence is measured against the bins about 50 cents away, whatever
+	// the resolution.
+	const auto prominenceSpan = std::max(1, (layout_.binsPerOctave + 12) / 24);
+
+	for (int bin = 0; bin < analysisBinCount_; ++bin) {
 		const auto left = bin > 0
 			? smoothedBins_[static_cast<std::size_t>(bin - 1)] : 0.0f;
 		const auto centre = smoothedBins_[static_cast<std::size_t>(bin)];
-		const auto right = bin + 1 < analysisBinCount
+		const auto right = bin + 1 < analysisBinCount_
 			? smoothedBins_[static_cast<std::size_t>(bin + 1)] : 0.0f;
 		if (centre <= left || centre < right)
 			continue;
 
-		const auto localProminence = (centre - std::max(left, right))
+		const auto lowerNeighbour = bin >= prominenceSpan
+			? smoothedBins_[static_cast<std::size_t>(bin - prominenceSpan)] : 0.0f;
+		const auto upperNeighbour = bin + prominenceSpan < analysisBinCount_
+			? smoothedBins_[static_cast<std::size_t>(bin + prominenceSpan)] : 0.0f;
+		const auto localProminence = (centre - std::max(lowerNeighbour, upperNeighbour))
 			/ std::max(centre, 0.000001f);
 		const auto noiseContrast = (centre - noiseFloor)
 			/ std::max(centre, 0.000001f);
@@ -252,100 +556,178 @@ void PitchTracker::findFundamentalPeaks()
 			offset = std::clamp(0.5f * (left - right) / denominator, -0.5f, 0.5f);
 		candidatePeaks_[static_cast<std::size_t>(candidatePeakCount_++)] = {
 			std::clamp(static_cast<float>(bin) + offset,
-				0.0f, static_cast<float>(analysisBinCount - 1)), strength
+				0.0f, static_cast<float>(analysisBinCount_ - 1)), strength
 		};
 	}
 
 	// Low fundamentals are considered before their overtones. A candidate near
 	// an integer multiple of an already accepted lower peak is rendered by the
-	// FFT but omitted from the colour mask.
+	// FFT but omitted from the colour mask. Accepted fundamentals stay sorted,
+	// so each harmonic is looked up rather than compared with every one.
+	std::array<float, 7> harmonicOffsets {};
+	for (std::size_t harmonic = 0; harmonic < harmonicOffsets.size(); ++harmonic) {
+		harmonicOffsets[harmonic] = static_cast<float>(layout_.binsPerOctave)
+			* std::log2(static_cast<float>(harmonic + 2));
+	}
+	const auto tolerance = presetParameters.harmonicTolerance;
 	for (int candidateIndex = 0; candidateIndex < candidatePeakCount_; ++candidateIndex) {
 		const auto& candidate = candidatePeaks_[static_cast<std::size_t>(candidateIndex)];
+		const auto fundamentalsEnd = fundamentalPeaks_.begin() + fundamentalPeakCount_;
 		auto explainedByHarmonic = false;
-		for (int fundamentalIndex = 0; fundamentalIndex < fundamentalPeakCount_; ++fundamentalIndex) {
-			const auto& lower = fundamentalPeaks_[static_cast<std::size_t>(fundamentalIndex)];
-			const auto ratio = std::pow(2.0f,
-				(candidate.position - lower.position) / static_cast<float>(binsPerOctave));
-			const auto harmonic = std::round(ratio);
-			if (harmonic < 2.0f || harmonic > 8.0f)
-				continue;
-			const auto harmonicDistance = std::abs(static_cast<float>(binsPerOctave)
-				* std::log2(ratio / harmonic));
-			if (harmonicDistance < presetParameters.harmonicTolerance && lower.strength > 0.06f) {
-				explainedByHarmonic = true;
-				break;
+		for (const auto offset : harmonicOffsets) {
+			const auto expectedPosition = candidate.position - offset;
+			for (auto lower = std::lower_bound(fundamentalPeaks_.begin(), fundamentalsEnd,
+					 expectedPosition - tolerance,
+					 [](const Peak& peak, float position) { return peak.position <= position; });
+				 lower != fundamentalsEnd && lower->position < expectedPosition + tolerance; ++lower) {
+				explainedByHarmonic = explainedByHarmonic || lower->strength > 0.06f;
 			}
+			if (explainedByHarmonic)
+				break;
 		}
-		if (!explainedByHarmonic && fundamentalPeakCount_ < maximumTrackedNotes)
+		if (!explainedByHarmonic && fundamentalPeakCount_ < layout_.polyphony)
 			fundamentalPeaks_[static_cast<std::size_t>(fundamentalPeakCount_++)] = candidate;
 	}
 }
 
+// Peaks and tracks are both walked in position order. Matches therefore never
+// cross, so two close notes cannot swap tracks, and the whole assignment
+// costs one sort of the active tracks.
 void PitchTracker::updateTrackedNotes()
 {
 	const auto presetParameters = parameters();
-	std::array<bool, maximumTrackedNotes> matchedTracks {};
-	for (int peakIndex = 0; peakIndex < fundamentalPeakCount_; ++peakIndex) {
-		const auto& peak = fundamentalPeaks_[static_cast<std::size_t>(peakIndex)];
-		int bestTrack = -1;
-		auto bestDistance = presetParameters.noteMatchDistance;
-		for (int trackIndex = 0; trackIndex < maximumTrackedNotes; ++trackIndex) {
-			const auto& track = trackedNotes_[static_cast<std::size_t>(trackIndex)];
-			if (!track.active || matchedTracks[static_cast<std::size_t>(trackIndex)])
-				continue;
-			const auto distance = std::abs(track.position - peak.position);
-			if (distance < bestDistance) {
-				bestDistance = distance;
-				bestTrack = trackIndex;
-			}
+	const auto noteAttack = followForSteps(presetParameters.noteAttack, updateSteps_);
+	const auto positionFollow = followForSteps(presetParameters.notePositionFollow, updateSteps_);
+	const auto noteRelease = std::pow(presetParameters.noteRelease, updateSteps_);
+	const auto matchDistance = presetParameters.noteMatchDistance;
+
+	trackOrder_.clear();
+	freeTracks_.clear();
+	for (int trackIndex = layout_.polyphony - 1; trackIndex >= 0; --trackIndex) {
+		auto& track = trackedNotes_[static_cast<std::size_t>(trackIndex)];
+		track.matched = false;
+		if (track.active)
+			trackOrder_.push_back(trackIndex);
+		else
+			freeTracks_.push_back(trackIndex);
+	}
+	std::sort(trackOrder_.begin(), trackOrder_.end(), [this](int first, int second) {
+		return trackedNotes_[static_cast<std::size_t>(first)].position
+			< trackedNotes_[static_cast<std::size_t>(second)].position;
+	});
+
+	const auto startTrack = [&](const Peak& peak) {
+		if (freeTracks_.empty())
+			return;
+		auto& track = trackedNotes_[static_cast<std::size_t>(freeTracks_.back())];
+		freeTracks_.pop_back();
+		track.id = nextNoteId_;
+		nextNoteId_ = nextNoteId_ == std::numeric_limits<std::uint32_t>::max() ? 1 : nextNoteId_ + 1;
+		track.position = peak.position;
+		track.strength = peak.strength * presetParameters.noteAttack;
+		track.active = true;
+		track.matched = true;
+	};
+	const auto trackPosition = [this](std::size_t orderIndex) {
+		return orderIndex < trackOrder_.size()
+			? trackedNotes_[static_cast<std::size_t>(trackOrder_[orderIndex])].position
+			: std::numeric_limits<float>::infinity();
+	};
+	const auto peakPosition = [this](std::size_t peakIndex) {
+		return peakIndex < static_cast<std::size_t>(fundamentalPeakCount_)
+			? fundamentalPeaks_[peakIndex].position
+			: std::numeric_limits<float>::infinity();
+	};
+
+	std::size_t peakIndex = 0;
+	std::size_t orderIndex = 0;
+	const auto peakCount = static_cast<std::size_t>(fundamentalPeakCount_);
+	while (peakIndex < peakCount && orderIndex < trackOrder_.size()) {
+		const auto& peak = fundamentalPeaks_[peakIndex];
+		auto& track = trackedNotes_[static_cast<std::size_t>(trackOrder_[orderIndex])];
+		const auto gap = peak.position - track.position;
+		if (gap <= -matchDistance) {
+			startTrack(peak);
+			++peakIndex;
+			continue;
+		}
+		if (gap >= matchDistance) {
+			++orderIndex;
+			continue;
 		}
 
-		if (bestTrack < 0) {
-			for (int trackIndex = 0; trackIndex < maximumTrackedNotes; ++trackIndex) {
-				if (!trackedNotes_[static_cast<std::size_t>(trackIndex)].active) {
-					bestTrack = trackIndex;
-					break;
-				}
-			}
+		// Either may be left out for a closer neighbour, but only when that
+		// neighbour has no closer partner of its own.
+		const auto distance = std::abs(gap);
+		const auto nextTrack = trackPosition(orderIndex + 1);
+		const auto nextPeak = peakPosition(peakIndex + 1);
+		const auto peakToNextTrack = std::abs(peak.position - nextTrack);
+		if (peakToNextTrack < distance && peakToNextTrack <= std::abs(nextPeak - nextTrack)) {
+			++orderIndex;
+			continue;
 		}
-		if (bestTrack < 0)
+		const auto nextPeakToTrack = std::abs(nextPeak - track.position);
+		if (nextPeakToTrack < distance && nextPeakToTrack <= std::abs(nextPeak - nextTrack)) {
+			startTrack(peak);
+			++peakIndex;
 			continue;
-
-		auto& track = trackedNotes_[static_cast<std::size_t>(bestTrack)];
-		if (!track.active) {
-			track.position = peak.position;
-			track.strength = peak.strength * presetParameters.noteAttack;
-			track.active = true;
-		} else {
-			track.position += presetParameters.notePositionFollow * (peak.position - track.position);
-			track.strength += presetParameters.noteAttack * (peak.strength - track.strength);
 		}
-		matchedTracks[static_cast<std::size_t>(bestTrack)] = true;
+
+		track.position += positionFollow * (peak.position - track.position);
+		track.strength += noteAttack * (peak.strength - track.strength);
+		track.matched = true;
+		++peakIndex;
+		++orderIndex;
 	}
+	for (; peakIndex < peakCount; ++peakIndex)
+		startTrack(fundamentalPeaks_[peakIndex]);
 
-	for (int trackIndex = 0; trackIndex < maximumTrackedNotes; ++trackIndex) {
-		auto& track = trackedNotes_[static_cast<std::size_t>(trackIndex)];
-		if (!track.active || matchedTracks[static_cast<std::size_t>(trackIndex)])
+	for (auto& track : trackedNotes_) {
+		if (!track.active || track.matched)
 			continue;
-		track.strength *= presetParameters.noteRelease;
+		track.strength *= noteRelease;
 		if (track.strength < noteRemovalStrength)
 			track = {};
 	}
 }
 
-void PitchTracker::renderTrackedField(float* destination) const
+int PitchTracker::copyFieldNotes(FieldNote* destination, int destinationCapacity) const noexcept
 {
-	const auto presetParameters = parameters();
-	std::fill_n(destination, outputBinCount, 0.0f);
+	if (destination == nullptr)
+		return 0;
+
+	auto count = 0;
 	for (const auto& note : trackedNotes_) {
-		if (!note.active)
-			continue;
-		for (int outputBin = 0; outputBin < outputBinCount; ++outputBin) {
+		if (note.active && count < destinationCapacity)
+			destination[count++] = { note.position, note.strength };
+	}
+	return count;
+}
+
+float PitchTracker::fieldSigma() const noexcept
+{
+	return parameters().fieldSigma;
+}
+
+// Beyond six sigma a note's Gaussian is below 1e-7, so each note only
+// touches the output bins within that reach.
+void PitchTracker::renderField(const FieldNote* notes, int noteCount, float sigma, float* destination) const noexcept
+{
+	std::fill_n(destination, layout_.outputBinCount, 0.0f);
+	const auto outputBinsPerAnalysisBin = static_cast<float>(layout_.outputBinCount)
+		/ static_cast<float>(analysisBinCount_);
+	const auto reach = 6.0f * sigma;
+	for (int noteIndex = 0; noteIndex < noteCount; ++noteIndex) {
+		const auto& note = notes[noteIndex];
+		const auto firstBin = std::max(0.0f,
+			std::ceil((note.position - reach) * outputBinsPerAnalysisBin - 0.5f));
+		const auto lastBin = std::min(static_cast<float>(layout_.outputBinCount - 1),
+			std::floor((note.position + reach) * outputBinsPerAnalysisBin - 0.5f));
+		for (auto outputBin = static_cast<int>(firstBin); outputBin <= static_cast<int>(lastBin); ++outputBin) {
 			const auto position = (static_cast<float>(outputBin) + 0.5f)
-				* static_cast<float>(analysisBinCount) / static_cast<float>(outputBinCount);
+				* static_cast<float>(analysisBinCount_) / static_cast<float>(layout_.outputBinCount);
 			const auto distance = std::abs(position - note.position);
-			const auto gaussian = std::exp(-0.5f * distance * distance
-				/ (presetParameters.fieldSigma * presetParameters.fieldSigma));
+			const auto gaussian = std::exp(-0.5f * distance * distance / (sigma * sigma));
 			auto& output = destination[outputBin];
 			output = std::max(output, clamp01(note.strength * gaussian));
 		}
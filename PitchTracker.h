@@ -6,12 +6,17 @@
 
 #pragma once
 
+#include "SimdKernels.h"
+
 #include <array>
+#include <cstdint>
+#include <vector>
 
 // A low-latency logarithmic pitch analyser. It maintains a constant-Q-like
 // resonator bank, finds adaptive local peaks, rejects peaks explained as
 // harmonics of lower fundamentals, and tracks the remaining notes over time.
-// The published field spans six absolute octaves from concert A / 8.
+// The published field spans a fixed number of absolute octaves from a
+// lowest A below concert A, six octaves from concert A / 8 by default.
 class PitchTracker {
 public:
 	enum class Preset {
@@ -20,33 +25,123 @@ public:
 		stable
 	};
 
-	static constexpr int binsPerOctave = 24;
-	static constexpr int octaveCount = 6;
-	static constexpr int analysisBinCount = binsPerOctave * octaveCount;
-	static constexpr int outputBinCount = 256;
-	static constexpr int maximumTrackedNotes = 12;
+	// Range and resolution of the resonator bank and of the published field.
+	// The per-sample cost grows with the number of analysis bins,
+	// binsPerOctave * octaveCount; all buffers are sized for the layout.
+	struct Layout {
+		int binsPerOctave { 24 };
+		int octaveCount { 6 };
+		int outputBinCount { 256 };
+		// The field starts at concert A / 2^octavesBelowConcertA.
+		int octavesBelowConcertA { 3 };
+		// Most notes tracked at once. Matching peaks to tracks costs
+		// O(n log n) in the number of notes, so dense material can use many.
+		int polyphony { 12 };
+	};
+
+	// Out-of-range layout values are clamped to 12-96 bins per octave,
+	// 1-10 octaves, 16-4096 output bins, 0-5 octaves below concert A and a
+	// polyphony of 1-128. The top of the layout must stay below Nyquist;
+	// resonators at or above it are silenced and report no notes.
+	PitchTracker();
+	explicit PitchTracker(const Layout& layout);
 
 	void prepare(double sampleRate, float concertAHz = 440.0f);
 	void reset();
+
+	// Retuning and preset changes keep the resonator energy and tracked notes.
+	// The resonator coefficients glide to their new values over 512 samples
+	// at 48 kHz, and tracked notes keep their absolute pitch.
 	void setConcertAHz(float frequencyHz);
 	void setPreset(Preset preset);
 
+	// Changes the rate of the input without resetting, as when a host starts
+	// or stops decimating it. The coefficients switch at once, the resonator
+	// magnitudes and tracked notes are kept, and a running glide keeps its
+	// remaining duration.
+	void setSampleRate(double sampleRate);
+
+	// A tracked fundamental as it is drawn into the output field. The position
+	// is measured in analysis bins above lowestFrequencyHz().
+	struct FieldNote {
+		float position { 0.0f };
+		float strength { 0.0f };
+	};
+
+	// A tracked note as of the latest calculate(). The id is unique for the
+	// tracker's lifetime, reset() included, and stays with the note while it
+	// is tracked, also across retuning.
+	struct Note {
+		std::uint32_t id { 0 };
+		float frequencyHz { 0.0f };
+		float strength { 0.0f };
+	};
+
+	// calculate() may run after any number of samples. Note attack, release
+	// and level tracking are defined per reference update, so the update
+	// rate changes the latency of the field but not how fast notes rise and
+	// fade. Without a destination, calculate() updates the tracked notes but
+	// renders no field.
 	void process(const float* samples, int numSamples);
 	void calculate(float* destination, int destinationSize);
+	void calculate();
+
+	// The number of input samples the smoothing coefficients are tuned for,
+	// at the rate passed to prepare(). A host calling calculate() once per
+	// this many samples gets the preset's coefficients unchanged, at any
+	// sample rate; other intervals scale them to the same time constants.
+	static constexpr double defaultReferenceUpdateSamples = 512.0;
+	void setReferenceUpdateSamples(double samples) noexcept;
+	double referenceUpdateSamples() const noexcept;
+
+	// Advances the tracker over numSamples of silence as if process() had
+	// been given zeros. The resonators are decayed and rotated in one step
+	// instead of being run sample by sample.
+	void skipSilence(int numSamples) noexcept;
+
+	// Copies up to destinationCapacity of the active notes, in no particular
+	// order, and returns how many were copied. There are at most polyphony().
+	int copyNotes(Note* destination, int destinationCapacity) const noexcept;
 
+	// Copies up to destinationCapacity of the active notes as calculate()
+	// draws them into the field, with fieldSigma(), and returns how many were
+	// copied.
+	int copyFieldNotes(FieldNote* destination, int destinationCapacity) const noexcept;
+	float fieldSigma() const noexcept;
+
+	const Layout& layout() const noexcept;
+	int analysisBinCount() const noexcept;
+	int outputBinCount() const noexcept;
+	int polyphony() const noexcept;
+	float lowestFrequencyHz() const noexcept;
+	float highestFrequencyHz() const noexcept;
 	double sampleRate() const noexcept;
 	float concertAHz() const noexcept;
 	Preset preset() const noexcept;
 
 private:
-	struct Resonator {
-		float cosineStep { 1.0f };
-		float sineStep { 0.0f };
-		float cosinePhase { 1.0f };
-		float sinePhase { 0.0f };
-		float decay { 0.0f };
-		float inPhase { 0.0f };
-		float quadrature { 0.0f };
+	// The tests compare renderField() with its reference loop and with the
+	// published field.
+	friend struct PitchTrackerTestAccess;
+
+	// Writes outputBinCount() values. Each is the strongest Gaussian of the
+	// given notes at that bin, with sigma in analysis bins, clamped to [0, 1].
+	void renderField(const FieldNote* notes, int noteCount, float sigma, float* destination) const noexcept;
+
+	// Input is DC-filtered into a small scratch block before it reaches the
+	// resonator kernel, so process() accepts any block size.
+	static constexpr int inputChunkSize = 256;
+
+	// Structure of arrays, so that the SIMD kernels update neighbouring
+	// resonators together.
+	struct Resonators {
+		std::vector<float> cosineStep;
+		std::vector<float> sineStep;
+		std::vector<float> cosinePhase;
+		std::vector<float> sinePhase;
+		std::vector<float> decay;
+		std::vector<float> inPhase;
+		std::vector<float> quadrature;
 	};
 
 	struct Peak {
@@ -55,9 +150,11 @@ private:
 	};
 
 	struct TrackedNote {
+		std::uint32_t id { 0 };
 		float position { 0.0f };
 		float strength { 0.0f };
 		bool active { false };
+		bool matched { false };
 	};
 
 	struct PresetParameters {
@@ -75,11 +172,21 @@ private:
 	};
 
 	PresetParameters parameters() const noexcept;
+	spectroscope::simd::ResonatorBank resonatorBank() noexcept;
 	void rebuildResonators();
+	void writeDcBlockerCoefficient() noexcept;
+	void startCoefficientCrossfade() noexcept;
+	void advanceCoefficientCrossfade(int numSamples) noexcept;
+	void writeResonatorCoefficients(bool keepMagnitudes) noexcept;
+	void rebuildSilenceSkip(int numSamples) noexcept;
 	void findFundamentalPeaks();
 	void updateTrackedNotes();
-	void renderTrackedField(float* destination) const;
+	void analyse();
 
+	const Layout layout_;
+	const int analysisBinCount_;
+	// The resonators below Nyquist, which are the only ones the bank runs.
+	int audibleBinCount_ { 0 };
 	double sampleRate_ { 0.0 };
 	float concertAHz_ { 440.0f };
 	Preset preset_ { Preset::balanced };
@@ -88,14 +195,37 @@ private:
 	float dcBlockerCoefficient_ { 0.0f };
 	float currentInputPeak_ { 0.0f };
 	float adaptiveSignalLevel_ { 0.0f };
+	std::int64_t samplesSinceCalculate_ { 0 };
+	std::int64_t inputPeakSamples_ { 0 };
+	double referenceUpdateSamples_ { defaultReferenceUpdateSamples };
+	float updateSteps_ { 1.0f };
+	// Tuning and memory the resonator coefficients currently represent; they
+	// differ from the targets while a crossfade is running.
+	float resonatorConcertAHz_ { 440.0f };
+	float resonatorCycles_ { 6.0f };
+	int crossfadeRemainingSamples_ { 0 };
+	std::uint32_t nextNoteId_ { 1 };
 
-	std::array<Resonator, analysisBinCount> resonators_ {};
-	std::array<float, analysisBinCount> analysisBins_ {};
-	std::array<float, analysisBinCount> smoothedBins_ {};
-	std::array<float, analysisBinCount> sortedBins_ {};
-	std::array<Peak, analysisBinCount> candidatePeaks_ {};
-	std::array<Peak, maximumTrackedNotes> fundamentalPeaks_ {};
-	std::array<TrackedNote, maximumTrackedNotes> trackedNotes_ {};
+	Resonators resonators_;
+	std::array<float, inputChunkSize> filteredInput_ {};
+	// Decay and phase rotation of each resonator over silenceSkipSamples_.
+	std::vector<float> silenceSkipDecay_;
+	std::vector<float> silenceSkipCosine_;
+	std::vector<float> silenceSkipSine_;
+	float silenceSkipDcBlockerDecay_ { 0.0f };
+	int silenceSkipSamples_ { 0 };
+	std::vector<float> analysisBins_;
+	std::vector<float> smoothedBins_;
+	std::vector<float> sortedBins_;
+	std::vector<Peak> candidatePeaks_;
+	// Fundamentals are found in ascending position order.
+	std::vector<Peak> fundamentalPeaks_;
+	std::vector<TrackedNote> trackedNotes_;
+	// Indices into trackedNotes_: the active tracks sorted by position, and
+	// the free slots.
+	std::vector<int> trackOrder_;
+	std::vector<int> freeTracks_;
+	std::vector<FieldNote> fieldNotes_;
 	int candidatePeakCount_ { 0 };
 	int fundamentalPeakCount_ { 0 };
 };
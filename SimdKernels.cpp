@@ -0,0 +1,200 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SimdKernelsDetail.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if JUCE_SPECTROSCOPE_SIMD_X86 && defined(_MSC_VER) && !defined(__clang__)
+	#include <intrin.h>
+#endif
+
+namespace {
+using spectroscope::simd::InstructionSet;
+using spectroscope::simd::Kernels;
+using spectroscope::simd::ResonatorBank;
+
+// The reference kernels. They reproduce the original per-sample loops
+// exactly and define the results the vector variants are compared against.
+void updateResonatorsScalar(const ResonatorBank& bank, const float* input, int numSamples)
+{
+	for (int sample = 0; sample < numSamples; ++sample) {
+		const auto value = input[sample];
+		for (int resonator = 0; resonator < bank.count; ++resonator) {
+			bank.inPhase[resonator] = bank.decay[resonator] * bank.inPhase[resonator]
+				+ value * bank.cosinePhase[resonator];
+			bank.quadrature[resonator] = bank.decay[resonator] * bank.quadrature[resonator]
+				+ value * bank.sinePhase[resonator];
+
+			const auto nextCosine = bank.cosinePhase[resonator] * bank.cosineStep[resonator]
+				- bank.sinePhase[resonator] * bank.sineStep[resonator];
+			const auto nextSine = bank.sinePhase[resonator] * bank.cosineStep[resonator]
+				+ bank.cosinePhase[resonator] * bank.sineStep[resonator];
+			bank.cosinePhase[resonator] = nextCosine;
+			bank.sinePhase[resonator] = nextSine;
+		}
+	}
+}
+
+void resonatorMagnitudesScalar(const ResonatorBank& bank, float* destination)
+{
+	for (int resonator = 0; resonator < bank.count; ++resonator) {
+		destination[resonator] = 2.0f * (1.0f - bank.decay[resonator])
+			* std::hypot(bank.inPhase[resonator], bank.quadrature[resonator]);
+	}
+}
+
+void magnitudesToDecibelsScalar(const float* magnitudes, float scale, float floorDb,
+	float* destination, int count)
+{
+	for (int index = 0; index < count; ++index) {
+		const auto gain = magnitudes[index] * scale;
+		const auto decibels = gain > 0.0f ? std::max(floorDb, std::log10(gain) * 20.0f) : floorDb;
+		destination[index] = std::clamp(decibels, floorDb, 0.0f);
+	}
+}
+
+#if JUCE_SPECTROSCOPE_SIMD_X86
+// __builtin_cpu_supports() also checks that the operating system saves the
+// wider registers; MSVC needs the XGETBV test spelled out.
+bool cpuSupportsAvx2() noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int registers[4] {};
+	__cpuid(registers, 0);
+	if (registers[0] < 7)
+		return false;
+	__cpuid(registers, 1);
+	const auto fma = (registers[2] & (1 << 12)) != 0;
+	const auto osxsave = (registers[2] & (1 << 27)) != 0;
+	const auto avx = (registers[2] & (1 << 28)) != 0;
+	if (!fma || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(registers, 7, 0);
+	return (registers[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+bool cpuSupportsAvx512() noexcept
+{
+	if (!cpuSupportsAvx2())
+		return false;
+#if defined(_MSC_VER) && !defined(__clang__)
+	int registers[4] {};
+	__cpuidex(registers, 7, 0);
+	return (registers[1] & (1 << 16)) != 0 && (_xgetbv(0) & 0xe6) == 0xe6;
+#else
+	return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+const Kernels* bestKernels() noexcept
+{
+	for (const auto instructionSet : { InstructionSet::avx512, InstructionSet::avx2,
+			 InstructionSet::sse2, InstructionSet::neon }) {
+		if (const auto* available = spectroscope::simd::kernelsFor(instructionSet))
+			return available;
+	}
+	return &spectroscope::simd::detail::scalarKernels;
+}
+
+const Kernels* environmentKernels() noexcept
+{
+	const auto* requested = std::getenv("JUCE_SPECTROSCOPE_ISA");
+	if (requested == nullptr)
+		return nullptr;
+
+	for (const auto instructionSet : { InstructionSet::scalar, InstructionSet::sse2,
+			 InstructionSet::avx2, InstructionSet::avx512, InstructionSet::neon }) {
+		if (std::strcmp(requested, spectroscope::simd::instructionSetName(instructionSet)) == 0)
+			return spectroscope::simd::kernelsFor(instructionSet);
+	}
+	return nullptr;
+}
+
+std::atomic<const Kernels*> selectedKernels { nullptr };
+}
+
+namespace spectroscope::simd {
+
+namespace detail {
+const Kernels scalarKernels { InstructionSet::scalar, &updateResonatorsScalar,
+	&resonatorMagnitudesScalar, &magnitudesToDecibelsScalar };
+}
+
+const Kernels& kernels() noexcept
+{
+	if (const auto* selected = selectedKernels.load(std::memory_order_acquire))
+		return *selected;
+
+	// Racing first calls pick the same table, so whichever store wins is fine.
+	const auto* environment = environmentKernels();
+	const auto* initial = environment != nullptr ? environment : bestKernels();
+	const Kernels* expected = nullptr;
+	if (!selectedKernels.compare_exchange_strong(expected, initial, std::memory_order_acq_rel))
+		return *expected;
+	return *initial;
+}
+
+const Kernels* kernelsFor(InstructionSet instructionSet) noexcept
+{
+	if (instructionSet == InstructionSet::scalar)
+		return &detail::scalarKernels;
+#if JUCE_SPECTROSCOPE_SIMD_X86
+	if (instructionSet == InstructionSet::sse2)
+		return &detail::sse2Kernels;
+	if (instructionSet == InstructionSet::avx2)
+		return cpuSupportsAvx2() ? &detail::avx2Kernels : nullptr;
+	if (instructionSet == InstructionSet::avx512)
+		return cpuSupportsAvx512() ? &detail::avx512Kernels : nullptr;
+#endif
+#if JUCE_SPECTROSCOPE_SIMD_NEON
+	if (instructionSet == InstructionSet::neon)
+		return &detail::neonKernels;
+#endif
+	return nullptr;
+}
+
+bool forceInstructionSet(InstructionSet instructionSet) noexcept
+{
+	const auto* forced = kernelsFor(instructionSet);
+	if (forced == nullptr)
+		return false;
+	selectedKernels.store(forced, std::memory_order_release);
+	return true;
+}
+
+void clearForcedInstructionSet() noexcept
+{
+	selectedKernels.store(bestKernels(), std::memory_order_release);
+}
+
+const char* instructionSetName(InstructionSet instructionSet) noexcept
+{
+	switch (instructionSet) {
+	case InstructionSet::scalar:
+		return "scalar";
+	case InstructionSet::sse2:
+		return "sse2";
+	case InstructionSet::avx2:
+		return "avx2";
+	case InstructionSet::avx512:
+		return "avx512";
+	case InstructionSet::neon:
+		return "neon";
+	}
+	return "unknown";
+}
+
+}
@@ -0,0 +1,72 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+// Hot analysis loops built once per instruction set. Each variant lives in its
+// own translation unit, which enables its instruction set with a target pragma
+// scoped to that file rather than a compiler flag, so the rest of the library
+// keeps the baseline target of the build and still runs on any CPU of that
+// architecture. The best variant the CPU and operating system support is
+// chosen on first use.
+namespace spectroscope::simd {
+
+enum class InstructionSet {
+	scalar,
+	sse2,
+	avx2,
+	avx512,
+	neon
+};
+
+// Structure-of-arrays view of a resonator bank. Every array holds count
+// elements; the kernels do not require any particular alignment.
+struct ResonatorBank {
+	const float* cosineStep;
+	const float* sineStep;
+	const float* decay;
+	float* cosinePhase;
+	float* sinePhase;
+	float* inPhase;
+	float* quadrature;
+	int count;
+};
+
+struct Kernels {
+	InstructionSet instructionSet;
+
+	// Runs every resonator over the input block. Phases are advanced but not
+	// renormalised; the caller does that once per block.
+	void (*updateResonators)(const ResonatorBank& bank, const float* input, int numSamples);
+
+	// destination[i] = 2 (1 - decay[i]) |inPhase[i] + j quadrature[i]|
+	void (*resonatorMagnitudes)(const ResonatorBank& bank, float* destination);
+
+	// destination[i] = clamp(20 log10(magnitudes[i] * scale), floorDb, 0)
+	void (*magnitudesToDecibels)(const float* magnitudes, float scale, float floorDb,
+		float* destination, int count);
+};
+
+// The kernels chosen for this process. Lock-free and cheap enough to call
+// once per block.
+const Kernels& kernels() noexcept;
+
+// The kernels for one instruction set, or nullptr when they were not built for
+// this architecture or the CPU cannot run them.
+const Kernels* kernelsFor(InstructionSet instructionSet) noexcept;
+
+// Forces later kernels() calls to the given instruction set. Returns false
+// and changes nothing when it is unavailable. The JUCE_SPECTROSCOPE_ISA
+// environment variable (scalar, sse2, avx2, avx512 or neon) does the same at
+// startup.
+bool forceInstructionSet(InstructionSet instructionSet) noexcept;
+
+// Returns to automatic selection, ignoring JUCE_SPECTROSCOPE_ISA.
+void clearForcedInstructionSet() noexcept;
+
+const char* instructionSetName(InstructionSet instructionSet) noexcept;
+
+}
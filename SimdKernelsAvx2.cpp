@@ -0,0 +1,68 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SimdKernelsDetail.h"
+
+#if JUCE_SPECTROSCOPE_SIMD_X86
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <immintrin.h>
+
+// The target switch is scoped to this file instead of a compiler flag, so the
+// library itself keeps the baseline target and distribution builds still get
+// this variant. MSVC accepts the intrinsics without any switch.
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx2,fma")
+#endif
+
+#include "SimdKernelsGeneric.h"
+
+namespace {
+struct Avx2Lane {
+	using Vector = __m256;
+	static constexpr int width = 8;
+
+	static Vector load(const float* source) noexcept { return _mm256_loadu_ps(source); }
+	static void store(float* destination, Vector value) noexcept { _mm256_storeu_ps(destination, value); }
+	static Vector broadcast(float value) noexcept { return _mm256_set1_ps(value); }
+	static Vector add(Vector left, Vector right) noexcept { return _mm256_add_ps(left, right); }
+	static Vector subtract(Vector left, Vector right) noexcept { return _mm256_sub_ps(left, right); }
+	static Vector multiply(Vector left, Vector right) noexcept { return _mm256_mul_ps(left, right); }
+	static Vector divide(Vector left, Vector right) noexcept { return _mm256_div_ps(left, right); }
+	static Vector multiplyAdd(Vector left, Vector right, Vector addend) noexcept { return _mm256_fmadd_ps(left, right, addend); }
+	static Vector multiplySubtract(Vector left, Vector right, Vector subtrahend) noexcept { return _mm256_fmsub_ps(left, right, subtrahend); }
+	static Vector squareRoot(Vector value) noexcept { return _mm256_sqrt_ps(value); }
+	static Vector minimum(Vector left, Vector right) noexcept { return _mm256_min_ps(left, right); }
+	static Vector maximum(Vector left, Vector right) noexcept { return _mm256_max_ps(left, right); }
+
+	static Vector splitExponent(Vector value, Vector& exponent) noexcept
+	{
+		const auto bits = _mm256_castps_si256(value);
+		exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+		return _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)),
+			_mm256_set1_epi32(0x3f800000)));
+	}
+};
+}
+
+namespace spectroscope::simd::detail {
+const Kernels avx2Kernels = makeKernels<Avx2Lane>(InstructionSet::avx2);
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+#endif
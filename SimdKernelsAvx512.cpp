@@ -0,0 +1,72 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SimdKernelsDetail.h"
+
+#if JUCE_SPECTROSCOPE_SIMD_X86
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// GCC 12 reports the deliberately undefined pass-through operand of its own
+// AVX-512 intrinsics as uninitialized (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include <immintrin.h>
+
+// See SimdKernelsAvx2.cpp for why the target switch lives in the source file.
+#if defined(__clang__)
+	#pragma clang attribute push(__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f,avx2,fma")
+#endif
+
+#include "SimdKernelsGeneric.h"
+
+namespace {
+struct Avx512Lane {
+	using Vector = __m512;
+	static constexpr int width = 16;
+
+	static Vector load(const float* source) noexcept { return _mm512_loadu_ps(source); }
+	static void store(float* destination, Vector value) noexcept { _mm512_storeu_ps(destination, value); }
+	static Vector broadcast(float value) noexcept { return _mm512_set1_ps(value); }
+	static Vector add(Vector left, Vector right) noexcept { return _mm512_add_ps(left, right); }
+	static Vector subtract(Vector left, Vector right) noexcept { return _mm512_sub_ps(left, right); }
+	static Vector multiply(Vector left, Vector right) noexcept { return _mm512_mul_ps(left, right); }
+	static Vector divide(Vector left, Vector right) noexcept { return _mm512_div_ps(left, right); }
+	static Vector multiplyAdd(Vector left, Vector right, Vector addend) noexcept { return _mm512_fmadd_ps(left, right, addend); }
+	static Vector multiplySubtract(Vector left, Vector right, Vector subtrahend) noexcept { return _mm512_fmsub_ps(left, right, subtrahend); }
+	static Vector squareRoot(Vector value) noexcept { return _mm512_sqrt_ps(value); }
+	static Vector minimum(Vector left, Vector right) noexcept { return _mm512_min_ps(left, right); }
+	static Vector maximum(Vector left, Vector right) noexcept { return _mm512_max_ps(left, right); }
+
+	static Vector splitExponent(Vector value, Vector& exponent) noexcept
+	{
+		const auto bits = _mm512_castps_si512(value);
+		exponent = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(127)));
+		return _mm512_castsi512_ps(_mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)),
+			_mm512_set1_epi32(0x3f800000)));
+	}
+};
+}
+
+namespace spectroscope::simd::detail {
+const Kernels avx512Kernels = makeKernels<Avx512Lane>(InstructionSet::avx512);
+}
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include "SimdKernels.h"
+
+// Shared between the dispatcher and the per-instruction-set translation units
+// only. 32-bit x86 has no guaranteed SSE2 and 32-bit ARM lacks the vector
+// division and square root the kernels need, so both use the scalar kernels.
+#if defined(__x86_64__) || defined(_M_X64)
+	#define JUCE_SPECTROSCOPE_SIMD_X86 1
+#else
+	#define JUCE_SPECTROSCOPE_SIMD_X86 0
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+	#define JUCE_SPECTROSCOPE_SIMD_NEON 1
+#else
+	#define JUCE_SPECTROSCOPE_SIMD_NEON 0
+#endif
+
+namespace spectroscope::simd::detail {
+
+extern const Kernels scalarKernels;
+#if JUCE_SPECTROSCOPE_SIMD_X86
+extern const Kernels sse2Kernels;
+extern const Kernels avx2Kernels;
+extern const Kernels avx512Kernels;
+#endif
+#if JUCE_SPECTROSCOPE_SIMD_NEON
+extern const Kernels neonKernels;
+#endif
+
+}
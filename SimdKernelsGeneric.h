@@ -0,0 +1,170 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+// Kernel bodies shared by the vector instruction sets. Each translation unit
+// includes this after switching on its target features and instantiates the
+// templates with its own Lane type, which wraps one vector register.
+//
+// Everything here has internal linkage on purpose: an inline function with
+// external linkage would be emitted by every instruction-set translation unit
+// and the linker could keep, say, the AVX-512 copy for all callers.
+//
+// Include <cmath>, <cstdint>, <cstring> and <limits> before switching target
+// features, so that standard library code keeps the baseline target.
+
+namespace {
+
+struct ScalarLane {
+	using Vector = float;
+	static constexpr int width = 1;
+
+	static Vector load(const float* source) noexcept { return *source; }
+	static void store(float* destination, Vector value) noexcept { *destination = value; }
+	static Vector broadcast(float value) noexcept { return value; }
+	static Vector add(Vector left, Vector right) noexcept { return left + right; }
+	static Vector subtract(Vector left, Vector right) noexcept { return left - right; }
+	static Vector multiply(Vector left, Vector right) noexcept { return left * right; }
+	static Vector divide(Vector left, Vector right) noexcept { return left / right; }
+	static Vector multiplyAdd(Vector left, Vector right, Vector addend) noexcept { return left * right + addend; }
+	static Vector multiplySubtract(Vector left, Vector right, Vector subtrahend) noexcept { return left * right - subtrahend; }
+	static Vector squareRoot(Vector value) noexcept { return std::sqrt(value); }
+	static Vector minimum(Vector left, Vector right) noexcept { return right < left ? right : left; }
+	static Vector maximum(Vector left, Vector right) noexcept { return left < right ? right : left; }
+
+	// Splits a positive normal float into its mantissa in [1, 2) and its
+	// unbiased binary exponent.
+	static Vector splitExponent(Vector value, Vector& exponent) noexcept
+	{
+		std::uint32_t bits = 0;
+		std::memcpy(&bits, &value, sizeof(bits));
+		exponent = static_cast<float>(static_cast<std::int32_t>(bits >> 23) - 127);
+		bits = (bits & 0x007fffffu) | 0x3f800000u;
+		float mantissa = 0.0f;
+		std::memcpy(&mantissa, &bits, sizeof(mantissa));
+		return mantissa;
+	}
+};
+
+// Each lane keeps its resonators in registers for the whole block, so only
+// the input sample is loaded per step.
+template <typename Lane>
+void updateResonatorLanes(const spectroscope::simd::ResonatorBank& bank, int first,
+	const float* input, int numSamples) noexcept
+{
+	const auto cosineStep = Lane::load(bank.cosineStep + first);
+	const auto sineStep = Lane::load(bank.sineStep + first);
+	const auto decay = Lane::load(bank.decay + first);
+	auto cosinePhase = Lane::load(bank.cosinePhase + first);
+	auto sinePhase = Lane::load(bank.sinePhase + first);
+	auto inPhase = Lane::load(bank.inPhase + first);
+	auto quadrature = Lane::load(bank.quadrature + first);
+
+	for (int sample = 0; sample < numSamples; ++sample) {
+		const auto value = Lane::broadcast(input[sample]);
+		inPhase = Lane::multiplyAdd(decay, inPhase, Lane::multiply(value, cosinePhase));
+		quadrature = Lane::multiplyAdd(decay, quadrature, Lane::multiply(value, sinePhase));
+
+		const auto nextCosine = Lane::multiplySubtract(cosinePhase, cosineStep,
+			Lane::multiply(sinePhase, sineStep));
+		const auto nextSine = Lane::multiplyAdd(sinePhase, cosineStep,
+			Lane::multiply(cosinePhase, sineStep));
+		cosinePhase = nextCosine;
+		sinePhase = nextSine;
+	}
+
+	Lane::store(bank.cosinePhase + first, cosinePhase);
+	Lane::store(bank.sinePhase + first, sinePhase);
+	Lane::store(bank.inPhase + first, inPhase);
+	Lane::store(bank.quadrature + first, quadrature);
+}
+
+template <typename Lane>
+void updateResonators(const spectroscope::simd::ResonatorBank& bank, const float* input, int numSamples)
+{
+	int first = 0;
+	for (; first + Lane::width <= bank.count; first += Lane::width)
+		updateResonatorLanes<Lane>(bank, first, input, numSamples);
+	for (; first < bank.count; ++first)
+		updateResonatorLanes<ScalarLane>(bank, first, input, numSamples);
+}
+
+template <typename Lane>
+void resonatorMagnitudeLanes(const spectroscope::simd::ResonatorBank& bank, int first,
+	float* destination) noexcept
+{
+	const auto inPhase = Lane::load(bank.inPhase + first);
+	const auto quadrature = Lane::load(bank.quadrature + first);
+	const auto gain = Lane::multiply(Lane::broadcast(2.0f),
+		Lane::subtract(Lane::broadcast(1.0f), Lane::load(bank.decay + first)));
+	const auto energy = Lane::multiplyAdd(inPhase, inPhase, Lane::multiply(quadrature, quadrature));
+	Lane::store(destination + first, Lane::multiply(gain, Lane::squareRoot(energy)));
+}
+
+template <typename Lane>
+void resonatorMagnitudes(const spectroscope::simd::ResonatorBank& bank, float* destination)
+{
+	int first = 0;
+	for (; first + Lane::width <= bank.count; first += Lane::width)
+		resonatorMagnitudeLanes<Lane>(bank, first, destination);
+	for (; first < bank.count; ++first)
+		resonatorMagnitudeLanes<ScalarLane>(bank, first, destination);
+}
+
+// ln(x) = e ln 2 + 2 atanh(s) with s = (m - 1) / (m + 1) for x = m 2^e and m in
+// [1, 2). Since s < 1/3, six series terms keep the error below 1e-7, well
+// under the float rounding of the result.
+template <typename Lane>
+typename Lane::Vector naturalLogarithm(typename Lane::Vector value) noexcept
+{
+	typename Lane::Vector exponent {};
+	const auto mantissa = Lane::splitExponent(value, exponent);
+	const auto one = Lane::broadcast(1.0f);
+	const auto s = Lane::divide(Lane::subtract(mantissa, one), Lane::add(mantissa, one));
+	const auto s2 = Lane::multiply(s, s);
+	auto series = Lane::broadcast(1.0f / 11.0f);
+	series = Lane::multiplyAdd(series, s2, Lane::broadcast(1.0f / 9.0f));
+	series = Lane::multiplyAdd(series, s2, Lane::broadcast(1.0f / 7.0f));
+	series = Lane::multiplyAdd(series, s2, Lane::broadcast(1.0f / 5.0f));
+	series = Lane::multiplyAdd(series, s2, Lane::broadcast(1.0f / 3.0f));
+	series = Lane::multiplyAdd(series, s2, one);
+	return Lane::multiplyAdd(exponent, Lane::broadcast(0.693147180559945f),
+		Lane::multiply(Lane::add(s, s), series));
+}
+
+// Zero and negative magnitudes are raised to the smallest normal float, whose
+// level of about -758 dB is then clamped to the floor like JUCE's
+// Decibels::gainToDecibels() does.
+template <typename Lane>
+void magnitudeToDecibelLanes(const float* magnitudes, float scale, float floorDb,
+	float* destination, int first) noexcept
+{
+	const auto gain = Lane::maximum(Lane::multiply(Lane::load(magnitudes + first), Lane::broadcast(scale)),
+		Lane::broadcast(std::numeric_limits<float>::min()));
+	const auto decibels = Lane::multiply(naturalLogarithm<Lane>(gain),
+		Lane::broadcast(8.68588963806504f));
+	Lane::store(destination + first, Lane::minimum(Lane::maximum(decibels, Lane::broadcast(floorDb)),
+		Lane::broadcast(0.0f)));
+}
+
+template <typename Lane>
+void magnitudesToDecibels(const float* magnitudes, float scale, float floorDb, float* destination, int count)
+{
+	int first = 0;
+	for (; first + Lane::width <= count; first += Lane::width)
+		magnitudeToDecibelLanes<Lane>(magnitudes, scale, floorDb, destination, first);
+	for (; first < count; ++first)
+		magnitudeToDecibelLanes<ScalarLane>(magnitudes, scale, floorDb, destination, first);
+}
+
+template <typename Lane>
+constexpr spectroscope::simd::Kernels makeKernels(spectroscope::simd::InstructionSet instructionSet) noexcept
+{
+	return { instructionSet, &updateResonators<Lane>, &resonatorMagnitudes<Lane>, &magnitudesToDecibels<Lane> };
+}
+
+}
@@ -0,0 +1,53 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SimdKernelsDetail.h"
+
+#if JUCE_SPECTROSCOPE_SIMD_NEON
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <arm_neon.h>
+
+// NEON is mandatory on AArch64, so this variant needs no target switch.
+#include "SimdKernelsGeneric.h"
+
+namespace {
+struct NeonLane {
+	using Vector = float32x4_t;
+	static constexpr int width = 4;
+
+	static Vector load(const float* source) noexcept { return vld1q_f32(source); }
+	static void store(float* destination, Vector value) noexcept { vst1q_f32(destination, value); }
+	static Vector broadcast(float value) noexcept { return vdupq_n_f32(value); }
+	static Vector add(Vector left, Vector right) noexcept { return vaddq_f32(left, right); }
+	static Vector subtract(Vector left, Vector right) noexcept { return vsubq_f32(left, right); }
+	static Vector multiply(Vector left, Vector right) noexcept { return vmulq_f32(left, right); }
+	static Vector divide(Vector left, Vector right) noexcept { return vdivq_f32(left, right); }
+	static Vector multiplyAdd(Vector left, Vector right, Vector addend) noexcept { return vfmaq_f32(addend, left, right); }
+	static Vector multiplySubtract(Vector left, Vector right, Vector subtrahend) noexcept { return vfmaq_f32(vnegq_f32(subtrahend), left, right); }
+	static Vector squareRoot(Vector value) noexcept { return vsqrtq_f32(value); }
+	static Vector minimum(Vector left, Vector right) noexcept { return vminq_f32(left, right); }
+	static Vector maximum(Vector left, Vector right) noexcept { return vmaxq_f32(left, right); }
+
+	static Vector splitExponent(Vector value, Vector& exponent) noexcept
+	{
+		const auto bits = vreinterpretq_u32_f32(value);
+		exponent = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(bits, 23)), vdupq_n_s32(127)));
+		return vreinterpretq_f32_u32(vorrq_u32(vandq_u32(bits, vdupq_n_u32(0x007fffffu)),
+			vdupq_n_u32(0x3f800000u)));
+	}
+};
+}
+
+namespace spectroscope::simd::detail {
+const Kernels neonKernels = makeKernels<NeonLane>(InstructionSet::neon);
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SimdKernelsDetail.h"
+
+#if JUCE_SPECTROSCOPE_SIMD_X86
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include <emmintrin.h>
+
+// SSE2 is part of every x86-64 CPU, so this variant needs no target switch.
+#include "SimdKernelsGeneric.h"
+
+namespace {
+struct Sse2Lane {
+	using Vector = __m128;
+	static constexpr int width = 4;
+
+	static Vector load(const float* source) noexcept { return _mm_loadu_ps(source); }
+	static void store(float* destination, Vector value) noexcept { _mm_storeu_ps(destination, value); }
+	static Vector broadcast(float value) noexcept { return _mm_set1_ps(value); }
+	static Vector add(Vector left, Vector right) noexcept { return _mm_add_ps(left, right); }
+	static Vector subtract(Vector left, Vector right) noexcept { return _mm_sub_ps(left, right); }
+	static Vector multiply(Vector left, Vector right) noexcept { return _mm_mul_ps(left, right); }
+	static Vector divide(Vector left, Vector right) noexcept { return _mm_div_ps(left, right); }
+	static Vector multiplyAdd(Vector left, Vector right, Vector addend) noexcept { return _mm_add_ps(_mm_mul_ps(left, right), addend); }
+	static Vector multiplySubtract(Vector left, Vector right, Vector subtrahend) noexcept { return _mm_sub_ps(_mm_mul_ps(left, right), subtrahend); }
+	static Vector squareRoot(Vector value) noexcept { return _mm_sqrt_ps(value); }
+	static Vector minimum(Vector left, Vector right) noexcept { return _mm_min_ps(left, right); }
+	static Vector maximum(Vector left, Vector right) noexcept { return _mm_max_ps(left, right); }
+
+	static Vector splitExponent(Vector value, Vector& exponent) noexcept
+	{
+		const auto bits = _mm_castps_si128(value);
+		exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+		return _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+			_mm_set1_epi32(0x3f800000)));
+	}
+};
+}
+
+namespace spectroscope::simd::detail {
+const Kernels sse2Kernels = makeKernels<Sse2Lane>(InstructionSet::sse2);
+}
+
+#endif
@@ -6,10 +6,17 @@
 
 #include "Spectrogram.h"
 
+#include "SimdKernels.h"
+#include "SpectroscopeTrace.h"
+
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cmath>
 #include <cstring>
 #include <numeric>
+#include <thread>
+#include <type_traits>
 
 namespace {
 int validatedFftOrder(int order)
@@ -29,9 +36,217 @@ int validatedHopSize(int requestedHopSize, int fftSize)
 
 	return juce::jlimit(1, fftSize, requestedHopSize);
 }
+
+// Readers give up rather than spin when the worker keeps overwriting the rows
+// they are copying, which needs a full history lap per attempt.
+constexpr int maximumCopyAttempts = 4;
+
+constexpr std::uint64_t completedRowStamp(std::uint64_t sequence) noexcept
+{
+	return sequence * 2;
+}
+
+// Payloads are stored and loaded relaxed; one fence on each side orders
+// them against the row stamps, which costs far less than ordering every
+// element. ThreadSanitizer cannot model standalone fences, so sanitized
+// builds order each element instead.
+#if defined(__SANITIZE_THREAD__)
+#define SPECTROSCOPE_ORDER_EACH_ELEMENT 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SPECTROSCOPE_ORDER_EACH_ELEMENT 1
+#endif
+#endif
+#ifndef SPECTROSCOPE_ORDER_EACH_ELEMENT
+#define SPECTROSCOPE_ORDER_EACH_ELEMENT 0
+#endif
+
+#if SPECTROSCOPE_ORDER_EACH_ELEMENT
+constexpr auto payloadStoreOrder = std::memory_order_release;
+constexpr auto payloadLoadOrder = std::memory_order_acquire;
+#else
+constexpr auto payloadStoreOrder = std::memory_order_relaxed;
+constexpr auto payloadLoadOrder = std::memory_order_relaxed;
+#endif
+
+// Between marking a row as being rewritten and writing its payload.
+void fenceBeforePayloadStores() noexcept
+{
+#if !SPECTROSCOPE_ORDER_EACH_ELEMENT
+	std::atomic_thread_fence(std::memory_order_release);
+#endif
+}
+
+// Between reading a row's payload and checking its stamp again.
+void fenceAfterPayloadLoads() noexcept
+{
+#if !SPECTROSCOPE_ORDER_EACH_ELEMENT
+	std::atomic_thread_fence(std::memory_order_acquire);
+#endif
+}
+
+void storeRow(std::atomic<float>* destination, const float* source, int count) noexcept
+{
+	for (int index = 0; index < count; ++index)
+		destination[index].store(source[index], payloadStoreOrder);
+}
+
+void loadRow(const std::atomic<float>* source, float* destination, int count) noexcept
+{
+	for (int index = 0; index < count; ++index)
+		destination[index] = source[index].load(payloadLoadOrder);
+}
+
+// Note lists and events are stored as words, so that their rings use the
+// same atomic, sequence-locked copies as the float rows.
+template <typename Value>
+constexpr size_t wordCount() noexcept
+{
+	static_assert(std::is_trivially_copyable_v<Value> && sizeof(Value) % sizeof(std::uint32_t) == 0);
+	return sizeof(Value) / sizeof(std::uint32_t);
+}
+
+template <typename Value>
+void storeWords(std::atomic<std::uint32_t>* destination, const Value& value) noexcept
+{
+	std::array<std::uint32_t, wordCount<Value>()> words {};
+	std::memcpy(words.data(), &value, sizeof(Value));
+	for (size_t index = 0; index < words.size(); ++index)
+		destination[index].store(words[index], payloadStoreOrder);
+}
+
+template <typename Value>
+Value loadWords(const std::atomic<std::uint32_t>* source) noexcept
+{
+	std::array<std::uint32_t, wordCount<Value>()> words {};
+	for (size_t index = 0; index < words.size(); ++index)
+		words[index] = source[index].load(payloadLoadOrder);
+	Value value;
+	std::memcpy(static_cast<void*>(&value), words.data(), sizeof(Value));
+	return value;
+}
+
+// The window-normalised magnitude of any bin is at most twice the largest
+// input sample, so a frame quieter than half the floor's amplitude cannot
+// produce a bin above the floor.
+constexpr float silenceMarginDb = 6.03f;
+
+// Returns the position after the last sample at or above the threshold, or 0
+// when the whole section is quieter.
+int signalEndInSection(const float* samples, int count, float threshold) noexcept
+{
+	if (count <= 0)
+		return 0;
+
+	if (juce::jmax(-juce::FloatVectorOperations::findMinimum(samples, count),
+			juce::FloatVectorOperations::findMaximum(samples, count)) < threshold)
+		return 0;
+
+	for (int index = count; index > 0; --index) {
+		if (std::abs(samples[index - 1]) >= threshold)
+			return index;
+	}
+	return 0;
+}
+
+// The governor's load is analysis time over the duration of the analysed
+// audio, smoothed over about a quarter second of input. Stepping back up
+// needs a much lower load than stepping down, so a level that relieved an
+// overload is not left again as soon as it takes effect.
+constexpr double loadSmoothingSeconds = 0.25;
+constexpr double overloadedLoad = 0.8;
+constexpr double relaxedLoad = 0.3;
+constexpr double stepDownSeconds = 0.5;
+constexpr double stepUpSeconds = 3.0;
+
+// The pitch tracker's rate is only halved while the reduced rate stays this
+// many times above its highest resonator, which for the default layout means
+// common audio rates from 32 kHz up.
+constexpr double minimumDecimatedPitchOversampling = 4.0;
+
+float windowMagnitudeScale(const juce::dsp::WindowingFunction<float>& window, int size)
+{
+	std::vector<float> windowValues(static_cast<size_t>(size), 1.0f);
+	window.multiplyWithWindowingTable(windowValues.data(), static_cast<size_t>(size));
+	const auto windowSum = std::accumulate(windowValues.begin(), windowValues.end(), 0.0f);
+	return windowSum > 0.0f ? 2.0f / windowSum : 1.0f;
+}
+
+void fillRows(std::vector<std::atomic<float>>& rows, float value) noexcept
+{
+	for (auto& element : rows)
+		element.store(value, std::memory_order_relaxed);
+}
+
+// Both history rings are sequence locked. A row's stamp is odd while the
+// worker rewrites it and twice its sequence number once complete.
+// storePayload(row) writes the payload of one ring row.
+template <typename StorePayload>
+void publishRingRow(std::atomic<std::uint64_t>& sequence,
+	std::vector<std::atomic<std::uint64_t>>& stamps, StorePayload&& storePayload) noexcept
+{
+	const auto nextSequence = sequence.load(std::memory_order_relaxed) + 1;
+	const auto row = static_cast<size_t>((nextSequence - 1) % stamps.size());
+	auto& rowStamp = stamps[row];
+	rowStamp.store(completedRowStamp(nextSequence) - 1, std::memory_order_relaxed);
+	fenceBeforePayloadStores();
+	storePayload(row);
+	rowStamp.store(completedRowStamp(nextSequence), std::memory_order_release);
+	sequence.store(nextSequence, std::memory_order_release);
+}
+
+// Copies the rows newer than afterSequence, oldest first, keeping the newest
+// when destinationRows cannot hold them all. loadPayload(sourceRow,
+// destinationRow) reads one row's payload; readers retry any row whose stamp
+// changed while it was being copied.
+template <typename LoadPayload>
+int copyRingRowsAfter(const std::atomic<std::uint64_t>& sequence,
+	const std::vector<std::atomic<std::uint64_t>>& stamps, std::uint64_t afterSequence,
+	int destinationRows, std::uint64_t* copiedThroughSequence, LoadPayload&& loadPayload)
+{
+	const auto capacity = static_cast<std::uint64_t>(stamps.size());
+	for (int attempt = 0; attempt < maximumCopyAttempts; ++attempt) {
+		const auto newestSequence = sequence.load(std::memory_order_acquire);
+		if (newestSequence == 0 || newestSequence <= afterSequence)
+			return 0;
+
+		const auto oldestRetainedSequence = newestSequence > capacity
+			? newestSequence - capacity + 1
+			: 1;
+		auto firstSequence = juce::jmax(afterSequence + 1, oldestRetainedSequence);
+		const auto availableRows = newestSequence - firstSequence + 1;
+		if (availableRows > static_cast<std::uint64_t>(destinationRows))
+			firstSequence = newestSequence - static_cast<std::uint64_t>(destinationRows) + 1;
+
+		const auto copiedRows = static_cast<int>(newestSequence - firstSequence + 1);
+		auto intact = true;
+		for (int destinationRow = 0; destinationRow < copiedRows && intact; ++destinationRow) {
+			const auto sourceSequence = firstSequence + static_cast<std::uint64_t>(destinationRow);
+			const auto sourceRow = static_cast<size_t>((sourceSequence - 1) % capacity);
+			const auto& rowStamp = stamps[sourceRow];
+			if (rowStamp.load(std::memory_order_acquire) != completedRowStamp(sourceSequence)) {
+				intact = false;
+				break;
+			}
+
+			loadPayload(sourceRow, destinationRow);
+			fenceAfterPayloadLoads();
+			intact = rowStamp.load(std::memory_order_relaxed) == completedRowStamp(sourceSequence);
+		}
+
+		if (intact) {
+			if (copiedThroughSequence != nullptr)
+				*copiedThroughSequence = newestSequence;
+			return copiedRows;
+		}
+		SPECTROSCOPE_TRACE_INSTANT("Spectrogram publication copy retry");
+	}
+	return 0;
+}
 }
 
-Spectrogram::Spectrogram(int fftOrder, int requestedHopSize, float requestedFloorDb)
+Spectrogram::Spectrogram(int fftOrder, int requestedHopSize, float requestedFloorDb,
+	const PitchTracker::Layout& pitchLayout)
 	: fftOrder_(validatedFftOrder(fftOrder))
 	, fftSize_(fftSizeForOrder(fftOrder_))
 	, hopSize_(validatedHopSize(requestedHopSize, fftSize_))
@@ -42,19 +257,44 @@ Spectrogram::Spectrogram(int fftOrder, int requestedHopSize, float requestedFloo
 	, hopBuffer_(1, hopSize_)
 	, forwardFFT_(fftOrder_)
 	, window_(static_cast<size_t>(fftSize_), juce::dsp::WindowingFunction<float>::hann, false)
+	, reducedFFT_(fftOrder_ - 1)
+	, reducedWindow_(static_cast<size_t>(fftSize_ / 2), juce::dsp::WindowingFunction<float>::hann, false)
+	, pitchTracker_(pitchLayout)
 	, inputData_(static_cast<size_t>(fftSize_), 0.0f)
 	, windowedData_(static_cast<size_t>(fftSize_), 0.0f)
 	, fftWork_(static_cast<size_t>(fftSize_ * 2), 0.0f)
 	, nextSpectrum_(static_cast<size_t>(fftSize_ / 2), floorDb_)
-	, nextPitchClass_(static_cast<size_t>(PitchTracker::outputBinCount), 0.0f)
-	, publishedSpectra_(static_cast<size_t>(fftSize_ / 2 * spectrumHistoryCapacity), floorDb_)
+	, nextPitchClass_(static_cast<size_t>(pitchTracker_.outputBinCount()), 0.0f)
+	, nextFieldNotes_(static_cast<size_t>(2 + 2 * pitchTracker_.polyphony()), 0.0f)
+	, fieldNotes_(static_cast<size_t>(pitchTracker_.polyphony()))
+	, reducedSpectrum_(static_cast<size_t>(fftSize_ / 4), floorDb_)
+	, decimatedHop_(static_cast<size_t>(hopSize_ / 2 + 1), 0.0f)
+	, publishedSpectra_(static_cast<size_t>(fftSize_ / 2 * spectrumHistoryCapacity))
 	, publishedPitchClasses_(static_cast<size_t>(
-		PitchTracker::outputBinCount * spectrumHistoryCapacity), 0.0f)
+		pitchTracker_.outputBinCount() * spectrumHistoryCapacity))
+	, publishedFieldNotes_(nextFieldNotes_.size() * static_cast<size_t>(spectrumHistoryCapacity))
+	, publishedRowStamps_(static_cast<size_t>(spectrumHistoryCapacity))
+	, publishedRowNotes_(static_cast<size_t>(pitchTracker_.polyphony() * spectrumHistoryCapacity)
+		* wordCount<spectroscope::TrackedPitch>())
+	, publishedRowNoteCounts_(static_cast<size_t>(spectrumHistoryCapacity))
+	, publishedPitchUpdates_(static_cast<size_t>(
+		pitchTracker_.outputBinCount() * pitchUpdateHistoryCapacity))
+	, publishedPitchUpdatePositions_(static_cast<size_t>(pitchUpdateHistoryCapacity))
+	, publishedPitchUpdateStamps_(static_cast<size_t>(pitchUpdateHistoryCapacity))
+	, publishedNoteEvents_(static_cast<size_t>(noteEventHistoryCapacity)
+		* wordCount<spectroscope::TrackedNoteEvent>())
+	, publishedNoteEventStamps_(static_cast<size_t>(noteEventHistoryCapacity))
 {
-	std::vector<float> windowValues(static_cast<size_t>(fftSize_), 1.0f);
-	window_.multiplyWithWindowingTable(windowValues.data(), static_cast<size_t>(fftSize_));
-	const auto windowSum = std::accumulate(windowValues.begin(), windowValues.end(), 0.0f);
-	windowMagnitudeScale_ = windowSum > 0.0f ? 2.0f / windowSum : 1.0f;
+	trackerNotes_.resize(static_cast<size_t>(pitchTracker_.polyphony()));
+	for (auto* notes : { &listedNotes_, &nextListedNotes_, &nextNotes_ })
+		notes->reserve(static_cast<size_t>(pitchTracker_.polyphony()));
+	fillRows(publishedSpectra_, floorDb_);
+	fillRows(publishedPitchClasses_, 0.0f);
+	fillRows(publishedFieldNotes_, 0.0f);
+	fillRows(publishedPitchUpdates_, 0.0f);
+	silenceThresholdDb_.store(floorDb_ - silenceMarginDb, std::memory_order_relaxed);
+	windowMagnitudeScale_ = windowMagnitudeScale(window_, fftSize_);
+	reducedWindowMagnitudeScale_ = windowMagnitudeScale(reducedWindow_, fftSize_ / 2);
 }
 
 int Spectrogram::fftSize() const noexcept
@@ -69,7 +309,12 @@ int Spectrogram::spectrumSize() const noexcept
 
 int Spectrogram::pitchClassSize() const noexcept
 {
-	return PitchTracker::outputBinCount;
+	return pitchTracker_.outputBinCount();
+}
+
+const PitchTracker::Layout& Spectrogram::pitchLayout() const noexcept
+{
+	return pitchTracker_.layout();
 }
 
 int Spectrogram::hopSize() const noexcept
@@ -88,6 +333,10 @@ void Spectrogram::prepare(double newSampleRate)
 	pitchTracker_.setPreset(pitchTrackingPreset_.load(std::memory_order_relaxed));
 	pitchTracker_.prepare(sampleRate_.load(std::memory_order_relaxed),
 		concertAHz_.load(std::memory_order_relaxed));
+	// One calculation per row is the tracker's reference update, so the
+	// default row-rate updates smooth the same way at every sample rate.
+	pitchTracker_.setReferenceUpdateSamples(static_cast<double>(hopSize_));
+	pitchTrackerDecimated_ = false;
 	reset();
 }
 
@@ -101,16 +350,45 @@ void Spectrogram::reset()
 	std::fill(fftWork_.begin(), fftWork_.end(), 0.0f);
 	std::fill(nextSpectrum_.begin(), nextSpectrum_.end(), floorDb_);
 	std::fill(nextPitchClass_.begin(), nextPitchClass_.end(), 0.0f);
+	std::fill(nextFieldNotes_.begin(), nextFieldNotes_.end(), 0.0f);
 	pitchTracker_.reset();
 	inputDataAvailable_ = 0;
+	appliedPitchUpdateInterval_ = 0;
+	samplesUntilPitchUpdate_ = 0;
+	decimatorHoldsSample_ = false;
+	decimatorHeldSample_ = 0.0f;
+	currentQuality_ = QualityLevel::full;
+	smoothedLoad_ = 0.0;
+	overloadedSeconds_ = 0.0;
+	relaxedSeconds_ = 0.0;
+	qualityLevel_.store(QualityLevel::full, std::memory_order_relaxed);
+	writtenSampleCount_ = 0;
+	readSampleCount_ = 0;
+	signalEndSample_ = 0;
 	droppedSamples_.store(0, std::memory_order_relaxed);
+	gatedRows_.store(0, std::memory_order_relaxed);
 
-	{
-		const juce::ScopedLock lock(publishedSpectrumLock_);
-		std::fill(publishedSpectra_.begin(), publishedSpectra_.end(), floorDb_);
-		std::fill(publishedPitchClasses_.begin(), publishedPitchClasses_.end(), 0.0f);
-		sequence_.store(0, std::memory_order_release);
-	}
+	for (auto& stamp : publishedRowStamps_)
+		stamp.store(0, std::memory_order_relaxed);
+	fillRows(publishedSpectra_, floorDb_);
+	fillRows(publishedPitchClasses_, 0.0f);
+	fillRows(publishedFieldNotes_, 0.0f);
+	sequence_.store(0, std::memory_order_release);
+
+	for (auto& stamp : publishedPitchUpdateStamps_)
+		stamp.store(0, std::memory_order_relaxed);
+	for (auto& position : publishedPitchUpdatePositions_)
+		position.store(0, std::memory_order_relaxed);
+	fillRows(publishedPitchUpdates_, 0.0f);
+	pitchUpdateSequence_.store(0, std::memory_order_release);
+
+	listedNotes_.clear();
+	nextNotes_.clear();
+	for (auto& count : publishedRowNoteCounts_)
+		count.store(0, std::memory_order_relaxed);
+	for (auto& stamp : publishedNoteEventStamps_)
+		stamp.store(0, std::memory_order_relaxed);
+	noteEventSequence_.store(0, std::memory_order_release);
 }
 
 int Spectrogram::process(const juce::AudioSourceChannelInfo& data)
@@ -118,22 +396,103 @@ int Spectrogram::process(const juce::AudioSourceChannelInfo& data)
 	if (data.buffer == nullptr || data.numSamples <= 0)
 		return 0;
 
+	SPECTROSCOPE_TRACE_SCOPE("Spectrogram::process");
+	// Windowing, the FFT and the pitch tracker all see decaying values
+	// during silence; subnormal arithmetic would make quiet hops the slowest.
+	const juce::ScopedNoDenormals noDenormals;
+	const auto started = governorClock_();
+	const auto droppedBefore = droppedSamples_.load(std::memory_order_relaxed);
 	writeInput(data);
+	const auto inputBacklogged = fifo_.getNumReady() > fifoCapacity_ / 2
+		|| droppedSamples_.load(std::memory_order_relaxed) != droppedBefore;
 
 	int rowsProduced = 0;
+	int hopsProcessed = 0;
 	while (fifo_.getNumReady() >= hopSize_) {
+		SPECTROSCOPE_TRACE_SCOPE("Spectrogram hop");
 		readHop();
-		pitchTracker_.setPreset(pitchTrackingPreset_.load(std::memory_order_relaxed));
-		pitchTracker_.setConcertAHz(concertAHz_.load(std::memory_order_relaxed));
-		pitchTracker_.process(hopBuffer_.getReadPointer(0), hopSize_);
+		++hopsProcessed;
+		const auto spectrumEnabled = spectrumEnabled_.load(std::memory_order_relaxed);
+		const auto pitchTrackingEnabled = pitchTrackingEnabled_.load(std::memory_order_relaxed)
+			&& currentQuality_ < QualityLevel::noPitchTracking;
+		if (pitchTrackingEnabled && !pitchTrackingActive_)
+			pitchTracker_.reset();
+		pitchTrackingActive_ = pitchTrackingEnabled;
+
+		if (pitchTrackingEnabled) {
+			const auto reducedPitchTracking = currentQuality_ >= QualityLevel::reducedPitchTracking;
+			configurePitchTracker(reducedPitchTracking ? PitchTracker::Preset::fast
+					: pitchTrackingPreset_.load(std::memory_order_relaxed),
+				reducedPitchTracking && sampleRate() / 2.0
+					>= minimumDecimatedPitchOversampling * pitchTracker_.highestFrequencyHz());
+			const auto silentHop = readSampleCount_ >= signalEndSample_ + static_cast<std::uint64_t>(hopSize_);
+			const auto updateInterval = currentQuality_ == QualityLevel::full
+				? pitchUpdateInterval_.load(std::memory_order_relaxed) : 0;
+			if (updateInterval != appliedPitchUpdateInterval_) {
+				appliedPitchUpdateInterval_ = updateInterval;
+				samplesUntilPitchUpdate_ = updateInterval;
+			}
+			if (updateInterval > 0) {
+				trackPitchInUpdates(updateInterval, silentHop);
+			} else if (pitchTrackerDecimated_) {
+				const auto decimatedSamples = decimateHop();
+				if (silentHop)
+					pitchTracker_.skipSilence(decimatedSamples);
+				else
+					pitchTracker_.process(decimatedHop_.data(), decimatedSamples);
+			} else if (silentHop) {
+				pitchTracker_.skipSilence(hopSize_);
+			} else {
+				pitchTracker_.process(hopBuffer_.getReadPointer(0), hopSize_);
+			}
+		}
+		// The window keeps filling while the spectrum is disabled, so the
+		// first row after re-enabling it already covers current input.
 		appendHop();
 
 		if (inputDataAvailable_ == fftSize_) {
-			calculateSpectrum();
+			// A held row republishes its predecessor, keeping the row rate
+			// and therefore the waterfall's time axis unchanged.
+			const auto holdRow = currentQuality_ >= QualityLevel::reducedRowRate
+				&& (sequence_.load(std::memory_order_relaxed) & 1) != 0;
+			if (!spectrumEnabled) {
+				std::fill(nextSpectrum_.begin(), nextSpectrum_.end(), floorDb_);
+			} else if (!holdRow) {
+				if (readSampleCount_ >= signalEndSample_ + static_cast<std::uint64_t>(fftSize_)) {
+					std::fill(nextSpectrum_.begin(), nextSpectrum_.end(), floorDb_);
+					gatedRows_.fetch_add(1, std::memory_order_relaxed);
+				} else if (currentQuality_ >= QualityLevel::reducedFftSize) {
+					calculateReducedSpectrum();
+				} else {
+					calculateSpectrum();
+				}
+			}
+			if (!pitchTrackingEnabled) {
+				std::fill(nextPitchClass_.begin(), nextPitchClass_.end(), 0.0f);
+				std::fill(nextFieldNotes_.begin(), nextFieldNotes_.end(), 0.0f);
+				if (!listedNotes_.empty())
+					updateNoteList(readSampleCount_, false);
+			} else if (!holdRow && appliedPitchUpdateInterval_ == 0) {
+				calculatePitch();
+				publishPitchUpdate(readSampleCount_);
+			}
+			publishRow();
 			++rowsProduced;
 		}
 	}
 
+	if (qualityGovernorEnabled_.load(std::memory_order_relaxed)) {
+		const auto analysisSeconds = governorClock_() - started;
+		const auto audioSeconds = sampleRate() > 0.0
+			? static_cast<double>(hopsProcessed * hopSize_) / sampleRate() : 0.0;
+		updateQualityGovernor(analysisSeconds, audioSeconds, inputBacklogged);
+	} else if (currentQuality_ != QualityLevel::full) {
+		currentQuality_ = QualityLevel::full;
+		qualityLevel_.store(currentQuality_, std::memory_order_relaxed);
+	}
+
+	if (rowsProduced > 0)
+		notifyPublishListeners();
 	return rowsProduced;
 }
 
@@ -142,20 +501,7 @@ bool Spectrogram::copyLatestSpectrum(float* destination, int destinationSize, st
 	if (destination == nullptr || destinationSize < spectrumSize())
 		return false;
 
-	const juce::ScopedLock lock(publishedSpectrumLock_);
-	const auto currentSequence = sequence_.load(std::memory_order_relaxed);
-	if (currentSequence == 0)
-		return false;
-
-	const auto row = static_cast<size_t>((currentSequence - 1)
-		% static_cast<std::uint64_t>(spectrumHistoryCapacity));
-	const auto rowStride = static_cast<size_t>(spectrumSize());
-	const auto rowStart = publishedSpectra_.begin()
-		+ static_cast<std::ptrdiff_t>(row * rowStride);
-	std::copy_n(rowStart, spectrumSize(), destination);
-	if (copiedSequence != nullptr)
-		*copiedSequence = currentSequence;
-	return true;
+	return copyPublishedRowsAfter(0, 1, destination, nullptr, nullptr, copiedSequence) > 0;
 }
 
 int Spectrogram::copySpectrumFramesAfter(std::uint64_t afterSequence, float* destination,
@@ -164,34 +510,8 @@ int Spectrogram::copySpectrumFramesAfter(std::uint64_t afterSequence, float* des
 	if (destination == nullptr || destinationSize < spectrumSize())
 		return 0;
 
-	const auto destinationRows = destinationSize / spectrumSize();
-	const juce::ScopedLock lock(publishedSpectrumLock_);
-	const auto newestSequence = sequence_.load(std::memory_order_relaxed);
-	if (newestSequence == 0 || newestSequence <= afterSequence)
-		return 0;
-
-	const auto oldestRetainedSequence = newestSequence > spectrumHistoryCapacity
-		? newestSequence - spectrumHistoryCapacity + 1
-		: 1;
-	auto firstSequence = juce::jmax(afterSequence + 1, oldestRetainedSequence);
-	const auto availableRows = newestSequence - firstSequence + 1;
-	if (availableRows > static_cast<std::uint64_t>(destinationRows))
-		firstSequence = newestSequence - static_cast<std::uint64_t>(destinationRows) + 1;
-
-	const auto copiedRows = static_cast<int>(newestSequence - firstSequence + 1);
-	const auto rowStride = static_cast<size_t>(spectrumSize());
-	for (int destinationRow = 0; destinationRow < copiedRows; ++destinationRow) {
-		const auto sourceSequence = firstSequence + static_cast<std::uint64_t>(destinationRow);
-		const auto sourceRow = static_cast<size_t>((sourceSequence - 1)
-			% static_cast<std::uint64_t>(spectrumHistoryCapacity));
-		const auto source = publishedSpectra_.begin()
-			+ static_cast<std::ptrdiff_t>(sourceRow * rowStride);
-		std::copy_n(source, spectrumSize(), destination + destinationRow * spectrumSize());
-	}
-
-	if (copiedThroughSequence != nullptr)
-		*copiedThroughSequence = newestSequence;
-	return copiedRows;
+	return copyPublishedRowsAfter(afterSequence, destinationSize / spectrumSize(),
+		destination, nullptr, nullptr, copiedThroughSequence);
 }
 
 int Spectrogram::copyAnalysisFramesAfter(std::uint64_t afterSequence,
@@ -206,39 +526,73 @@ int Spectrogram::copyAnalysisFramesAfter(std::uint64_t afterSequence,
 
 	const auto destinationRows = std::min(
 		spectrumDestinationSize / spectrumSize(), pitchDestinationSize / pitchClassSize());
-	const juce::ScopedLock lock(publishedSpectrumLock_);
-	const auto newestSequence = sequence_.load(std::memory_order_relaxed);
-	if (newestSequence == 0 || newestSequence <= afterSequence)
-		return 0;
+	return copyPublishedRowsAfter(afterSequence, destinationRows,
+		spectrumDestination, pitchDestination, nullptr, copiedThroughSequence);
+}
 
-	const auto oldestRetainedSequence = newestSequence > spectrumHistoryCapacity
-		? newestSequence - spectrumHistoryCapacity + 1
-		: 1;
-	auto firstSequence = juce::jmax(afterSequence + 1, oldestRetainedSequence);
-	const auto availableRows = newestSequence - firstSequence + 1;
-	if (availableRows > static_cast<std::uint64_t>(destinationRows))
-		firstSequence = newestSequence - static_cast<std::uint64_t>(destinationRows) + 1;
-
-	const auto copiedRows = static_cast<int>(newestSequence - firstSequence + 1);
-	const auto spectrumStride = static_cast<size_t>(spectrumSize());
-	const auto pitchStride = static_cast<size_t>(pitchClassSize());
-	for (int destinationRow = 0; destinationRow < copiedRows; ++destinationRow) {
-		const auto sourceSequence = firstSequence + static_cast<std::uint64_t>(destinationRow);
-		const auto sourceRow = static_cast<size_t>((sourceSequence - 1)
-			% static_cast<std::uint64_t>(spectrumHistoryCapacity));
-		const auto spectrumSource = publishedSpectra_.begin()
-			+ static_cast<std::ptrdiff_t>(sourceRow * spectrumStride);
-		const auto pitchSource = publishedPitchClasses_.begin()
-			+ static_cast<std::ptrdiff_t>(sourceRow * pitchStride);
-		std::copy_n(spectrumSource, spectrumSize(),
-			spectrumDestination + destinationRow * spectrumSize());
-		std::copy_n(pitchSource, pitchClassSize(),
-			pitchDestination + destinationRow * pitchClassSize());
+int Spectrogram::fieldNoteRowSize() const noexcept
+{
+	return static_cast<int>(nextFieldNotes_.size());
+}
+
+int Spectrogram::copyFieldNoteFramesAfter(std::uint64_t afterSequence,
+	float* spectrumDestination, int spectrumDestinationSize,
+	float* fieldNoteDestination, int fieldNoteDestinationSize,
+	std::uint64_t* copiedThroughSequence) const
+{
+	if (spectrumDestination == nullptr || spectrumDestinationSize < spectrumSize()
+		|| fieldNoteDestination == nullptr || fieldNoteDestinationSize < fieldNoteRowSize()) {
+		return 0;
 	}
 
-	if (copiedThroughSequence != nullptr)
-		*copiedThroughSequence = newestSequence;
-	return copiedRows;
+	const auto destinationRows = std::min(
+		spectrumDestinationSize / spectrumSize(), fieldNoteDestinationSize / fieldNoteRowSize());
+	return copyPublishedRowsAfter(afterSequence, destinationRows,
+		spectrumDestination, nullptr, fieldNoteDestination, copiedThroughSequence);
+}
+
+void Spectrogram::setPitchFieldEnabled(bool enabled) noexcept
+{
+	pitchFieldEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Spectrogram::isPitchFieldEnabled() const noexcept
+{
+	return pitchFieldEnabled_.load(std::memory_order_relaxed);
+}
+
+void Spectrogram::setPitchUpdateInterval(int samples) noexcept
+{
+	pitchUpdateInterval_.store(samples > 0 ? juce::jmax(minimumPitchUpdateInterval, samples) : 0,
+		std::memory_order_relaxed);
+}
+
+int Spectrogram::pitchUpdateInterval() const noexcept
+{
+	return pitchUpdateInterval_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Spectrogram::pitchUpdateSequence() const noexcept
+{
+	return pitchUpdateSequence_.load(std::memory_order_acquire);
+}
+
+int Spectrogram::copyPitchUpdatesAfter(std::uint64_t afterSequence, float* destination,
+	int destinationSize, std::uint64_t* samplePositions, std::uint64_t* copiedThroughSequence) const
+{
+	if (destination == nullptr || destinationSize < pitchClassSize())
+		return 0;
+
+	return copyRingRowsAfter(pitchUpdateSequence_, publishedPitchUpdateStamps_, afterSequence,
+		destinationSize / pitchClassSize(), copiedThroughSequence,
+		[&](size_t sourceRow, int destinationRow) {
+			loadRow(publishedPitchUpdates_.data() + sourceRow * static_cast<size_t>(pitchClassSize()),
+				destination + destinationRow * pitchClassSize(), pitchClassSize());
+			if (samplePositions != nullptr) {
+				samplePositions[destinationRow] = publishedPitchUpdatePositions_[sourceRow].load(
+					std::memory_order_relaxed);
+			}
+		});
 }
 
 bool Spectrogram::copyLatestPitchClass(float* destination, int destinationSize,
@@ -247,20 +601,65 @@ bool Spectrogram::copyLatestPitchClass(float* destination, int destinationSize,
 	if (destination == nullptr || destinationSize < pitchClassSize())
 		return false;
 
-	const juce::ScopedLock lock(publishedSpectrumLock_);
-	const auto currentSequence = sequence_.load(std::memory_order_relaxed);
-	if (currentSequence == 0)
-		return false;
+	return copyPublishedRowsAfter(0, 1, nullptr, destination, nullptr, copiedSequence) > 0;
+}
+
+int Spectrogram::copyLatestTrackedNotes(spectroscope::TrackedPitch* destination, int destinationCapacity,
+	std::uint64_t* copiedSequence) const
+{
+	if (destination == nullptr || destinationCapacity <= 0)
+		return 0;
+
+	constexpr auto noteWords = wordCount<spectroscope::TrackedPitch>();
+	const auto rowWords = static_cast<size_t>(pitchTracker_.polyphony()) * noteWords;
+	auto selectedCount = 0;
+	const auto copiedRows = copyRingRowsAfter(sequence_, publishedRowStamps_, 0, 1, copiedSequence,
+		[&](size_t sourceRow, int) {
+			// destination holds the strongest notes so far, strongest first.
+			selectedCount = 0;
+			const auto noteCount = juce::jlimit(0, pitchTracker_.polyphony(),
+				publishedRowNoteCounts_[sourceRow].load(std::memory_order_acquire));
+			for (int noteIndex = 0; noteIndex < noteCount; ++noteIndex) {
+				const auto note = loadWords<spectroscope::TrackedPitch>(publishedRowNotes_.data()
+					+ sourceRow * rowWords + static_cast<size_t>(noteIndex) * noteWords);
+				if (selectedCount == destinationCapacity
+					&& note.confidence <= destination[selectedCount - 1].confidence) {
+					continue;
+				}
+				auto slot = std::min(selectedCount, destinationCapacity - 1);
+				for (; slot > 0 && destination[slot - 1].confidence < note.confidence; --slot)
+					destination[slot] = destination[slot - 1];
+				destination[slot] = note;
+				selectedCount = std::min(selectedCount + 1, destinationCapacity);
+			}
+		});
+	if (copiedRows == 0)
+		return 0;
 
-	const auto row = static_cast<size_t>((currentSequence - 1)
-		% static_cast<std::uint64_t>(spectrumHistoryCapacity));
-	const auto rowStride = static_cast<size_t>(pitchClassSize());
-	const auto rowStart = publishedPitchClasses_.begin()
-		+ static_cast<std::ptrdiff_t>(row * rowStride);
-	std::copy_n(rowStart, pitchClassSize(), destination);
-	if (copiedSequence != nullptr)
-		*copiedSequence = currentSequence;
-	return true;
+	std::sort(destination, destination + selectedCount,
+		[](const spectroscope::TrackedPitch& first, const spectroscope::TrackedPitch& second) {
+			return first.frequencyHz < second.frequencyHz;
+		});
+	return selectedCount;
+}
+
+std::uint64_t Spectrogram::noteEventSequence() const noexcept
+{
+	return noteEventSequence_.load(std::memory_order_acquire);
+}
+
+int Spectrogram::copyNoteEventsAfter(std::uint64_t afterSequence, spectroscope::TrackedNoteEvent* destination,
+	int destinationCapacity, std::uint64_t* copiedThroughSequence) const
+{
+	if (destination == nullptr || destinationCapacity <= 0)
+		return 0;
+
+	constexpr auto eventWords = wordCount<spectroscope::TrackedNoteEvent>();
+	return copyRingRowsAfter(noteEventSequence_, publishedNoteEventStamps_, afterSequence,
+		destinationCapacity, copiedThroughSequence, [&](size_t sourceRow, int destinationRow) {
+			destination[destinationRow] = loadWords<spectroscope::TrackedNoteEvent>(
+				publishedNoteEvents_.data() + sourceRow * eventWords);
+		});
 }
 
 void Spectrogram::setConcertAHz(float frequencyHz) noexcept
@@ -283,6 +682,92 @@ PitchTracker::Preset Spectrogram::pitchTrackingPreset() const noexcept
 	return pitchTrackingPreset_.load(std::memory_order_relaxed);
 }
 
+void Spectrogram::setSpectrumEnabled(bool enabled) noexcept
+{
+	spectrumEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Spectrogram::isSpectrumEnabled() const noexcept
+{
+	return spectrumEnabled_.load(std::memory_order_relaxed);
+}
+
+void Spectrogram::setPitchTrackingEnabled(bool enabled) noexcept
+{
+	pitchTrackingEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Spectrogram::isPitchTrackingEnabled() const noexcept
+{
+	return pitchTrackingEnabled_.load(std::memory_order_relaxed);
+}
+
+void Spectrogram::setQualityGovernorEnabled(bool enabled) noexcept
+{
+	qualityGovernorEnabled_.store(enabled, std::memory_order_relaxed);
+}
+
+bool Spectrogram::isQualityGovernorEnabled() const noexcept
+{
+	return qualityGovernorEnabled_.load(std::memory_order_relaxed);
+}
+
+Spectrogram::QualityLevel Spectrogram::qualityLevel() const noexcept
+{
+	return qualityLevel_.load(std::memory_order_relaxed);
+}
+
+void Spectrogram::setSilenceThresholdDb(float thresholdDb) noexcept
+{
+	silenceThresholdDb_.store(juce::jmin(0.0f, thresholdDb), std::memory_order_relaxed);
+}
+
+float Spectrogram::silenceThresholdDb() const noexcept
+{
+	return silenceThresholdDb_.load(std::memory_order_relaxed);
+}
+
+bool Spectrogram::addPublishListener(PublishListener* listener) noexcept
+{
+	if (listener == nullptr)
+		return false;
+
+	for (auto& slot : publishListeners_) {
+		PublishListener* expected = nullptr;
+		if (slot.compare_exchange_strong(expected, listener))
+			return true;
+	}
+	return false;
+}
+
+// Clearing the slot and then reading the counter pairs with the worker's
+// increment before it reads the slots; both sides are sequentially
+// consistent, so either the worker sees the empty slot or removal sees the
+// notification running.
+void Spectrogram::removePublishListener(PublishListener* listener) noexcept
+{
+	if (listener == nullptr)
+		return;
+
+	for (auto& slot : publishListeners_) {
+		auto* expected = listener;
+		slot.compare_exchange_strong(expected, nullptr);
+	}
+	while (notifyingPublishListeners_.load() != 0)
+		std::this_thread::yield();
+}
+
+void Spectrogram::notifyPublishListeners() noexcept
+{
+	notifyingPublishListeners_.fetch_add(1);
+	const auto newestSequence = sequence_.load(std::memory_order_relaxed);
+	for (auto& slot : publishListeners_) {
+		if (auto* listener = slot.load())
+			listener->rowsPublished(newestSequence);
+	}
+	notifyingPublishListeners_.fetch_sub(1, std::memory_order_release);
+}
+
 std::uint64_t Spectrogram::sequence() const noexcept
 {
 	return sequence_.load(std::memory_order_acquire);
@@ -293,6 +778,11 @@ std::uint64_t Spectrogram::droppedSamples() const noexcept
 	return droppedSamples_.load(std::memory_order_relaxed);
 }
 
+std::uint64_t Spectrogram::gatedRows() const noexcept
+{
+	return gatedRows_.load(std::memory_order_relaxed);
+}
+
 double Spectrogram::sampleRate() const noexcept
 {
 	return sampleRate_.load(std::memory_order_relaxed);
@@ -312,19 +802,27 @@ int Spectrogram::writeInput(const juce::AudioSourceChannelInfo& data)
 	fifo_.prepareToWrite(requestedSamples, start1, size1, start2, size2);
 	const auto writtenSamples = size1 + size2;
 	const auto gain = availableChannels > 0 ? 1.0f / static_cast<float>(availableChannels) : 0.0f;
+	const auto silenceThreshold = std::pow(10.0f,
+		silenceThresholdDb_.load(std::memory_order_relaxed) / 20.0f);
 
-	auto writeSection = [&](int destinationStart, int sourceStart, int count) {
+	auto writeSection = [&](int destinationStart, int sourceStart, int count, std::uint64_t firstSample) {
 		if (count <= 0)
 			return;
 
 		fifoBuffer_.clear(0, destinationStart, count);
 		for (int channel = 0; channel < availableChannels; ++channel)
 			fifoBuffer_.addFrom(0, destinationStart, *data.buffer, channel, sourceStart, count, gain);
+
+		const auto signalEnd = signalEndInSection(fifoBuffer_.getReadPointer(0, destinationStart),
+			count, silenceThreshold);
+		if (signalEnd > 0)
+			signalEndSample_ = firstSample + static_cast<std::uint64_t>(signalEnd);
 	};
 
-	writeSection(start1, validStart, size1);
-	writeSection(start2, validStart + size1, size2);
+	writeSection(start1, validStart, size1, writtenSampleCount_);
+	writeSection(start2, validStart + size1, size2, writtenSampleCount_ + static_cast<std::uint64_t>(size1));
 	fifo_.finishedWrite(writtenSamples);
+	writtenSampleCount_ += static_cast<std::uint64_t>(writtenSamples);
 
 	if (writtenSamples < requestedSamples)
 		droppedSamples_.fetch_add(static_cast<std::uint64_t>(requestedSamples - writtenSamples), std::memory_order_relaxed);
@@ -347,6 +845,7 @@ void Spectrogram::readHop()
 		hopBuffer_.copyFrom(0, size1, fifoBuffer_, 0, start2, size2);
 
 	fifo_.finishedRead(size1 + size2);
+	readSampleCount_ += static_cast<std::uint64_t>(size1 + size2);
 }
 
 void Spectrogram::appendHop()
@@ -364,8 +863,44 @@ void Spectrogram::appendHop()
 	std::copy_n(hop, hopSize_, inputData_.end() - hopSize_);
 }
 
+void Spectrogram::configurePitchTracker(PitchTracker::Preset preset, bool decimated)
+{
+	const auto concertAHz = concertAHz_.load(std::memory_order_relaxed);
+	pitchTracker_.setPreset(preset);
+	if (decimated == pitchTrackerDecimated_) {
+		pitchTracker_.setConcertAHz(concertAHz);
+		return;
+	}
+
+	// Switching the rate keeps the tracked notes, so stepping quality up or
+	// down does not restart them.
+	pitchTracker_.setSampleRate(decimated ? sampleRate() / 2.0 : sampleRate());
+	pitchTracker_.setConcertAHz(concertAHz);
+	const auto hopSamples = static_cast<double>(hopSize_);
+	pitchTracker_.setReferenceUpdateSamples(decimated ? 0.5 * hopSamples : hopSamples);
+	pitchTrackerDecimated_ = decimated;
+	decimatorHoldsSample_ = false;
+}
+
+// Averaging sample pairs is a crude half-band filter, but what it lets alias
+// lands far above the pitch tracker's range.
+int Spectrogram::decimateHop()
+{
+	const auto* hop = hopBuffer_.getReadPointer(0);
+	int decimatedSamples = 0;
+	for (int sample = 0; sample < hopSize_; ++sample) {
+		if (decimatorHoldsSample_)
+			decimatedHop_[static_cast<size_t>(decimatedSamples++)] = 0.5f * (decimatorHeldSample_ + hop[sample]);
+		else
+			decimatorHeldSample_ = hop[sample];
+		decimatorHoldsSample_ = !decimatorHoldsSample_;
+	}
+	return decimatedSamples;
+}
+
 void Spectrogram::calculateSpectrum()
 {
+	SPECTROSCOPE_TRACE_SCOPE("Spectrogram::calculateSpectrum");
 	std::copy(inputData_.begin(), inputData_.end(), windowedData_.begin());
 	window_.multiplyWithWindowingTable(windowedData_.data(), static_cast<size_t>(fftSize_));
 
@@ -373,26 +908,214 @@ void Spectrogram::calculateSpectrum()
 	std::copy(windowedData_.begin(), windowedData_.end(), fftWork_.begin());
 	forwardFFT_.performFrequencyOnlyForwardTransform(fftWork_.data());
 
+	spectroscope::simd::kernels().magnitudesToDecibels(fftWork_.data(), windowMagnitudeScale_,
+		floorDb_, nextSpectrum_.data(), spectrumSize());
+}
+
+// Bin k of the half-size transform lies on bin 2k of the full one, so the
+// odd bins in between are interpolated.
+void Spectrogram::calculateReducedSpectrum()
+{
+	SPECTROSCOPE_TRACE_SCOPE("Spectrogram::calculateReducedSpectrum");
+	const auto reducedSize = fftSize_ / 2;
+	const auto reducedBins = reducedSize / 2;
+	std::fill(fftWork_.begin(), fftWork_.begin() + reducedSize * 2, 0.0f);
+	std::copy(inputData_.end() - reducedSize, inputData_.end(), fftWork_.begin());
+	reducedWindow_.multiplyWithWindowingTable(fftWork_.data(), static_cast<size_t>(reducedSize));
+	reducedFFT_.performFrequencyOnlyForwardTransform(fftWork_.data());
+	spectroscope::simd::kernels().magnitudesToDecibels(fftWork_.data(), reducedWindowMagnitudeScale_,
+		floorDb_, reducedSpectrum_.data(), reducedBins);
+
 	for (int bin = 0; bin < spectrumSize(); ++bin) {
-		const auto normalizedMagnitude = fftWork_[static_cast<size_t>(bin)] * windowMagnitudeScale_;
-		nextSpectrum_[static_cast<size_t>(bin)] = juce::jlimit(
-			floorDb_, 0.0f, juce::Decibels::gainToDecibels(normalizedMagnitude, floorDb_));
+		const auto lower = static_cast<size_t>(bin / 2);
+		const auto upper = static_cast<size_t>(std::min(bin / 2 + 1, reducedBins - 1));
+		nextSpectrum_[static_cast<size_t>(bin)] = bin % 2 == 0
+			? reducedSpectrum_[lower]
+			: 0.5f * (reducedSpectrum_[lower] + reducedSpectrum_[upper]);
+	}
+}
+
+// The field notes are cheap to gather, so they are published whether or not
+// the dense field is rendered.
+void Spectrogram::calculatePitch()
+{
+	if (pitchFieldEnabled_.load(std::memory_order_relaxed)) {
+		pitchTracker_.calculate(nextPitchClass_.data(), pitchClassSize());
+	} else {
+		pitchTracker_.calculate();
+		std::fill(nextPitchClass_.begin(), nextPitchClass_.end(), 0.0f);
+	}
+
+	const auto noteCount = pitchTracker_.copyFieldNotes(fieldNotes_.data(), pitchTracker_.polyphony());
+	nextFieldNotes_[0] = static_cast<float>(noteCount);
+	nextFieldNotes_[1] = pitchTracker_.fieldSigma();
+	for (int note = 0; note < pitchTracker_.polyphony(); ++note) {
+		const auto index = static_cast<size_t>(note);
+		nextFieldNotes_[2 + 2 * index] = note < noteCount ? fieldNotes_[index].position : 0.0f;
+		nextFieldNotes_[3 + 2 * index] = note < noteCount ? fieldNotes_[index].strength : 0.0f;
 	}
-	pitchTracker_.calculate(nextPitchClass_.data(), pitchClassSize());
-
-	{
-		const juce::ScopedLock lock(publishedSpectrumLock_);
-		const auto nextSequence = sequence_.load(std::memory_order_relaxed) + 1;
-		const auto destinationRow = static_cast<size_t>((nextSequence - 1)
-			% static_cast<std::uint64_t>(spectrumHistoryCapacity));
-		const auto rowStride = static_cast<size_t>(spectrumSize());
-		auto destination = publishedSpectra_.begin()
-			+ static_cast<std::ptrdiff_t>(destinationRow * rowStride);
-		std::copy(nextSpectrum_.begin(), nextSpectrum_.end(), destination);
-		const auto pitchStride = static_cast<size_t>(pitchClassSize());
-		auto pitchDestination = publishedPitchClasses_.begin()
-			+ static_cast<std::ptrdiff_t>(destinationRow * pitchStride);
-		std::copy(nextPitchClass_.begin(), nextPitchClass_.end(), pitchDestination);
-		sequence_.store(nextSequence, std::memory_order_release);
+}
+
+// Splits the hop at update boundaries, so each update sees exactly the input
+// up to its position. Silence needs no splitting: the skipped resonators only
+// decay, so a silent hop publishes one update at its end if any was due.
+void Spectrogram::trackPitchInUpdates(int updateInterval, bool silentHop)
+{
+	if (silentHop) {
+		pitchTracker_.skipSilence(hopSize_);
+		samplesUntilPitchUpdate_ -= hopSize_;
+		if (samplesUntilPitchUpdate_ <= 0) {
+			calculatePitch();
+			publishPitchUpdate(readSampleCount_);
+			samplesUntilPitchUpdate_ = updateInterval;
+		}
+		return;
 	}
+
+	const auto* samples = hopBuffer_.getReadPointer(0);
+	const auto hopStart = readSampleCount_ - static_cast<std::uint64_t>(hopSize_);
+	for (int offset = 0; offset < hopSize_;) {
+		const auto count = juce::jmin(samplesUntilPitchUpdate_, hopSize_ - offset);
+		pitchTracker_.process(samples + offset, count);
+		offset += count;
+		samplesUntilPitchUpdate_ -= count;
+		if (samplesUntilPitchUpdate_ == 0) {
+			calculatePitch();
+			publishPitchUpdate(hopStart + static_cast<std::uint64_t>(offset));
+			samplesUntilPitchUpdate_ = updateInterval;
+		}
+	}
+}
+
+void Spectrogram::publishRow()
+{
+	publishRingRow(sequence_, publishedRowStamps_, [this](size_t row) {
+		storeRow(publishedSpectra_.data() + row * static_cast<size_t>(spectrumSize()),
+			nextSpectrum_.data(), spectrumSize());
+		storeRow(publishedPitchClasses_.data() + row * static_cast<size_t>(pitchClassSize()),
+			nextPitchClass_.data(), pitchClassSize());
+		storeRow(publishedFieldNotes_.data() + row * nextFieldNotes_.size(),
+			nextFieldNotes_.data(), fieldNoteRowSize());
+		constexpr auto noteWords = wordCount<spectroscope::TrackedPitch>();
+		auto* notes = publishedRowNotes_.data() + row * static_cast<size_t>(pitchTracker_.polyphony()) * noteWords;
+		for (size_t noteIndex = 0; noteIndex < nextNotes_.size(); ++noteIndex)
+			storeWords(notes + noteIndex * noteWords, nextNotes_[noteIndex]);
+		publishedRowNoteCounts_[row].store(static_cast<int>(nextNotes_.size()), std::memory_order_release);
+	});
+}
+
+void Spectrogram::publishPitchUpdate(std::uint64_t samplePosition)
+{
+	updateNoteList(samplePosition, true);
+	publishRingRow(pitchUpdateSequence_, publishedPitchUpdateStamps_, [&](size_t row) {
+		storeRow(publishedPitchUpdates_.data() + row * static_cast<size_t>(pitchClassSize()),
+			nextPitchClass_.data(), pitchClassSize());
+		publishedPitchUpdatePositions_[row].store(samplePosition, std::memory_order_relaxed);
+	});
+}
+
+// Walks the previous list and the tracker's notes in id order. A listed note
+// stays while it is tracked at noteOffConfidence or more, and an unlisted one
+// joins once it reaches noteOnConfidence.
+void Spectrogram::updateNoteList(std::uint64_t samplePosition, bool tracking)
+{
+	using spectroscope::TrackedNoteEvent;
+	const auto byId = [](const auto& first, const auto& second) { return first.id < second.id; };
+	const auto trackedCount = tracking
+		? pitchTracker_.copyNotes(trackerNotes_.data(), static_cast<int>(trackerNotes_.size())) : 0;
+	const auto trackedEnd = trackerNotes_.begin() + trackedCount;
+	std::sort(trackerNotes_.begin(), trackedEnd, byId);
+
+	const auto rowSequence = sequence_.load(std::memory_order_relaxed) + 1;
+	const auto concertAHz = pitchTracker_.concertAHz();
+	nextListedNotes_.clear();
+	auto listed = listedNotes_.cbegin();
+	auto tracked = trackerNotes_.cbegin();
+	while (listed != listedNotes_.cend() || tracked != trackedEnd) {
+		if (tracked == trackedEnd || (listed != listedNotes_.cend() && listed->id < tracked->id)) {
+			publishNoteEvent({ samplePosition, rowSequence, *listed, TrackedNoteEvent::Type::noteOff });
+			++listed;
+			continue;
+		}
+
+		const auto note = spectroscope::makeTrackedPitch(tracked->frequencyHz,
+			juce::jmin(1.0f, tracked->strength), concertAHz, tracked->id);
+		if (listed != listedNotes_.cend() && listed->id == tracked->id) {
+			if (note.confidence < noteOffConfidence)
+				publishNoteEvent({ samplePosition, rowSequence, note, TrackedNoteEvent::Type::noteOff });
+			else
+				nextListedNotes_.push_back(note);
+			++listed;
+		} else if (note.confidence >= noteOnConfidence) {
+			publishNoteEvent({ samplePosition, rowSequence, note, TrackedNoteEvent::Type::noteOn });
+			nextListedNotes_.push_back(note);
+		}
+		++tracked;
+	}
+
+	listedNotes_.swap(nextListedNotes_);
+	nextNotes_.assign(listedNotes_.cbegin(), listedNotes_.cend());
+	std::sort(nextNotes_.begin(), nextNotes_.end(),
+		[](const spectroscope::TrackedPitch& first, const spectroscope::TrackedPitch& second) {
+			return first.frequencyHz < second.frequencyHz;
+		});
+}
+
+void Spectrogram::publishNoteEvent(const spectroscope::TrackedNoteEvent& event)
+{
+	publishRingRow(noteEventSequence_, publishedNoteEventStamps_, [&](size_t row) {
+		storeWords(publishedNoteEvents_.data() + row * wordCount<spectroscope::TrackedNoteEvent>(), event);
+	});
+}
+
+double Spectrogram::steadyClockSeconds() noexcept
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Spectrogram::updateQualityGovernor(double analysisSeconds, double audioSeconds, bool inputBacklogged)
+{
+	if (audioSeconds > 0.0) {
+		const auto smoothing = 1.0 - std::exp(-audioSeconds / loadSmoothingSeconds);
+		smoothedLoad_ += smoothing * (analysisSeconds / audioSeconds - smoothedLoad_);
+	}
+
+	const auto overloaded = inputBacklogged || smoothedLoad_ > overloadedLoad;
+	overloadedSeconds_ = overloaded ? overloadedSeconds_ + audioSeconds : 0.0;
+	relaxedSeconds_ = !overloaded && smoothedLoad_ < relaxedLoad ? relaxedSeconds_ + audioSeconds : 0.0;
+
+	auto level = static_cast<int>(currentQuality_);
+	if (overloadedSeconds_ >= stepDownSeconds && currentQuality_ != QualityLevel::reducedFftSize)
+		++level;
+	else if (relaxedSeconds_ >= stepUpSeconds && currentQuality_ != QualityLevel::full)
+		--level;
+	else
+		return;
+
+	currentQuality_ = static_cast<QualityLevel>(level);
+	overloadedSeconds_ = 0.0;
+	relaxedSeconds_ = 0.0;
+	qualityLevel_.store(currentQuality_, std::memory_order_relaxed);
+	SPECTROSCOPE_TRACE_INSTANT("Spectrogram quality level changed");
+}
+
+int Spectrogram::copyPublishedRowsAfter(std::uint64_t afterSequence, int destinationRows,
+	float* spectrumDestination, float* pitchDestination, float* fieldNoteDestination,
+	std::uint64_t* copiedThroughSequence) const
+{
+	return copyRingRowsAfter(sequence_, publishedRowStamps_, afterSequence, destinationRows,
+		copiedThroughSequence, [&](size_t sourceRow, int destinationRow) {
+			if (spectrumDestination != nullptr) {
+				loadRow(publishedSpectra_.data() + sourceRow * static_cast<size_t>(spectrumSize()),
+					spectrumDestination + destinationRow * spectrumSize(), spectrumSize());
+			}
+			if (pitchDestination != nullptr) {
+				loadRow(publishedPitchClasses_.data() + sourceRow * static_cast<size_t>(pitchClassSize()),
+					pitchDestination + destinationRow * pitchClassSize(), pitchClassSize());
+			}
+			if (fieldNoteDestination != nullptr) {
+				loadRow(publishedFieldNotes_.data() + sourceRow * nextFieldNotes_.size(),
+					fieldNoteDestination + destinationRow * fieldNoteRowSize(), fieldNoteRowSize());
+			}
+		});
 }
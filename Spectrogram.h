@@ -7,29 +7,58 @@
 #pragma once
 
 #include "PitchTracker.h"
+#include "TrackedPitch.h"
 
 #include <juce_audio_basics/juce_audio_basics.h>
 #include <juce_core/juce_core.h>
 #include <juce_dsp/juce_dsp.h>
 
+#include <array>
 #include <atomic>
 #include <cstdint>
 #include <vector>
 
 // Stateful FFT and fundamental-pitch analyzer. process() is intended to run on an analysis
 // worker, never on a real-time audio callback. The UI may copy completed
-// synchronized spectrum and tracked-pitch frames concurrently.
+// synchronized spectrum and tracked-pitch frames concurrently; publication is
+// lock-free, so readers never delay the analysis worker.
 class Spectrogram {
 public:
 	static constexpr int defaultFftOrder = 11;
 	static constexpr float defaultFloorDb = -100.0f;
 	static constexpr int spectrumHistoryCapacity = 128;
+	static constexpr int pitchUpdateHistoryCapacity = 512;
+	static constexpr int minimumPitchUpdateInterval = 16;
+	static constexpr int noteEventHistoryCapacity = 1024;
+	// Confidence at which a tracked note enters the note list, and below which
+	// it leaves it again.
+	static constexpr float noteOnConfidence = 0.05f;
+	static constexpr float noteOffConfidence = 0.025f;
 
-	explicit Spectrogram(int fftOrder = defaultFftOrder, int hopSize = 0, float floorDb = defaultFloorDb);
+	// Steps the quality governor takes under sustained overload. Each level
+	// keeps the reductions of the levels before it.
+	enum class QualityLevel {
+		full,
+		// Every second row repeats its predecessor instead of running the FFT
+		// and the pitch calculation.
+		reducedRowRate,
+		// The fast preset on input decimated to half the sample rate.
+		reducedPitchTracking,
+		noPitchTracking,
+		// Rows come from an FFT of half the size, interpolated to the usual
+		// number of bins.
+		reducedFftSize
+	};
+
+	// pitchLayout sets the range and resolution of the tracked-pitch field;
+	// pitchClassSize() is its output bin count.
+	explicit Spectrogram(int fftOrder = defaultFftOrder, int hopSize = 0, float floorDb = defaultFloorDb,
+		const PitchTracker::Layout& pitchLayout = {});
 
 	int fftSize() const noexcept;
 	int spectrumSize() const noexcept;
 	int pitchClassSize() const noexcept;
+	const PitchTracker::Layout& pitchLayout() const noexcept;
 	int hopSize() const noexcept;
 	float floorDb() const noexcept;
 
@@ -62,21 +91,148 @@ public:
 	bool copyLatestPitchClass(float* destination, int destinationSize,
 		std::uint64_t* copiedSequence = nullptr) const;
 
-	// Thread-safe tuning target; the analysis worker applies changes at the next hop.
+	// The notes each row's tracked-pitch field is rendered from, for consumers
+	// that evaluate the field themselves. A row holds fieldNoteRowSize()
+	// floats: the note count, the Gaussian sigma, then the position and
+	// strength of each note. Positions and sigma are in analysis bins above
+	// the layout's lowest frequency. The field at a bin is the strongest
+	// note's strength times its Gaussian there, clamped to [0, 1]. Copies
+	// synchronized FFT and field-note rows like copyAnalysisFramesAfter().
+	int fieldNoteRowSize() const noexcept;
+	int copyFieldNoteFramesAfter(std::uint64_t afterSequence,
+		float* spectrumDestination, int spectrumDestinationSize,
+		float* fieldNoteDestination, int fieldNoteDestinationSize,
+		std::uint64_t* copiedThroughSequence = nullptr) const;
+
+	// Rendering the dense tracked-pitch field can be switched off when every
+	// consumer reads field notes or the note list instead. Rows and pitch
+	// updates then carry a zero field. Enabled by default; thread-safe and
+	// applied at the next pitch calculation.
+	void setPitchFieldEnabled(bool enabled) noexcept;
+	bool isPitchFieldEnabled() const noexcept;
+
+	// Tracked-pitch updates published independently of the FFT rows. With an
+	// interval of N samples the worker calculates the field every N input
+	// samples and publishes it together with the absolute input position, in
+	// samples since reset(), at which it was calculated. Zero, the default,
+	// calculates once per row. Updates fall back to the row rate below full
+	// quality, and none are published while pitch tracking is disabled. The
+	// rows' tracked-pitch field is always the newest update.
+	void setPitchUpdateInterval(int samples) noexcept;
+	int pitchUpdateInterval() const noexcept;
+	std::uint64_t pitchUpdateSequence() const noexcept;
+
+	// Copies the updates newer than afterSequence, oldest first, keeping the
+	// newest when destination cannot hold them all. samplePositions, if given,
+	// receives one position per copied update.
+	int copyPitchUpdatesAfter(std::uint64_t afterSequence, float* destination, int destinationSize,
+		std::uint64_t* samplePositions = nullptr, std::uint64_t* copiedThroughSequence = nullptr) const;
+
+	// A compact alternative to the tracked-pitch field. Every row also carries
+	// the note list of its newest pitch update, ordered by frequency: the
+	// notes that reached noteOnConfidence and have neither fallen below
+	// noteOffConfidence nor ended since, each with the tracker's note id.
+	// Copies the newest row's notes, keeping the strongest when destination
+	// cannot hold them all. Returns the number of copied notes.
+	int copyLatestTrackedNotes(spectroscope::TrackedPitch* destination, int destinationCapacity,
+		std::uint64_t* copiedSequence = nullptr) const;
+
+	// Note-on and note-off events for every change of the note list, in order.
+	// Copies the events newer than afterSequence, keeping the newest when
+	// destination cannot hold them all. A note still listed when pitch
+	// tracking is disabled gets its note-off; reset() starts a new stream.
+	std::uint64_t noteEventSequence() const noexcept;
+	int copyNoteEventsAfter(std::uint64_t afterSequence, spectroscope::TrackedNoteEvent* destination,
+		int destinationCapacity, std::uint64_t* copiedThroughSequence = nullptr) const;
+
+	// Thread-safe tuning target; the analysis worker applies changes at the next hop
+	// without resetting the tracked notes.
 	void setConcertAHz(float frequencyHz) noexcept;
 	float concertAHz() const noexcept;
 	void setPitchTrackingPreset(PitchTracker::Preset preset) noexcept;
 	PitchTracker::Preset pitchTrackingPreset() const noexcept;
 
+	// Thread-safe switches for the two analysis stages, applied at the next
+	// hop. A disabled stage skips its work while rows keep being published:
+	// the spectrum rests at the floor and the tracked-pitch field at zero.
+	// Re-enabling pitch tracking starts from a reset tracker rather than the
+	// notes it held when it was switched off.
+	void setSpectrumEnabled(bool enabled) noexcept;
+	bool isSpectrumEnabled() const noexcept;
+	void setPitchTrackingEnabled(bool enabled) noexcept;
+	bool isPitchTrackingEnabled() const noexcept;
+
+	// While enabled, the worker compares its analysis time with the duration
+	// of the audio it analysed, and watches the input FIFO and dropped samples.
+	// The FIFO counts as backlogged when a process() call leaves more than
+	// half of it unread after writing its block. The worker drains the FIFO
+	// in every call, so only blocks larger than half the FIFO, 4 * fftSize()
+	// samples, trigger this; smaller ones are only caught by dropped samples.
+	// Sustained overload lowers the quality level one step at a time; a long
+	// period of low load raises it again. Disabled by default, in which case
+	// the analyzer stays at full quality.
+	void setQualityGovernorEnabled(bool enabled) noexcept;
+	bool isQualityGovernorEnabled() const noexcept;
+	QualityLevel qualityLevel() const noexcept;
+
+	// Input quieter than this level counts as silence. Hops of silence skip
+	// the pitch tracker's resonators, and rows whose whole FFT frame is silent
+	// publish the floor without windowing or transforming it. The default lies
+	// 6 dB below the floor, where no bin of the skipped FFT could have risen
+	// above the floor, so gating does not change the spectrum. Applies to
+	// samples written after the change; -infinity disables the gate.
+	void setSilenceThresholdDb(float thresholdDb) noexcept;
+	float silenceThresholdDb() const noexcept;
+
+	// Woken on the analysis worker at the end of every process() call that
+	// published rows, with the newest row's sequence number, so that views can
+	// redraw on new data instead of polling. Implementations must return
+	// quickly and must not add or remove listeners.
+	class PublishListener {
+	public:
+		virtual ~PublishListener() = default;
+		virtual void rowsPublished(std::uint64_t newestSequence) noexcept = 0;
+	};
+
+	static constexpr int maximumPublishListeners = 8;
+	// Thread-safe and lock-free for the worker. Adding returns false when all
+	// slots are taken. Removing waits for a notification in progress to
+	// return, so the listener may be destroyed afterwards.
+	bool addPublishListener(PublishListener* listener) noexcept;
+	void removePublishListener(PublishListener* listener) noexcept;
+
 	std::uint64_t sequence() const noexcept;
 	std::uint64_t droppedSamples() const noexcept;
+	// Rows published from a silent frame without running the FFT.
+	std::uint64_t gatedRows() const noexcept;
 	double sampleRate() const noexcept;
 
 private:
+	// The tests replace the governor's clock to control the measured load.
+	friend struct SpectrogramTestAccess;
+
+	// Seconds on a monotonic clock.
+	using GovernorClock = double (*)() noexcept;
+	static double steadyClockSeconds() noexcept;
+
 	int writeInput(const juce::AudioSourceChannelInfo& data);
 	void readHop();
 	void appendHop();
+	void configurePitchTracker(PitchTracker::Preset preset, bool decimated);
+	int decimateHop();
 	void calculateSpectrum();
+	void calculateReducedSpectrum();
+	void calculatePitch();
+	void trackPitchInUpdates(int updateInterval, bool silentHop);
+	void publishRow();
+	void publishPitchUpdate(std::uint64_t samplePosition);
+	void updateNoteList(std::uint64_t samplePosition, bool tracking);
+	void publishNoteEvent(const spectroscope::TrackedNoteEvent& event);
+	void notifyPublishListeners() noexcept;
+	void updateQualityGovernor(double analysisSeconds, double audioSeconds, bool inputBacklogged);
+	int copyPublishedRowsAfter(std::uint64_t afterSequence, int destinationRows,
+		float* spectrumDestination, float* pitchDestination, float* fieldNoteDestination,
+		std::uint64_t* copiedThroughSequence) const;
 
 	const int fftOrder_;
 	const int fftSize_;
@@ -90,21 +246,78 @@ private:
 
 	juce::dsp::FFT forwardFFT_;
 	juce::dsp::WindowingFunction<float> window_;
+	juce::dsp::FFT reducedFFT_;
+	juce::dsp::WindowingFunction<float> reducedWindow_;
 	PitchTracker pitchTracker_;
 	std::vector<float> inputData_;
 	std::vector<float> windowedData_;
 	std::vector<float> fftWork_;
 	std::vector<float> nextSpectrum_;
 	std::vector<float> nextPitchClass_;
-	std::vector<float> publishedSpectra_;
-	std::vector<float> publishedPitchClasses_;
+	std::vector<float> nextFieldNotes_;
+	std::vector<PitchTracker::FieldNote> fieldNotes_;
+	std::vector<float> reducedSpectrum_;
+	std::vector<float> decimatedHop_;
+	std::vector<PitchTracker::Note> trackerNotes_;
+	// The note list sorted by id, as the previous update left it, and the
+	// next row's copy sorted by frequency.
+	std::vector<spectroscope::TrackedPitch> listedNotes_;
+	std::vector<spectroscope::TrackedPitch> nextListedNotes_;
+	std::vector<spectroscope::TrackedPitch> nextNotes_;
+	// Sequence-locked history ring. A row's stamp is odd while the worker
+	// rewrites it and twice its sequence number once complete; readers retry
+	// any row whose stamp changed while it was being copied.
+	std::vector<std::atomic<float>> publishedSpectra_;
+	std::vector<std::atomic<float>> publishedPitchClasses_;
+	std::vector<std::atomic<float>> publishedFieldNotes_;
+	std::vector<std::atomic<std::uint64_t>> publishedRowStamps_;
+	// Each row's note list, stored as words under the row's stamp.
+	std::vector<std::atomic<std::uint32_t>> publishedRowNotes_;
+	std::vector<std::atomic<int>> publishedRowNoteCounts_;
+	// The same scheme for the tracked-pitch updates.
+	std::vector<std::atomic<float>> publishedPitchUpdates_;
+	std::vector<std::atomic<std::uint64_t>> publishedPitchUpdatePositions_;
+	std::vector<std::atomic<std::uint64_t>> publishedPitchUpdateStamps_;
+	// And for the note events.
+	std::vector<std::atomic<std::uint32_t>> publishedNoteEvents_;
+	std::vector<std::atomic<std::uint64_t>> publishedNoteEventStamps_;
 	int inputDataAvailable_ { 0 };
+	bool pitchTrackingActive_ { true };
+	int appliedPitchUpdateInterval_ { 0 };
+	int samplesUntilPitchUpdate_ { 0 };
+	// Absolute sample positions since reset(), used to find silent hops and
+	// frames without rescanning the FIFO.
+	std::uint64_t writtenSampleCount_ { 0 };
+	std::uint64_t readSampleCount_ { 0 };
+	std::uint64_t signalEndSample_ { 0 };
 	float windowMagnitudeScale_ { 1.0f };
+	float reducedWindowMagnitudeScale_ { 1.0f };
+	bool pitchTrackerDecimated_ { false };
+	bool decimatorHoldsSample_ { false };
+	float decimatorHeldSample_ { 0.0f };
+	// Governor state, owned by the analysis worker.
+	GovernorClock governorClock_ { &Spectrogram::steadyClockSeconds };
+	QualityLevel currentQuality_ { QualityLevel::full };
+	double smoothedLoad_ { 0.0 };
+	double overloadedSeconds_ { 0.0 };
+	double relaxedSeconds_ { 0.0 };
 
-	mutable juce::CriticalSection publishedSpectrumLock_;
 	std::atomic<std::uint64_t> sequence_ { 0 };
+	std::atomic<std::uint64_t> pitchUpdateSequence_ { 0 };
+	std::atomic<std::uint64_t> noteEventSequence_ { 0 };
 	std::atomic<std::uint64_t> droppedSamples_ { 0 };
+	std::atomic<std::uint64_t> gatedRows_ { 0 };
+	std::atomic<float> silenceThresholdDb_ { 0.0f };
 	std::atomic<double> sampleRate_ { 0.0 };
 	std::atomic<float> concertAHz_ { 440.0f };
 	std::atomic<PitchTracker::Preset> pitchTrackingPreset_ { PitchTracker::Preset::balanced };
+	std::atomic<int> pitchUpdateInterval_ { 0 };
+	std::atomic<bool> spectrumEnabled_ { true };
+	std::atomic<bool> pitchTrackingEnabled_ { true };
+	std::atomic<bool> pitchFieldEnabled_ { true };
+	std::atomic<bool> qualityGovernorEnabled_ { false };
+	std::atomic<QualityLevel> qualityLevel_ { QualityLevel::full };
+	std::array<std::atomic<PublishListener*>, maximumPublishListeners> publishListeners_ {};
+	// Notifications running on the worker; removal waits for it to drop to zero.
+	std::atomic<int> notifyingPublishListeners_ { 0 };
 };
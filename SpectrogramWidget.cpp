@@ -10,12 +10,12 @@
 #include "FrequencyAxis.h"
 #include "NoteAtlasLayout.h"
 #include "OpenGLHelpers.h"
+#include "SpectroscopeTrace.h"
 #include "TrackedNoteDisplay.h"
 #include "WaterfallTimeline.h"
 
 #include <algorithm>
 #include <cmath>
-#include <iterator>
 
 using namespace juce;
 using namespace juce::gl;
@@ -24,6 +24,56 @@ namespace {
 constexpr int waterfallRows = 512;
 constexpr int maximumRowsPerRefresh = 32;
 constexpr int noteAtlasTextureUnit = 5;
+constexpr int shadedWaterfallTextureUnit = 1;
+constexpr int axisMappingTextureUnit = 4;
+
+bool sameColumnParameters(const spectroscope::frequency_axis::ColumnParameters& a,
+	const spectroscope::frequency_axis::ColumnParameters& b)
+{
+	return a.sampleRate == b.sampleRate && a.minimumFrequencyHz == b.minimumFrequencyHz
+		&& a.logarithmic == b.logarithmic && a.concertAHz == b.concertAHz
+		&& a.trackedOctavesBelowConcertA == b.trackedOctavesBelowConcertA
+		&& a.trackedOctaveCount == b.trackedOctaveCount;
+}
+
+// Values of the fragment shader's waterfallPass.
+constexpr int shadeEveryPixelPass = 0;
+constexpr int shadeHistoryRowsPass = 1;
+constexpr int compositeWaterfallPass = 2;
+constexpr int convertWaterfallPass = 3;
+
+// Passes measured by the GPU timer queries, in frame order.
+constexpr int uploadsTimedPass = 0;
+constexpr int shadeRowsTimedPass = 1;
+constexpr int waterfallTimedPass = 2;
+constexpr int noteOverlayTimedPass = 3;
+
+String millisecondsText(const spectroscope::frame_timing::Summary& summary)
+{
+	if (summary.sampleCount == 0)
+		return "-";
+	return String(summary.meanMs, 2) + "/" + String(summary.maximumMs, 2);
+}
+
+String describeFrameStatistics(const spectroscope::frame_timing::FrameStatistics& statistics)
+{
+	StringArray lines;
+	lines.add("ms mean/max over " + String(statistics.frameInterval.sampleCount) + " frames");
+	lines.add("frame " + millisecondsText(statistics.frameInterval)
+		+ ", missed vsync " + String(statistics.missedFrames));
+	lines.add("cpu render " + millisecondsText(statistics.renderCpu)
+		+ "  pull " + millisecondsText(statistics.pullFramesCpu)
+		+ "  upload " + millisecondsText(statistics.uploadsCpu));
+	if (statistics.gpuTimersAvailable) {
+		lines.add("gpu upload " + millisecondsText(statistics.uploadsGpu)
+			+ "  shade " + millisecondsText(statistics.shadeRowsGpu));
+		lines.add("gpu waterfall " + millisecondsText(statistics.waterfallGpu)
+			+ "  notes " + millisecondsText(statistics.noteOverlayGpu));
+	} else {
+		lines.add("gpu timer queries unavailable");
+	}
+	return lines.joinIntoString("\n");
+}
 
 Colour colourForMidiNote(int midiNote)
 {
@@ -55,22 +105,34 @@ public:
 		setInterceptsMouseClicks(false, false);
 	}
 
-	void setNotes(std::array<spectroscope::TrackedPitch, 6> newNotes, int newNoteCount,
-		double newSampleRate, double newMinimumFrequencyHz)
+	struct PublishedNotes {
+		std::array<spectroscope::TrackedPitch, 6> notes {};
+		int noteCount { 0 };
+		double sampleRate { 0.0 };
+		double minimumFrequencyHz { 1.0 };
+	};
+
+	// Called on the OpenGL thread. The snapshot waits in a preallocated
+	// single-producer queue until the timer collects it on the message thread,
+	// so publishing never allocates or posts a message. A full queue drops the
+	// snapshot; the next one follows within 100 ms.
+	void post(const PublishedNotes& published) noexcept
 	{
-		const auto validNoteCount = jlimit(0, static_cast<int>(newNotes.size()), newNoteCount);
-		noteDisplay_.update(
-			newNotes.data(), validNoteCount, Time::getMillisecondCounterHiRes());
-		sampleRate_ = newSampleRate;
-		minimumFrequencyHz_ = newMinimumFrequencyHz;
-		startTimerHz(30);
-		repaint();
+		int start1 = 0;
+		int size1 = 0;
+		int start2 = 0;
+		int size2 = 0;
+		mailbox_.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 <= 0)
+			return;
+		mailboxSlots_[static_cast<std::size_t>(start1)] = published;
+		mailbox_.finishedWrite(1);
 	}
 
 	void clearNotes()
 	{
 		noteDisplay_.clear();
-		stopTimer();
+		hadVisibleEntries_ = false;
 		repaint();
 	}
 
@@ -148,44 +210,176 @@ private:
 			Colours::lightgrey, opacity);
 	}
 
+	// The timer only runs while the overlay is shown. Snapshots queued while
+	// it was hidden describe notes that are no longer current.
+	void visibilityChanged() override
+	{
+		if (isVisible()) {
+			discardPostedNotes();
+			startTimerHz(30);
+		} else {
+			stopTimer();
+		}
+	}
+
+	bool takeLatestPostedNotes(PublishedNotes& latest) noexcept
+	{
+		const auto ready = mailbox_.getNumReady();
+		if (ready <= 0)
+			return false;
+
+		int start1 = 0;
+		int size1 = 0;
+		int start2 = 0;
+		int size2 = 0;
+		mailbox_.prepareToRead(ready, start1, size1, start2, size2);
+		const auto newest = size2 > 0 ? start2 + size2 - 1 : start1 + size1 - 1;
+		latest = mailboxSlots_[static_cast<std::size_t>(newest)];
+		mailbox_.finishedRead(size1 + size2);
+		return true;
+	}
+
+	void discardPostedNotes() noexcept
+	{
+		PublishedNotes ignored;
+		takeLatestPostedNotes(ignored);
+	}
+
 	void timerCallback() override
 	{
+		const auto nowMs = Time::getMillisecondCounterHiRes();
+		PublishedNotes published;
+		if (takeLatestPostedNotes(published)) {
+			SPECTROSCOPE_TRACE_THREAD_NAME("Message thread");
+			SPECTROSCOPE_TRACE_SCOPE("tracked notes delivery");
+			const auto validNoteCount = jlimit(0, static_cast<int>(published.notes.size()),
+				published.noteCount);
+			noteDisplay_.update(published.notes.data(), validNoteCount, nowMs);
+			sampleRate_ = published.sampleRate;
+			minimumFrequencyHz_ = published.minimumFrequencyHz;
+		}
+
 		std::array<spectroscope::TrackedNoteDisplay::Entry,
 			spectroscope::TrackedNoteDisplay::capacity> entries {};
 		const auto hasVisibleEntries = noteDisplay_.visibleEntries(
-			Time::getMillisecondCounterHiRes(), entries.data(), static_cast<int>(entries.size())) > 0;
-		if (!hasVisibleEntries)
-			stopTimer();
-		repaint();
+			nowMs, entries.data(), static_cast<int>(entries.size())) > 0;
+		if (hasVisibleEntries || hadVisibleEntries_)
+			repaint();
+		hadVisibleEntries_ = hasVisibleEntries;
 	}
 
+	static constexpr int mailboxCapacity = 4;
+	AbstractFifo mailbox_ { mailboxCapacity };
+	std::array<PublishedNotes, mailboxCapacity> mailboxSlots_ {};
+	bool hadVisibleEntries_ { false };
 	spectroscope::TrackedNoteDisplay noteDisplay_;
 	double sampleRate_ { 0.0 };
 	double minimumFrequencyHz_ { 1.0 };
 	bool logarithmic_ { true };
 };
 
+class SpectrogramWidget::FrameStatisticsOverlay final : public Component, private Timer {
+public:
+	FrameStatisticsOverlay()
+	{
+		setInterceptsMouseClicks(false, false);
+	}
+
+	// Called on the OpenGL thread through the same kind of preallocated
+	// single-producer queue as TrackedNotesOverlay::post(). A full queue
+	// drops the snapshot; the next one follows within 100 ms.
+	void post(const spectroscope::frame_timing::FrameStatistics& statistics) noexcept
+	{
+		int start1 = 0;
+		int size1 = 0;
+		int start2 = 0;
+		int size2 = 0;
+		mailbox_.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 <= 0)
+			return;
+		mailboxSlots_[static_cast<std::size_t>(start1)] = statistics;
+		mailbox_.finishedWrite(1);
+	}
+
+	// Snapshots are collected while the statistics are enabled, whether the
+	// overlay is shown or not, so the API never reports a stale window.
+	void setCollecting(bool collecting)
+	{
+		if (collecting) {
+			takeLatest(latest_);
+			startTimerHz(10);
+		} else {
+			stopTimer();
+			latest_ = {};
+			repaint();
+		}
+	}
+
+	const spectroscope::frame_timing::FrameStatistics& latest() const noexcept
+	{
+		return latest_;
+	}
+
+	void paint(Graphics& graphics) override
+	{
+		constexpr float lineHeight = 15.0f;
+		constexpr float boxWidth = 330.0f;
+		const auto lines = StringArray::fromLines(describeFrameStatistics(latest_));
+		auto box = Rectangle<float>(static_cast<float>(getWidth()) - boxWidth - 4.0f, 4.0f,
+			boxWidth, lineHeight * static_cast<float>(lines.size()) + 8.0f);
+		graphics.setColour(Colours::black.withAlpha(0.68f));
+		graphics.fillRoundedRectangle(box, 3.0f);
+		box.reduce(6.0f, 4.0f);
+		graphics.setColour(Colours::white);
+		graphics.setFont(12.0f);
+		for (const auto& line : lines)
+			graphics.drawText(line, box.removeFromTop(lineHeight), Justification::centredLeft, false);
+	}
+
+private:
+	bool takeLatest(spectroscope::frame_timing::FrameStatistics& latest) noexcept
+	{
+		const auto ready = mailbox_.getNumReady();
+		if (ready <= 0)
+			return false;
+
+		int start1 = 0;
+		int size1 = 0;
+		int start2 = 0;
+		int size2 = 0;
+		mailbox_.prepareToRead(ready, start1, size1, start2, size2);
+		const auto newest = size2 > 0 ? start2 + size2 - 1 : start1 + size1 - 1;
+		latest = mailboxSlots_[static_cast<std::size_t>(newest)];
+		mailbox_.finishedRead(size1 + size2);
+		return true;
+	}
+
+	void timerCallback() override
+	{
+		if (takeLatest(latest_) && isVisible())
+			repaint();
+	}
+
+	static constexpr int mailboxCapacity = 4;
+	AbstractFifo mailbox_ { mailboxCapacity };
+	std::array<spectroscope::frame_timing::FrameStatistics, mailboxCapacity> mailboxSlots_ {};
+	spectroscope::frame_timing::FrameStatistics latest_;
+};
+
 SpectrogramWidget::SpectrogramWidget(std::weak_ptr<Spectrogram> spectrogram)
 	: spectrogram_(std::move(spectrogram))
 {
 	noteAtlasImage_ = createNoteAtlasImage();
-	noteVertices_.reserve(static_cast<std::size_t>(
-		spectroscope::TrackedNoteHistory::capacity * 4 * 4));
-	noteIndices_.reserve(static_cast<std::size_t>(
-		spectroscope::TrackedNoteHistory::capacity * 6));
 	addChildComponent(statusLabel_);
 	statusLabel_.setJustificationType(Justification::topLeft);
 	trackedNotesOverlay_ = std::make_unique<TrackedNotesOverlay>();
 	addChildComponent(*trackedNotesOverlay_);
+	frameStatisticsOverlay_ = std::make_unique<FrameStatisticsOverlay>();
+	addChildComponent(*frameStatisticsOverlay_);
 
 	if (const auto analyzer = spectrogram_.lock()) {
-		fftData_.resize(static_cast<size_t>(analyzer->spectrumSize() * waterfallRows), analyzer->floorDb());
-		pendingSpectra_.resize(
-			static_cast<size_t>(analyzer->spectrumSize() * maximumRowsPerRefresh), analyzer->floorDb());
-		pitchClassDataHistory_.resize(
-			static_cast<size_t>(analyzer->pitchClassSize() * waterfallRows), 0.0f);
-		pendingPitchClasses_.resize(
-			static_cast<size_t>(analyzer->pitchClassSize() * maximumRowsPerRefresh), 0.0f);
+		pendingFieldNotes_.resize(
+			static_cast<size_t>(analyzer->fieldNoteRowSize() * maximumRowsPerRefresh), 0.0f);
 	} else {
 		statusLabel_.setText("Spectrum analyzer unavailable", dontSendNotification);
 	}
@@ -193,8 +387,12 @@ SpectrogramWidget::SpectrogramWidget(std::weak_ptr<Spectrogram> spectrogram)
 
 SpectrogramWidget::~SpectrogramWidget()
 {
+	setAnalysisStageGating(false);
+	cancelPendingUpdate();
+	renderOnDemand_.store(false, std::memory_order_release);
 	// JUCE invokes openGLContextClosing() from detach(), so this must happen
-	// before destruction falls through to ShaderBasedComponent.
+	// before destruction falls through to ShaderBasedComponent. It also
+	// removes the publish listener.
 	shutdownOpenGL();
 }
 
@@ -202,6 +400,10 @@ void SpectrogramWidget::newOpenGLContextCreated()
 {
 	releaseOpenGLResources();
 	openGLReady_ = false;
+	// A core profile context already has JUCE's vertex array bound here.
+	GLint contextVertexArray = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &contextVertexArray);
+	contextVertexArray_ = static_cast<GLuint>(contextVertexArray);
 
 	const std::string vertexShader(
 		reinterpret_cast<const char*>(oscilloscope_vert_glsl), oscilloscope_vert_glsl_size);
@@ -226,30 +428,39 @@ void SpectrogramWidget::newOpenGLContextCreated()
 	waterfallStartUniform_ = createUniform(context_, *shader_, "waterfallStartPosition");
 	waterfallSpanUniform_ = createUniform(context_, *shader_, "waterfallHistorySpan");
 	uUpperHalfPercentage_ = createUniform(context_, *shader_, "upperHalfPercentage");
-	audioSampleData_ = createUniform(context_, *shader_, "audioSampleData");
+	latestSpectrumPositionUniform_ = createUniform(context_, *shader_, "latestSpectrumPosition");
+	waterfallValueOffsetUniform_ = createUniform(context_, *shader_, "waterfallValueOffset");
+	waterfallValueScaleUniform_ = createUniform(context_, *shader_, "waterfallValueScale");
 	waterfallTexture_ = createUniform(context_, *shader_, "waterfall");
-	pitchClassDataUniform_ = createUniform(context_, *shader_, "pitchClassData");
-	pitchClassHistoryUniform_ = createUniform(context_, *shader_, "pitchClassHistory");
+	fieldNoteHistoryUniform_ = createUniform(context_, *shader_, "fieldNoteHistory");
+	latestFieldNoteRowUniform_ = createUniform(context_, *shader_, "latestFieldNoteRow");
+	waterfallPassUniform_ = createUniform(context_, *shader_, "waterfallPass");
+	shadedWaterfallUniform_ = createUniform(context_, *shader_, "shadedWaterfall");
+	convertedValueOffsetUniform_ = createUniform(context_, *shader_, "convertedValueOffset");
+	convertedValueScaleUniform_ = createUniform(context_, *shader_, "convertedValueScale");
+	fieldNoteCapacityUniform_ = createUniform(context_, *shader_, "fieldNoteCapacity");
 	lutTexture_ = createUniform(context_, *shader_, "lutTexture");
-	logXAxis_ = createUniform(context_, *shader_, "xAxisLog");
 	uHorizontal_ = createUniform(context_, *shader_, "horizontalMode");
 	uPitchColourMode_ = createUniform(context_, *shader_, "pitchColourMode");
-	uSampleRate_ = createUniform(context_, *shader_, "sampleRate");
-	uConcertAHz_ = createUniform(context_, *shader_, "concertAHz");
-	uMinimumFrequencyHz_ = createUniform(context_, *shader_, "minimumFrequencyHz");
+	uTrackedAnalysisBinCount_ = createUniform(context_, *shader_, "trackedAnalysisBinCount");
 	uSpectrumTexelWidth_ = createUniform(context_, *shader_, "spectrumTexelWidth");
+	axisMappingUniform_ = createUniform(context_, *shader_, "axisMapping");
 
 	const auto analyzer = spectrogram_.lock();
 	const auto invalidAttribute = position_ == nullptr
 		|| position_->attributeID == static_cast<GLuint>(-1);
 	const auto missingUniform = resolution_ == nullptr || waterfallStartUniform_ == nullptr
 		|| waterfallSpanUniform_ == nullptr
-		|| uUpperHalfPercentage_ == nullptr || audioSampleData_ == nullptr
-		|| waterfallTexture_ == nullptr || pitchClassDataUniform_ == nullptr
-		|| pitchClassHistoryUniform_ == nullptr || lutTexture_ == nullptr
-		|| logXAxis_ == nullptr || uHorizontal_ == nullptr
-		|| uPitchColourMode_ == nullptr || uSampleRate_ == nullptr || uConcertAHz_ == nullptr
-		|| uMinimumFrequencyHz_ == nullptr || uSpectrumTexelWidth_ == nullptr;
+		|| uUpperHalfPercentage_ == nullptr || latestSpectrumPositionUniform_ == nullptr
+		|| waterfallValueOffsetUniform_ == nullptr || waterfallValueScaleUniform_ == nullptr
+		|| waterfallTexture_ == nullptr || fieldNoteHistoryUniform_ == nullptr
+		|| latestFieldNoteRowUniform_ == nullptr || fieldNoteCapacityUniform_ == nullptr
+		|| waterfallPassUniform_ == nullptr || shadedWaterfallUniform_ == nullptr
+		|| convertedValueOffsetUniform_ == nullptr || convertedValueScaleUniform_ == nullptr
+		|| lutTexture_ == nullptr
+		|| uHorizontal_ == nullptr || uPitchColourMode_ == nullptr
+		|| uTrackedAnalysisBinCount_ == nullptr || uSpectrumTexelWidth_ == nullptr
+		|| axisMappingUniform_ == nullptr;
 	if (analyzer == nullptr || invalidAttribute || missingUniform) {
 		publishStatus(analyzer == nullptr ? "Spectrum analyzer unavailable"
 			: "Spectrogram shader interface is incomplete");
@@ -257,17 +468,17 @@ void SpectrogramWidget::newOpenGLContextCreated()
 	}
 
 	textureLUT_ = createColorLookupTexture();
-	spectrumData_ = createDataTexture(analyzer->spectrumSize(), 1, analyzer->floorDb());
-	spectrumHistory_ = createDataTexture(analyzer->spectrumSize(), waterfallRows, analyzer->floorDb());
-	pitchClassData_ = createDataTexture(analyzer->pitchClassSize(), 1, 0.0f);
-	pitchClassHistory_ = createDataTexture(analyzer->pitchClassSize(), waterfallRows, 0.0f);
+	createWaterfallTexture(*analyzer);
+	fieldNoteHistory_ = createDataTexture(analyzer->fieldNoteRowSize() / 2, waterfallRows, 0.0f, 2);
+	axisMapping_ = std::make_shared<OpenGLFloatTexture>();
+	axisMappingPixels_ = 0;
+	if (spectrumHistory_ != nullptr && fieldNoteHistory_ != nullptr)
+		restoreHistory(*analyzer);
 	noteOverlayReady_ = createNoteOverlayResources();
 
-	context_.extensions.glGenBuffers(1, &vertexBuffer_);
-	context_.extensions.glGenBuffers(1, &elements_);
-	openGLReady_ = textureLUT_ != nullptr && spectrumData_ != nullptr && spectrumHistory_ != nullptr
-		&& pitchClassData_ != nullptr && pitchClassHistory_ != nullptr
-		&& vertexBuffer_ != 0 && elements_ != 0;
+	const auto geometryReady = createFullScreenGeometry();
+	openGLReady_ = textureLUT_ != nullptr && spectrumHistory_ != nullptr
+		&& fieldNoteHistory_ != nullptr && axisMapping_ != nullptr && geometryReady;
 
 	if (openGLReady_.load(std::memory_order_acquire)) {
 		publishStatus(noteOverlayReady_ ? String() : "Note atlas unavailable");
@@ -275,10 +486,12 @@ void SpectrogramWidget::newOpenGLContextCreated()
 	else
 		publishStatus("Unable to initialize spectrogram OpenGL resources");
 	refreshRequested_.store(true, std::memory_order_release);
+	updatePublishListener(renderOnDemand_.load(std::memory_order_acquire));
 }
 
 void SpectrogramWidget::openGLContextClosing()
 {
+	updatePublishListener(false);
 	releaseOpenGLResources();
 }
 
@@ -300,14 +513,65 @@ std::shared_ptr<OpenGLTexture> SpectrogramWidget::createColorLookupTexture()
 }
 
 std::shared_ptr<OpenGLFloatTexture> SpectrogramWidget::createDataTexture(
-	int width, int height, float initialValue)
+	int width, int height, float initialValue, int channels)
 {
 	auto texture = std::make_shared<OpenGLFloatTexture>();
-	std::vector<GLfloat> emptyPixels(static_cast<size_t>(width * height), initialValue);
-	texture->create(width, height, emptyPixels.data());
+	std::vector<GLfloat> emptyPixels(static_cast<size_t>(width * height * channels), initialValue);
+	texture->create(width, height, emptyPixels.data(), channels);
 	return texture;
 }
 
+// Waterfall values are decibels between the floor and 0 dB, so the
+// normalized formats store exactly that range.
+void SpectrogramWidget::createWaterfallTexture(const Spectrogram& analyzer)
+{
+	spectrumHistory_ = std::make_shared<OpenGLFloatTexture>();
+	spectrumHistory_->setFormat(waterfallFormat_.load(std::memory_order_relaxed), analyzer.floorDb(), 0.0f);
+	std::vector<GLfloat> emptyPixels(static_cast<size_t>(analyzer.spectrumSize() * waterfallRows),
+		analyzer.floorDb());
+	spectrumHistory_->create(analyzer.spectrumSize(), waterfallRows, emptyPixels.data());
+
+	const auto streaming = spectrumHistory_->createUploadStream(analyzer.spectrumSize(), maximumRowsPerRefresh);
+	if (!streaming)
+		DBG("Waterfall rows are uploaded synchronously, no pixel unpack buffer is available");
+	// Only float rows can be copied into the stream as they arrive; packed
+	// formats stage them here first.
+	const auto zeroCopy = streaming && spectrumHistory_->getFormat() == OpenGLFloatTexture::Format::float32;
+	pendingSpectra_ = std::vector<GLfloat>(zeroCopy ? size_t { 0 }
+		: static_cast<size_t>(analyzer.spectrumSize() * maximumRowsPerRefresh), analyzer.floorDb());
+}
+
+bool SpectrogramWidget::createFullScreenGeometry()
+{
+	const GLfloat vertices[] = {
+		1.0f, 1.0f, 0.0f,
+		1.0f, -1.0f, 0.0f,
+		-1.0f, -1.0f, 0.0f,
+		-1.0f, 1.0f, 0.0f
+	};
+	const GLuint indices[] = { 0, 1, 3, 1, 2, 3 };
+
+	glGenVertexArrays(1, &fullScreenVertexArray_);
+	context_.extensions.glGenBuffers(1, &vertexBuffer_);
+	context_.extensions.glGenBuffers(1, &elements_);
+	if (fullScreenVertexArray_ == 0 || vertexBuffer_ == 0 || elements_ == 0)
+		return false;
+
+	// The element buffer binding belongs to the vertex array, so it stays
+	// bound until the context's vertex array is current again.
+	glBindVertexArray(fullScreenVertexArray_);
+	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
+	context_.extensions.glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	context_.extensions.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements_);
+	context_.extensions.glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	context_.extensions.glVertexAttribPointer(
+		position_->attributeID, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+	context_.extensions.glEnableVertexAttribArray(position_->attributeID);
+	glBindVertexArray(contextVertexArray_);
+	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return true;
+}
+
 Image SpectrogramWidget::createNoteAtlasImage()
 {
 	using namespace spectroscope::note_atlas;
@@ -349,15 +613,20 @@ bool SpectrogramWidget::createNoteOverlayResources()
 	}
 
 	noteShader_->use();
-	notePosition_ = std::make_unique<OpenGLShaderProgram::Attribute>(*noteShader_, "position");
-	noteTextureCoordinate_ = std::make_unique<OpenGLShaderProgram::Attribute>(
-		*noteShader_, "textureCoordinate");
 	noteAtlasUniform_ = createUniform(context_, *noteShader_, "noteAtlas");
-	const auto invalidAttribute = [](const auto& attribute) {
-		return attribute == nullptr || attribute->attributeID == static_cast<GLuint>(-1);
-	};
-	if (invalidAttribute(notePosition_) || invalidAttribute(noteTextureCoordinate_)
-		|| noteAtlasUniform_ == nullptr) {
+	noteRecordsUniform_ = createUniform(context_, *noteShader_, "noteRecords");
+	newestNoteRowUniform_ = createUniform(context_, *noteShader_, "newestRow");
+	noteComponentSizeUniform_ = createUniform(context_, *noteShader_, "componentSize");
+	const auto historyRowCountUniform = createUniform(context_, *noteShader_, "historyRowCount");
+	const auto cardSizeUniform = createUniform(context_, *noteShader_, "cardSize");
+	const auto rightPaddingUniform = createUniform(context_, *noteShader_, "rightPadding");
+	const auto atlasCellSizeUniform = createUniform(context_, *noteShader_, "atlasCellSize");
+	const auto atlasColumnsUniform = createUniform(context_, *noteShader_, "atlasColumns");
+	if (noteAtlasUniform_ == nullptr || noteRecordsUniform_ == nullptr
+		|| newestNoteRowUniform_ == nullptr || noteComponentSizeUniform_ == nullptr
+		|| historyRowCountUniform == nullptr || cardSizeUniform == nullptr
+		|| rightPaddingUniform == nullptr || atlasCellSizeUniform == nullptr
+		|| atlasColumnsUniform == nullptr) {
 		DBG("Note overlay shader interface is incomplete");
 		return false;
 	}
@@ -365,249 +634,456 @@ bool SpectrogramWidget::createNoteOverlayResources()
 	noteAtlasTexture_ = std::make_shared<OpenGLTexture>();
 	noteAtlasTexture_->loadImage(noteAtlasImage_);
 	noteAtlasTexture_->unbind();
-	context_.extensions.glGenBuffers(1, &noteVertexBuffer_);
-	context_.extensions.glGenBuffers(1, &noteElements_);
-	return noteAtlasTexture_->getTextureID() != 0
-		&& noteVertexBuffer_ != 0 && noteElements_ != 0;
+	if (noteAtlasTexture_->getTextureID() == 0)
+		return false;
+
+	// Card and atlas geometry are fixed for the lifetime of the program.
+	using namespace spectroscope::note_atlas;
+	setUniform(noteAtlasUniform_, noteAtlasTextureUnit);
+	setUniform(historyRowCountUniform, static_cast<float>(waterfallRows));
+	cardSizeUniform->set(static_cast<float>(cellWidth) / rasterScale,
+		static_cast<float>(cellHeight) / rasterScale);
+	setUniform(rightPaddingUniform, static_cast<float>(horizontalPadding));
+	atlasCellSizeUniform->set(
+		static_cast<float>(cellWidth) / static_cast<float>(noteAtlasTexture_->getWidth()),
+		static_cast<float>(cellHeight) / static_cast<float>(noteAtlasTexture_->getHeight()));
+	setUniform(atlasColumnsUniform, columns);
+	noteRecordsUploaded_ = false;
+
+	// A core profile draws nothing without a vertex array, even one without
+	// attributes.
+	glGenVertexArrays(1, &noteVertexArray_);
+	return noteVertexArray_ != 0;
 }
 
 void SpectrogramWidget::renderOpenGL()
 {
 	jassert(OpenGLHelpers::isContextActive());
+	SPECTROSCOPE_TRACE_THREAD_NAME("OpenGL render");
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget::renderOpenGL");
 
 	const auto renderingScale = static_cast<float>(context_.getRenderingScale());
-	glViewport(0, 0, roundToInt(renderingScale * static_cast<float>(getWidth())),
-		roundToInt(renderingScale * static_cast<float>(getHeight())));
+	const auto viewportWidth = roundToInt(renderingScale * static_cast<float>(getWidth()));
+	const auto viewportHeight = roundToInt(renderingScale * static_cast<float>(getHeight()));
+	const auto axisPixels = horizontal_.load(std::memory_order_relaxed) ? viewportHeight : viewportWidth;
+	glViewport(0, 0, viewportWidth, viewportHeight);
 	OpenGLHelpers::clear(getLookAndFeel().findColour(ResizableWindow::backgroundColourId));
+	updatePublishListener(renderOnDemand_.load(std::memory_order_acquire));
 
 	if (!openGLReady_.load(std::memory_order_acquire) || shader_ == nullptr || position_ == nullptr)
 		return;
+	const auto timing = beginFrameTiming();
 	if (clearTrackedNoteHistoryRequested_.exchange(false, std::memory_order_acq_rel))
 		trackedNoteHistory_.clear();
 
+	if (waterfallFormatChanged_.exchange(false, std::memory_order_acq_rel)) {
+		if (const auto analyzer = spectrogram_.lock()) {
+			const auto previousHistory = spectrumHistory_;
+			createWaterfallTexture(*analyzer);
+			if (!convertWaterfall(*previousHistory)) {
+				DBG("The waterfall could not be converted on the GPU, restoring the analyzer's rows");
+				restoreHistory(*analyzer);
+			}
+			previousHistory->release();
+			shadedWaterfallStale_.store(true, std::memory_order_release);
+			glViewport(0, 0, viewportWidth, viewportHeight);
+		}
+	}
+
 	int spectraUpdated = 0;
 	const auto refreshWasRequested = refreshRequested_.exchange(false, std::memory_order_acq_rel);
-	if (isRunning() || refreshWasRequested)
+	if (isRunning() || refreshWasRequested) {
+		const auto pullStartMs = timing ? Time::getMillisecondCounterHiRes() : 0.0;
 		spectraUpdated = pullAvailableFrames();
+		if (timing)
+			frameTimings_.pullFramesCpu.add(static_cast<float>(Time::getMillisecondCounterHiRes() - pullStartMs));
+	}
 
 	shader_->use();
-	resolution_->set(renderingScale * static_cast<float>(getWidth()), renderingScale * static_cast<float>(getHeight()));
 	setUniform(lutTexture_, 0);
-	setUniform(logXAxis_, xLogAxis_.load(std::memory_order_relaxed) ? 1 : 0);
 	setUniform(uHorizontal_, horizontal_.load(std::memory_order_relaxed) ? 1 : 0);
 	setUniform(uPitchColourMode_, pitchColourMode_.load(std::memory_order_relaxed) ? 1 : 0);
 	setUniform(waterfallStartUniform_,
 		spectroscope::waterfall::oldestRowCentre(waterfallPosition_, waterfallRows));
 	setUniform(waterfallSpanUniform_, spectroscope::waterfall::historySpan(waterfallRows));
 	setUniform(uUpperHalfPercentage_, upperHalfPercentage_);
-	setUniform(audioSampleData_, 1);
+	setUniform(waterfallValueOffsetUniform_, spectrumHistory_->getValueOffset());
+	setUniform(waterfallValueScaleUniform_, spectrumHistory_->getValueScale());
+	// The vertical view's spectrum is the newest waterfall row.
+	setUniform(latestSpectrumPositionUniform_,
+		(static_cast<float>(waterfallPosition_) + 0.5f) / static_cast<float>(waterfallRows));
 	setUniform(waterfallTexture_, 2);
-	setUniform(pitchClassDataUniform_, 3);
-	setUniform(pitchClassHistoryUniform_, 4);
-	setUniform(uConcertAHz_, concertAHz_.load(std::memory_order_relaxed));
+	setUniform(fieldNoteHistoryUniform_, 3);
+	setUniform(shadedWaterfallUniform_, shadedWaterfallTextureUnit);
+	setUniform(latestFieldNoteRowUniform_, waterfallPosition_);
+	setUniform(axisMappingUniform_, axisMappingTextureUnit);
 	if (const auto analyzer = spectrogram_.lock()) {
-		setUniform(uSampleRate_, static_cast<float>(analyzer->sampleRate()));
-		setUniform(uMinimumFrequencyHz_, static_cast<float>(
-			analyzer->sampleRate() / static_cast<double>(analyzer->fftSize())));
 		setUniform(uSpectrumTexelWidth_, 1.0f / static_cast<float>(analyzer->spectrumSize()));
+		setUniform(uTrackedAnalysisBinCount_, static_cast<float>(
+			analyzer->pitchLayout().binsPerOctave * analyzer->pitchLayout().octaveCount));
+		setUniform(fieldNoteCapacityUniform_, analyzer->fieldNoteRowSize() / 2 - 1);
 	} else {
-		setUniform(uSampleRate_, 0.0f);
-		setUniform(uMinimumFrequencyHz_, 1.0f);
 		setUniform(uSpectrumTexelWidth_, 1.0f);
+		setUniform(uTrackedAnalysisBinCount_, 1.0f);
+		setUniform(fieldNoteCapacityUniform_, 0);
+	}
+
+	// A mapped segment is submitted even without new rows, so the stream
+	// never keeps a segment mapped into the next frame.
+	const auto uploadStartMs = timing ? Time::getMillisecondCounterHiRes() : 0.0;
+	beginTimedPass(timing, uploadsTimedPass);
+	if (spectraStaged_) {
+		SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget streamed uploads");
+		context_.extensions.glActiveTexture(GL_TEXTURE2);
+		spectrumHistory_->submitUpload(firstPendingRow_, spectraUpdated, waterfallRows);
 	}
 
 	if (const auto analyzer = spectrogram_.lock()) {
 		if (spectraUpdated > 0) {
-			const auto latestRowOffset = static_cast<size_t>(waterfallPosition_ * analyzer->spectrumSize());
-			const auto latestPitchRowOffset = static_cast<size_t>(
-				waterfallPosition_ * analyzer->pitchClassSize());
-			context_.extensions.glActiveTexture(GL_TEXTURE1);
-			spectrumData_->load(fftData_.data() + latestRowOffset, analyzer->spectrumSize(), 1);
-			context_.extensions.glActiveTexture(GL_TEXTURE3);
-			pitchClassData_->load(
-				pitchClassDataHistory_.data() + latestPitchRowOffset, analyzer->pitchClassSize(), 1);
-
-			context_.extensions.glActiveTexture(GL_TEXTURE2);
-			for (int pendingRow = 0; pendingRow < spectraUpdated; ++pendingRow) {
-				const auto textureRow = pendingTextureRows_[static_cast<size_t>(pendingRow)];
-				const auto rowOffset = static_cast<size_t>(textureRow * analyzer->spectrumSize());
-				const auto* rowData = fftData_.data() + rowOffset;
-				spectrumHistory_->load(rowData, analyzer->spectrumSize(), 1, textureRow);
+			SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget texture uploads");
+			if (!spectraStaged_) {
+				context_.extensions.glActiveTexture(GL_TEXTURE2);
+				spectrumHistory_->loadRows(pendingSpectra_.data(), analyzer->spectrumSize(),
+					firstPendingRow_, spectraUpdated, waterfallRows);
 			}
-			context_.extensions.glActiveTexture(GL_TEXTURE4);
+			// Only the header and as many notes as the fullest row holds are
+			// uploaded; the shader ignores texels beyond each row's note count.
+			context_.extensions.glActiveTexture(GL_TEXTURE3);
+			const auto fieldNoteRowTexels = analyzer->fieldNoteRowSize() / 2;
+			auto mostNotes = 0;
 			for (int pendingRow = 0; pendingRow < spectraUpdated; ++pendingRow) {
-				const auto textureRow = pendingTextureRows_[static_cast<size_t>(pendingRow)];
-				const auto rowOffset = static_cast<size_t>(
-					textureRow * analyzer->pitchClassSize());
-				const auto* rowData = pitchClassDataHistory_.data() + rowOffset;
-				pitchClassHistory_->load(rowData, analyzer->pitchClassSize(), 1, textureRow);
+				const auto noteCount = pendingFieldNotes_[static_cast<size_t>(pendingRow * analyzer->fieldNoteRowSize())];
+				mostNotes = std::max(mostNotes, jlimit(0, fieldNoteRowTexels - 1, static_cast<int>(noteCount)));
 			}
+			fieldNoteHistory_->loadRows(pendingFieldNotes_.data(), 1 + mostNotes,
+				firstPendingRow_, spectraUpdated, waterfallRows, fieldNoteRowTexels);
 		}
 	}
 
+	spectraStaged_ = false;
+	updateAxisMapping(axisPixels);
+	endTimedPass(timing);
+	if (timing)
+		frameTimings_.uploadsCpu.add(static_cast<float>(Time::getMillisecondCounterHiRes() - uploadStartMs));
+
 	// Texture uploads bind on the currently active unit. Re-establish every
 	// sampler binding after uploads so the one-row spectrum can never replace
 	// the waterfall texture on unit 2.
 	context_.extensions.glActiveTexture(GL_TEXTURE0);
 	textureLUT_->bind();
-	context_.extensions.glActiveTexture(GL_TEXTURE1);
-	spectrumData_->bind();
 	context_.extensions.glActiveTexture(GL_TEXTURE2);
 	spectrumHistory_->bind();
 	context_.extensions.glActiveTexture(GL_TEXTURE3);
-	pitchClassData_->bind();
-	context_.extensions.glActiveTexture(GL_TEXTURE4);
-	pitchClassHistory_->bind();
+	fieldNoteHistory_->bind();
+	context_.extensions.glActiveTexture(GL_TEXTURE0 + axisMappingTextureUnit);
+	axisMapping_->bind();
 
 #if JUCE_DEBUG
 	assertTextureBound(context_, GL_TEXTURE0, textureLUT_->getTextureID());
-	assertTextureBound(context_, GL_TEXTURE1, spectrumData_->getTextureID());
 	assertTextureBound(context_, GL_TEXTURE2, spectrumHistory_->getTextureID());
-	assertTextureBound(context_, GL_TEXTURE3, pitchClassData_->getTextureID());
-	assertTextureBound(context_, GL_TEXTURE4, pitchClassHistory_->getTextureID());
+	assertTextureBound(context_, GL_TEXTURE3, fieldNoteHistory_->getTextureID());
+	assertTextureBound(context_, GL_TEXTURE0 + axisMappingTextureUnit, axisMapping_->getTextureID());
 #endif
 
-	const GLfloat vertices[] = {
-		1.0f, 1.0f, 0.0f,
-		1.0f, -1.0f, 0.0f,
-		-1.0f, -1.0f, 0.0f,
-		-1.0f, 1.0f, 0.0f
-	};
-	const GLuint indices[] = { 0, 1, 3, 1, 2, 3 };
-
-	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer_);
-	context_.extensions.glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STREAM_DRAW);
-	context_.extensions.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements_);
-	context_.extensions.glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STREAM_DRAW);
-	context_.extensions.glVertexAttribPointer(
-		position_->attributeID, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
-	context_.extensions.glEnableVertexAttribArray(position_->attributeID);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-	context_.extensions.glDisableVertexAttribArray(position_->attributeID);
-	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, 0);
-	context_.extensions.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	auto composited = false;
+	if (incrementalWaterfall_.load(std::memory_order_relaxed)) {
+		beginTimedPass(timing, shadeRowsTimedPass);
+		composited = updateShadedWaterfall(axisPixels, spectraUpdated);
+		endTimedPass(timing);
+	}
+	if (composited) {
+		context_.extensions.glActiveTexture(GL_TEXTURE0 + shadedWaterfallTextureUnit);
+		glBindTexture(GL_TEXTURE_2D, shadedWaterfall_.getTextureID());
+	}
 
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget waterfall draw");
+	glViewport(0, 0, viewportWidth, viewportHeight);
+	resolution_->set(static_cast<float>(viewportWidth), static_cast<float>(viewportHeight));
+	setUniform(waterfallPassUniform_, composited ? compositeWaterfallPass : shadeEveryPixelPass);
+	beginTimedPass(timing, waterfallTimedPass);
+	drawFullScreenQuad();
+	endTimedPass(timing);
+
+	if (composited) {
+		context_.extensions.glActiveTexture(GL_TEXTURE0 + shadedWaterfallTextureUnit);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
 	context_.extensions.glActiveTexture(GL_TEXTURE0);
 	textureLUT_->unbind();
-	context_.extensions.glActiveTexture(GL_TEXTURE1);
-	spectrumData_->unbind();
 	context_.extensions.glActiveTexture(GL_TEXTURE2);
 	spectrumHistory_->unbind();
 	context_.extensions.glActiveTexture(GL_TEXTURE3);
-	pitchClassData_->unbind();
-	context_.extensions.glActiveTexture(GL_TEXTURE4);
-	pitchClassHistory_->unbind();
+	fieldNoteHistory_->unbind();
+	context_.extensions.glActiveTexture(GL_TEXTURE0 + axisMappingTextureUnit);
+	axisMapping_->unbind();
+	context_.extensions.glActiveTexture(GL_TEXTURE0);
 
 	if (horizontal_.load(std::memory_order_relaxed)
 		&& trackedNoteOverlayEnabled_.load(std::memory_order_relaxed)) {
-		if (const auto analyzer = spectrogram_.lock()) {
-			renderHorizontalNoteHistory(analyzer->sampleRate(),
-				analyzer->sampleRate() / static_cast<double>(analyzer->fftSize()));
-		}
+		beginTimedPass(timing, noteOverlayTimedPass);
+		renderHorizontalNoteHistory();
+		endTimedPass(timing);
 	}
+	if (timing)
+		endFrameTiming();
 }
 
-void SpectrogramWidget::renderHorizontalNoteHistory(
-	double sampleRate, double minimumFrequencyHz)
+// Everything the shader derives from a frequency-axis pixel depends only on
+// the axis and the tuning, so it is computed here whenever those or the size
+// change instead of per fragment.
+void SpectrogramWidget::updateAxisMapping(int axisPixels)
 {
-	if (!noteOverlayReady_ || noteShader_ == nullptr || noteAtlasTexture_ == nullptr
-		|| getWidth() <= 0 || getHeight() <= 0) {
+	if (axisPixels <= 0)
 		return;
+
+	spectroscope::frequency_axis::ColumnParameters parameters;
+	parameters.logarithmic = xLogAxis_.load(std::memory_order_relaxed);
+	parameters.concertAHz = concertAHz_.load(std::memory_order_relaxed);
+	if (const auto analyzer = spectrogram_.lock()) {
+		parameters.sampleRate = analyzer->sampleRate();
+		parameters.minimumFrequencyHz = analyzer->sampleRate() / static_cast<double>(analyzer->fftSize());
+		parameters.trackedOctavesBelowConcertA = analyzer->pitchLayout().octavesBelowConcertA;
+		parameters.trackedOctaveCount = analyzer->pitchLayout().octaveCount;
 	}
+	if (axisPixels == axisMappingPixels_ && sameColumnParameters(parameters, axisMappingParameters_))
+		return;
 
-	std::array<spectroscope::TrackedNoteHistory::Entry,
-		spectroscope::TrackedNoteHistory::capacity> entries {};
-	const auto entryCount = trackedNoteHistory_.visibleEntries(lastSequence_, waterfallRows,
-		entries.data(), static_cast<int>(entries.size()));
-	if (entryCount <= 0)
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget axis mapping");
+	static_assert(sizeof(spectroscope::frequency_axis::ColumnMapping) == 4 * sizeof(GLfloat),
+		"column mappings are uploaded as RGBA texels");
+	axisColumns_.resize(static_cast<size_t>(axisPixels));
+	spectroscope::frequency_axis::fillColumnMappings(axisColumns_.data(), axisPixels, parameters);
+	context_.extensions.glActiveTexture(GL_TEXTURE0 + axisMappingTextureUnit);
+	axisMapping_->create(axisPixels, 1, reinterpret_cast<const GLfloat*>(axisColumns_.data()), 4);
+	axisMappingPixels_ = axisPixels;
+	axisMappingParameters_ = parameters;
+	shadedWaterfallStale_.store(true, std::memory_order_release);
+}
+
+// The ring has the waterfall texture's rows, so the rows uploaded this frame
+// are the rows to shade. Everything is shaded again when the ring is new or
+// a setting changed the colours of existing rows.
+bool SpectrogramWidget::updateShadedWaterfall(int axisPixels, int newRows)
+{
+	if (axisPixels <= 0 || axisPixels == failedShadedWaterfallWidth_)
+		return false;
+
+	auto shadeAllRows = shadedWaterfallStale_.exchange(false, std::memory_order_acq_rel);
+	if (!shadedWaterfall_.isValid() || shadedWaterfall_.getWidth() != axisPixels) {
+		shadedWaterfall_.release();
+		context_.extensions.glActiveTexture(GL_TEXTURE0 + shadedWaterfallTextureUnit);
+		if (!shadedWaterfall_.initialise(context_, axisPixels, waterfallRows)) {
+			DBG("No framebuffer for the shaded waterfall, every pixel is shaded each frame");
+			failedShadedWaterfallWidth_ = axisPixels;
+			shadedWaterfall_.release();
+			return false;
+		}
+		// History positions run past 1 and wrap like the waterfall texture.
+		glBindTexture(GL_TEXTURE_2D, shadedWaterfall_.getTextureID());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		failedShadedWaterfallWidth_ = 0;
+		shadeAllRows = true;
+	}
+
+	const auto firstRow = shadeAllRows ? 0 : firstPendingRow_;
+	const auto rowCount = shadeAllRows ? waterfallRows : std::min(newRows, waterfallRows);
+	if (rowCount <= 0)
+		return true;
+
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget shade waterfall rows");
+	shadedWaterfall_.makeCurrentRenderingTarget();
+	resolution_->set(static_cast<float>(axisPixels), static_cast<float>(waterfallRows));
+	setUniform(waterfallPassUniform_, shadeHistoryRowsPass);
+	const auto firstRange = std::min(rowCount, waterfallRows - firstRow);
+	glViewport(0, firstRow, axisPixels, firstRange);
+	drawFullScreenQuad();
+	if (rowCount > firstRange) {
+		glViewport(0, 0, axisPixels, rowCount - firstRange);
+		drawFullScreenQuad();
+	}
+	shadedWaterfall_.releaseAsRenderingTarget();
+	return true;
+}
+
+// Draws source into the new waterfall texture through a framebuffer, so a
+// format change keeps the whole history rather than the analyzer's retained
+// rows. Every normalized and float format used here is colour-renderable.
+bool SpectrogramWidget::convertWaterfall(const OpenGLFloatTexture& source)
+{
+	if (source.getWidth() != spectrumHistory_->getWidth() || source.getHeight() != spectrumHistory_->getHeight())
+		return false;
+
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	GLuint framebuffer = 0;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, spectrumHistory_->getTextureID(), 0);
+	const auto complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	if (complete) {
+		shader_->use();
+		context_.extensions.glActiveTexture(GL_TEXTURE2);
+		source.bind();
+		setUniform(waterfallTexture_, 2);
+		setUniform(waterfallValueOffsetUniform_, source.getValueOffset());
+		setUniform(waterfallValueScaleUniform_, source.getValueScale());
+		setUniform(convertedValueOffsetUniform_, spectrumHistory_->getValueOffset());
+		setUniform(convertedValueScaleUniform_, spectrumHistory_->getValueScale());
+		setUniform(waterfallPassUniform_, convertWaterfallPass);
+		glViewport(0, 0, spectrumHistory_->getWidth(), spectrumHistory_->getHeight());
+		drawFullScreenQuad();
+		spectrumHistory_->bind();
+		context_.extensions.glActiveTexture(GL_TEXTURE0);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer));
+	glDeleteFramebuffers(1, &framebuffer);
+	return complete;
+}
+
+void SpectrogramWidget::drawFullScreenQuad()
+{
+	glBindVertexArray(fullScreenVertexArray_);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+	glBindVertexArray(contextVertexArray_);
+}
+
+// Returns whether this frame is timed. Enabling starts from empty windows
+// and fresh queries, so nothing measured earlier carries over.
+bool SpectrogramWidget::beginFrameTiming()
+{
+	const auto enabled = frameStatisticsEnabled_.load(std::memory_order_relaxed);
+	if (enabled != frameTimings_.active) {
+		passTimer_.release();
+		frameTimings_ = {};
+		frameTimings_.active = enabled;
+		if (enabled && !passTimer_.create(timedPassCount))
+			DBG("No GL timer queries, frame statistics are measured on the CPU only");
+	}
+	if (!enabled)
+		return false;
+
+	const auto nowMs = Time::getMillisecondCounterHiRes();
+	if (frameTimings_.previousFrameStartMs > 0.0)
+		frameTimings_.frameInterval.add(static_cast<float>(nowMs - frameTimings_.previousFrameStartMs));
+	frameTimings_.previousFrameStartMs = nowMs;
+	frameTimings_.frameStartMs = nowMs;
+
+	std::array<float, timedPassCount> passMilliseconds {};
+	if (passTimer_.beginFrame(passMilliseconds.data())) {
+		for (int pass = 0; pass < timedPassCount; ++pass) {
+			if (passMilliseconds[static_cast<size_t>(pass)] >= 0.0f)
+				frameTimings_.gpuPasses[static_cast<size_t>(pass)].add(passMilliseconds[static_cast<size_t>(pass)]);
+		}
+	}
+	return true;
+}
+
+void SpectrogramWidget::beginTimedPass(bool timing, int pass)
+{
+	if (timing)
+		passTimer_.beginPass(pass);
+}
+
+void SpectrogramWidget::endTimedPass(bool timing)
+{
+	if (timing)
+		passTimer_.endPass();
+}
+
+void SpectrogramWidget::endFrameTiming()
+{
+	const auto nowMs = Time::getMillisecondCounterHiRes();
+	frameTimings_.renderCpu.add(static_cast<float>(nowMs - frameTimings_.frameStartMs));
+	if (nowMs < frameTimings_.nextPublishMs)
 		return;
+	frameTimings_.nextPublishMs = nowMs + 100.0;
+
+	spectroscope::frame_timing::FrameStatistics statistics;
+	statistics.frameInterval = frameTimings_.frameInterval.summary();
+	statistics.renderCpu = frameTimings_.renderCpu.summary();
+	statistics.pullFramesCpu = frameTimings_.pullFramesCpu.summary();
+	statistics.uploadsCpu = frameTimings_.uploadsCpu.summary();
+	statistics.uploadsGpu = frameTimings_.gpuPasses[uploadsTimedPass].summary();
+	statistics.shadeRowsGpu = frameTimings_.gpuPasses[shadeRowsTimedPass].summary();
+	statistics.waterfallGpu = frameTimings_.gpuPasses[waterfallTimedPass].summary();
+	statistics.noteOverlayGpu = frameTimings_.gpuPasses[noteOverlayTimedPass].summary();
+	statistics.missedFrames = frameTimings_.frameInterval.missedFrames();
+	statistics.gpuTimersAvailable = passTimer_.isAvailable();
+	frameStatisticsOverlay_->post(statistics);
+}
 
-	using namespace spectroscope::note_atlas;
-	const auto componentWidth = static_cast<float>(getWidth());
-	const auto componentHeight = static_cast<float>(getHeight());
-	const auto displayCellWidth = static_cast<float>(cellWidth) / rasterScale;
-	const auto displayCellHeight = static_cast<float>(cellHeight) / rasterScale;
-	const auto rightPadding = static_cast<float>(horizontalPadding);
-	const auto textureWidth = static_cast<float>(noteAtlasTexture_->getWidth());
-	const auto textureHeight = static_cast<float>(noteAtlasTexture_->getHeight());
-
-	noteVertices_.clear();
-	noteIndices_.clear();
-	for (int entryIndex = 0; entryIndex < entryCount; ++entryIndex) {
-		const auto& entry = entries[static_cast<std::size_t>(entryIndex)];
-		const auto frequencyPosition = spectroscope::frequency_axis::normalisedPosition(
-			entry.note.frequencyHz, sampleRate, minimumFrequencyHz,
-			xLogAxis_.load(std::memory_order_relaxed));
-		const auto screenPosition = spectroscope::frequency_axis::horizontalScreenPosition(
-			frequencyPosition);
-		const auto anchorX = entry.historyPosition * componentWidth;
-		const auto centreY = jlimit(displayCellHeight * 0.5f,
-			componentHeight - displayCellHeight * 0.5f, screenPosition * componentHeight);
-		const auto right = anchorX + rightPadding;
-		const auto left = right - displayCellWidth;
-		const auto top = centreY - displayCellHeight * 0.5f;
-		const auto bottom = centreY + displayCellHeight * 0.5f;
-		const auto toNdcX = [componentWidth](float x) {
-			return 2.0f * x / componentWidth - 1.0f;
-		};
-		const auto toNdcY = [componentHeight](float y) {
-			return 1.0f - 2.0f * y / componentHeight;
-		};
-
-		const auto atlasBounds = pixelBoundsForMidiNote(entry.note.midiNote);
-		const auto textureLeft = static_cast<float>(atlasBounds.x) / textureWidth;
-		const auto textureRight = static_cast<float>(atlasBounds.x + atlasBounds.width) / textureWidth;
-		const auto textureTop = 1.0f - static_cast<float>(atlasBounds.y) / textureHeight;
-		const auto textureBottom = 1.0f
-			- static_cast<float>(atlasBounds.y + atlasBounds.height) / textureHeight;
-		const GLfloat quad[] = {
-			toNdcX(right), toNdcY(top), textureRight, textureTop,
-			toNdcX(right), toNdcY(bottom), textureRight, textureBottom,
-			toNdcX(left), toNdcY(bottom), textureLeft, textureBottom,
-			toNdcX(left), toNdcY(top), textureLeft, textureTop
-		};
-		noteVertices_.insert(noteVertices_.end(), std::begin(quad), std::end(quad));
-		const auto baseVertex = static_cast<GLuint>(entryIndex * 4);
-		const GLuint indices[] = {
-			baseVertex, baseVertex + 1, baseVertex + 3,
-			baseVertex + 1, baseVertex + 2, baseVertex + 3
-		};
-		noteIndices_.insert(noteIndices_.end(), std::begin(indices), std::end(indices));
+void SpectrogramWidget::renderHorizontalNoteHistory()
+{
+	if (!noteOverlayReady_ || noteShader_ == nullptr || noteAtlasTexture_ == nullptr
+		|| getWidth() <= 0 || getHeight() <= 0) {
+		return;
 	}
 
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget::renderHorizontalNoteHistory");
 	noteShader_->use();
-	setUniform(noteAtlasUniform_, noteAtlasTextureUnit);
+	updateNoteRecords();
+	if (noteRecordCount_ <= 0)
+		return;
+
+	// Scrolling only moves the newest row; the records stay where they are.
+	setUniform(newestNoteRowUniform_,
+		static_cast<float>(static_cast<std::int64_t>(lastSequence_ - noteRecordBaseSequence_)));
+	noteComponentSizeUniform_->set(static_cast<float>(getWidth()), static_cast<float>(getHeight()));
 	context_.extensions.glActiveTexture(GL_TEXTURE0 + noteAtlasTextureUnit);
 	noteAtlasTexture_->bind();
-	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, noteVertexBuffer_);
-	context_.extensions.glBufferData(GL_ARRAY_BUFFER,
-		static_cast<GLsizeiptr>(noteVertices_.size() * sizeof(GLfloat)),
-		noteVertices_.data(), GL_STREAM_DRAW);
-	context_.extensions.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, noteElements_);
-	context_.extensions.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-		static_cast<GLsizeiptr>(noteIndices_.size() * sizeof(GLuint)),
-		noteIndices_.data(), GL_STREAM_DRAW);
-	context_.extensions.glVertexAttribPointer(notePosition_->attributeID, 2, GL_FLOAT, GL_FALSE,
-		4 * sizeof(GLfloat), nullptr);
-	context_.extensions.glVertexAttribPointer(noteTextureCoordinate_->attributeID, 2, GL_FLOAT,
-		GL_FALSE, 4 * sizeof(GLfloat), reinterpret_cast<const void*>(2 * sizeof(GLfloat)));
-	context_.extensions.glEnableVertexAttribArray(notePosition_->attributeID);
-	context_.extensions.glEnableVertexAttribArray(noteTextureCoordinate_->attributeID);
+	glBindVertexArray(noteVertexArray_);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(noteIndices_.size()), GL_UNSIGNED_INT, nullptr);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, noteRecordCount_);
 	glDisable(GL_BLEND);
-	context_.extensions.glDisableVertexAttribArray(notePosition_->attributeID);
-	context_.extensions.glDisableVertexAttribArray(noteTextureCoordinate_->attributeID);
-	context_.extensions.glBindBuffer(GL_ARRAY_BUFFER, 0);
-	context_.extensions.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindVertexArray(contextVertexArray_);
 	noteAtlasTexture_->unbind();
+	context_.extensions.glActiveTexture(GL_TEXTURE0);
+}
+
+// Rebuilds the note shader's card records when the tracked-note history or
+// the frequency axis changed since they were last uploaded. Anchor rows are
+// stored relative to the newest row at that time so they stay exact floats.
+void SpectrogramWidget::updateNoteRecords()
+{
+	const auto revision = trackedNoteHistory_.revision();
+	if (noteRecordsUploaded_ && revision == noteRecordRevision_
+		&& sameColumnParameters(axisMappingParameters_, noteRecordAxis_)) {
+		return;
+	}
+
+	static_assert(spectroscope::TrackedNoteHistory::capacity == 48,
+		"note_overlay.vert.glsl sizes noteRecords for the history capacity");
+	std::array<spectroscope::TrackedNoteHistory::AnchoredEntry,
+		spectroscope::TrackedNoteHistory::capacity> entries {};
+	noteRecordCount_ = trackedNoteHistory_.anchoredEntries(entries.data(),
+		static_cast<int>(entries.size()));
+	noteRecordBaseSequence_ = lastSequence_;
+	for (int entryIndex = 0; entryIndex < noteRecordCount_; ++entryIndex) {
+		const auto& entry = entries[static_cast<std::size_t>(entryIndex)];
+		const auto anchorRow = entry.tracking ? 0.0f : static_cast<float>(
+			static_cast<std::int64_t>(entry.anchorSequence - noteRecordBaseSequence_));
+		auto* record = noteRecords_.data() + entryIndex * 4;
+		record[0] = static_cast<GLfloat>(entry.note.midiNote);
+		record[1] = anchorRow;
+		record[2] = spectroscope::frequency_axis::normalisedPosition(entry.note.frequencyHz,
+			axisMappingParameters_.sampleRate, axisMappingParameters_.minimumFrequencyHz,
+			axisMappingParameters_.logarithmic);
+		record[3] = entry.tracking ? 1.0f : 0.0f;
+	}
+	if (noteRecordCount_ > 0)
+		glUniform4fv(noteRecordsUniform_->uniformID, noteRecordCount_, noteRecords_.data());
+	noteRecordRevision_ = revision;
+	noteRecordAxis_ = axisMappingParameters_;
+	noteRecordsUploaded_ = true;
 }
 
 void SpectrogramWidget::resized()
 {
 	statusLabel_.setBounds(getLocalBounds().reduced(4).removeFromTop(75));
 	trackedNotesOverlay_->setBounds(getLocalBounds());
+	frameStatisticsOverlay_->setBounds(getLocalBounds());
 	context_.triggerRepaint();
 }
 
@@ -617,6 +1093,59 @@ void SpectrogramWidget::refreshData()
 	context_.triggerRepaint();
 }
 
+// The render thread registers or removes the listener on its next frame.
+void SpectrogramWidget::setRenderOnDemand(bool enabled)
+{
+	if (renderOnDemand_.exchange(enabled, std::memory_order_acq_rel) == enabled)
+		return;
+
+	if (enabled)
+		setContinuousRedrawing(false);
+	refreshData();
+}
+
+// Render thread only. Notifications wake the render thread through the
+// context, so the listener is only registered while the context exists:
+// openGLContextClosing() removes it, and removal waits for a notification in
+// progress, before JUCE releases the context.
+void SpectrogramWidget::updatePublishListener(bool listening)
+{
+	if (listening == publishListenerRegistered_)
+		return;
+
+	const auto analyzer = spectrogram_.lock();
+	if (analyzer == nullptr)
+		return;
+
+	if (!listening) {
+		analyzer->removePublishListener(this);
+		publishListenerRegistered_ = false;
+	} else if (analyzer->addPublishListener(this)) {
+		publishListenerRegistered_ = true;
+		publishListenerUnavailable_.store(false, std::memory_order_release);
+	} else if (!publishListenerUnavailable_.exchange(true, std::memory_order_acq_rel)) {
+		DBG("The analyzer has no free publish listener slot, redrawing continuously");
+		triggerAsyncUpdate();
+	}
+}
+
+// Message thread. Applies the fallback the render thread asked for, unless a
+// slot became free in the meantime.
+void SpectrogramWidget::handleAsyncUpdate()
+{
+	if (publishListenerUnavailable_.exchange(false, std::memory_order_acq_rel)
+		&& renderOnDemand_.exchange(false, std::memory_order_acq_rel)) {
+		setContinuousRedrawing(true);
+	}
+}
+
+// Called on the analysis worker, only while the context exists. The render
+// thread pulls the new rows.
+void SpectrogramWidget::rowsPublished(std::uint64_t) noexcept
+{
+	refreshData();
+}
+
 void SpectrogramWidget::setXAxis(bool logAxis)
 {
 	xLogAxis_.store(logAxis, std::memory_order_relaxed);
@@ -627,6 +1156,7 @@ void SpectrogramWidget::setXAxis(bool logAxis)
 void SpectrogramWidget::setHorizontalMode(bool horizontal)
 {
 	horizontal_.store(horizontal, std::memory_order_relaxed);
+	shadedWaterfallStale_.store(true, std::memory_order_release);
 	const auto overlayEnabled = trackedNoteOverlayEnabled_.load(std::memory_order_relaxed);
 	trackedNotesOverlay_->setVisible(overlayEnabled && !horizontal);
 	if (horizontal)
@@ -638,6 +1168,8 @@ void SpectrogramWidget::setHorizontalMode(bool horizontal)
 void SpectrogramWidget::setPitchColourMode(bool enabled)
 {
 	pitchColourMode_.store(enabled, std::memory_order_relaxed);
+	shadedWaterfallStale_.store(true, std::memory_order_release);
+	updateAnalysisStages();
 	context_.triggerRepaint();
 }
 
@@ -649,9 +1181,88 @@ void SpectrogramWidget::setTrackedNoteOverlayEnabled(bool enabled)
 	if (!enabled)
 		trackedNotesOverlay_->clearNotes();
 	clearTrackedNoteHistoryRequested_.store(true, std::memory_order_release);
+	updateAnalysisStages();
 	refreshData();
 }
 
+void SpectrogramWidget::setAnalysisStageGating(bool enabled)
+{
+	if (analysisStageGating_ == enabled)
+		return;
+
+	analysisStageGating_ = enabled;
+	if (const auto analyzer = spectrogram_.lock()) {
+		if (enabled) {
+			pitchTrackingBeforeGating_ = analyzer->isPitchTrackingEnabled();
+			pitchFieldBeforeGating_ = analyzer->isPitchFieldEnabled();
+			// The shader evaluates the tracked-pitch field from the field
+			// notes, so the analyzer never has to render it.
+			analyzer->setPitchFieldEnabled(false);
+		} else {
+			analyzer->setPitchTrackingEnabled(pitchTrackingBeforeGating_);
+			analyzer->setPitchFieldEnabled(pitchFieldBeforeGating_);
+		}
+	}
+	updateAnalysisStages();
+}
+
+void SpectrogramWidget::updateAnalysisStages()
+{
+	if (!analysisStageGating_)
+		return;
+
+	if (const auto analyzer = spectrogram_.lock()) {
+		analyzer->setPitchTrackingEnabled(pitchColourMode_.load(std::memory_order_relaxed)
+			|| trackedNoteOverlayEnabled_.load(std::memory_order_relaxed));
+	}
+}
+
+void SpectrogramWidget::setWaterfallFormat(OpenGLFloatTexture::Format format)
+{
+	if (waterfallFormat_.exchange(format, std::memory_order_relaxed) != format) {
+		waterfallFormatChanged_.store(true, std::memory_order_release);
+		context_.triggerRepaint();
+	}
+}
+
+void SpectrogramWidget::setIncrementalWaterfall(bool enabled)
+{
+	incrementalWaterfall_.store(enabled, std::memory_order_relaxed);
+	shadedWaterfallStale_.store(true, std::memory_order_release);
+	context_.triggerRepaint();
+}
+
+void SpectrogramWidget::setFrameStatisticsEnabled(bool enabled)
+{
+	JUCE_ASSERT_MESSAGE_THREAD
+	if (frameStatisticsEnabled_.exchange(enabled, std::memory_order_relaxed) == enabled)
+		return;
+
+	frameStatisticsOverlay_->setCollecting(enabled);
+	if (!enabled)
+		frameStatisticsOverlay_->setVisible(false);
+	context_.triggerRepaint();
+}
+
+void SpectrogramWidget::setFrameStatisticsOverlayVisible(bool visible)
+{
+	JUCE_ASSERT_MESSAGE_THREAD
+	if (visible)
+		setFrameStatisticsEnabled(true);
+	frameStatisticsOverlay_->setVisible(visible);
+}
+
+spectroscope::frame_timing::FrameStatistics SpectrogramWidget::getFrameStatistics() const
+{
+	JUCE_ASSERT_MESSAGE_THREAD
+	return frameStatisticsOverlay_->latest();
+}
+
+String SpectrogramWidget::getFrameStatisticsSummary() const
+{
+	return describeFrameStatistics(getFrameStatistics());
+}
+
 void SpectrogramWidget::setPitchTrackingPreset(PitchTracker::Preset preset)
 {
 	if (const auto analyzer = spectrogram_.lock())
@@ -676,7 +1287,10 @@ bool SpectrogramWidget::isOpenGLReady() const noexcept
 void SpectrogramWidget::publishStatus(String statusText)
 {
 	Component::SafePointer<SpectrogramWidget> safeThis(this);
+	SPECTROSCOPE_TRACE_INSTANT("publishStatus posted");
 	MessageManager::callAsync([safeThis, statusTextToPublish = std::move(statusText)]() mutable {
+		SPECTROSCOPE_TRACE_THREAD_NAME("Message thread");
+		SPECTROSCOPE_TRACE_SCOPE("publishStatus delivery");
 		if (safeThis != nullptr) {
 			safeThis->statusLabel_.setText(std::move(statusTextToPublish), dontSendNotification);
 			safeThis->statusLabel_.setVisible(safeThis->statusLabel_.getText().isNotEmpty());
@@ -685,19 +1299,13 @@ void SpectrogramWidget::publishStatus(String statusText)
 }
 
 void SpectrogramWidget::publishTrackedNotes(
-	std::array<spectroscope::TrackedPitch, 6> notes, int noteCount,
+	const std::array<spectroscope::TrackedPitch, 6>& notes, int noteCount,
 	double sampleRate, double minimumFrequencyHz)
 {
-	Component::SafePointer<SpectrogramWidget> safeThis(this);
-	MessageManager::callAsync([safeThis, notesToPublish = std::move(notes), noteCount,
-		sampleRate, minimumFrequencyHz]() mutable {
-		if (safeThis != nullptr
-			&& safeThis->trackedNoteOverlayEnabled_.load(std::memory_order_relaxed)
-			&& !safeThis->horizontal_.load(std::memory_order_relaxed)) {
-			safeThis->trackedNotesOverlay_->setNotes(
-				std::move(notesToPublish), noteCount, sampleRate, minimumFrequencyHz);
-		}
-	});
+	// The overlay outlives every render callback: the destructor shuts down
+	// OpenGL before members are destroyed.
+	SPECTROSCOPE_TRACE_INSTANT("publishTrackedNotes posted");
+	trackedNotesOverlay_->post({ notes, noteCount, sampleRate, minimumFrequencyHz });
 }
 
 void SpectrogramWidget::updateTrackedNoteOverlay(const Spectrogram& analyzer)
@@ -710,16 +1318,15 @@ void SpectrogramWidget::updateTrackedNoteOverlay(const Spectrogram& analyzer)
 		return;
 	nextTrackedNoteUpdateMs_ = nowMs + 100.0;
 
+	// The analyzer's note list already holds frequencies, cents and note
+	// numbers, so nothing is re-derived from the drawn field.
 	constexpr int maximumDisplayedNotes = 6;
 	std::array<spectroscope::TrackedPitch, maximumDisplayedNotes> notes {};
-	const auto rowOffset = static_cast<size_t>(waterfallPosition_ * analyzer.pitchClassSize());
-	const auto noteCount = spectroscope::extractTrackedPitches(
-		pitchClassDataHistory_.data() + rowOffset, analyzer.pitchClassSize(),
-		concertAHz_.load(std::memory_order_relaxed), notes.data(), maximumDisplayedNotes);
+	const auto noteCount = analyzer.copyLatestTrackedNotes(notes.data(), maximumDisplayedNotes);
 	trackedNoteHistory_.update(notes.data(), noteCount, lastSequence_);
 
 	if (!horizontal_.load(std::memory_order_relaxed)) {
-		publishTrackedNotes(std::move(notes), noteCount, analyzer.sampleRate(),
+		publishTrackedNotes(notes, noteCount, analyzer.sampleRate(),
 			analyzer.sampleRate() / static_cast<double>(analyzer.fftSize()));
 	}
 }
@@ -727,6 +1334,16 @@ void SpectrogramWidget::updateTrackedNoteOverlay(const Spectrogram& analyzer)
 void SpectrogramWidget::releaseOpenGLResources()
 {
 	openGLReady_ = false;
+	passTimer_.release();
+	frameTimings_.active = false;
+	if (fullScreenVertexArray_ != 0) {
+		glDeleteVertexArrays(1, &fullScreenVertexArray_);
+		fullScreenVertexArray_ = 0;
+	}
+	if (noteVertexArray_ != 0) {
+		glDeleteVertexArrays(1, &noteVertexArray_);
+		noteVertexArray_ = 0;
+	}
 	if (vertexBuffer_ != 0) {
 		context_.extensions.glDeleteBuffers(1, &vertexBuffer_);
 		vertexBuffer_ = 0;
@@ -735,54 +1352,53 @@ void SpectrogramWidget::releaseOpenGLResources()
 		context_.extensions.glDeleteBuffers(1, &elements_);
 		elements_ = 0;
 	}
-	if (noteVertexBuffer_ != 0) {
-		context_.extensions.glDeleteBuffers(1, &noteVertexBuffer_);
-		noteVertexBuffer_ = 0;
-	}
-	if (noteElements_ != 0) {
-		context_.extensions.glDeleteBuffers(1, &noteElements_);
-		noteElements_ = 0;
-	}
 
 	if (textureLUT_ != nullptr)
 		textureLUT_->release();
-	if (spectrumData_ != nullptr)
-		spectrumData_->release();
 	if (spectrumHistory_ != nullptr)
 		spectrumHistory_->release();
-	if (pitchClassData_ != nullptr)
-		pitchClassData_->release();
-	if (pitchClassHistory_ != nullptr)
-		pitchClassHistory_->release();
+	if (fieldNoteHistory_ != nullptr)
+		fieldNoteHistory_->release();
+	if (axisMapping_ != nullptr)
+		axisMapping_->release();
 	if (noteAtlasTexture_ != nullptr)
 		noteAtlasTexture_->release();
+	shadedWaterfall_.release();
+	failedShadedWaterfallWidth_ = 0;
+	shadedWaterfallStale_.store(true, std::memory_order_release);
 	textureLUT_.reset();
-	spectrumData_.reset();
 	spectrumHistory_.reset();
-	pitchClassData_.reset();
-	pitchClassHistory_.reset();
+	fieldNoteHistory_.reset();
+	axisMapping_.reset();
 	noteAtlasTexture_.reset();
 
 	position_.reset();
 	resolution_.reset();
-	audioSampleData_.reset();
+	latestSpectrumPositionUniform_.reset();
+	waterfallValueOffsetUniform_.reset();
+	waterfallValueScaleUniform_.reset();
 	lutTexture_.reset();
 	waterfallTexture_.reset();
-	pitchClassDataUniform_.reset();
-	pitchClassHistoryUniform_.reset();
+	fieldNoteHistoryUniform_.reset();
+	latestFieldNoteRowUniform_.reset();
+	waterfallPassUniform_.reset();
+	shadedWaterfallUniform_.reset();
+	convertedValueOffsetUniform_.reset();
+	convertedValueScaleUniform_.reset();
+	fieldNoteCapacityUniform_.reset();
 	waterfallStartUniform_.reset();
 	waterfallSpanUniform_.reset();
-	logXAxis_.reset();
 	uUpperHalfPercentage_.reset();
 	uHorizontal_.reset();
 	uPitchColourMode_.reset();
-	uSampleRate_.reset();
-	uConcertAHz_.reset();
-	uMinimumFrequencyHz_.reset();
+	uTrackedAnalysisBinCount_.reset();
 	uSpectrumTexelWidth_.reset();
-	notePosition_.reset();
-	noteTextureCoordinate_.reset();
+	axisMappingUniform_.reset();
 	noteAtlasUniform_.reset();
+	noteRecordsUniform_.reset();
+	newestNoteRowUniform_.reset();
+	noteComponentSizeUniform_.reset();
+	noteRecordsUploaded_ = false;
 	noteShader_.reset();
 	noteOverlayReady_ = false;
 	shader_.reset();
@@ -790,6 +1406,7 @@ void SpectrogramWidget::releaseOpenGLResources()
 
 int SpectrogramWidget::pullAvailableFrames()
 {
+	SPECTROSCOPE_TRACE_SCOPE("SpectrogramWidget::pullAvailableFrames");
 	const auto analyzer = spectrogram_.lock();
 	if (analyzer == nullptr)
 		return 0;
@@ -800,29 +1417,62 @@ int SpectrogramWidget::pullAvailableFrames()
 	if (currentSequence == lastSequence_)
 		return 0;
 
+	// The analyzer copies spectra straight into the mapped upload segment.
+	auto* stagedSpectra = spectrumHistory_ != nullptr ? spectrumHistory_->beginUpload() : nullptr;
+	spectraStaged_ = stagedSpectra != nullptr;
+	const auto stagingSize = spectraStaged_ ? analyzer->spectrumSize() * maximumRowsPerRefresh
+		: static_cast<int>(pendingSpectra_.size());
 	std::uint64_t copiedSequence = 0;
-	const auto copiedRows = analyzer->copyAnalysisFramesAfter(lastSequence_,
-		pendingSpectra_.data(), static_cast<int>(pendingSpectra_.size()),
-		pendingPitchClasses_.data(), static_cast<int>(pendingPitchClasses_.size()),
+	const auto copiedRows = analyzer->copyFieldNoteFramesAfter(lastSequence_,
+		spectraStaged_ ? stagedSpectra : pendingSpectra_.data(), stagingSize,
+		pendingFieldNotes_.data(), static_cast<int>(pendingFieldNotes_.size()),
 		&copiedSequence);
-	if (copiedRows <= 0)
+	if (copiedRows <= 0) {
+		// The worker kept overwriting the rows being copied. They stay
+		// published, but without another frame an on-demand widget would not
+		// draw them before the next publish.
+		refreshRequested_.store(true, std::memory_order_release);
+		context_.triggerRepaint();
 		return 0;
-
-	for (int pendingRow = 0; pendingRow < copiedRows; ++pendingRow) {
-		waterfallPosition_ = spectroscope::waterfall::nextRow(waterfallPosition_, waterfallRows);
-		pendingTextureRows_[static_cast<size_t>(pendingRow)] = waterfallPosition_;
-		const auto sourceOffset = static_cast<size_t>(pendingRow * analyzer->spectrumSize());
-		const auto destinationOffset = static_cast<size_t>(waterfallPosition_ * analyzer->spectrumSize());
-		std::copy_n(pendingSpectra_.data() + sourceOffset, analyzer->spectrumSize(),
-			fftData_.data() + destinationOffset);
-		const auto sourcePitchOffset = static_cast<size_t>(pendingRow * analyzer->pitchClassSize());
-		const auto destinationPitchOffset = static_cast<size_t>(
-			waterfallPosition_ * analyzer->pitchClassSize());
-		std::copy_n(pendingPitchClasses_.data() + sourcePitchOffset, analyzer->pitchClassSize(),
-			pitchClassDataHistory_.data() + destinationPitchOffset);
 	}
 
+	firstPendingRow_ = spectroscope::waterfall::nextRow(waterfallPosition_, waterfallRows);
+	waterfallPosition_ = (waterfallPosition_ + copiedRows) % waterfallRows;
+
 	lastSequence_ = copiedSequence;
 	updateTrackedNoteOverlay(*analyzer);
 	return copiedRows;
 }
+
+// The widget keeps no CPU copy of its textures. A new context refills them
+// from the rows the analyzer still retains; rows published since the last
+// pull advance the waterfall as they would have. This one-off staging is
+// freed again before the first frame.
+void SpectrogramWidget::restoreHistory(const Spectrogram& analyzer)
+{
+	const auto restoredRows = std::min(waterfallRows, Spectrogram::spectrumHistoryCapacity);
+	std::vector<GLfloat> spectra(static_cast<size_t>(analyzer.spectrumSize() * restoredRows));
+	std::vector<GLfloat> fieldNotes(static_cast<size_t>(analyzer.fieldNoteRowSize() * restoredRows));
+	std::uint64_t copiedSequence = 0;
+	const auto copiedRows = analyzer.copyFieldNoteFramesAfter(0,
+		spectra.data(), static_cast<int>(spectra.size()),
+		fieldNotes.data(), static_cast<int>(fieldNotes.size()), &copiedSequence);
+	if (copiedRows <= 0)
+		return;
+
+	// Rows published while there was no context still scroll the waterfall,
+	// so the restored ones land where a continuous render would have put them.
+	if (lastSequence_ > 0 && copiedSequence > lastSequence_) {
+		const auto newRows = std::min(copiedSequence - lastSequence_, static_cast<std::uint64_t>(waterfallRows));
+		waterfallPosition_ = (waterfallPosition_ + static_cast<int>(newRows)) % waterfallRows;
+	}
+	const auto firstRow = (waterfallPosition_ - copiedRows + 1 + waterfallRows) % waterfallRows;
+	context_.extensions.glActiveTexture(GL_TEXTURE2);
+	spectrumHistory_->loadRows(spectra.data(), analyzer.spectrumSize(), firstRow, copiedRows, waterfallRows);
+	context_.extensions.glActiveTexture(GL_TEXTURE3);
+	fieldNoteHistory_->loadRows(fieldNotes.data(), analyzer.fieldNoteRowSize() / 2, firstRow, copiedRows,
+		waterfallRows);
+	context_.extensions.glActiveTexture(GL_TEXTURE0);
+	lastSequence_ = copiedSequence;
+	shadedWaterfallStale_.store(true, std::memory_order_release);
+}
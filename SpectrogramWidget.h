@@ -8,7 +8,10 @@
 
 #include <juce_gui_basics/juce_gui_basics.h>
 
+#include "FrameTiming.h"
+#include "FrequencyAxis.h"
 #include "OpenGLFloatTexture.h"
+#include "OpenGLPassTimer.h"
 #include "ShaderBasedComponent.h"
 #include "Spectrogram.h"
 #include "TrackedNoteDisplay.h"
@@ -19,7 +22,8 @@
 #include <cstdint>
 #include <memory>
 
-class SpectrogramWidget final : public ShaderBasedComponent {
+class SpectrogramWidget final : public ShaderBasedComponent, private Spectrogram::PublishListener,
+	private juce::AsyncUpdater {
 public:
 	explicit SpectrogramWidget(std::weak_ptr<Spectrogram> spectrogram);
 	~SpectrogramWidget() override;
@@ -32,82 +36,202 @@ public:
 	// Safe to call from a non-OpenGL thread. The actual snapshot transfer and
 	// history update happen on the OpenGL render thread.
 	void refreshData();
+	// Instead of redrawing on every display refresh, redraws only when the
+	// analyzer publishes rows, a setting changes or the component needs
+	// repainting, so an idle display costs no GPU or render-thread time.
+	// Turns continuous redrawing off; falls back to it when the analyzer has
+	// no free listener slot. Disabling only stops the wakeups. The widget
+	// listens to the analyzer only while its OpenGL context exists.
+	void setRenderOnDemand(bool enabled);
 
 	void setXAxis(bool logAxis);
 	void setHorizontalMode(bool horizontal);
+	// Opt-in for applications where this widget is the analyzer's only
+	// consumer. While enabled the widget owns the analyzer's pitch-tracking
+	// and pitch-field switches. It turns pitch tracking off whenever neither
+	// pitch colours nor the note overlay show tracked pitch, and the dense
+	// field off for good, since its shader evaluates the field from field
+	// notes. Disabling it, or destroying the widget, restores both switches
+	// to their state before it was enabled.
+	void setAnalysisStageGating(bool enabled);
 	void setPitchColourMode(bool enabled);
 	void setTrackedNoteOverlayEnabled(bool enabled);
 	void setPitchTrackingPreset(PitchTracker::Preset preset);
 	void setConcertAHz(float frequencyHz);
+	// Storage of the waterfall texture. Half floats by default, which halve
+	// its memory and upload bandwidth against float32 without visible loss;
+	// unorm8 quarters them at 0.4 dB steps for the default 100 dB range.
+	// Switching converts the whole history on the GPU, requantizing it to
+	// the new format; without a usable framebuffer only the analyzer's
+	// retained rows are restored.
+	void setWaterfallFormat(OpenGLFloatTexture::Format format);
+	// Keeps the shaded waterfall in a framebuffer ring with one row per
+	// history row, so each frame only shades its new rows and the screen is
+	// composited from the ring. On by default; without a usable framebuffer
+	// every pixel is shaded each frame as before.
+	void setIncrementalWaterfall(bool enabled);
+	// Opt-in frame cost instrumentation. While enabled the render thread
+	// times its frame, pullAvailableFrames() and the uploads on the CPU, and
+	// the uploads, row shading, waterfall draw and note overlay on the GPU
+	// where timer queries exist. Showing the overlay enables it. Statistics
+	// are read on the message thread and are at most about 100 ms old.
+	void setFrameStatisticsEnabled(bool enabled);
+	void setFrameStatisticsOverlayVisible(bool visible);
+	spectroscope::frame_timing::FrameStatistics getFrameStatistics() const;
+	juce::String getFrameStatisticsSummary() const;
 	bool isOpenGLReady() const noexcept;
 
 private:
 	class TrackedNotesOverlay;
+	class FrameStatisticsOverlay;
+
+	static constexpr int timedPassCount = 4;
+
+	// Rolling windows of the render thread's measurements; the GPU windows
+	// are indexed by timed pass.
+	struct FrameTimings {
+		spectroscope::frame_timing::RollingWindow frameInterval;
+		spectroscope::frame_timing::RollingWindow renderCpu;
+		spectroscope::frame_timing::RollingWindow pullFramesCpu;
+		spectroscope::frame_timing::RollingWindow uploadsCpu;
+		std::array<spectroscope::frame_timing::RollingWindow, timedPassCount> gpuPasses;
+		double frameStartMs { 0.0 };
+		double previousFrameStartMs { 0.0 };
+		double nextPublishMs { 0.0 };
+		bool active { false };
+	};
 
 	std::shared_ptr<juce::OpenGLTexture> createColorLookupTexture();
-	std::shared_ptr<OpenGLFloatTexture> createDataTexture(int width, int height, float initialValue);
+	void createWaterfallTexture(const Spectrogram& analyzer);
+	bool convertWaterfall(const OpenGLFloatTexture& source);
+	std::shared_ptr<OpenGLFloatTexture> createDataTexture(int width, int height, float initialValue,
+		int channels = 1);
 	static juce::Image createNoteAtlasImage();
 	bool createNoteOverlayResources();
-	void renderHorizontalNoteHistory(double sampleRate, double minimumFrequencyHz);
+	bool createFullScreenGeometry();
+	void renderHorizontalNoteHistory();
+	void updateNoteRecords();
 	void publishStatus(juce::String statusText);
-	void publishTrackedNotes(std::array<spectroscope::TrackedPitch, 6> notes, int noteCount,
+	void publishTrackedNotes(const std::array<spectroscope::TrackedPitch, 6>& notes, int noteCount,
 		double sampleRate, double minimumFrequencyHz);
 	void updateTrackedNoteOverlay(const Spectrogram& analyzer);
+	void updateAnalysisStages();
 	void releaseOpenGLResources();
 	int pullAvailableFrames();
+	void restoreHistory(const Spectrogram& analyzer);
+	void rowsPublished(std::uint64_t newestSequence) noexcept override;
+	void updatePublishListener(bool listening);
+	void handleAsyncUpdate() override;
+	void updateAxisMapping(int axisPixels);
+	bool updateShadedWaterfall(int axisPixels, int newRows);
+	void drawFullScreenQuad();
+	bool beginFrameTiming();
+	void beginTimedPass(bool timing, int pass);
+	void endTimedPass(bool timing);
+	void endFrameTiming();
 
 	std::weak_ptr<Spectrogram> spectrogram_;
 
+	// The full-screen quad never changes, so its buffers and attribute
+	// layout are recorded once in a vertex array. Note cards have no vertex
+	// data at all; the note shader expands each instance's record into a quad.
+	GLuint fullScreenVertexArray_ { 0 };
+	GLuint noteVertexArray_ { 0 };
 	GLuint vertexBuffer_ { 0 };
 	GLuint elements_ { 0 };
-	GLuint noteVertexBuffer_ { 0 };
-	GLuint noteElements_ { 0 };
+	// The vertex array JUCE renders with, bound again after every draw.
+	GLuint contextVertexArray_ { 0 };
 	std::shared_ptr<juce::OpenGLTexture> textureLUT_;
 	std::shared_ptr<juce::OpenGLTexture> noteAtlasTexture_;
-	std::shared_ptr<OpenGLFloatTexture> spectrumData_;
 	std::shared_ptr<OpenGLFloatTexture> spectrumHistory_;
-	std::shared_ptr<OpenGLFloatTexture> pitchClassData_;
-	std::shared_ptr<OpenGLFloatTexture> pitchClassHistory_;
+	// One row of field-note records per waterfall row: a (count, sigma) header
+	// texel followed by a (position, strength) texel per tracked note.
+	std::shared_ptr<OpenGLFloatTexture> fieldNoteHistory_;
+	// Waterfall colours by history row and frequency axis pixel, in the
+	// waterfall texture's row order.
+	juce::OpenGLFrameBuffer shadedWaterfall_;
+	// Frequency, tracked-pitch position, hue and tuning saturation per
+	// frequency-axis pixel.
+	std::shared_ptr<OpenGLFloatTexture> axisMapping_;
+	std::vector<spectroscope::frequency_axis::ColumnMapping> axisColumns_;
+	spectroscope::frequency_axis::ColumnParameters axisMappingParameters_;
+	int axisMappingPixels_ { 0 };
+	int failedShadedWaterfallWidth_ { 0 };
 
 	std::unique_ptr<juce::OpenGLShaderProgram> shader_;
 	std::unique_ptr<juce::OpenGLShaderProgram::Attribute> position_;
 	std::unique_ptr<juce::OpenGLShaderProgram> noteShader_;
-	std::unique_ptr<juce::OpenGLShaderProgram::Attribute> notePosition_;
-	std::unique_ptr<juce::OpenGLShaderProgram::Attribute> noteTextureCoordinate_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> noteAtlasUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> noteRecordsUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> newestNoteRowUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> noteComponentSizeUniform_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> resolution_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> audioSampleData_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> latestSpectrumPositionUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallValueOffsetUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallValueScaleUniform_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> lutTexture_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallTexture_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> pitchClassDataUniform_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> pitchClassHistoryUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> fieldNoteHistoryUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> latestFieldNoteRowUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallPassUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> shadedWaterfallUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> convertedValueOffsetUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> convertedValueScaleUniform_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> fieldNoteCapacityUniform_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallStartUniform_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> waterfallSpanUniform_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> logXAxis_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uUpperHalfPercentage_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uHorizontal_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uPitchColourMode_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uSampleRate_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uConcertAHz_;
-	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uMinimumFrequencyHz_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uTrackedAnalysisBinCount_;
 	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> uSpectrumTexelWidth_;
+	std::shared_ptr<juce::OpenGLShaderProgram::Uniform> axisMappingUniform_;
 
-	std::vector<GLfloat> fftData_;
+	// New spectrum rows are copied straight into the waterfall's mapped upload
+	// stream; this buffer only stages them when no stream could be mapped and
+	// stays empty otherwise.
 	std::vector<GLfloat> pendingSpectra_;
-	std::vector<GLfloat> pitchClassDataHistory_;
-	std::vector<GLfloat> pendingPitchClasses_;
-	std::vector<GLfloat> noteVertices_;
-	std::vector<GLuint> noteIndices_;
-	std::array<int, 32> pendingTextureRows_ {};
+	bool spectraStaged_ { false };
+	std::vector<GLfloat> pendingFieldNotes_;
+	// One (MIDI note, anchor row, frequency axis position, tracking) record
+	// per note card, with anchor rows counted from noteRecordBaseSequence_.
+	// They are uploaded only when the history or the axis changes.
+	std::array<GLfloat, spectroscope::TrackedNoteHistory::capacity * 4> noteRecords_ {};
+	int noteRecordCount_ { 0 };
+	std::uint64_t noteRecordBaseSequence_ { 0 };
+	std::uint64_t noteRecordRevision_ { 0 };
+	spectroscope::frequency_axis::ColumnParameters noteRecordAxis_;
+	bool noteRecordsUploaded_ { false };
+	FrameTimings frameTimings_;
+	OpenGLPassTimer passTimer_;
+	std::atomic<bool> frameStatisticsEnabled_ { false };
+	// Rows pulled for the current frame occupy consecutive texture rows from
+	// here on, wrapping at the end of the history.
+	int firstPendingRow_ { 0 };
 	int waterfallPosition_ { 0 };
 	std::uint64_t lastSequence_ { 0 };
 	std::atomic<bool> refreshRequested_ { true };
+	std::atomic<bool> renderOnDemand_ { false };
+	// Render thread only.
+	bool publishListenerRegistered_ { false };
+	// Set by the render thread when the analyzer had no free listener slot;
+	// the message thread then falls back to continuous redrawing.
+	std::atomic<bool> publishListenerUnavailable_ { false };
 	std::atomic<bool> xLogAxis_ { true };
 	std::atomic<bool> horizontal_ { false };
 	std::atomic<bool> pitchColourMode_ { false };
 	std::atomic<bool> trackedNoteOverlayEnabled_ { false };
+	// Message thread only.
+	bool analysisStageGating_ { false };
+	bool pitchTrackingBeforeGating_ { true };
+	bool pitchFieldBeforeGating_ { true };
 	std::atomic<bool> clearTrackedNoteHistoryRequested_ { false };
 	std::atomic<float> concertAHz_ { 440.0f };
+	std::atomic<OpenGLFloatTexture::Format> waterfallFormat_ { OpenGLFloatTexture::Format::float16 };
+	std::atomic<bool> waterfallFormatChanged_ { false };
+	std::atomic<bool> incrementalWaterfall_ { true };
+	// Set whenever already shaded rows would look different now.
+	std::atomic<bool> shadedWaterfallStale_ { true };
 	float upperHalfPercentage_ { 0.618f };
 	std::atomic<bool> openGLReady_ { false };
 	double nextTrackedNoteUpdateMs_ { 0.0 };
@@ -117,6 +241,7 @@ private:
 
 	juce::Label statusLabel_;
 	std::unique_ptr<TrackedNotesOverlay> trackedNotesOverlay_;
+	std::unique_ptr<FrameStatisticsOverlay> frameStatisticsOverlay_;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrogramWidget)
 };
@@ -0,0 +1,356 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "SpectroscopeTrace.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace spectroscope::trace {
+namespace {
+constexpr std::int64_t instantDuration = -1;
+
+struct StoredEvent {
+	std::atomic<const char*> name { nullptr };
+	std::atomic<std::int64_t> startNanoseconds { 0 };
+	std::atomic<std::int64_t> durationNanoseconds { 0 };
+};
+
+// A single-writer ring. begun is advanced before a slot is overwritten and
+// written after it is complete, so a concurrent snapshot can discard any slot
+// that may have been reused while it was being copied.
+struct ThreadBuffer {
+	std::atomic<const char*> threadName { nullptr };
+	std::atomic<std::uint64_t> begun { 0 };
+	std::atomic<std::uint64_t> written { 0 };
+	std::array<StoredEvent, eventsPerThread> events;
+};
+
+struct SnapshotEvent {
+	const char* name;
+	std::int64_t startNanoseconds;
+	std::int64_t durationNanoseconds;
+	int thread;
+};
+
+struct Snapshot {
+	std::vector<const char*> threadNames;
+	std::vector<SnapshotEvent> events;
+};
+
+std::array<ThreadBuffer, maximumThreads> threadBuffers;
+std::atomic<int> registeredThreads { 0 };
+std::atomic<std::uint64_t> droppedEventCount { 0 };
+thread_local ThreadBuffer* currentThreadBuffer = nullptr;
+thread_local bool currentThreadUnregistered = false;
+
+ThreadBuffer* bufferForCurrentThread() noexcept
+{
+	if (currentThreadBuffer != nullptr || currentThreadUnregistered)
+		return currentThreadBuffer;
+
+	const auto slot = registeredThreads.fetch_add(1, std::memory_order_acq_rel);
+	if (slot >= maximumThreads) {
+		registeredThreads.store(maximumThreads, std::memory_order_release);
+		currentThreadUnregistered = true;
+		return nullptr;
+	}
+	currentThreadBuffer = &threadBuffers[static_cast<std::size_t>(slot)];
+	return currentThreadBuffer;
+}
+
+void record(const char* name, std::int64_t startNanoseconds, std::int64_t durationNanoseconds) noexcept
+{
+	auto* buffer = bufferForCurrentThread();
+	if (buffer == nullptr || name == nullptr) {
+		droppedEventCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const auto index = buffer->written.load(std::memory_order_relaxed);
+	buffer->begun.store(index + 1, std::memory_order_relaxed);
+	// Release stores keep begun ordered before the slot contents without a
+	// standalone fence, which ThreadSanitizer cannot model.
+	auto& event = buffer->events[static_cast<std::size_t>(index % eventsPerThread)];
+	event.name.store(name, std::memory_order_release);
+	event.startNanoseconds.store(startNanoseconds, std::memory_order_release);
+	event.durationNanoseconds.store(durationNanoseconds, std::memory_order_release);
+	buffer->written.store(index + 1, std::memory_order_release);
+}
+
+Snapshot takeSnapshot()
+{
+	Snapshot snapshot;
+	const auto threadCount = std::min(maximumThreads,
+		registeredThreads.load(std::memory_order_acquire));
+	snapshot.threadNames.resize(static_cast<std::size_t>(threadCount), nullptr);
+	for (int thread = 0; thread < threadCount; ++thread) {
+		auto& buffer = threadBuffers[static_cast<std::size_t>(thread)];
+		snapshot.threadNames[static_cast<std::size_t>(thread)] =
+			buffer.threadName.load(std::memory_order_relaxed);
+
+		const auto written = buffer.written.load(std::memory_order_acquire);
+		const auto first = written > eventsPerThread ? written - eventsPerThread : 0;
+		const auto copiedFrom = snapshot.events.size();
+		for (auto index = first; index < written; ++index) {
+			const auto& event = buffer.events[static_cast<std::size_t>(index % eventsPerThread)];
+			snapshot.events.push_back({ event.name.load(std::memory_order_acquire),
+				event.startNanoseconds.load(std::memory_order_acquire),
+				event.durationNanoseconds.load(std::memory_order_acquire), thread });
+		}
+
+		const auto begun = buffer.begun.load(std::memory_order_relaxed);
+		const auto firstIntact = begun > eventsPerThread ? begun - eventsPerThread : 0;
+		if (firstIntact > first) {
+			const auto overwritten = std::min<std::uint64_t>(firstIntact - first, written - first);
+			snapshot.events.erase(snapshot.events.begin() + static_cast<std::ptrdiff_t>(copiedFrom),
+				snapshot.events.begin() + static_cast<std::ptrdiff_t>(copiedFrom + overwritten));
+		}
+	}
+	return snapshot;
+}
+
+void writeJsonString(std::ostream& output, const char* text)
+{
+	output << '"';
+	for (const auto* character = text; character != nullptr && *character != '\0'; ++character) {
+		if (*character == '"' || *character == '\\')
+			output << '\\';
+		if (static_cast<unsigned char>(*character) >= 0x20)
+			output << *character;
+	}
+	output << '"';
+}
+
+std::string fallbackThreadName(int thread)
+{
+	return "Thread " + std::to_string(thread + 1);
+}
+
+void appendVarint(std::string& output, std::uint64_t value)
+{
+	while (value >= 0x80) {
+		output.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	output.push_back(static_cast<char>(value));
+}
+
+void appendVarintField(std::string& output, int field, std::uint64_t value)
+{
+	appendVarint(output, static_cast<std::uint64_t>(field) << 3);
+	appendVarint(output, value);
+}
+
+void appendBytesField(std::string& output, int field, const std::string& bytes)
+{
+	appendVarint(output, (static_cast<std::uint64_t>(field) << 3) | 2);
+	appendVarint(output, bytes.size());
+	output += bytes;
+}
+
+// Field numbers follow perfetto/protos/perfetto/trace/trace_packet.proto and
+// track_event/{track_event,track_descriptor,thread_descriptor}.proto.
+namespace perfetto_field {
+constexpr int tracePacket = 1;
+constexpr int timestamp = 8;
+constexpr int trustedPacketSequenceId = 10;
+constexpr int trackEvent = 11;
+constexpr int trackDescriptor = 60;
+constexpr int trackUuid = 1;
+constexpr int trackThread = 4;
+constexpr int threadPid = 1;
+constexpr int threadTid = 2;
+constexpr int threadName = 5;
+constexpr int eventType = 9;
+constexpr int eventTrackUuid = 11;
+constexpr int eventName = 23;
+constexpr std::uint64_t sliceBegin = 1;
+constexpr std::uint64_t sliceEnd = 2;
+constexpr std::uint64_t instant = 3;
+}
+
+constexpr std::uint64_t tracedProcessId = 1;
+constexpr std::uint64_t sequenceId = 1;
+
+std::uint64_t trackUuidForThread(int thread)
+{
+	return static_cast<std::uint64_t>(thread) + 1;
+}
+
+void appendTrackEventPacket(std::string& trace, std::int64_t timestamp, std::uint64_t type,
+	int thread, const char* name)
+{
+	std::string event;
+	appendVarintField(event, perfetto_field::eventType, type);
+	appendVarintField(event, perfetto_field::eventTrackUuid, trackUuidForThread(thread));
+	if (name != nullptr)
+		appendBytesField(event, perfetto_field::eventName, name);
+
+	std::string packet;
+	appendVarintField(packet, perfetto_field::timestamp, static_cast<std::uint64_t>(std::max<std::int64_t>(0, timestamp)));
+	appendBytesField(packet, perfetto_field::trackEvent, event);
+	appendVarintField(packet, perfetto_field::trustedPacketSequenceId, sequenceId);
+	appendBytesField(trace, perfetto_field::tracePacket, packet);
+}
+}
+
+void setCurrentThreadName(const char* name) noexcept
+{
+	if (auto* buffer = bufferForCurrentThread())
+		buffer->threadName.store(name, std::memory_order_relaxed);
+}
+
+std::int64_t nowNanoseconds() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void recordComplete(const char* name, std::int64_t startNanoseconds, std::int64_t endNanoseconds) noexcept
+{
+	record(name, startNanoseconds, std::max<std::int64_t>(0, endNanoseconds - startNanoseconds));
+}
+
+void recordInstant(const char* name) noexcept
+{
+	record(name, nowNanoseconds(), instantDuration);
+}
+
+void clear() noexcept
+{
+	for (auto& buffer : threadBuffers) {
+		buffer.begun.store(0, std::memory_order_relaxed);
+		buffer.written.store(0, std::memory_order_release);
+	}
+	droppedEventCount.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t droppedEvents() noexcept
+{
+	return droppedEventCount.load(std::memory_order_relaxed);
+}
+
+bool writeChromeJson(std::ostream& output)
+{
+	const auto snapshot = takeSnapshot();
+	auto origin = snapshot.events.empty() ? std::int64_t { 0 } : snapshot.events.front().startNanoseconds;
+	for (const auto& event : snapshot.events)
+		origin = std::min(origin, event.startNanoseconds);
+
+	output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	output << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << tracedProcessId
+		<< ",\"args\":{\"name\":\"juce-spectroscope\"}}";
+	for (std::size_t thread = 0; thread < snapshot.threadNames.size(); ++thread) {
+		const auto* name = snapshot.threadNames[thread];
+		const auto fallbackName = fallbackThreadName(static_cast<int>(thread));
+		output << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << tracedProcessId
+			<< ",\"tid\":" << thread + 1 << ",\"args\":{\"name\":";
+		writeJsonString(output, name != nullptr ? name : fallbackName.c_str());
+		output << "}}";
+	}
+
+	output << std::fixed << std::setprecision(3);
+	for (const auto& event : snapshot.events) {
+		output << ",\n{\"name\":";
+		writeJsonString(output, event.name);
+		output << ",\"cat\":\"spectroscope\",\"pid\":" << tracedProcessId
+			<< ",\"tid\":" << event.thread + 1
+			<< ",\"ts\":" << static_cast<double>(event.startNanoseconds - origin) / 1000.0;
+		if (event.durationNanoseconds == instantDuration)
+			output << ",\"ph\":\"i\",\"s\":\"t\"}";
+		else
+			output << ",\"ph\":\"X\",\"dur\":" << static_cast<double>(event.durationNanoseconds) / 1000.0 << '}';
+	}
+	output << "\n]}\n";
+	return static_cast<bool>(output);
+}
+
+bool writePerfettoProtobuf(std::ostream& output)
+{
+	const auto snapshot = takeSnapshot();
+	std::string trace;
+	for (std::size_t thread = 0; thread < snapshot.threadNames.size(); ++thread) {
+		const auto* name = snapshot.threadNames[thread];
+		std::string threadDescriptor;
+		appendVarintField(threadDescriptor, perfetto_field::threadPid, tracedProcessId);
+		appendVarintField(threadDescriptor, perfetto_field::threadTid, thread + 1);
+		appendBytesField(threadDescriptor, perfetto_field::threadName,
+			name != nullptr ? std::string(name) : fallbackThreadName(static_cast<int>(thread)));
+
+		std::string trackDescriptor;
+		appendVarintField(trackDescriptor, perfetto_field::trackUuid,
+			trackUuidForThread(static_cast<int>(thread)));
+		appendBytesField(trackDescriptor, perfetto_field::trackThread, threadDescriptor);
+
+		std::string packet;
+		appendBytesField(packet, perfetto_field::trackDescriptor, trackDescriptor);
+		appendVarintField(packet, perfetto_field::trustedPacketSequenceId, sequenceId);
+		appendBytesField(trace, perfetto_field::tracePacket, packet);
+	}
+
+	// Complete events are recorded when a scope ends, so inner scopes precede
+	// their parents. Slice begin and end markers must be emitted in time order
+	// with enclosing slices opening first and closing last.
+	struct Marker {
+		std::int64_t timestamp;
+		std::int64_t duration;
+		std::uint64_t type;
+		int thread;
+		const char* name;
+	};
+	std::vector<Marker> markers;
+	markers.reserve(snapshot.events.size() * 2);
+	for (const auto& event : snapshot.events) {
+		if (event.durationNanoseconds == instantDuration) {
+			markers.push_back({ event.startNanoseconds, 0, perfetto_field::instant,
+				event.thread, event.name });
+			continue;
+		}
+		markers.push_back({ event.startNanoseconds, event.durationNanoseconds,
+			perfetto_field::sliceBegin, event.thread, event.name });
+		markers.push_back({ event.startNanoseconds + event.durationNanoseconds,
+			event.durationNanoseconds, perfetto_field::sliceEnd, event.thread, nullptr });
+	}
+	std::stable_sort(markers.begin(), markers.end(), [](const Marker& first, const Marker& second) {
+		if (first.timestamp != second.timestamp)
+			return first.timestamp < second.timestamp;
+		const auto firstEnds = first.type == perfetto_field::sliceEnd;
+		const auto secondEnds = second.type == perfetto_field::sliceEnd;
+		if (firstEnds != secondEnds)
+			return firstEnds;
+		return firstEnds ? first.duration < second.duration : first.duration > second.duration;
+	});
+	for (const auto& marker : markers)
+		appendTrackEventPacket(trace, marker.timestamp, marker.type, marker.thread, marker.name);
+
+	output.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+	return static_cast<bool>(output);
+}
+
+bool writeToFile(const char* path)
+{
+	if (path == nullptr)
+		return false;
+
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	if (!output)
+		return false;
+
+	const auto length = std::strlen(path);
+	const auto isJson = length >= 5 && std::strcmp(path + length - 5, ".json") == 0;
+	return isJson ? writeChromeJson(output) : writePerfettoProtobuf(output);
+}
+
+}
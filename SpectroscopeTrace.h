@@ -0,0 +1,73 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+// Timeline recorder for analysis, render, and message-thread hitches. Each
+// thread writes into its own preallocated ring of events, so recording never
+// allocates or locks and is safe on an audio callback. The SPECTROSCOPE_TRACE_*
+// macros compile to nothing unless JUCE_SPECTROSCOPE_TRACING is enabled.
+namespace spectroscope::trace {
+
+constexpr int maximumThreads = 16;
+constexpr int eventsPerThread = 8192;
+
+// Event and thread names must be string literals or otherwise outlive the trace.
+void setCurrentThreadName(const char* name) noexcept;
+std::int64_t nowNanoseconds() noexcept;
+void recordComplete(const char* name, std::int64_t startNanoseconds, std::int64_t endNanoseconds) noexcept;
+void recordInstant(const char* name) noexcept;
+
+// Discards recorded events but keeps thread registrations and names. Call only
+// while no traced thread is running.
+void clear() noexcept;
+std::uint64_t droppedEvents() noexcept;
+
+// Snapshots may be taken while threads keep recording; events overwritten
+// during the snapshot are omitted rather than reported torn.
+bool writeChromeJson(std::ostream& output);
+bool writePerfettoProtobuf(std::ostream& output);
+// Chooses Chrome JSON for a .json path and Perfetto protobuf otherwise.
+bool writeToFile(const char* path);
+
+class ScopedEvent {
+public:
+	explicit ScopedEvent(const char* name) noexcept
+		: name_(name), startNanoseconds_(nowNanoseconds())
+	{
+	}
+
+	~ScopedEvent()
+	{
+		recordComplete(name_, startNanoseconds_, nowNanoseconds());
+	}
+
+	ScopedEvent(const ScopedEvent&) = delete;
+	ScopedEvent& operator=(const ScopedEvent&) = delete;
+
+private:
+	const char* name_;
+	std::int64_t startNanoseconds_;
+};
+
+}
+
+#define SPECTROSCOPE_TRACE_JOIN_INNER(first, second) first##second
+#define SPECTROSCOPE_TRACE_JOIN(first, second) SPECTROSCOPE_TRACE_JOIN_INNER(first, second)
+
+#if JUCE_SPECTROSCOPE_TRACING
+#define SPECTROSCOPE_TRACE_SCOPE(name) \
+	const spectroscope::trace::ScopedEvent SPECTROSCOPE_TRACE_JOIN(spectroscopeTraceScope, __LINE__)(name)
+#define SPECTROSCOPE_TRACE_INSTANT(name) spectroscope::trace::recordInstant(name)
+#define SPECTROSCOPE_TRACE_THREAD_NAME(name) spectroscope::trace::setCurrentThreadName(name)
+#else
+#define SPECTROSCOPE_TRACE_SCOPE(name) static_cast<void>(0)
+#define SPECTROSCOPE_TRACE_INSTANT(name) static_cast<void>(0)
+#define SPECTROSCOPE_TRACE_THREAD_NAME(name) static_cast<void>(0)
+#endif
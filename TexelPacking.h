@@ -0,0 +1,84 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Conversions of float texels into the packed texture formats, kept free of
+// OpenGL so they can be tested without a context.
+namespace spectroscope::texel_packing {
+
+// IEEE 754 binary16 with round to nearest even, including subnormals. Values
+// beyond the largest half float become infinity; NaN stays NaN.
+inline std::uint16_t toHalf(float value) noexcept
+{
+	std::uint32_t bits = 0;
+	std::memcpy(&bits, &value, sizeof(bits));
+	const auto sign = static_cast<std::uint32_t>((bits >> 16) & 0x8000u);
+	const auto biasedExponent = static_cast<int>((bits >> 23) & 0xffu);
+	auto mantissa = bits & 0x7fffffu;
+	if (biasedExponent == 0xff)
+		return static_cast<std::uint16_t>(sign | 0x7c00u | (mantissa != 0 ? 0x200u : 0u));
+
+	const auto exponent = biasedExponent - 127 + 15;
+	if (exponent >= 31)
+		return static_cast<std::uint16_t>(sign | 0x7c00u);
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return static_cast<std::uint16_t>(sign);
+		mantissa |= 0x800000u;
+		const auto shift = static_cast<std::uint32_t>(14 - exponent);
+		auto half = mantissa >> shift;
+		const auto remainder = mantissa & ((1u << shift) - 1u);
+		const auto halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (half & 1u) != 0))
+			++half;
+		return static_cast<std::uint16_t>(sign | half);
+	}
+
+	// A carry out of the mantissa correctly rounds up into the exponent.
+	auto half = (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+	const auto remainder = mantissa & 0x1fffu;
+	if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u) != 0))
+		++half;
+	return static_cast<std::uint16_t>(sign | half);
+}
+
+// Maps the values between lowestValue and highestValue linearly onto
+// [0, 1], clamped, as the normalized formats store them.
+class UnormRange {
+public:
+	UnormRange(float lowestValue, float highestValue) noexcept
+		: lowestValue_(lowestValue)
+		, scale_(1.0f / (highestValue - lowestValue))
+	{
+	}
+
+	float normalised(float value) const noexcept
+	{
+		return std::clamp((value - lowestValue_) * scale_, 0.0f, 1.0f);
+	}
+
+	std::uint16_t toUnorm16(float value) const noexcept
+	{
+		return static_cast<std::uint16_t>(std::lround(normalised(value) * 65535.0f));
+	}
+
+	std::uint8_t toUnorm8(float value) const noexcept
+	{
+		return static_cast<std::uint8_t>(std::lround(normalised(value) * 255.0f));
+	}
+
+private:
+	float lowestValue_;
+	float scale_;
+};
+
+} // namespace spectroscope::texel_packing
@@ -161,6 +161,7 @@ public:
 			clear();
 
 		std::array<bool, capacity> claimedSlots {};
+		auto changed = false;
 		const auto validNoteCount = notes != nullptr ? std::max(0, noteCount) : 0;
 		for (int noteIndex = 0; noteIndex < validNoteCount; ++noteIndex) {
 			const auto& note = notes[noteIndex];
@@ -172,8 +173,10 @@ public:
 				continue;
 
 			auto& slot = slots_[static_cast<std::size_t>(slotIndex)];
-			if (!continuingTrack || slot.note.confidence < note.confidence)
+			if (!continuingTrack || slot.note.confidence < note.confidence) {
 				slot.note = note;
+				changed = true;
+			}
 			slot.sequence = newestSequence;
 			slot.occupied = true;
 			slot.tracking = true;
@@ -189,9 +192,12 @@ public:
 					slot.tracking = false;
 					slot.sequence = newestSequence;
 				}
+				changed = true;
 			}
 		}
 		latestUpdateSequence_ = newestSequence;
+		if (changed)
+			++revision_;
 	}
 
 	int visibleEntries(std::uint64_t newestSequence, int historyRowCount,
@@ -228,11 +234,54 @@ public:
 		return count;
 	}
 
+	// Every card with the row it is anchored to, in visibleEntries()' paint
+	// order and including cards older than the history. A tracking card
+	// follows the newest row and its anchorSequence has no meaning. Nothing
+	// here changes unless revision() does, so a renderer can keep the cards
+	// on the GPU and scroll them by the newest sequence alone.
+	struct AnchoredEntry {
+		TrackedPitch note;
+		std::uint64_t anchorSequence { 0 };
+		bool tracking { false };
+		int slotIndex { -1 };
+	};
+
+	int anchoredEntries(AnchoredEntry* destination, int destinationCapacity) const noexcept
+	{
+		if (destination == nullptr || destinationCapacity <= 0)
+			return 0;
+
+		auto count = 0;
+		for (int slotIndex = 0; slotIndex < capacity && count < destinationCapacity; ++slotIndex) {
+			const auto& slot = slots_[static_cast<std::size_t>(slotIndex)];
+			if (slot.occupied)
+				destination[count++] = { slot.note, slot.tracking ? 0 : slot.sequence, slot.tracking, slotIndex };
+		}
+
+		std::sort(destination, destination + count,
+			[](const AnchoredEntry& first, const AnchoredEntry& second) {
+				if (first.note.confidence < second.note.confidence)
+					return true;
+				if (second.note.confidence < first.note.confidence)
+					return false;
+				if (first.tracking != second.tracking)
+					return second.tracking;
+				return !first.tracking && first.anchorSequence < second.anchorSequence;
+			});
+		return count;
+	}
+
+	std::uint64_t revision() const noexcept
+	{
+		return revision_;
+	}
+
 	void clear() noexcept
 	{
 		for (auto& slot : slots_)
 			slot = {};
 		latestUpdateSequence_ = 0;
+		++revision_;
 	}
 
 private:
@@ -287,6 +336,7 @@ private:
 
 	std::array<Slot, capacity> slots_ {};
 	std::uint64_t latestUpdateSequence_ { 0 };
+	std::uint64_t revision_ { 0 };
 };
 
 }
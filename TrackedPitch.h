@@ -9,35 +9,65 @@
 #include "PitchTracker.h"
 
 #include <algorithm>
-#include <array>
 #include <cmath>
+#include <cstdint>
 
 namespace spectroscope {
+// id is the pitch tracker's note id when the pitch comes from the analyzer's
+// note list, and 0 when it was extracted from a field.
 struct TrackedPitch {
 	float frequencyHz { 0.0f };
 	float confidence { 0.0f };
 	float cents { 0.0f };
 	int midiNote { 0 };
+	std::uint32_t id { 0 };
 };
 
-// Extracts the strongest local maxima from an absolute tracked-pitch field.
-// Results are ordered by frequency so a diagnostic display remains stable.
-inline int extractTrackedPitches(const float* field, int fieldSize, float concertAHz,
-	TrackedPitch* destination, int destinationCapacity, float minimumConfidence = 0.05f)
+// A note entering or leaving the analyzer's note list. samplePosition is the
+// input position of the pitch update that caused it and rowSequence the first
+// row whose note list reflects it.
+struct TrackedNoteEvent {
+	enum class Type : std::uint32_t {
+		noteOn,
+		noteOff
+	};
+
+	std::uint64_t samplePosition { 0 };
+	std::uint64_t rowSequence { 0 };
+	TrackedPitch note;
+	Type type { Type::noteOn };
+};
+
+inline TrackedPitch makeTrackedPitch(float frequencyHz, float confidence, float concertAHz,
+	std::uint32_t id = 0) noexcept
 {
-	if (field == nullptr || fieldSize != PitchTracker::outputBinCount
+	const auto midiPosition = 69.0f + 12.0f * std::log2(frequencyHz / concertAHz);
+	const auto midiNote = static_cast<int>(std::round(midiPosition));
+	return { frequencyHz, confidence, 100.0f * (midiPosition - static_cast<float>(midiNote)), midiNote, id };
+}
+
+// Extracts the strongest local maxima from an absolute tracked-pitch field
+// laid out as described by layout. Results are ordered by frequency so a
+// diagnostic display remains stable.
+inline int extractTrackedPitches(const float* field, int fieldSize, const PitchTracker::Layout& layout,
+	float concertAHz, TrackedPitch* destination, int destinationCapacity, float minimumConfidence = 0.05f)
+{
+	if (field == nullptr || fieldSize != layout.outputBinCount
 		|| destination == nullptr || destinationCapacity <= 0 || concertAHz <= 0.0f) {
 		return 0;
 	}
 
-	std::array<TrackedPitch, PitchTracker::outputBinCount> candidates {};
-	auto candidateCount = 0;
+	// destination holds the strongest maxima so far, strongest first.
+	const auto lowestFrequency = std::ldexp(concertAHz, -layout.octavesBelowConcertA);
+	auto selectedCount = 0;
 	for (int bin = 0; bin < fieldSize; ++bin) {
 		const auto left = bin > 0 ? field[bin - 1] : 0.0f;
 		const auto centre = field[bin];
 		const auto right = bin + 1 < fieldSize ? field[bin + 1] : 0.0f;
 		if (centre < minimumConfidence || centre <= left || centre < right)
 			continue;
+		if (selectedCount == destinationCapacity && centre <= destination[selectedCount - 1].confidence)
+			continue;
 
 		const auto denominator = left - 2.0f * centre + right;
 		auto offset = 0.0f;
@@ -45,26 +75,29 @@ inline int extractTrackedPitches(const float* field, int fieldSize, float concer
 			offset = std::clamp(0.5f * (left - right) / denominator, -0.5f, 0.5f);
 		const auto texturePosition = (static_cast<float>(bin) + 0.5f + offset)
 			/ static_cast<float>(fieldSize);
-		const auto frequency = concertAHz / 8.0f * std::pow(
-			2.0f, texturePosition * static_cast<float>(PitchTracker::octaveCount));
-		const auto midiPosition = 69.0f + 12.0f * std::log2(frequency / concertAHz);
-		const auto midiNote = static_cast<int>(std::round(midiPosition));
-		candidates[static_cast<std::size_t>(candidateCount++)] = {
-			frequency, centre, 100.0f * (midiPosition - static_cast<float>(midiNote)), midiNote
-		};
+		const auto frequency = lowestFrequency * std::pow(
+			2.0f, texturePosition * static_cast<float>(layout.octaveCount));
+		const auto pitch = makeTrackedPitch(frequency, centre, concertAHz);
+
+		auto slot = std::min(selectedCount, destinationCapacity - 1);
+		for (; slot > 0 && destination[slot - 1].confidence < centre; --slot)
+			destination[slot] = destination[slot - 1];
+		destination[slot] = pitch;
+		selectedCount = std::min(selectedCount + 1, destinationCapacity);
 	}
 
-	const auto selectedCount = std::min(candidateCount, destinationCapacity);
-	std::partial_sort(candidates.begin(), candidates.begin() + selectedCount,
-		candidates.begin() + candidateCount,
-		[](const TrackedPitch& first, const TrackedPitch& second) {
-			return first.confidence > second.confidence;
-		});
-	std::sort(candidates.begin(), candidates.begin() + selectedCount,
+	std::sort(destination, destination + selectedCount,
 		[](const TrackedPitch& first, const TrackedPitch& second) {
 			return first.frequencyHz < second.frequencyHz;
 		});
-	std::copy_n(candidates.begin(), selectedCount, destination);
 	return selectedCount;
 }
+
+// The default layout, six octaves from concert A / 8 in 256 bins.
+inline int extractTrackedPitches(const float* field, int fieldSize, float concertAHz,
+	TrackedPitch* destination, int destinationCapacity, float minimumConfidence = 0.05f)
+{
+	return extractTrackedPitches(field, fieldSize, PitchTracker::Layout {}, concertAHz,
+		destination, destinationCapacity, minimumConfidence);
+}
 }
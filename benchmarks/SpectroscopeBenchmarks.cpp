@@ -0,0 +1,845 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PitchTracker.h"
+#include "SimdKernels.h"
+#include "Spectrogram.h"
+#include "TrackedPitch.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+constexpr double sampleRate = 48000.0;
+constexpr int deviceBlockSize = 512;
+// A silent block may cost this much more than a loud one before the silence
+// benchmarks fail. Subnormal arithmetic typically costs ten times more. The
+// check needs an idle machine, so --quick runs only report the ratio.
+constexpr double maximumSilenceSlowdown = 1.5;
+
+struct Settings {
+	bool quick { false };
+	double minimumBatchSeconds { 0.05 };
+	int repetitions { 5 };
+	juce::String filter;
+	juce::String outputPath;
+	juce::String baselinePath;
+	double tolerance { 0.10 };
+};
+
+struct BenchmarkResult {
+	std::string name;
+	double nanosecondsPerOperation { 0.0 };
+	std::vector<std::pair<std::string, double>> metrics;
+};
+
+// Timing is reported as the median of several batches. Each batch repeats the
+// operation until it runs long enough to hide clock resolution and call noise.
+template <typename Operation>
+double measureNanosecondsPerOperation(const Settings& settings, Operation&& operation)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto runBatch = [&operation](std::int64_t iterations) {
+		const auto start = Clock::now();
+		for (std::int64_t iteration = 0; iteration < iterations; ++iteration)
+			operation();
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	};
+
+	std::int64_t iterations = 1;
+	auto batchSeconds = runBatch(iterations);
+	while (batchSeconds < settings.minimumBatchSeconds && iterations < (std::int64_t { 1 } << 40)) {
+		const auto scale = batchSeconds > 0.0
+			? std::clamp(settings.minimumBatchSeconds / batchSeconds * 1.2, 2.0, 100.0) : 100.0;
+		iterations = static_cast<std::int64_t>(std::ceil(static_cast<double>(iterations) * scale));
+		batchSeconds = runBatch(iterations);
+	}
+
+	std::vector<double> samples;
+	samples.reserve(static_cast<std::size_t>(settings.repetitions));
+	samples.push_back(batchSeconds);
+	while (static_cast<int>(samples.size()) < settings.repetitions)
+		samples.push_back(runBatch(iterations));
+	std::sort(samples.begin(), samples.end());
+	return samples[samples.size() / 2] * 1.0e9 / static_cast<double>(iterations);
+}
+
+// A detuned chord with a little noise keeps the pitch tracker's peak picking
+// and note matching busy instead of measuring an idle resonator bank.
+std::vector<float> createTestSignal(int sampleCount)
+{
+	constexpr std::array<double, 4> frequencies { 110.0, 164.81, 220.0, 277.18 };
+	std::vector<float> signal(static_cast<std::size_t>(sampleCount));
+	std::uint32_t randomState = 0x2468aceu;
+	for (int sample = 0; sample < sampleCount; ++sample) {
+		auto value = 0.0;
+		for (const auto frequency : frequencies) {
+			value += std::sin(juce::MathConstants<double>::twoPi * frequency
+				* static_cast<double>(sample) / sampleRate);
+		}
+		randomState = randomState * 1664525u + 1013904223u;
+		const auto noise = static_cast<double>((randomState >> 8) & 0x00ffffffu)
+			/ static_cast<double>(0x00ffffffu) * 2.0 - 1.0;
+		signal[static_cast<std::size_t>(sample)] = static_cast<float>(0.15 * value + 0.01 * noise);
+	}
+	return signal;
+}
+
+// Notes a fixed number of semitones apart from an octave above lowestHz,
+// with the same level per note. The spacing is not a whole number of
+// semitones, so few notes land on a low harmonic of another.
+std::vector<float> createClusterSignal(int sampleCount, int noteCount, double lowestHz, int octaveCount)
+{
+	const auto spacing = static_cast<double>(octaveCount - 1) * 12.0 / static_cast<double>(noteCount) * 0.97;
+	std::vector<double> frequencies;
+	for (int note = 0; note < noteCount; ++note)
+		frequencies.push_back(lowestHz * std::pow(2.0, 1.0 + static_cast<double>(note) * spacing / 12.0));
+	std::vector<float> signal(static_cast<std::size_t>(sampleCount));
+	for (int sample = 0; sample < sampleCount; ++sample) {
+		auto value = 0.0;
+		for (const auto frequency : frequencies) {
+			value += std::sin(juce::MathConstants<double>::twoPi * frequency
+				* static_cast<double>(sample) / sampleRate);
+		}
+		signal[static_cast<std::size_t>(sample)] = static_cast<float>(0.6 * value / static_cast<double>(noteCount));
+	}
+	return signal;
+}
+
+class SignalCursor {
+public:
+	explicit SignalCursor(const std::vector<float>& signal)
+		: signal_(signal)
+	{
+	}
+
+	// Copies the next block, wrapping at the end of the prepared signal.
+	void fill(float* destination, int sampleCount) noexcept
+	{
+		for (int sample = 0; sample < sampleCount; ++sample) {
+			destination[sample] = signal_[position_];
+			if (++position_ == signal_.size())
+				position_ = 0;
+		}
+	}
+
+private:
+	const std::vector<float>& signal_;
+	std::size_t position_ { 0 };
+};
+
+const char* presetName(PitchTracker::Preset preset)
+{
+	switch (preset) {
+	case PitchTracker::Preset::fast:
+		return "fast";
+	case PitchTracker::Preset::balanced:
+		return "balanced";
+	case PitchTracker::Preset::stable:
+		return "stable";
+	}
+	return "unknown";
+}
+
+class BenchmarkRunner {
+public:
+	explicit BenchmarkRunner(Settings settings)
+		: settings_(std::move(settings))
+		, signal_(createTestSignal(static_cast<int>(sampleRate)))
+	{
+	}
+
+	void runAll()
+	{
+		benchmarkSpectrogramProcess();
+		benchmarkAnalysisStages();
+		benchmarkPitchUpdateIntervals();
+		benchmarkPitchTracker();
+		benchmarkPitchTrackerLayouts();
+		benchmarkPitchTrackerPolyphony();
+		benchmarkSimdKernels();
+		benchmarkCopyApis();
+		benchmarkTrackedPitchExtraction();
+		benchmarkSilenceAfterLoudPassage();
+		benchmarkSessionWithSilentChannels();
+	}
+
+	const std::vector<BenchmarkResult>& results() const noexcept
+	{
+		return results_;
+	}
+
+	const std::vector<std::string>& failures() const noexcept
+	{
+		return failures_;
+	}
+
+private:
+	bool selected(const std::string& name) const
+	{
+		return settings_.filter.isEmpty() || juce::String(name).contains(settings_.filter);
+	}
+
+	void addResult(std::string name, double nanosecondsPerOperation,
+		std::vector<std::pair<std::string, double>> metrics = {})
+	{
+		std::cerr << std::left << std::setw(56) << name << std::right << std::fixed
+			<< std::setprecision(1) << std::setw(14) << nanosecondsPerOperation << " ns/op";
+		for (const auto& [metricName, value] : metrics)
+			std::cerr << "  " << metricName << '=' << std::setprecision(2) << value;
+		std::cerr << '\n';
+		results_.push_back({ std::move(name), nanosecondsPerOperation, std::move(metrics) });
+	}
+
+	// One operation delivers max(blockSize, hop) samples in device-sized
+	// blocks, so every operation produces at least one complete row.
+	void benchmarkSpectrogramProcess()
+	{
+		for (int order = 5; order <= 16; ++order) {
+			const auto fftSize = 1 << order;
+			for (const auto hopSize : { fftSize / 4, fftSize / 2, fftSize }) {
+				const auto name = "spectrogram.process/order=" + std::to_string(order)
+					+ "/hop=" + std::to_string(hopSize);
+				if (!selected(name))
+					continue;
+
+				Spectrogram analyzer(order, hopSize);
+				analyzer.prepare(sampleRate);
+				const auto blockSize = std::min(deviceBlockSize, fftSize * 4);
+				const auto samplesPerOperation = std::max(blockSize, hopSize);
+				juce::AudioBuffer<float> block(1, blockSize);
+				SignalCursor cursor(signal_);
+				const auto processSamples = [&](int sampleCount) {
+					for (int offset = 0; offset < sampleCount; offset += blockSize) {
+						const auto count = std::min(blockSize, sampleCount - offset);
+						cursor.fill(block.getWritePointer(0), count);
+						analyzer.process(juce::AudioSourceChannelInfo(&block, 0, count));
+					}
+				};
+				processSamples(fftSize * 2);
+
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_,
+					[&] { processSamples(samplesPerOperation); });
+				const auto seconds = nanoseconds * 1.0e-9;
+				addResult(name, nanoseconds, {
+					{ "rowsPerSecond", static_cast<double>(samplesPerOperation)
+						/ static_cast<double>(hopSize) / seconds },
+					{ "realtimeFactor", static_cast<double>(samplesPerOperation) / sampleRate / seconds },
+				});
+			}
+		}
+	}
+
+	void benchmarkAnalysisStages()
+	{
+		// Enabled spectrum, pitch tracking and dense pitch field. The widget
+		// runs "both/fieldNotes", evaluating the field from the notes itself.
+		const std::array<std::pair<const char*, std::array<bool, 3>>, 4> stages { {
+			{ "spectrum", { true, false, true } },
+			{ "pitch", { false, true, true } },
+			{ "both", { true, true, true } },
+			{ "both/fieldNotes", { true, true, false } },
+		} };
+		for (const auto& [stageName, enabled] : stages) {
+			const auto name = std::string("stages.spectrogram.process/") + stageName
+				+ "/block=" + std::to_string(deviceBlockSize);
+			if (!selected(name))
+				continue;
+
+			Spectrogram analyzer;
+			analyzer.setSpectrumEnabled(enabled[0]);
+			analyzer.setPitchTrackingEnabled(enabled[1]);
+			analyzer.setPitchFieldEnabled(enabled[2]);
+			analyzer.prepare(sampleRate);
+			juce::AudioBuffer<float> block(1, deviceBlockSize);
+			SignalCursor cursor(signal_);
+			const auto processBlock = [&] {
+				cursor.fill(block.getWritePointer(0), deviceBlockSize);
+				analyzer.process(juce::AudioSourceChannelInfo(&block, 0, deviceBlockSize));
+			};
+			for (int warmUp = 0; warmUp < 20; ++warmUp)
+				processBlock();
+
+			const auto nanoseconds = measureNanosecondsPerOperation(settings_, processBlock);
+			addResult(name, nanoseconds, {
+				{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate / (nanoseconds * 1.0e-9) },
+			});
+		}
+	}
+
+	// Interval 0 calculates once per row, the hop of 512 samples.
+	void benchmarkPitchUpdateIntervals()
+	{
+		for (const auto interval : { 0, 384, 96, 48 }) {
+			const auto name = "pitchUpdates.spectrogram.process/interval=" + std::to_string(interval)
+				+ "/block=" + std::to_string(deviceBlockSize);
+			if (!selected(name))
+				continue;
+
+			Spectrogram analyzer;
+			analyzer.setPitchUpdateInterval(interval);
+			analyzer.prepare(sampleRate);
+			juce::AudioBuffer<float> block(1, deviceBlockSize);
+			SignalCursor cursor(signal_);
+			const auto processBlock = [&] {
+				cursor.fill(block.getWritePointer(0), deviceBlockSize);
+				analyzer.process(juce::AudioSourceChannelInfo(&block, 0, deviceBlockSize));
+			};
+			for (int warmUp = 0; warmUp < 20; ++warmUp)
+				processBlock();
+
+			const auto updatesBefore = analyzer.pitchUpdateSequence();
+			const auto rowsBefore = analyzer.sequence();
+			const auto nanoseconds = measureNanosecondsPerOperation(settings_, processBlock);
+			const auto rows = analyzer.sequence() - rowsBefore;
+			addResult(name, nanoseconds, {
+				{ "updatesPerRow", rows > 0 ? static_cast<double>(analyzer.pitchUpdateSequence() - updatesBefore)
+					/ static_cast<double>(rows) : 0.0 },
+				{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate / (nanoseconds * 1.0e-9) },
+			});
+		}
+	}
+
+	void benchmarkPitchTracker()
+	{
+		for (const auto preset : { PitchTracker::Preset::fast, PitchTracker::Preset::balanced,
+				 PitchTracker::Preset::stable }) {
+			PitchTracker tracker;
+			tracker.setPreset(preset);
+			tracker.prepare(sampleRate);
+			std::vector<float> samples(static_cast<std::size_t>(deviceBlockSize));
+			std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+			SignalCursor cursor(signal_);
+			for (int block = 0; block < 50; ++block) {
+				cursor.fill(samples.data(), deviceBlockSize);
+				tracker.process(samples.data(), deviceBlockSize);
+			}
+
+			const auto processName = std::string("pitchTracker.process/") + presetName(preset)
+				+ "/block=" + std::to_string(deviceBlockSize);
+			if (selected(processName)) {
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, [&] {
+					cursor.fill(samples.data(), deviceBlockSize);
+					tracker.process(samples.data(), deviceBlockSize);
+				});
+				addResult(processName, nanoseconds, {
+					{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate
+						/ (nanoseconds * 1.0e-9) },
+				});
+			}
+
+			const auto calculateName = std::string("pitchTracker.calculate/") + presetName(preset);
+			if (selected(calculateName)) {
+				addResult(calculateName, measureNanosecondsPerOperation(settings_, [&] {
+					tracker.calculate(field.data(), static_cast<int>(field.size()));
+				}));
+			}
+		}
+	}
+
+	// One operation processes a device block and calculates one field, so the
+	// table shows how range and resolution scale the tracker's cost.
+	void benchmarkPitchTrackerLayouts()
+	{
+		const std::array<PitchTracker::Layout, 6> layouts { {
+			{ 12, 6, 128, 3 },
+			{ 24, 6, 256, 3 },
+			{ 24, 8, 384, 4 },
+			{ 48, 6, 512, 3 },
+			{ 48, 8, 768, 4 },
+			{ 96, 6, 1024, 3 },
+		} };
+		for (const auto& layout : layouts) {
+			const auto name = "pitchTracker.layout/bins=" + std::to_string(layout.binsPerOctave)
+				+ "x" + std::to_string(layout.octaveCount) + "/output=" + std::to_string(layout.outputBinCount)
+				+ "/block=" + std::to_string(deviceBlockSize);
+			if (!selected(name))
+				continue;
+
+			PitchTracker tracker(layout);
+			tracker.prepare(sampleRate);
+			std::vector<float> samples(static_cast<std::size_t>(deviceBlockSize));
+			std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+			SignalCursor cursor(signal_);
+			const auto processBlock = [&] {
+				cursor.fill(samples.data(), deviceBlockSize);
+				tracker.process(samples.data(), deviceBlockSize);
+				tracker.calculate(field.data(), static_cast<int>(field.size()));
+			};
+			for (int block = 0; block < 50; ++block)
+				processBlock();
+
+			const auto nanoseconds = measureNanosecondsPerOperation(settings_, processBlock);
+			addResult(name, nanoseconds, {
+				{ "analysisBins", static_cast<double>(tracker.analysisBinCount()) },
+				{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate / (nanoseconds * 1.0e-9) },
+			});
+		}
+	}
+
+	// Dense clusters on a piano-range layout, so the table shows what peak
+	// picking and note assignment add to the per-row budget as the polyphony
+	// grows. One operation processes a device block and calculates one field.
+	void benchmarkPitchTrackerPolyphony()
+	{
+		for (const auto noteCount : { 8, 24, 64 }) {
+			for (const auto polyphony : { 12, 64, 128 }) {
+				const auto name = "pitchTracker.polyphony/notes=" + std::to_string(noteCount)
+					+ "/polyphony=" + std::to_string(polyphony) + "/block=" + std::to_string(deviceBlockSize);
+				if (!selected(name))
+					continue;
+
+				const PitchTracker::Layout layout { 48, 8, 768, 4, polyphony };
+				PitchTracker tracker(layout);
+				tracker.prepare(sampleRate);
+				const auto cluster = createClusterSignal(static_cast<int>(sampleRate), noteCount,
+					static_cast<double>(tracker.lowestFrequencyHz()), layout.octaveCount);
+				std::vector<float> samples(static_cast<std::size_t>(deviceBlockSize));
+				std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+				SignalCursor cursor(cluster);
+				const auto processBlock = [&] {
+					cursor.fill(samples.data(), deviceBlockSize);
+					tracker.process(samples.data(), deviceBlockSize);
+					tracker.calculate(field.data(), static_cast<int>(field.size()));
+				};
+				for (int block = 0; block < 50; ++block)
+					processBlock();
+
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, processBlock);
+				addResult(name, nanoseconds, {
+					{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate
+						/ (nanoseconds * 1.0e-9) },
+				});
+			}
+		}
+	}
+
+	// Every kernel variant the CPU supports is measured, so a regression in one
+	// instruction set is not hidden behind automatic selection. The bank has
+	// the pitch tracker's size and tuning.
+	void benchmarkSimdKernels()
+	{
+		namespace simd = spectroscope::simd;
+		constexpr PitchTracker::Layout layout;
+		constexpr auto count = static_cast<std::size_t>(layout.binsPerOctave * layout.octaveCount);
+		std::vector<float> cosineStep(count);
+		std::vector<float> sineStep(count);
+		std::vector<float> decay(count);
+		for (std::size_t bin = 0; bin < count; ++bin) {
+			const auto frequency = 55.0 * std::pow(2.0, static_cast<double>(bin) / layout.binsPerOctave);
+			const auto radians = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+			cosineStep[bin] = static_cast<float>(std::cos(radians));
+			sineStep[bin] = static_cast<float>(std::sin(radians));
+			decay[bin] = static_cast<float>(std::exp(-frequency / (6.0 * sampleRate)));
+		}
+		std::vector<float> cosinePhase(count);
+		std::vector<float> sinePhase(count);
+		std::vector<float> inPhase(count, 0.0f);
+		std::vector<float> quadrature(count, 0.0f);
+		std::vector<float> bankMagnitudes(count);
+		const simd::ResonatorBank bank { cosineStep.data(), sineStep.data(), decay.data(),
+			cosinePhase.data(), sinePhase.data(), inPhase.data(), quadrature.data(),
+			static_cast<int>(count) };
+
+		Spectrogram analyzer;
+		std::vector<float> spectrum(static_cast<std::size_t>(analyzer.spectrumSize()));
+		for (std::size_t bin = 0; bin < spectrum.size(); ++bin)
+			spectrum[bin] = std::abs(signal_[bin]) * 100.0f;
+		std::vector<float> decibels(spectrum.size());
+
+		for (const auto instructionSet : { simd::InstructionSet::scalar, simd::InstructionSet::sse2,
+				 simd::InstructionSet::avx2, simd::InstructionSet::avx512, simd::InstructionSet::neon }) {
+			const auto* kernels = simd::kernelsFor(instructionSet);
+			if (kernels == nullptr)
+				continue;
+
+			const std::string isa = simd::instructionSetName(instructionSet);
+			const auto resonatorName = "kernels.updateResonators/" + isa + "/block="
+				+ std::to_string(deviceBlockSize);
+			if (selected(resonatorName)) {
+				// Phases restart every block because the kernel leaves
+				// renormalisation to its caller.
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, [&] {
+					std::fill(cosinePhase.begin(), cosinePhase.end(), 1.0f);
+					std::fill(sinePhase.begin(), sinePhase.end(), 0.0f);
+					kernels->updateResonators(bank, signal_.data(), deviceBlockSize);
+				});
+				addResult(resonatorName, nanoseconds, {
+					{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate
+						/ (nanoseconds * 1.0e-9) },
+				});
+			}
+
+			const auto magnitudeName = "kernels.resonatorMagnitudes/" + isa;
+			if (selected(magnitudeName)) {
+				addResult(magnitudeName, measureNanosecondsPerOperation(settings_, [&] {
+					kernels->resonatorMagnitudes(bank, bankMagnitudes.data());
+				}));
+			}
+
+			const auto decibelName = "kernels.magnitudesToDecibels/" + isa + "/bins="
+				+ std::to_string(spectrum.size());
+			if (selected(decibelName)) {
+				addResult(decibelName, measureNanosecondsPerOperation(settings_, [&] {
+					kernels->magnitudesToDecibels(spectrum.data(), 0.001f, -100.0f,
+						decibels.data(), static_cast<int>(spectrum.size()));
+				}));
+			}
+		}
+	}
+
+	// The analyzer is filled once, so repeated copies after a fixed sequence
+	// always transfer the same backlog without any producer running.
+	void benchmarkCopyApis()
+	{
+		Spectrogram analyzer;
+		analyzer.prepare(sampleRate);
+		juce::AudioBuffer<float> block(1, deviceBlockSize);
+		SignalCursor cursor(signal_);
+		while (analyzer.sequence() < static_cast<std::uint64_t>(Spectrogram::spectrumHistoryCapacity * 2)) {
+			cursor.fill(block.getWritePointer(0), deviceBlockSize);
+			analyzer.process(juce::AudioSourceChannelInfo(&block, 0, deviceBlockSize));
+		}
+
+		const auto spectrumSize = analyzer.spectrumSize();
+		const auto pitchSize = analyzer.pitchClassSize();
+		std::vector<float> spectra(static_cast<std::size_t>(spectrumSize * Spectrogram::spectrumHistoryCapacity));
+		std::vector<float> pitches(static_cast<std::size_t>(pitchSize * Spectrogram::spectrumHistoryCapacity));
+		const auto fieldNoteSize = analyzer.fieldNoteRowSize();
+		std::vector<float> fieldNotes(static_cast<std::size_t>(fieldNoteSize * Spectrogram::spectrumHistoryCapacity));
+
+		if (selected("copy.latestSpectrum")) {
+			addResult("copy.latestSpectrum", measureNanosecondsPerOperation(settings_, [&] {
+				analyzer.copyLatestSpectrum(spectra.data(), spectrumSize);
+			}));
+		}
+		if (selected("copy.latestPitchClass")) {
+			addResult("copy.latestPitchClass", measureNanosecondsPerOperation(settings_, [&] {
+				analyzer.copyLatestPitchClass(pitches.data(), pitchSize);
+			}));
+		}
+		if (selected("copy.latestTrackedNotes")) {
+			std::array<spectroscope::TrackedPitch, 6> notes {};
+			addResult("copy.latestTrackedNotes", measureNanosecondsPerOperation(settings_, [&] {
+				analyzer.copyLatestTrackedNotes(notes.data(), static_cast<int>(notes.size()));
+			}));
+		}
+
+		for (const auto backlog : { 1, 4, 16, 64, Spectrogram::spectrumHistoryCapacity }) {
+			const auto after = analyzer.sequence() - static_cast<std::uint64_t>(backlog);
+			const auto spectrumName = "copy.spectrumFramesAfter/backlog=" + std::to_string(backlog);
+			if (selected(spectrumName)) {
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, [&] {
+					analyzer.copySpectrumFramesAfter(after, spectra.data(), backlog * spectrumSize);
+				});
+				addResult(spectrumName, nanoseconds, {
+					{ "rowsPerSecond", static_cast<double>(backlog) / (nanoseconds * 1.0e-9) },
+				});
+			}
+
+			const auto analysisName = "copy.analysisFramesAfter/backlog=" + std::to_string(backlog);
+			if (selected(analysisName)) {
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, [&] {
+					analyzer.copyAnalysisFramesAfter(after, spectra.data(), backlog * spectrumSize,
+						pitches.data(), backlog * pitchSize);
+				});
+				addResult(analysisName, nanoseconds, {
+					{ "rowsPerSecond", static_cast<double>(backlog) / (nanoseconds * 1.0e-9) },
+					{ "pitchBytesPerRow", static_cast<double>(pitchSize * static_cast<int>(sizeof(float))) },
+				});
+			}
+
+			// A renderer uploads only the header and the tracked notes of a row.
+			const auto fieldNoteName = "copy.fieldNoteFramesAfter/backlog=" + std::to_string(backlog);
+			if (selected(fieldNoteName)) {
+				const auto nanoseconds = measureNanosecondsPerOperation(settings_, [&] {
+					analyzer.copyFieldNoteFramesAfter(after, spectra.data(), backlog * spectrumSize,
+						fieldNotes.data(), backlog * fieldNoteSize);
+				});
+				auto uploadedFloats = 0.0;
+				for (int row = 0; row < backlog; ++row)
+					uploadedFloats += 2.0 + 2.0 * static_cast<double>(fieldNotes[static_cast<std::size_t>(row * fieldNoteSize)]);
+				addResult(fieldNoteName, nanoseconds, {
+					{ "rowsPerSecond", static_cast<double>(backlog) / (nanoseconds * 1.0e-9) },
+					{ "pitchBytesPerRow", uploadedFloats * static_cast<double>(sizeof(float)) / static_cast<double>(backlog) },
+				});
+			}
+		}
+	}
+
+	void benchmarkTrackedPitchExtraction()
+	{
+		if (!selected("extractTrackedPitches"))
+			return;
+
+		PitchTracker tracker;
+		tracker.prepare(sampleRate);
+		std::vector<float> samples(static_cast<std::size_t>(deviceBlockSize));
+		std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+		SignalCursor cursor(signal_);
+		for (int block = 0; block < 80; ++block) {
+			cursor.fill(samples.data(), deviceBlockSize);
+			tracker.process(samples.data(), deviceBlockSize);
+			tracker.calculate(field.data(), static_cast<int>(field.size()));
+		}
+
+		std::array<spectroscope::TrackedPitch, 6> pitches {};
+		addResult("extractTrackedPitches", measureNanosecondsPerOperation(settings_, [&] {
+			spectroscope::extractTrackedPitches(field.data(), static_cast<int>(field.size()), 440.0f,
+				pitches.data(), static_cast<int>(pitches.size()));
+		}));
+	}
+
+	// Decaying filter state must be flushed before it becomes subnormal, so the
+	// slowest second of a long digital silence after a loud passage may not
+	// cost noticeably more per block than the loud passage itself. PitchTracker
+	// runs without any FTZ/DAZ mode here, exercising its explicit flushing.
+	// The analyzer's silence gate is disabled, since it would skip exactly the
+	// decaying tail this measures.
+	void benchmarkSilenceAfterLoudPassage()
+	{
+		PitchTracker tracker;
+		tracker.prepare(sampleRate);
+		measureSilenceAfterLoudPassage("silence.pitchTracker.process/balanced",
+			[&tracker](const float* samples) { tracker.process(samples, deviceBlockSize); });
+
+		Spectrogram analyzer;
+		analyzer.prepare(sampleRate);
+		analyzer.setSilenceThresholdDb(-std::numeric_limits<float>::infinity());
+		juce::AudioBuffer<float> block(1, deviceBlockSize);
+		measureSilenceAfterLoudPassage("silence.spectrogram.process", [&](const float* samples) {
+			std::copy_n(samples, deviceBlockSize, block.getWritePointer(0));
+			analyzer.process(juce::AudioSourceChannelInfo(&block, 0, deviceBlockSize));
+		});
+	}
+
+	// A monitoring session where most channels are idle. One operation feeds
+	// a device block to every channel; with the silence gate the cost should
+	// follow the number of active channels rather than the channel count.
+	void benchmarkSessionWithSilentChannels()
+	{
+		constexpr int channelCount = 64;
+		for (const auto activeChannels : { 0, 8, 32, channelCount }) {
+			const auto name = "session.spectrogram.process/channels=" + std::to_string(channelCount)
+				+ "/active=" + std::to_string(activeChannels);
+			if (!selected(name))
+				continue;
+
+			std::vector<std::unique_ptr<Spectrogram>> analyzers;
+			for (int channel = 0; channel < channelCount; ++channel) {
+				analyzers.push_back(std::make_unique<Spectrogram>());
+				analyzers.back()->prepare(sampleRate);
+			}
+			juce::AudioBuffer<float> loudBlock(1, deviceBlockSize);
+			juce::AudioBuffer<float> silentBlock(1, deviceBlockSize);
+			silentBlock.clear();
+			SignalCursor cursor(signal_);
+			const auto processSession = [&] {
+				cursor.fill(loudBlock.getWritePointer(0), deviceBlockSize);
+				for (int channel = 0; channel < channelCount; ++channel) {
+					auto& block = channel < activeChannels ? loudBlock : silentBlock;
+					analyzers[static_cast<std::size_t>(channel)]->process(
+						juce::AudioSourceChannelInfo(&block, 0, deviceBlockSize));
+				}
+			};
+			for (int block = 0; block < 20; ++block)
+				processSession();
+
+			const auto nanoseconds = measureNanosecondsPerOperation(settings_, processSession);
+			addResult(name, nanoseconds, {
+				{ "realtimeFactor", static_cast<double>(deviceBlockSize) / sampleRate / (nanoseconds * 1.0e-9) },
+				{ "gatedRows", static_cast<double>(analyzers.back()->gatedRows()) },
+			});
+		}
+	}
+
+	template <typename ProcessBlock>
+	void measureSilenceAfterLoudPassage(const std::string& name, ProcessBlock&& processBlock)
+	{
+		if (!selected(name))
+			return;
+
+		using Clock = std::chrono::steady_clock;
+		const auto blocksPerSecond = static_cast<int>(sampleRate) / deviceBlockSize;
+		const auto timeBlock = [&processBlock](const float* samples) {
+			const auto start = Clock::now();
+			processBlock(samples);
+			return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+		};
+		const auto median = [](std::vector<double> values) {
+			std::sort(values.begin(), values.end());
+			return values[values.size() / 2];
+		};
+
+		std::vector<float> samples(static_cast<std::size_t>(deviceBlockSize));
+		SignalCursor cursor(signal_);
+		std::vector<double> blockNanoseconds;
+		for (int block = 0; block < 3 * blocksPerSecond; ++block) {
+			cursor.fill(samples.data(), deviceBlockSize);
+			const auto nanoseconds = timeBlock(samples.data());
+			if (block >= blocksPerSecond)
+				blockNanoseconds.push_back(nanoseconds);
+		}
+		const auto loudNanoseconds = median(blockNanoseconds);
+
+		// The slowest resonators of the default preset reach the subnormal
+		// range after roughly ten seconds without explicit flushing.
+		std::fill(samples.begin(), samples.end(), 0.0f);
+		auto slowestSilentNanoseconds = 0.0;
+		for (int second = 0; second < 30; ++second) {
+			blockNanoseconds.clear();
+			for (int block = 0; block < blocksPerSecond; ++block)
+				blockNanoseconds.push_back(timeBlock(samples.data()));
+			slowestSilentNanoseconds = std::max(slowestSilentNanoseconds, median(blockNanoseconds));
+		}
+
+		const auto slowdown = slowestSilentNanoseconds / loudNanoseconds;
+		addResult(name, slowestSilentNanoseconds, {
+			{ "loudNanosecondsPerBlock", loudNanoseconds },
+			{ "silenceSlowdown", slowdown },
+		});
+		if (!settings_.quick && slowdown > maximumSilenceSlowdown)
+			failures_.push_back(name);
+	}
+
+	Settings settings_;
+	std::vector<float> signal_;
+	std::vector<BenchmarkResult> results_;
+	std::vector<std::string> failures_;
+};
+
+juce::var resultsToJson(const std::vector<BenchmarkResult>& results, bool quick)
+{
+	juce::var benchmarks;
+	for (const auto& result : results) {
+		auto* entry = new juce::DynamicObject();
+		entry->setProperty("name", juce::String(result.name));
+		entry->setProperty("nanosecondsPerOperation", result.nanosecondsPerOperation);
+		for (const auto& [metricName, value] : result.metrics)
+			entry->setProperty(juce::Identifier(juce::String(metricName)), value);
+		benchmarks.append(juce::var(entry));
+	}
+
+	auto* root = new juce::DynamicObject();
+	root->setProperty("schema", 1);
+	root->setProperty("quick", quick);
+	root->setProperty("instructionSet", juce::String(spectroscope::simd::instructionSetName(
+		spectroscope::simd::kernels().instructionSet)));
+	root->setProperty("benchmarks", benchmarks);
+	return juce::var(root);
+}
+
+// Returns false when any benchmark in the baseline became slower than the
+// tolerance allows. Benchmarks missing on either side are reported only.
+bool compareWithBaseline(const std::vector<BenchmarkResult>& results, const juce::var& baseline,
+	double tolerance)
+{
+	const auto* baselineBenchmarks = baseline["benchmarks"].getArray();
+	if (baselineBenchmarks == nullptr) {
+		std::cerr << "Baseline does not contain a benchmarks array\n";
+		return false;
+	}
+
+	auto withinTolerance = true;
+	std::cout << std::left << std::setw(56) << "benchmark" << std::right << std::setw(14) << "baseline"
+		<< std::setw(14) << "current" << std::setw(10) << "change" << '\n';
+	for (const auto& entry : *baselineBenchmarks) {
+		const auto name = entry["name"].toString().toStdString();
+		const auto current = std::find_if(results.begin(), results.end(),
+			[&name](const BenchmarkResult& result) { return result.name == name; });
+		if (current == results.end())
+			continue;
+
+		const auto baselineNanoseconds = static_cast<double>(entry["nanosecondsPerOperation"]);
+		if (baselineNanoseconds <= 0.0)
+			continue;
+		const auto change = current->nanosecondsPerOperation / baselineNanoseconds - 1.0;
+		const auto regressed = change > tolerance;
+		withinTolerance = withinTolerance && !regressed;
+		std::cout << std::left << std::setw(56) << name << std::right << std::fixed
+			<< std::setprecision(1) << std::setw(14) << baselineNanoseconds
+			<< std::setw(14) << current->nanosecondsPerOperation
+			<< std::showpos << std::setw(9) << change * 100.0 << '%' << std::noshowpos
+			<< (regressed ? "  REGRESSION" : "") << '\n';
+	}
+	return withinTolerance;
+}
+
+bool parseArguments(int argc, char* argv[], Settings& settings)
+{
+	for (int index = 1; index < argc; ++index) {
+		const juce::String argument(argv[index]);
+		if (argument == "--quick") {
+			settings.quick = true;
+			settings.minimumBatchSeconds = 0.002;
+			settings.repetitions = 1;
+		} else if (argument.startsWith("--filter=")) {
+			settings.filter = argument.fromFirstOccurrenceOf("=", false, false);
+		} else if (argument.startsWith("--output=")) {
+			settings.outputPath = argument.fromFirstOccurrenceOf("=", false, false);
+		} else if (argument.startsWith("--baseline=")) {
+			settings.baselinePath = argument.fromFirstOccurrenceOf("=", false, false);
+		} else if (argument.startsWith("--tolerance=")) {
+			settings.tolerance = argument.fromFirstOccurrenceOf("=", false, false).getDoubleValue() / 100.0;
+		} else {
+			std::cerr << "Unknown argument: " << argument << "\n"
+				"Usage: juce-spectroscope-bench [--quick] [--filter=<text>] [--output=<file.json>]\n"
+				"       [--baseline=<file.json>] [--tolerance=<percent>]\n";
+			return false;
+		}
+	}
+	return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	Settings settings;
+	if (!parseArguments(argc, argv, settings))
+		return 2;
+
+	BenchmarkRunner runner(settings);
+	runner.runAll();
+	for (const auto& failure : runner.failures()) {
+		std::cerr << failure << ": silent blocks cost more than " << maximumSilenceSlowdown
+			<< "x a loud block\n";
+	}
+
+	const auto json = juce::JSON::toString(resultsToJson(runner.results(), settings.quick));
+	if (settings.outputPath.isNotEmpty()) {
+		if (!juce::File::getCurrentWorkingDirectory().getChildFile(settings.outputPath)
+				.replaceWithText(json)) {
+			std::cerr << "Could not write " << settings.outputPath << '\n';
+			return 1;
+		}
+	} else if (settings.baselinePath.isEmpty()) {
+		std::cout << json << '\n';
+	}
+
+	if (settings.baselinePath.isNotEmpty()) {
+		const auto baselineFile = juce::File::getCurrentWorkingDirectory()
+			.getChildFile(settings.baselinePath);
+		if (!baselineFile.existsAsFile()) {
+			std::cerr << "Baseline " << settings.baselinePath << " does not exist\n";
+			return 1;
+		}
+		if (!compareWithBaseline(runner.results(), juce::JSON::parse(baselineFile.loadFileAsString()),
+				settings.tolerance)) {
+			return 1;
+		}
+	}
+	return runner.failures().empty() ? 0 : 1;
+}
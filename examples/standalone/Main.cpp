@@ -5,9 +5,12 @@
 */
 
 #include "MainComponent.h"
+#include "SpectroscopeTrace.h"
 
 #include <juce_gui_basics/juce_gui_basics.h>
 
+#include <iostream>
+
 class SpectroscopeDemoApplication final : public juce::JUCEApplication,
 	private juce::Timer {
 public:
@@ -18,14 +21,29 @@ public:
 	void initialise(const juce::String& commandLine) override
 	{
 		const auto exitSmokeTest = commandLine.contains("--exit-smoke-test");
+		traceOutput_ = commandLine.fromFirstOccurrenceOf("--trace-output=", false, false)
+			.upToFirstOccurrenceOf(" ", false, false).unquoted();
+		frameStatistics_ = commandLine.contains("--frame-statistics");
 		mainWindow_ = std::make_unique<MainWindow>(getApplicationName(), !exitSmokeTest);
+		if (frameStatistics_)
+			mainWindow_->showFrameStatistics();
 		if (exitSmokeTest)
 			startTimer(1500);
 	}
 
 	void shutdown() override
 	{
+		// Printed so that headless runs, such as CI on a software renderer,
+		// keep the last published statistics.
+		if (frameStatistics_ && mainWindow_ != nullptr)
+			std::cout << mainWindow_->frameStatisticsSummary().toStdString() << std::endl;
 		mainWindow_.reset();
+#if JUCE_SPECTROSCOPE_TRACING
+		// The audio callback, analysis worker, and renderer have stopped, so the
+		// snapshot contains their complete final timeline.
+		if (traceOutput_.isNotEmpty())
+			spectroscope::trace::writeToFile(traceOutput_.toRawUTF8());
+#endif
 	}
 
 	void systemRequestedQuit() override
@@ -70,12 +88,25 @@ private:
 			return mainComponent_ != nullptr && mainComponent_->isRendererReady();
 		}
 
+		void showFrameStatistics()
+		{
+			if (mainComponent_ != nullptr)
+				mainComponent_->showFrameStatistics();
+		}
+
+		juce::String frameStatisticsSummary() const
+		{
+			return mainComponent_ != nullptr ? mainComponent_->frameStatisticsSummary() : juce::String();
+		}
+
 	private:
 		MainComponent* mainComponent_ { nullptr };
 		JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MainWindow)
 	};
 
 	std::unique_ptr<MainWindow> mainWindow_;
+	juce::String traceOutput_;
+	bool frameStatistics_ { false };
 };
 
 START_JUCE_APPLICATION(SpectroscopeDemoApplication)
@@ -6,6 +6,8 @@
 
 #include "MainComponent.h"
 
+#include "SpectroscopeTrace.h"
+
 DemoAnalysisWorker::DemoAnalysisWorker(std::shared_ptr<Spectrogram> analyzer)
 	: juce::Thread("Spectroscope demo analysis")
 	, analyzer_(std::move(analyzer))
@@ -71,6 +73,7 @@ bool DemoAnalysisWorker::enqueue(
 
 void DemoAnalysisWorker::run()
 {
+	SPECTROSCOPE_TRACE_THREAD_NAME("Analysis worker");
 	while (!threadShouldExit() || fifo_.getNumReady() > 0) {
 		int start1 = 0;
 		int size1 = 0;
@@ -90,6 +93,7 @@ void DemoAnalysisWorker::run()
 
 void DemoAnalysisWorker::process(Frame& frame)
 {
+	SPECTROSCOPE_TRACE_SCOPE("DemoAnalysisWorker::process");
 	std::array<float*, 2> channelPointers {
 		frame.channels[0].data(), frame.channels[1].data()
 	};
@@ -103,6 +107,8 @@ MainComponent::MainComponent(bool startAudio)
 	, spectrogram_(analyzer_)
 	, deviceSelector_(deviceManager_, 1, 2, 0, 0, false, false, true, false)
 {
+	// On a slow machine the demo would rather show coarser rows than lose input.
+	analyzer_->setQualityGovernorEnabled(true);
 	addAndMakeVisible(spectrogram_);
 	addAndMakeVisible(deviceButton_);
 	addAndMakeVisible(logarithmicButton_);
@@ -129,6 +135,9 @@ MainComponent::MainComponent(bool startAudio)
 	concertASlider_.setTextValueSuffix(" Hz");
 	concertASlider_.setSliderStyle(juce::Slider::LinearHorizontal);
 	concertASlider_.setTextBoxStyle(juce::Slider::TextBoxRight, false, 72, 24);
+	// The widget is the analyzer's only consumer, so it may switch off the
+	// stages it does not display.
+	spectrogram_.setAnalysisStageGating(true);
 	spectrogram_.setPitchColourMode(true);
 	deviceButton_.onClick = [this] {
 		const auto showSettings = !deviceSelector_.isVisible();
@@ -167,9 +176,9 @@ MainComponent::MainComponent(bool startAudio)
 	};
 
 	setSize(900, 650);
-	// Continuous OpenGL repainting is synchronized by swap interval 1, so the
-	// waterfall follows the display refresh instead of a fixed message timer.
-	spectrogram_.setContinuousRedrawing(true);
+	// The widget redraws when the analysis worker publishes rows, at most once
+	// per display refresh with swap interval 1, and stays idle otherwise.
+	spectrogram_.setRenderOnDemand(true);
 
 	if (!startAudio) {
 		statusLabel_.setText("Audio disabled for exit smoke test", juce::dontSendNotification);
@@ -229,6 +238,18 @@ bool MainComponent::isRendererReady() const noexcept
 	return spectrogram_.isOpenGLReady();
 }
 
+void MainComponent::showFrameStatistics()
+{
+	spectrogram_.setRenderOnDemand(false);
+	spectrogram_.setContinuousRedrawing(true);
+	spectrogram_.setFrameStatisticsOverlayVisible(true);
+}
+
+juce::String MainComponent::frameStatisticsSummary() const
+{
+	return spectrogram_.getFrameStatisticsSummary();
+}
+
 void MainComponent::initialiseAudio()
 {
 	const auto error = deviceManager_.initialiseWithDefaultDevices(2, 0);
@@ -250,6 +271,8 @@ void MainComponent::audioDeviceIOCallbackWithContext(
 	int numSamples,
 	const juce::AudioIODeviceCallbackContext&)
 {
+	SPECTROSCOPE_TRACE_THREAD_NAME("Audio callback");
+	SPECTROSCOPE_TRACE_SCOPE("Audio callback");
 	analysisWorker_.enqueue(inputChannelData, numInputChannels, numSamples);
 	for (int channel = 0; channel < numOutputChannels; ++channel) {
 		if (outputChannelData[channel] != nullptr)
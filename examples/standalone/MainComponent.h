@@ -49,6 +49,10 @@ public:
 	void paint(juce::Graphics& graphics) override;
 	void resized() override;
 	bool isRendererReady() const noexcept;
+	// Redraws continuously so frame intervals show missed vsyncs, and shows
+	// the widget's frame statistics overlay.
+	void showFrameStatistics();
+	juce::String frameStatisticsSummary() const;
 
 private:
 	void initialiseAudio();
@@ -1,12 +1,44 @@
 #version 150
 
-in vec2 position;
-in vec2 textureCoordinate;
+// One instance per note card: (MIDI note, anchor row, frequency axis position,
+// tracking). Anchor rows and newestRow share an origin chosen by the widget.
+// Sized for TrackedNoteHistory::capacity.
+uniform vec4 noteRecords[48];
+uniform float newestRow;
+uniform float historyRowCount;
+uniform vec2 componentSize;
+uniform vec2 cardSize;
+uniform float rightPadding;
+uniform vec2 atlasCellSize;
+uniform int atlasColumns;
 
 out vec2 atlasCoordinate;
 
 void main()
 {
-	atlasCoordinate = textureCoordinate;
-	gl_Position = vec4(position, 0.0, 1.0);
+	vec4 record = noteRecords[gl_InstanceID];
+	// A tracking card follows the newest row; a released one scrolls left
+	// with its row until it leaves the history.
+	float ageRows = record.w > 0.5 ? 0.0 : max(newestRow - record.y, 0.0);
+	if (ageRows >= historyRowCount) {
+		atlasCoordinate = vec2(0.0);
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	// Triangle strip corners, x to the right and y down from the top left.
+	vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+	float historyPosition = 1.0 - ageRows / max(historyRowCount - 1.0, 1.0);
+	float right = historyPosition * componentSize.x + rightPadding;
+	float centreY = clamp((1.0 - record.z) * componentSize.y,
+		cardSize.y * 0.5, componentSize.y - cardSize.y * 0.5);
+	vec2 pixel = vec2(right - (1.0 - corner.x) * cardSize.x,
+		centreY + (corner.y - 0.5) * cardSize.y);
+	gl_Position = vec4(2.0 * pixel.x / componentSize.x - 1.0,
+		1.0 - 2.0 * pixel.y / componentSize.y, 0.0, 1.0);
+
+	int midiNote = clamp(int(record.x + 0.5), 0, 127);
+	vec2 cell = vec2(float(midiNote % atlasColumns), float(midiNote / atlasColumns));
+	atlasCoordinate = vec2((cell.x + corner.x) * atlasCellSize.x,
+		1.0 - (cell.y + corner.y) * atlasCellSize.y);
 }
@@ -7,37 +7,47 @@
 #version 150
 
 uniform vec2  resolution;
-uniform int xAxisLog;
 uniform int horizontalMode;
 uniform int pitchColourMode;
 
 uniform float waterfallStartPosition;
 uniform float waterfallHistorySpan;
+// Texel centre of the newest waterfall row, drawn as the vertical view's curve.
+uniform float latestSpectrumPosition;
 uniform float upperHalfPercentage;
-uniform float sampleRate;
-uniform float concertAHz;
-uniform float minimumFrequencyHz;
+// Field notes are positioned in analysis bins, trackedAnalysisBinCount of
+// which span the field.
+uniform float trackedAnalysisBinCount;
+uniform int fieldNoteCapacity;
+uniform int latestFieldNoteRow;
 uniform float spectrumTexelWidth;
-uniform sampler2D audioSampleData;
+// One texel per frequency-axis pixel, precomputed on the CPU: (FFT texture
+// coordinate, tracked-pitch field position or -1, circle-of-fifths hue,
+// tuning saturation).
+uniform sampler2D axisMapping;
 uniform sampler2D lutTexture; 
 uniform sampler2D waterfall; 
-uniform sampler2D pitchClassData;
-uniform sampler2D pitchClassHistory;
+// Maps a waterfall sample to decibels; identity unless it is stored normalized.
+uniform float waterfallValueOffset;
+uniform float waterfallValueScale;
+// Row r holds the field notes of waterfall row r: texel 0 is (note count,
+// sigma) and texel 1 + i is (position, strength) of note i.
+uniform sampler2D fieldNoteHistory;
+// 0 shades every pixel. 1 shades waterfall rows into shadedWaterfall, a
+// colour ring with one row per waterfall row and one column per frequency
+// axis pixel; the viewport covers the rows to shade. 2 composites the screen
+// from that ring and only shades the vertical view's curve. 3 converts the
+// waterfall texel by texel into a texture of another format, which stores
+// decibels as convertedValueOffset + convertedValueScale * value.
+uniform int waterfallPass;
+uniform sampler2D shadedWaterfall;
+uniform float convertedValueOffset;
+uniform float convertedValueScale;
 
 out vec4 fragmentColour;
 
-float frequencyPosition(float axisPosition) {
-	float normalisedPosition = clamp(axisPosition, 0.0f, 1.0f);
-	if (xAxisLog == 0)
-		return normalisedPosition;
-
-	float nyquist = sampleRate * 0.5f;
-	if (nyquist <= 0.0f)
-		return normalisedPosition;
-
-	float minimumFrequency = clamp(minimumFrequencyHz, 0.001f, nyquist);
-	float frequency = minimumFrequency * pow(nyquist / minimumFrequency, normalisedPosition);
-	return frequency / nyquist;
+vec4 axisColumn(float axisPixel) {
+	return texelFetch(axisMapping, ivec2(int(axisPixel), 0), 0);
 }
 
 vec3 hsvToRgb(vec3 hsv) {
@@ -45,53 +55,55 @@ vec3 hsvToRgb(vec3 hsv) {
 	return hsv.z * mix(vec3(1.0f), rgb, hsv.y);
 }
 
-float spectralSalience(sampler2D sourceTexture, vec2 texturePosition) {
+float waterfallDecibels(vec2 texturePosition) {
+	return waterfallValueOffset + waterfallValueScale * texture(waterfall, texturePosition).r;
+}
+
+float spectralSalience(vec2 texturePosition) {
 	float offset = max(spectrumTexelWidth, 0.000001f);
-	float centre = texture(sourceTexture, texturePosition).r;
-	float lower = texture(sourceTexture, vec2(max(texturePosition.x - offset, 0.0f), texturePosition.y)).r;
-	float upper = texture(sourceTexture, vec2(min(texturePosition.x + offset, 1.0f), texturePosition.y)).r;
+	float centre = waterfallDecibels(texturePosition);
+	float lower = waterfallDecibels(vec2(max(texturePosition.x - offset, 0.0f), texturePosition.y));
+	float upper = waterfallDecibels(vec2(min(texturePosition.x + offset, 1.0f), texturePosition.y));
 	float prominenceDb = centre - max(lower, upper);
 	return smoothstep(0.0f, 6.0f, prominenceDb);
 }
 
-float trackedPitchPosition(float frequencyPosition) {
-	float frequency = frequencyPosition * sampleRate * 0.5f;
-	if (frequency <= 0.0f || concertAHz <= 0.0f)
-		return -1.0f;
-	float lowestTrackedFrequency = concertAHz / 8.0f;
-	return log(frequency / lowestTrackedFrequency) / log(2.0f) / 6.0f;
+int fieldNoteRow(float historyPosition) {
+	int rows = textureSize(fieldNoteHistory, 0).y;
+	return min(int(floor(fract(historyPosition) * float(rows))), rows - 1);
 }
 
-float trackedPitchConfidence(sampler2D sourceTexture, float frequencyPosition, float historyPosition) {
-	float trackedPosition = trackedPitchPosition(frequencyPosition);
+// The strongest Gaussian of the row's notes, as PitchTracker::renderField()
+// would have drawn it, evaluated at this exact position.
+float trackedPitchConfidence(float trackedPosition, int row) {
 	if (trackedPosition < 0.0f || trackedPosition >= 1.0f)
 		return 0.0f;
-	return texture(sourceTexture, vec2(trackedPosition, historyPosition)).r;
+
+	vec2 header = texelFetch(fieldNoteHistory, ivec2(0, row), 0).rg;
+	int noteCount = clamp(int(header.x + 0.5f), 0, fieldNoteCapacity);
+	float sigma = max(header.y, 0.000001f);
+	float position = trackedPosition * trackedAnalysisBinCount;
+	float confidence = 0.0f;
+	for (int note = 0; note < noteCount; ++note) {
+		vec2 fieldNote = texelFetch(fieldNoteHistory, ivec2(note + 1, row), 0).rg;
+		float distance = (position - fieldNote.x) / sigma;
+		confidence = max(confidence, fieldNote.y * exp(-0.5f * distance * distance));
+	}
+	return clamp(confidence, 0.0f, 1.0f);
 }
 
-vec4 spectrumColour(float decibels, float frequencyPosition, float salience, float pitchConfidence) {
+vec4 spectrumColour(float decibels, vec4 column, float salience, float pitchConfidence) {
 	float linearIntensity = clamp(1.0f + decibels / 100.0f, 0.0f, 1.0f);
 	float intensity = pow(linearIntensity, 1.7f);
 	if (pitchColourMode == 0)
 		return texture(lutTexture, vec2(linearIntensity, 0.0f));
 
-	float frequency = frequencyPosition * sampleRate * 0.5f;
-	if (frequency <= 0.0f || concertAHz <= 0.0f)
-		return vec4(vec3(intensity), 1.0f);
-
-	float fractionalMidiNote = 69.0f + 12.0f * log(frequency / concertAHz) / log(2.0f);
-	float nearestMidiNote = floor(fractionalMidiNote + 0.5f);
-	float centsFromNote = abs(100.0f * (fractionalMidiNote - nearestMidiNote));
-
-	// Multiplication by seven maps chromatic pitch classes onto circle-of-fifths order:
-	// C, G, D, A, E, B, F#, C#, G#, D#, A#, F.
-	float pitchClass = mod(nearestMidiNote, 12.0f);
-	float fifthIndex = mod(pitchClass * 7.0f, 12.0f);
-	float hue = fifthIndex / 12.0f;
-
-	// Colour falls continuously from a tempered note centre to neutral grey at
-	// the midpoint between notes. The peak position shows whether it is flat or sharp.
-	float tuningSaturation = clamp(1.0f - centsFromNote / 50.0f, 0.0f, 1.0f);
+	// Hue is the nearest note's circle-of-fifths position: C, G, D, A, E, B,
+	// F#, C#, G#, D#, A#, F. Colour falls continuously from a tempered note
+	// centre to neutral grey at the midpoint between notes, so the peak
+	// position shows whether it is flat or sharp.
+	float hue = column.z;
+	float tuningSaturation = column.w;
 	float amplitudeConfidence = smoothstep(0.08f, 0.42f, linearIntensity);
 	// Real instruments spread their energy over harmonics and seldom reach the
 	// confidence of a stationary sine. Treat tracking as soft evidence and use a
@@ -103,34 +115,49 @@ vec4 spectrumColour(float decibels, float frequencyPosition, float salience, flo
 	return vec4(hsvToRgb(vec3(hue, saturation, intensity)), 1.0f);
 }
 
+vec4 historyColour(vec4 column, float historyPosition) {
+	vec2 texturePosition = vec2(column.x, historyPosition);
+	float value = waterfallDecibels(texturePosition);
+	float pitchConfidence = trackedPitchConfidence(column.y, fieldNoteRow(historyPosition));
+	return spectrumColour(value, column, spectralSalience(texturePosition), pitchConfidence);
+}
+
 void main()
 {
 	float y = gl_FragCoord.y / resolution.y;
 
-	if (horizontalMode == 1) {
+	if (waterfallPass == 3) {
+		float decibels = waterfallValueOffset
+			+ waterfallValueScale * texelFetch(waterfall, ivec2(gl_FragCoord.xy), 0).r;
+		fragmentColour = vec4((decibels - convertedValueOffset) / convertedValueScale, 0.0f, 0.0f, 1.0f);
+	} else if (waterfallPass == 1) {
+		// gl_FragCoord.y is the centre of the shaded row.
+		fragmentColour = historyColour(axisColumn(gl_FragCoord.x), y);
+	} else if (horizontalMode == 1) {
 		// Horizontal Mode
 		float x = gl_FragCoord.x / resolution.x;
-		float frequency = frequencyPosition(y);
 		float historyPosition = waterfallStartPosition + x * waterfallHistorySpan;
-		vec2 texturePosition = vec2(frequency, historyPosition);
-		float value = texture(waterfall, texturePosition).r;
-		float pitchConfidence = trackedPitchConfidence(
-			pitchClassHistory, frequency, historyPosition);
-		fragmentColour = spectrumColour(
-			value, frequency, spectralSalience(waterfall, texturePosition), pitchConfidence);
+		if (waterfallPass == 2)
+			fragmentColour = texture(shadedWaterfall, vec2(y, historyPosition));
+		else
+			fragmentColour = historyColour(axisColumn(gl_FragCoord.y), historyPosition);
+	} else if (waterfallPass == 2 && y <= upperHalfPercentage) {
+		// Vertical Mode history from the shaded rows
+		float historyPosition = waterfallStartPosition + y / upperHalfPercentage * waterfallHistorySpan;
+		fragmentColour = texture(shadedWaterfall, vec2(gl_FragCoord.x / resolution.x, historyPosition));
 	} else {
 		// Vertical Mode
-		float x = frequencyPosition(gl_FragCoord.x / resolution.x);
+		vec4 column = axisColumn(gl_FragCoord.x);
 
-		vec2 spectrumPosition = vec2(x, 0.0f);
-		float amplitude = texture(audioSampleData, spectrumPosition).r;
+		vec2 spectrumPosition = vec2(column.x, latestSpectrumPosition);
+		float amplitude = waterfallDecibels(spectrumPosition);
 		float amplitudeNormalised = clamp(1.0f + amplitude / 100.0f, 0.0f, 1.0f);
 		if (y > upperHalfPercentage) {
 			// upper half of screen shows curve
 			if ((y-upperHalfPercentage)/(1-upperHalfPercentage) < amplitudeNormalised)  {
-				float pitchConfidence = trackedPitchConfidence(pitchClassData, x, 0.0f);
+				float pitchConfidence = trackedPitchConfidence(column.y, latestFieldNoteRow);
 				fragmentColour = spectrumColour(
-					amplitude, x, spectralSalience(audioSampleData, spectrumPosition), pitchConfidence);
+					amplitude, column, spectralSalience(spectrumPosition), pitchConfidence);
 			}
 			else {
 				fragmentColour = vec4 (0.0, 0.0, 0.0, 1.0);
@@ -139,12 +166,7 @@ void main()
 			// lower half shows history
 			float historyProgress = y / upperHalfPercentage;
 			float historyPosition = waterfallStartPosition + historyProgress * waterfallHistorySpan;
-			vec2 texturePosition = vec2(x, historyPosition);
-			float value = texture(waterfall, texturePosition).r;
-			float pitchConfidence = trackedPitchConfidence(
-				pitchClassHistory, x, historyPosition);
-			fragmentColour = spectrumColour(
-				value, x, spectralSalience(waterfall, texturePosition), pitchConfidence);
+			fragmentColour = historyColour(column, historyPosition);
 		}
 	}
 }
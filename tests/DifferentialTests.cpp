@@ -0,0 +1,479 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PitchTracker.h"
+#include "SimdKernels.h"
+#include "Spectrogram.h"
+#include "TrackedPitch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Test-only access to PitchTracker's field renderer.
+struct PitchTrackerTestAccess {
+	static void renderField(const PitchTracker& tracker, const PitchTracker::FieldNote* notes, int noteCount,
+		float sigma, float* destination) noexcept
+	{
+		tracker.renderField(notes, noteCount, sigma, destination);
+	}
+};
+
+// Compares the optimized analysis paths with straightforward references on
+// randomized and adversarial signals:
+//   - every spectrum row against a double-precision DFT of the same window;
+//   - every tracked-pitch row and tracked note of each available SIMD variant
+//     against the analyzer running the scalar reference kernels;
+//   - the pitch tracker's field renderer against the original per-note loop.
+// Divergence is bounded per row and per note. Threshold decisions in the
+// pitch tracker may flip on tiny numeric differences, so a small share of
+// pitch rows and notes may exceed the bound before a signal fails.
+namespace {
+namespace simd = spectroscope::simd;
+
+constexpr double sampleRate = 48000.0;
+constexpr int fftOrder = 10;
+constexpr int fftSize = 1 << fftOrder;
+constexpr int hopSize = 256;
+constexpr int blockSize = 512;
+
+// Spectrum rows: linear error relative to the row peak, plus a tighter
+// decibel bound for bins within 60 dB of the peak.
+constexpr double spectrumLinearTolerance = 1.0e-5;
+constexpr double spectrumDecibelTolerance = 0.05;
+constexpr double spectrumDecibelRange = 60.0;
+
+// Tracked-pitch rows and notes.
+constexpr float pitchRowTolerance = 0.05f;
+constexpr float noteCentsTolerance = 5.0f;
+constexpr float noteConfidenceTolerance = 0.05f;
+constexpr float minimumComparedConfidence = 0.15f;
+constexpr double allowedOutlierShare = 0.01;
+
+struct TestSignal {
+	std::string name;
+	std::vector<float> samples;
+};
+
+class Random {
+public:
+	explicit Random(std::uint32_t seed)
+		: state_(seed)
+	{
+	}
+
+	float next() noexcept
+	{
+		state_ = state_ * 1664525u + 1013904223u;
+		return static_cast<float>((state_ >> 8) & 0x00ffffffu) / static_cast<float>(0x00ffffffu);
+	}
+
+	float between(float lower, float upper) noexcept
+	{
+		return lower + (upper - lower) * next();
+	}
+
+private:
+	std::uint32_t state_;
+};
+
+int samplesFor(double seconds)
+{
+	return static_cast<int>(seconds * sampleRate);
+}
+
+void addSine(std::vector<float>& samples, int start, int count, double frequency, double amplitude)
+{
+	for (int sample = 0; sample < count; ++sample) {
+		samples[static_cast<std::size_t>(start + sample)] += static_cast<float>(amplitude
+			* std::sin(juce::MathConstants<double>::twoPi * frequency * sample / sampleRate));
+	}
+}
+
+std::vector<TestSignal> createSignals()
+{
+	std::vector<TestSignal> signals;
+	const auto length = samplesFor(1.5);
+
+	for (std::uint32_t seed = 1; seed <= 4; ++seed) {
+		Random random(seed * 7919u);
+		TestSignal signal { "random chord " + std::to_string(seed),
+			std::vector<float>(static_cast<std::size_t>(length), 0.0f) };
+		const auto noteCount = 1 + static_cast<int>(random.next() * 4.0f) % 4;
+		for (int note = 0; note < noteCount; ++note) {
+			const auto frequency = 55.0 * std::pow(2.0, random.between(0.0f, 5.0f));
+			addSine(signal.samples, 0, length, frequency, random.between(0.05f, 0.3f));
+		}
+		for (auto& sample : signal.samples)
+			sample += random.between(-0.005f, 0.005f);
+		signals.push_back(std::move(signal));
+	}
+
+	TestSignal sweep { "exponential sweep", std::vector<float>(static_cast<std::size_t>(length)) };
+	for (int sample = 0; sample < length; ++sample) {
+		const auto time = sample / sampleRate;
+		const auto duration = length / sampleRate;
+		const auto rate = std::log(8000.0 / 40.0) / duration;
+		const auto phase = juce::MathConstants<double>::twoPi * 40.0 * (std::exp(rate * time) - 1.0) / rate;
+		sweep.samples[static_cast<std::size_t>(sample)] = static_cast<float>(0.5 * std::sin(phase));
+	}
+	signals.push_back(std::move(sweep));
+
+	TestSignal chord { "C major chord", std::vector<float>(static_cast<std::size_t>(length), 0.0f) };
+	for (const auto frequency : { 130.81, 164.81, 196.0, 261.63 })
+		addSine(chord.samples, 0, length, frequency, 0.2);
+	signals.push_back(std::move(chord));
+
+	Random noiseRandom(424242u);
+	TestSignal noise { "white noise", std::vector<float>(static_cast<std::size_t>(length)) };
+	for (auto& sample : noise.samples)
+		sample = noiseRandom.between(-0.5f, 0.5f);
+	signals.push_back(std::move(noise));
+
+	TestSignal dc { "DC offset", std::vector<float>(static_cast<std::size_t>(length), 0.5f) };
+	addSine(dc.samples, 0, length, 220.0, 0.1);
+	signals.push_back(std::move(dc));
+
+	TestSignal silenceAfterLoud { "silence after loud",
+		std::vector<float>(static_cast<std::size_t>(length), 0.0f) };
+	for (const auto frequency : { 110.0, 277.18, 329.63 })
+		addSine(silenceAfterLoud.samples, 0, samplesFor(0.5), frequency, 0.3);
+	signals.push_back(std::move(silenceAfterLoud));
+
+	Random denormalRandom(1234u);
+	TestSignal denormals { "denormal-range input", std::vector<float>(static_cast<std::size_t>(length)) };
+	for (auto& sample : denormals.samples)
+		sample = denormalRandom.between(-1.0e-38f, 1.0e-38f);
+	addSine(denormals.samples, samplesFor(1.0), samplesFor(0.5), 440.0, 1.0e-30);
+	signals.push_back(std::move(denormals));
+
+	TestSignal square { "clipped square wave", std::vector<float>(static_cast<std::size_t>(length)) };
+	for (int sample = 0; sample < length; ++sample) {
+		const auto phase = std::fmod(220.0 * sample / sampleRate, 1.0);
+		square.samples[static_cast<std::size_t>(sample)] = phase < 0.5 ? 1.0f : -1.0f;
+	}
+	signals.push_back(std::move(square));
+
+	TestSignal nyquist { "Nyquist alternation", std::vector<float>(static_cast<std::size_t>(length)) };
+	for (int sample = 0; sample < length; ++sample)
+		nyquist.samples[static_cast<std::size_t>(sample)] = (sample % 2) == 0 ? 0.8f : -0.8f;
+	signals.push_back(std::move(nyquist));
+
+	TestSignal clicks { "impulse train", std::vector<float>(static_cast<std::size_t>(length), 0.0f) };
+	for (int sample = 0; sample < length; sample += samplesFor(0.1))
+		clicks.samples[static_cast<std::size_t>(sample)] = 1.0f;
+	signals.push_back(std::move(clicks));
+
+	return signals;
+}
+
+// Computes the analyzer's spectrum row for the window that ends at endSample
+// with a direct double-precision DFT and the same Hann window and scaling.
+class ReferenceSpectrum {
+public:
+	ReferenceSpectrum()
+		: window_(static_cast<std::size_t>(fftSize))
+		, cosine_(static_cast<std::size_t>(fftSize))
+		, sine_(static_cast<std::size_t>(fftSize))
+	{
+		auto windowSum = 0.0;
+		for (int index = 0; index < fftSize; ++index) {
+			const auto angle = juce::MathConstants<double>::twoPi * index / fftSize;
+			window_[static_cast<std::size_t>(index)] = 0.5 - 0.5 * std::cos(
+				juce::MathConstants<double>::twoPi * index / (fftSize - 1));
+			windowSum += window_[static_cast<std::size_t>(index)];
+			cosine_[static_cast<std::size_t>(index)] = std::cos(angle);
+			sine_[static_cast<std::size_t>(index)] = std::sin(angle);
+		}
+		scale_ = 2.0 / windowSum;
+	}
+
+	void calculate(const std::vector<float>& signal, int endSample, float floorDb, std::vector<double>& destination) const
+	{
+		destination.assign(static_cast<std::size_t>(fftSize / 2), 0.0);
+		const auto start = endSample - fftSize;
+		for (int bin = 0; bin < fftSize / 2; ++bin) {
+			auto real = 0.0;
+			auto imaginary = 0.0;
+			for (int index = 0; index < fftSize; ++index) {
+				// Subnormal input is flushed like the analyzer does.
+				const auto input = static_cast<double>(signal[static_cast<std::size_t>(start + index)]);
+				const auto value = std::abs(input) < 1.0e-37 ? 0.0 : input * window_[static_cast<std::size_t>(index)];
+				const auto twiddle = static_cast<std::size_t>((bin * index) % fftSize);
+				real += value * cosine_[twiddle];
+				imaginary -= value * sine_[twiddle];
+			}
+			const auto magnitude = std::sqrt(real * real + imaginary * imaginary) * scale_;
+			destination[static_cast<std::size_t>(bin)] = magnitude > 0.0
+				? std::clamp(20.0 * std::log10(magnitude), static_cast<double>(floorDb), 0.0)
+				: static_cast<double>(floorDb);
+		}
+	}
+
+private:
+	std::vector<double> window_;
+	std::vector<double> cosine_;
+	std::vector<double> sine_;
+	double scale_ { 1.0 };
+};
+
+struct Divergence {
+	int rows { 0 };
+	int spectrumFailures { 0 };
+	int pitchOutlierRows { 0 };
+	int comparedNotes { 0 };
+	int noteOutliers { 0 };
+	double worstSpectrumDb { 0.0 };
+	float worstPitch { 0.0f };
+	float worstNoteCents { 0.0f };
+};
+
+double toLinear(double decibels)
+{
+	return std::pow(10.0, decibels / 20.0);
+}
+
+bool compareSpectrumRow(const std::vector<double>& reference, const float* actual, float floorDb,
+	Divergence& divergence)
+{
+	const auto peakDb = *std::max_element(reference.begin(), reference.end());
+	const auto linearTolerance = spectrumLinearTolerance * toLinear(peakDb) + toLinear(floorDb);
+	auto matches = true;
+	for (std::size_t bin = 0; bin < reference.size(); ++bin) {
+		const auto error = std::abs(reference[bin] - static_cast<double>(actual[bin]));
+		if (reference[bin] >= peakDb - spectrumDecibelRange && reference[bin] > floorDb) {
+			divergence.worstSpectrumDb = std::max(divergence.worstSpectrumDb, error);
+			matches = matches && error <= spectrumDecibelTolerance;
+		}
+		matches = matches && std::abs(toLinear(reference[bin]) - toLinear(actual[bin])) <= linearTolerance;
+	}
+	return matches;
+}
+
+float centsBetween(float first, float second)
+{
+	return 1200.0f * std::abs(std::log2(first / second));
+}
+
+void comparePitchRow(const float* reference, const float* actual, Divergence& divergence)
+{
+	constexpr int outputBinCount = PitchTracker::Layout {}.outputBinCount;
+	auto worstBin = 0.0f;
+	for (int bin = 0; bin < outputBinCount; ++bin)
+		worstBin = std::max(worstBin, std::abs(reference[bin] - actual[bin]));
+	divergence.worstPitch = std::max(divergence.worstPitch, worstBin);
+	if (worstBin > pitchRowTolerance)
+		++divergence.pitchOutlierRows;
+
+	constexpr auto polyphony = static_cast<std::size_t>(PitchTracker::Layout {}.polyphony);
+	std::array<spectroscope::TrackedPitch, polyphony> referenceNotes {};
+	std::array<spectroscope::TrackedPitch, polyphony> actualNotes {};
+	const auto referenceCount = spectroscope::extractTrackedPitches(reference, outputBinCount,
+		440.0f, referenceNotes.data(), static_cast<int>(referenceNotes.size()));
+	const auto actualCount = spectroscope::extractTrackedPitches(actual, outputBinCount,
+		440.0f, actualNotes.data(), static_cast<int>(actualNotes.size()));
+	for (int noteIndex = 0; noteIndex < referenceCount; ++noteIndex) {
+		const auto& note = referenceNotes[static_cast<std::size_t>(noteIndex)];
+		if (note.confidence < minimumComparedConfidence)
+			continue;
+
+		++divergence.comparedNotes;
+		auto closestCents = 1200.0f;
+		auto confidenceError = 1.0f;
+		for (int candidate = 0; candidate < actualCount; ++candidate) {
+			const auto& other = actualNotes[static_cast<std::size_t>(candidate)];
+			const auto cents = centsBetween(note.frequencyHz, other.frequencyHz);
+			if (cents < closestCents) {
+				closestCents = cents;
+				confidenceError = std::abs(note.confidence - other.confidence);
+			}
+		}
+		divergence.worstNoteCents = std::max(divergence.worstNoteCents, closestCents);
+		if (closestCents > noteCentsTolerance || confidenceError > noteConfidenceTolerance)
+			++divergence.noteOutliers;
+	}
+}
+
+bool withinOutlierShare(int outliers, int total)
+{
+	return static_cast<double>(outliers) <= allowedOutlierShare * static_cast<double>(std::max(total, 1));
+}
+
+// DFT rows for every sequence number the analyzer publishes for a signal,
+// computed once and shared by all variants.
+std::vector<std::vector<double>> createReferenceRows(const TestSignal& signal, const ReferenceSpectrum& dft)
+{
+	const auto processedSamples = static_cast<int>(signal.samples.size()) / blockSize * blockSize;
+	std::vector<std::vector<double>> rows;
+	for (auto endSample = fftSize; endSample <= processedSamples; endSample += hopSize) {
+		rows.emplace_back();
+		dft.calculate(signal.samples, endSample, Spectrogram::defaultFloorDb, rows.back());
+	}
+	return rows;
+}
+
+// Runs one analyzer with the scalar reference kernels and one with the
+// variant under test, block by block, and compares every published row.
+bool compareSignal(const TestSignal& signal, const simd::Kernels& kernels,
+	const std::vector<std::vector<double>>& dftRows)
+{
+	Spectrogram reference(fftOrder, hopSize);
+	Spectrogram optimized(fftOrder, hopSize);
+	reference.prepare(sampleRate);
+	optimized.prepare(sampleRate);
+	const auto spectrumSize = optimized.spectrumSize();
+	const auto pitchSize = optimized.pitchClassSize();
+	const auto capacity = Spectrogram::spectrumHistoryCapacity;
+	std::vector<float> referenceSpectra(static_cast<std::size_t>(spectrumSize * capacity));
+	std::vector<float> referencePitches(static_cast<std::size_t>(pitchSize * capacity));
+	std::vector<float> optimizedSpectra(referenceSpectra.size());
+	std::vector<float> optimizedPitches(referencePitches.size());
+	juce::AudioBuffer<float> block(1, blockSize);
+	std::uint64_t referenceThrough = 0;
+	std::uint64_t optimizedThrough = 0;
+	Divergence divergence;
+
+	const auto blockCount = static_cast<int>(signal.samples.size()) / blockSize;
+	for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex) {
+		std::copy_n(signal.samples.begin() + blockIndex * blockSize, blockSize, block.getWritePointer(0));
+		simd::forceInstructionSet(simd::InstructionSet::scalar);
+		reference.process(juce::AudioSourceChannelInfo(&block, 0, blockSize));
+		simd::forceInstructionSet(kernels.instructionSet);
+		optimized.process(juce::AudioSourceChannelInfo(&block, 0, blockSize));
+
+		const auto referenceRows = reference.copyAnalysisFramesAfter(referenceThrough,
+			referenceSpectra.data(), static_cast<int>(referenceSpectra.size()),
+			referencePitches.data(), static_cast<int>(referencePitches.size()), &referenceThrough);
+		const auto optimizedRows = optimized.copyAnalysisFramesAfter(optimizedThrough,
+			optimizedSpectra.data(), static_cast<int>(optimizedSpectra.size()),
+			optimizedPitches.data(), static_cast<int>(optimizedPitches.size()), &optimizedThrough);
+		if (referenceRows != optimizedRows || referenceThrough != optimizedThrough) {
+			std::cerr << "FAILED: " << signal.name << " published different row ranges\n";
+			return false;
+		}
+
+		for (int row = 0; row < optimizedRows; ++row) {
+			const auto sequence = optimizedThrough - static_cast<std::uint64_t>(optimizedRows - row - 1);
+			if (sequence > dftRows.size()
+				|| !compareSpectrumRow(dftRows[static_cast<std::size_t>(sequence - 1)],
+					optimizedSpectra.data() + row * spectrumSize, optimized.floorDb(), divergence)) {
+				++divergence.spectrumFailures;
+			}
+			comparePitchRow(referencePitches.data() + row * pitchSize,
+				optimizedPitches.data() + row * pitchSize, divergence);
+			++divergence.rows;
+		}
+	}
+
+	std::cout << std::left << std::setw(24) << signal.name << std::right << std::setw(8)
+		<< simd::instructionSetName(kernels.instructionSet) << std::setw(6) << divergence.rows
+		<< std::fixed << std::setprecision(4) << std::setw(12) << divergence.worstSpectrumDb
+		<< std::setw(10) << divergence.worstPitch << std::setw(7) << divergence.pitchOutlierRows
+		<< std::setw(7) << divergence.comparedNotes << std::setw(10) << std::setprecision(2)
+		<< divergence.worstNoteCents << std::setw(7) << divergence.noteOutliers << '\n';
+
+	auto passed = true;
+	if (divergence.rows == 0 || divergence.spectrumFailures > 0) {
+		std::cerr << "FAILED: " << signal.name << " has " << divergence.spectrumFailures
+			<< " spectrum rows outside the DFT reference tolerance\n";
+		passed = false;
+	}
+	if (!withinOutlierShare(divergence.pitchOutlierRows, divergence.rows)) {
+		std::cerr << "FAILED: " << signal.name << " has " << divergence.pitchOutlierRows
+			<< " tracked-pitch rows diverging from the scalar reference\n";
+		passed = false;
+	}
+	if (!withinOutlierShare(divergence.noteOutliers, divergence.comparedNotes)) {
+		std::cerr << "FAILED: " << signal.name << " has " << divergence.noteOutliers
+			<< " tracked notes diverging from the scalar reference\n";
+		passed = false;
+	}
+	return passed;
+}
+
+// The original per-note loop of PitchTracker::renderTrackedField().
+void renderFieldReference(const PitchTracker& tracker, const std::vector<PitchTracker::FieldNote>& notes,
+	float sigma, float* destination)
+{
+	std::fill_n(destination, tracker.outputBinCount(), 0.0f);
+	for (const auto& note : notes) {
+		for (int outputBin = 0; outputBin < tracker.outputBinCount(); ++outputBin) {
+			const auto position = (static_cast<float>(outputBin) + 0.5f)
+				* static_cast<float>(tracker.analysisBinCount())
+				/ static_cast<float>(tracker.outputBinCount());
+			const auto distance = std::abs(position - note.position);
+			const auto gaussian = std::exp(-0.5f * distance * distance / (sigma * sigma));
+			destination[outputBin] = std::max(destination[outputBin],
+				std::clamp(note.strength * gaussian, 0.0f, 1.0f));
+		}
+	}
+}
+
+bool testRenderField()
+{
+	Random random(2718u);
+	auto worstError = 0.0f;
+	for (const auto& layout : { PitchTracker::Layout {}, PitchTracker::Layout { 48, 8, 640, 4, 64 } }) {
+		const PitchTracker tracker(layout);
+		std::vector<float> expected(static_cast<std::size_t>(tracker.outputBinCount()));
+		std::vector<float> actual(expected.size());
+		for (int trial = 0; trial < 500; ++trial) {
+			const auto noteCount = static_cast<int>(random.next() * static_cast<float>(tracker.polyphony() + 1))
+				% (tracker.polyphony() + 1);
+			std::vector<PitchTracker::FieldNote> notes;
+			for (int note = 0; note < noteCount; ++note) {
+				// Includes notes just outside the range, overlapping notes and
+				// strengths above one, which must clamp.
+				notes.push_back({ random.between(-5.0f, static_cast<float>(tracker.analysisBinCount()) + 5.0f),
+					random.between(0.0f, 1.2f) });
+			}
+			if (noteCount > 1 && trial % 7 == 0)
+				notes[1].position = notes[0].position + 0.01f;
+			const auto sigma = random.between(0.3f, 1.5f);
+			renderFieldReference(tracker, notes, sigma, expected.data());
+			PitchTrackerTestAccess::renderField(tracker, notes.data(), noteCount, sigma, actual.data());
+			for (std::size_t bin = 0; bin < expected.size(); ++bin)
+				worstError = std::max(worstError, std::abs(expected[bin] - actual[bin]));
+		}
+	}
+
+	std::cout << "renderField worst error " << std::scientific << worstError << std::fixed << '\n';
+	if (worstError > 1.0e-4f) {
+		std::cerr << "FAILED: PitchTracker::renderField diverges from the reference loop\n";
+		return false;
+	}
+	return true;
+}
+}
+
+int main()
+{
+	const auto signals = createSignals();
+	const ReferenceSpectrum dft;
+	auto passed = testRenderField();
+
+	std::cout << "signal                      isa  rows  spectrum/dB  pitch  rows>  notes  cents  notes>\n";
+	for (const auto& signal : signals) {
+		const auto dftRows = createReferenceRows(signal, dft);
+		for (const auto instructionSet : { simd::InstructionSet::scalar, simd::InstructionSet::sse2,
+				 simd::InstructionSet::avx2, simd::InstructionSet::avx512, simd::InstructionSet::neon }) {
+			if (const auto* kernels = simd::kernelsFor(instructionSet))
+				passed = compareSignal(signal, *kernels, dftRows) && passed;
+		}
+	}
+	simd::clearForcedInstructionSet();
+
+	if (!passed)
+		return EXIT_FAILURE;
+	std::cout << "All differential tests passed\n";
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,275 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "Spectrogram.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One analysis writer publishes at a paced, realistic rate while 0-8 reader
+// threads copy synchronized frames as fast as they can. Every copied row is
+// compared bit for bit with the row a single-threaded reference analyzer
+// produced for the same sequence number, so torn or misordered publication is
+// reported as a failure. Writer latency percentiles show how much the readers
+// delay publication relative to the reader-free baseline.
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr double sampleRate = 48000.0;
+constexpr int blockSize = 512;
+constexpr int fftOrder = 10;
+constexpr int hopSize = 128;
+
+struct Settings {
+	double durationSeconds { 2.0 };
+	double speed { 1.0 };
+};
+
+struct ReferenceRows {
+	int spectrumSize { 0 };
+	int pitchSize { 0 };
+	std::vector<float> spectra;
+	std::vector<float> pitches;
+
+	std::uint64_t rowCount() const noexcept
+	{
+		return spectrumSize > 0 ? static_cast<std::uint64_t>(spectra.size()) / static_cast<std::uint64_t>(spectrumSize) : 0;
+	}
+
+	// Sequence numbers start at one for the first published row.
+	const float* spectrum(std::uint64_t sequence) const noexcept
+	{
+		return spectra.data() + (sequence - 1) * static_cast<std::uint64_t>(spectrumSize);
+	}
+
+	const float* pitch(std::uint64_t sequence) const noexcept
+	{
+		return pitches.data() + (sequence - 1) * static_cast<std::uint64_t>(pitchSize);
+	}
+};
+
+struct ReaderResult {
+	std::uint64_t calls { 0 };
+	std::uint64_t rows { 0 };
+	std::uint64_t tornRows { 0 };
+	std::uint64_t misorderedCopies { 0 };
+};
+
+struct RunResult {
+	std::vector<double> publishMicroseconds;
+	std::vector<ReaderResult> readers;
+	double elapsedSeconds { 0.0 };
+};
+
+std::vector<float> createSignal(int sampleCount)
+{
+	std::vector<float> signal(static_cast<std::size_t>(sampleCount));
+	for (int sample = 0; sample < sampleCount; ++sample) {
+		// A slow sweep makes neighbouring rows differ, so a row copied for the
+		// wrong sequence number cannot match its reference by accident.
+		const auto time = static_cast<double>(sample) / sampleRate;
+		const auto phase = juce::MathConstants<double>::twoPi * (110.0 * time + 40.0 * time * time);
+		signal[static_cast<std::size_t>(sample)] = static_cast<float>(0.5 * std::sin(phase)
+			+ 0.2 * std::sin(3.0 * phase));
+	}
+	return signal;
+}
+
+void processBlock(Spectrogram& analyzer, juce::AudioBuffer<float>& block,
+	const std::vector<float>& signal, int blockIndex)
+{
+	std::memcpy(block.getWritePointer(0),
+		signal.data() + static_cast<std::size_t>(blockIndex) * static_cast<std::size_t>(blockSize),
+		sizeof(float) * static_cast<std::size_t>(blockSize));
+	analyzer.process(juce::AudioSourceChannelInfo(&block, 0, blockSize));
+}
+
+ReferenceRows createReferenceRows(const std::vector<float>& signal, int blockCount)
+{
+	Spectrogram analyzer(fftOrder, hopSize);
+	analyzer.prepare(sampleRate);
+	ReferenceRows reference;
+	reference.spectrumSize = analyzer.spectrumSize();
+	reference.pitchSize = analyzer.pitchClassSize();
+	juce::AudioBuffer<float> block(1, blockSize);
+	std::vector<float> spectra(static_cast<std::size_t>(reference.spectrumSize * Spectrogram::spectrumHistoryCapacity));
+	std::vector<float> pitches(static_cast<std::size_t>(reference.pitchSize * Spectrogram::spectrumHistoryCapacity));
+	std::uint64_t copiedThrough = 0;
+	for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex) {
+		processBlock(analyzer, block, signal, blockIndex);
+		const auto rows = analyzer.copyAnalysisFramesAfter(copiedThrough,
+			spectra.data(), static_cast<int>(spectra.size()),
+			pitches.data(), static_cast<int>(pitches.size()), &copiedThrough);
+		reference.spectra.insert(reference.spectra.end(), spectra.begin(),
+			spectra.begin() + rows * reference.spectrumSize);
+		reference.pitches.insert(reference.pitches.end(), pitches.begin(),
+			pitches.begin() + rows * reference.pitchSize);
+	}
+	return reference;
+}
+
+RunResult runConfiguration(const Settings& settings, const std::vector<float>& signal,
+	const ReferenceRows& reference, int blockCount, int readerCount, int backlog)
+{
+	Spectrogram analyzer(fftOrder, hopSize);
+	analyzer.prepare(sampleRate);
+
+	RunResult result;
+	result.readers.resize(static_cast<std::size_t>(readerCount));
+	result.publishMicroseconds.reserve(static_cast<std::size_t>(blockCount));
+	std::atomic<bool> writerFinished { false };
+	std::atomic<int> readersStarted { 0 };
+
+	std::vector<std::thread> readers;
+	for (int readerIndex = 0; readerIndex < readerCount; ++readerIndex) {
+		readers.emplace_back([&, readerIndex] {
+			auto& readerResult = result.readers[static_cast<std::size_t>(readerIndex)];
+			std::vector<float> spectra(static_cast<std::size_t>(reference.spectrumSize * backlog));
+			std::vector<float> pitches(static_cast<std::size_t>(reference.pitchSize * backlog));
+			std::uint64_t previousCopiedThrough = 0;
+			readersStarted.fetch_add(1, std::memory_order_release);
+			while (!writerFinished.load(std::memory_order_acquire)) {
+				const auto newest = analyzer.sequence();
+				const auto after = newest > static_cast<std::uint64_t>(backlog)
+					? newest - static_cast<std::uint64_t>(backlog) : 0;
+				std::uint64_t copiedThrough = 0;
+				const auto rows = analyzer.copyAnalysisFramesAfter(after,
+					spectra.data(), static_cast<int>(spectra.size()),
+					pitches.data(), static_cast<int>(pitches.size()), &copiedThrough);
+				++readerResult.calls;
+				if (rows <= 0)
+					continue;
+
+				readerResult.rows += static_cast<std::uint64_t>(rows);
+				if (copiedThrough < previousCopiedThrough || copiedThrough > reference.rowCount()
+					|| copiedThrough < static_cast<std::uint64_t>(rows)) {
+					++readerResult.misorderedCopies;
+					continue;
+				}
+				previousCopiedThrough = copiedThrough;
+
+				const auto firstSequence = copiedThrough - static_cast<std::uint64_t>(rows) + 1;
+				for (int row = 0; row < rows; ++row) {
+					const auto sequence = firstSequence + static_cast<std::uint64_t>(row);
+					const auto spectrumMatches = std::memcmp(
+						spectra.data() + static_cast<std::size_t>(row * reference.spectrumSize),
+						reference.spectrum(sequence),
+						sizeof(float) * static_cast<std::size_t>(reference.spectrumSize)) == 0;
+					const auto pitchMatches = std::memcmp(
+						pitches.data() + static_cast<std::size_t>(row * reference.pitchSize),
+						reference.pitch(sequence),
+						sizeof(float) * static_cast<std::size_t>(reference.pitchSize)) == 0;
+					if (!spectrumMatches || !pitchMatches)
+						++readerResult.tornRows;
+				}
+			}
+		});
+	}
+	while (readersStarted.load(std::memory_order_acquire) < readerCount)
+		std::this_thread::yield();
+
+	juce::AudioBuffer<float> block(1, blockSize);
+	const auto blockPeriod = std::chrono::duration<double>(
+		static_cast<double>(blockSize) / sampleRate / settings.speed);
+	const auto start = Clock::now();
+	for (int blockIndex = 0; blockIndex < blockCount; ++blockIndex) {
+		std::this_thread::sleep_until(start
+			+ std::chrono::duration_cast<Clock::duration>(blockPeriod * blockIndex));
+		const auto publishStart = Clock::now();
+		processBlock(analyzer, block, signal, blockIndex);
+		result.publishMicroseconds.push_back(
+			std::chrono::duration<double, std::micro>(Clock::now() - publishStart).count());
+	}
+	result.elapsedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	writerFinished.store(true, std::memory_order_release);
+	for (auto& reader : readers)
+		reader.join();
+	return result;
+}
+
+double percentile(std::vector<double> values, double fraction)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	const auto index = static_cast<std::size_t>(std::ceil(fraction * static_cast<double>(values.size()))) - 1;
+	return values[std::min(index, values.size() - 1)];
+}
+
+bool parseArguments(int argc, char* argv[], Settings& settings)
+{
+	for (int index = 1; index < argc; ++index) {
+		const std::string argument(argv[index]);
+		if (argument.rfind("--duration=", 0) == 0) {
+			settings.durationSeconds = std::stod(argument.substr(11));
+		} else if (argument.rfind("--speed=", 0) == 0) {
+			settings.speed = std::stod(argument.substr(8));
+		} else {
+			std::cerr << "Usage: juce-spectroscope-publication-stress [--duration=<seconds per run>]"
+				" [--speed=<realtime multiple>]\n";
+			return false;
+		}
+	}
+	return settings.durationSeconds > 0.0 && settings.speed > 0.0;
+}
+}
+
+int main(int argc, char* argv[])
+{
+	Settings settings;
+	if (!parseArguments(argc, argv, settings))
+		return 2;
+
+	const auto blockCount = std::max(1, static_cast<int>(
+		settings.durationSeconds * settings.speed * sampleRate / blockSize));
+	const auto signal = createSignal(blockCount * blockSize);
+	const auto reference = createReferenceRows(signal, blockCount);
+
+	std::cout << "readers backlog  publish p50/us    p99/us  p99.9/us    max/us  reader rows/s  torn  misordered\n";
+	auto failures = 0;
+	for (const auto readerCount : { 0, 1, 2, 4, 8 }) {
+		for (const auto backlog : { 1, 16, Spectrogram::spectrumHistoryCapacity }) {
+			if (readerCount == 0 && backlog != 1)
+				continue;
+
+			const auto run = runConfiguration(settings, signal, reference, blockCount, readerCount, backlog);
+			ReaderResult total;
+			for (const auto& reader : run.readers) {
+				total.rows += reader.rows;
+				total.tornRows += reader.tornRows;
+				total.misorderedCopies += reader.misorderedCopies;
+			}
+			failures += static_cast<int>(total.tornRows + total.misorderedCopies);
+			const auto readerRowsPerSecond = readerCount > 0
+				? static_cast<double>(total.rows) / run.elapsedSeconds / readerCount : 0.0;
+			std::cout << std::setw(7) << readerCount << std::setw(8) << (readerCount > 0 ? backlog : 0)
+				<< std::fixed << std::setprecision(1)
+				<< std::setw(16) << percentile(run.publishMicroseconds, 0.5)
+				<< std::setw(10) << percentile(run.publishMicroseconds, 0.99)
+				<< std::setw(10) << percentile(run.publishMicroseconds, 0.999)
+				<< std::setw(10) << percentile(run.publishMicroseconds, 1.0)
+				<< std::setw(15) << std::setprecision(0) << readerRowsPerSecond
+				<< std::setw(6) << total.tornRows << std::setw(12) << total.misorderedCopies << '\n';
+		}
+	}
+
+	if (failures > 0) {
+		std::cerr << "FAILED: readers observed " << failures << " torn rows or misordered copies\n";
+		return EXIT_FAILURE;
+	}
+	std::cout << "Publication stress run found no torn or misordered rows\n";
+	return EXIT_SUCCESS;
+}
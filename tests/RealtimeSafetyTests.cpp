@@ -0,0 +1,400 @@
+/*
+   Copyright (c) 2026 Christof Ruch. All rights reserved.
+
+   Dual licensed: Distributed under Affero GPL license by default, an MIT license is available for purchase
+*/
+
+#include "PitchTracker.h"
+#include "Spectrogram.h"
+#include "TrackedNoteDisplay.h"
+#include "TrackedPitch.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer)
+#define SPECTROSCOPE_SANITIZER_BUILD 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define SPECTROSCOPE_SANITIZER_BUILD 1
+#endif
+
+// Sanitizers intercept malloc and pthread themselves, so only operator new
+// is counted in sanitizer builds and on other C libraries.
+#if defined(__GLIBC__) && !defined(SPECTROSCOPE_SANITIZER_BUILD)
+#define SPECTROSCOPE_INTERPOSE_LIBC 1
+#include <dlfcn.h>
+#include <pthread.h>
+#else
+#define SPECTROSCOPE_INTERPOSE_LIBC 0
+#endif
+
+// GCC flags free() in the replaced operator delete once it is inlined next
+// to a replaced operator new, although both use malloc underneath.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+// Replaces the global allocation functions and, with glibc, malloc and
+// pthread_mutex_lock, counting calls per thread while a probe is armed. Each
+// hot path is warmed up first and must then run without a single allocation
+// or mutex acquisition.
+namespace {
+struct ThreadProbe {
+	bool armed { false };
+	std::uint64_t allocations { 0 };
+	std::uint64_t mutexLocks { 0 };
+};
+
+thread_local ThreadProbe probe;
+
+void countAllocation() noexcept
+{
+	if (probe.armed)
+		++probe.allocations;
+}
+
+constexpr bool interposesLibc = SPECTROSCOPE_INTERPOSE_LIBC != 0;
+
+void* allocate(std::size_t size)
+{
+	countAllocation();
+	if (auto* memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+	throw std::bad_alloc();
+}
+
+#if !defined(_WIN32)
+void* allocateAligned(std::size_t size, std::align_val_t alignment)
+{
+	countAllocation();
+	void* memory = nullptr;
+	const auto alignmentBytes = std::max(sizeof(void*), static_cast<std::size_t>(alignment));
+	if (posix_memalign(&memory, alignmentBytes, size == 0 ? 1 : size) != 0)
+		throw std::bad_alloc();
+	return memory;
+}
+#endif
+}
+
+void* operator new(std::size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new[](std::size_t size)
+{
+	return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	countAllocation();
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	countAllocation();
+	return std::malloc(size == 0 ? 1 : size);
+}
+
+// MSVC pairs aligned allocations with _aligned_free, so its defaults are kept.
+#if !defined(_WIN32)
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	return allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	return allocateAligned(size, alignment);
+}
+#endif
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+#if !defined(_WIN32)
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+#if SPECTROSCOPE_INTERPOSE_LIBC
+namespace {
+using MutexFunction = int (*)(pthread_mutex_t*);
+
+// glibc only exports its internal mutex entry points as compatibility
+// symbols, so the real functions are looked up on first use. Plain atomics
+// avoid static-initialisation guards, which may themselves lock.
+MutexFunction nextMutexFunction(std::atomic<MutexFunction>& cached, const char* name) noexcept
+{
+	auto function = cached.load(std::memory_order_acquire);
+	if (function == nullptr) {
+		function = reinterpret_cast<MutexFunction>(dlsym(RTLD_NEXT, name));
+		cached.store(function, std::memory_order_release);
+	}
+	return function;
+}
+
+std::atomic<MutexFunction> nextMutexLock { nullptr };
+std::atomic<MutexFunction> nextMutexTryLock { nullptr };
+}
+
+extern "C" {
+void* __libc_malloc(std::size_t size);
+void* __libc_calloc(std::size_t count, std::size_t size);
+void* __libc_realloc(void* memory, std::size_t size);
+
+void* malloc(std::size_t size)
+{
+	countAllocation();
+	return __libc_malloc(size);
+}
+
+void* calloc(std::size_t count, std::size_t size)
+{
+	countAllocation();
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* memory, std::size_t size)
+{
+	countAllocation();
+	return __libc_realloc(memory, size);
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+	if (probe.armed)
+		++probe.mutexLocks;
+	return nextMutexFunction(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex)
+{
+	if (probe.armed)
+		++probe.mutexLocks;
+	return nextMutexFunction(nextMutexTryLock, "pthread_mutex_trylock")(mutex);
+}
+}
+#endif
+
+namespace {
+bool expect(bool condition, const std::string& message)
+{
+	if (!condition)
+		std::cerr << "FAILED: " << message << '\n';
+	return condition;
+}
+
+class ArmedProbe {
+public:
+	ArmedProbe() noexcept
+	{
+		probe = {};
+		probe.armed = true;
+	}
+
+	~ArmedProbe()
+	{
+		probe.armed = false;
+	}
+
+	ArmedProbe(const ArmedProbe&) = delete;
+	ArmedProbe& operator=(const ArmedProbe&) = delete;
+};
+
+template <typename Operation>
+bool expectRealtimeSafe(const std::string& name, Operation&& operation)
+{
+	ThreadProbe observed;
+	{
+		const ArmedProbe armed;
+		operation();
+		observed = probe;
+	}
+	return expect(observed.allocations == 0,
+			name + " allocated " + std::to_string(observed.allocations) + " times after warm-up")
+		&& expect(observed.mutexLocks == 0,
+			name + " acquired a mutex " + std::to_string(observed.mutexLocks) + " times after warm-up");
+}
+
+bool testProbeDetectsAllocationsAndLocks()
+{
+	ThreadProbe observed;
+	std::mutex mutex;
+	{
+		const ArmedProbe armed;
+		auto values = std::make_unique<std::vector<float>>(16);
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			(*values)[0] = 1.0f;
+		}
+		observed = probe;
+	}
+	return expect(observed.allocations >= 2, "operator new should be counted while armed")
+		&& expect(!interposesLibc || observed.mutexLocks == 1,
+			"pthread_mutex_lock should be counted while armed");
+}
+
+void fillChord(juce::AudioBuffer<float>& buffer, double sampleRate, double& phase)
+{
+	for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
+		const auto value = static_cast<float>(0.3 * std::sin(phase) + 0.2 * std::sin(1.5 * phase)
+			+ 0.1 * std::sin(2.52 * phase));
+		phase += juce::MathConstants<double>::twoPi * 196.0 / sampleRate;
+		for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+			buffer.setSample(channel, sample, value);
+	}
+}
+
+bool testSpectrogramHotPaths()
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr int blockSize = 480;
+	Spectrogram analyzer;
+	analyzer.prepare(sampleRate);
+	juce::AudioBuffer<float> block(2, blockSize);
+	std::vector<float> spectra(static_cast<std::size_t>(
+		analyzer.spectrumSize() * Spectrogram::spectrumHistoryCapacity));
+	std::vector<float> pitches(static_cast<std::size_t>(
+		analyzer.pitchClassSize() * Spectrogram::spectrumHistoryCapacity));
+	auto phase = 0.0;
+	std::uint64_t lastSequence = 0;
+	const auto runBlocks = [&](int blockCount) {
+		for (int index = 0; index < blockCount; ++index) {
+			fillChord(block, sampleRate, phase);
+			analyzer.process(juce::AudioSourceChannelInfo(&block, 0, blockSize));
+			analyzer.copyAnalysisFramesAfter(lastSequence, spectra.data(), static_cast<int>(spectra.size()),
+				pitches.data(), static_cast<int>(pitches.size()), &lastSequence);
+		}
+	};
+	runBlocks(200);
+
+	return expectRealtimeSafe("Spectrogram::process", [&] {
+			for (int index = 0; index < 400; ++index) {
+				fillChord(block, sampleRate, phase);
+				analyzer.process(juce::AudioSourceChannelInfo(&block, 0, blockSize));
+			}
+		})
+		&& expectRealtimeSafe("Spectrogram copy APIs", [&] {
+			for (int index = 0; index < 100; ++index) {
+				analyzer.copyLatestSpectrum(spectra.data(), analyzer.spectrumSize());
+				analyzer.copyLatestPitchClass(pitches.data(), analyzer.pitchClassSize());
+				analyzer.copySpectrumFramesAfter(0, spectra.data(), static_cast<int>(spectra.size()));
+				analyzer.copyAnalysisFramesAfter(0, spectra.data(), static_cast<int>(spectra.size()),
+					pitches.data(), static_cast<int>(pitches.size()));
+			}
+		})
+		&& expectRealtimeSafe("Spectrogram tuning and preset changes", [&] {
+			analyzer.setConcertAHz(442.0f);
+			analyzer.setPitchTrackingPreset(PitchTracker::Preset::fast);
+			runBlocks(50);
+			analyzer.setPitchTrackingPreset(PitchTracker::Preset::balanced);
+			runBlocks(50);
+		});
+}
+
+// The OpenGL render callback cannot run headless, but the CPU work it does per
+// frame for tracked notes can.
+bool testRenderThreadNoteHelpers()
+{
+	PitchTracker tracker;
+	tracker.prepare(48000.0);
+	std::vector<float> samples(512);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+	auto phase = 0.0;
+	const auto runBlock = [&] {
+		for (auto& sample : samples) {
+			sample = static_cast<float>(0.5 * std::sin(phase));
+			phase += juce::MathConstants<double>::twoPi * 261.63 / 48000.0;
+		}
+		tracker.process(samples.data(), static_cast<int>(samples.size()));
+		tracker.calculate(field.data(), static_cast<int>(field.size()));
+	};
+	for (int block = 0; block < 50; ++block)
+		runBlock();
+
+	spectroscope::TrackedNoteHistory history;
+	spectroscope::TrackedNoteDisplay display;
+	std::array<spectroscope::TrackedPitch, 6> notes {};
+	std::array<spectroscope::TrackedNoteHistory::Entry,
+		spectroscope::TrackedNoteHistory::capacity> historyEntries {};
+	std::array<spectroscope::TrackedNoteDisplay::Entry,
+		spectroscope::TrackedNoteDisplay::capacity> displayEntries {};
+	return expectRealtimeSafe("tracked-note render helpers", [&] {
+		for (std::uint64_t sequence = 1; sequence <= 200; ++sequence) {
+			runBlock();
+			const auto noteCount = spectroscope::extractTrackedPitches(field.data(),
+				static_cast<int>(field.size()), 440.0f, notes.data(), static_cast<int>(notes.size()));
+			history.update(notes.data(), noteCount, sequence);
+			history.visibleEntries(sequence, 512, historyEntries.data(),
+				static_cast<int>(historyEntries.size()));
+			display.update(notes.data(), noteCount, static_cast<double>(sequence) * 10.0);
+			display.visibleEntries(static_cast<double>(sequence) * 10.0, displayEntries.data(),
+				static_cast<int>(displayEntries.size()));
+		}
+	});
+}
+}
+
+int main()
+{
+	if (!interposesLibc)
+		std::cout << "malloc and mutex interposition unavailable; checking operator new only\n";
+
+	const auto passed = testProbeDetectsAllocationsAndLocks() && testSpectrogramHotPaths()
+		&& testRenderThreadNoteHelpers();
+	if (!passed)
+		return EXIT_FAILURE;
+
+	std::cout << "All realtime-safety tests passed\n";
+	return EXIT_SUCCESS;
+}
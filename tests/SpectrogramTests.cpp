@@ -1,19 +1,45 @@
+#include "FrameTiming.h"
 #include "FrequencyAxis.h"
 #include "NoteAtlasLayout.h"
 #include "PitchTracker.h"
+#include "SimdKernels.h"
 #include "Spectrogram.h"
+#include "SpectroscopeTrace.h"
+#include "TexelPacking.h"
 #include "TrackedNoteDisplay.h"
 #include "TrackedPitch.h"
 #include "WaterfallTimeline.h"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+// Test-only access to PitchTracker's field renderer.
+struct PitchTrackerTestAccess {
+	static void renderField(const PitchTracker& tracker, const PitchTracker::FieldNote* notes, int noteCount,
+		float sigma, float* destination) noexcept
+	{
+		tracker.renderField(notes, noteCount, sigma, destination);
+	}
+};
+
+// Test-only access to the quality governor's clock.
+struct SpectrogramTestAccess {
+	static void setGovernorClock(Spectrogram& analyzer, Spectrogram::GovernorClock clock) noexcept
+	{
+		analyzer.governorClock_ = clock;
+	}
+};
+
 namespace {
 bool expect(bool condition, const std::string& message)
 {
@@ -64,8 +90,8 @@ int pitchFieldPeak(const std::vector<float>& field)
 int pitchFieldBinForFrequency(double frequency, double concertA)
 {
 	const auto octavePosition = std::log2(frequency / (concertA / 8.0));
-	return static_cast<int>(std::floor(octavePosition / PitchTracker::octaveCount
-		* PitchTracker::outputBinCount));
+	constexpr PitchTracker::Layout layout;
+	return static_cast<int>(std::floor(octavePosition / layout.octaveCount * layout.outputBinCount));
 }
 
 float pitchFieldAtFrequency(const std::vector<float>& field, double frequency, double concertA)
@@ -86,7 +112,7 @@ int blocksUntilPitchVisible(PitchTracker::Preset preset, double frequency,
 	tracker.setPreset(preset);
 	tracker.prepare(sampleRate, static_cast<float>(concertA));
 	std::vector<float> samples(blockSize);
-	std::vector<float> field(PitchTracker::outputBinCount);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 	auto phase = 0.0;
 	for (int block = 1; block <= maximumBlocks; ++block) {
 		for (auto& sample : samples) {
@@ -172,7 +198,7 @@ bool testPitchTrackerStablePitchAndDetuning()
 	const auto c4 = concertA * 0.5 * 0.5 * std::pow(2.0, 3.0 / 12.0);
 	PitchTracker tracker;
 	tracker.prepare(48000.0, static_cast<float>(concertA));
-	std::vector<float> field(PitchTracker::outputBinCount);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 	processPitchSignal(tracker, { c4 }, 80, field);
 
 	const auto expectedC = pitchFieldBinForFrequency(c4, concertA);
@@ -245,13 +271,148 @@ bool testPitchTrackerPresets()
 		"the analyzer should expose the preset selected by its UI consumer");
 }
 
+bool testPitchTrackerRetuneKeepsNotes()
+{
+	constexpr double frequency = 220.0;
+	constexpr double retunedConcertA = 466.0;
+	PitchTracker tracker;
+	tracker.prepare(48000.0, 440.0f);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+	processPitchSignal(tracker, { frequency }, 40, field);
+
+	// One hop after the retune the note must still be there, at the same
+	// absolute pitch on the shifted grid.
+	tracker.setConcertAHz(static_cast<float>(retunedConcertA));
+	processPitchSignal(tracker, { frequency }, 1, field);
+	const auto expectedBin = pitchFieldBinForFrequency(frequency, retunedConcertA);
+	if (!expect(pitchFieldAtFrequency(field, frequency, retunedConcertA) > 0.5f,
+			"retuning should keep a sustained note visible")
+		|| !expect(std::abs(pitchFieldPeak(field) - expectedBin) <= 1,
+			"a retuned note should keep its absolute pitch")) {
+		return false;
+	}
+
+	tracker.setPreset(PitchTracker::Preset::stable);
+	processPitchSignal(tracker, { frequency }, 1, field);
+	if (!expect(pitchFieldAtFrequency(field, frequency, retunedConcertA) > 0.5f,
+			"a preset change should keep a sustained note visible")) {
+		return false;
+	}
+
+	// Once the coefficients have settled, the tracker matches one prepared
+	// with the new settings.
+	PitchTracker reference;
+	reference.setPreset(PitchTracker::Preset::stable);
+	reference.prepare(48000.0, static_cast<float>(retunedConcertA));
+	std::vector<float> referenceField(static_cast<std::size_t>(reference.outputBinCount()));
+	processPitchSignal(tracker, { frequency }, 60, field);
+	processPitchSignal(reference, { frequency }, 60, referenceField);
+	return expect(pitchFieldPeak(field) == pitchFieldPeak(referenceField),
+		"a retuned tracker should settle where a freshly prepared one does");
+}
+
+bool testPitchTrackerLayouts()
+{
+	// A piano-range tuner layout: eight octaves from A0 at 25 cents per bin.
+	const PitchTracker::Layout tunerLayout { 48, 8, 768, 4 };
+	Spectrogram analyzer(Spectrogram::defaultFftOrder, 0, Spectrogram::defaultFloorDb, tunerLayout);
+	analyzer.prepare(48000.0);
+	if (!expect(analyzer.pitchClassSize() == tunerLayout.outputBinCount,
+			"the published field should have the layout's output bin count")) {
+		return false;
+	}
+
+	juce::AudioBuffer<float> block(1, analyzer.hopSize());
+	std::vector<float> field(static_cast<std::size_t>(analyzer.pitchClassSize()));
+	std::array<spectroscope::TrackedPitch, 4> pitches {};
+	for (const auto frequency : { 32.7, 4186.0 }) {
+		analyzer.reset();
+		auto phase = 0.0;
+		for (int hop = 0; hop < 60; ++hop) {
+			fillSine(block, frequency, 48000.0, phase);
+			analyzer.process({ &block, 0, block.getNumSamples() });
+		}
+		analyzer.copyLatestPitchClass(field.data(), static_cast<int>(field.size()));
+		const auto count = spectroscope::extractTrackedPitches(field.data(), static_cast<int>(field.size()),
+			analyzer.pitchLayout(), 440.0f, pitches.data(), static_cast<int>(pitches.size()));
+		const auto strongest = std::max_element(pitches.begin(), pitches.begin() + count,
+			[](const spectroscope::TrackedPitch& first, const spectroscope::TrackedPitch& second) {
+				return first.confidence < second.confidence;
+			});
+		if (!expect(count > 0 && std::abs(1200.0 * std::log2(strongest->frequencyHz / frequency)) < 15.0,
+				"a wide layout should track C1 and C8 (" + std::to_string(frequency) + " Hz)")) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool testPitchTrackerAboveNyquist()
+{
+	// Ten octaves from A2 reach 56 kHz. The resonator at 28160 Hz would alias
+	// onto a 19840 Hz tone at 48 kHz.
+	constexpr double aliasedFrequency = 48000.0 - 28160.0;
+	PitchTracker tracker({ 24, 10, 256, 3 });
+	tracker.prepare(48000.0);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+	processPitchSignal(tracker, { 220.0, aliasedFrequency }, 60, field);
+	std::array<PitchTracker::Note, 12> notes {};
+	const auto count = tracker.copyNotes(notes.data(), static_cast<int>(notes.size()));
+	return expect(count > 0, "a layout reaching past Nyquist should still track notes below it")
+		&& expect(std::none_of(notes.begin(), notes.begin() + count,
+				[](const PitchTracker::Note& note) { return note.frequencyHz >= 24000.0f; }),
+			"resonators above Nyquist should report no notes");
+}
+
+bool testPitchTrackerPolyphony()
+{
+	constexpr double concertA = 440.0;
+	auto pitchCount = [](const PitchTracker::Layout& layout, const std::vector<double>& frequencies,
+		float minimumConfidence) {
+		PitchTracker tracker(layout);
+		tracker.prepare(48000.0, static_cast<float>(concertA));
+		std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
+		processPitchSignal(tracker, frequencies, 80, field);
+		std::array<spectroscope::TrackedPitch, 64> pitches {};
+		return spectroscope::extractTrackedPitches(field.data(), static_cast<int>(field.size()),
+			layout, static_cast<float>(concertA), pitches.data(), static_cast<int>(pitches.size()),
+			minimumConfidence);
+	};
+
+	const std::vector<double> triad { 130.81, 164.81, 196.0 };
+	PitchTracker::Layout duophonic;
+	duophonic.polyphony = 2;
+	const auto duophonicCount = pitchCount(duophonic, triad, 0.05f);
+	if (!expect(pitchCount({}, triad, 0.05f) == 3, "the default polyphony should track a triad")
+		|| !expect(duophonicCount > 0 && duophonicCount <= 2,
+			"a polyphony of two should track at most two notes of a triad ("
+				+ std::to_string(duophonicCount) + ")")) {
+		return false;
+	}
+
+	// Sixteen notes 4.5 semitones apart over seven octaves, none of them near
+	// a low harmonic of another.
+	std::vector<double> cluster;
+	for (const auto semitones : { 12.0, 16.5, 21.0, 25.5, 30.0, 34.5, 39.0, 43.5,
+			51.5, 56.0, 60.5, 65.0, 69.5, 74.0, 78.5, 83.0 }) {
+		cluster.push_back(27.5 * std::pow(2.0, semitones / 12.0));
+	}
+	PitchTracker::Layout piano { 24, 8, 384, 4, 12 };
+	const auto limitedCount = pitchCount(piano, cluster, 0.02f);
+	piano.polyphony = 32;
+	const auto denseCount = pitchCount(piano, cluster, 0.02f);
+	return expect(denseCount > limitedCount,
+		"a higher polyphony should keep more notes of a dense cluster ("
+			+ std::to_string(denseCount) + " versus " + std::to_string(limitedCount) + ")");
+}
+
 bool testTrackedPitchMusicalValues()
 {
 	constexpr double concertA = 440.0;
 	constexpr double frequency = 445.0;
 	PitchTracker tracker;
 	tracker.prepare(48000.0, static_cast<float>(concertA));
-	std::vector<float> field(PitchTracker::outputBinCount);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 	processPitchSignal(tracker, { frequency }, 80, field);
 
 	std::array<spectroscope::TrackedPitch, 6> notes {};
@@ -372,6 +533,57 @@ bool testTrackedNoteHorizontalHistory()
 		"horizontal history should not archive guesses below 15 percent confidence");
 }
 
+bool testTrackedNoteHistoryAnchors()
+{
+	spectroscope::TrackedNoteHistory history;
+	const std::array<spectroscope::TrackedPitch, 3> notes {
+		spectroscope::TrackedPitch { 440.0f, 0.50f, 0.0f, 69 },
+		spectroscope::TrackedPitch { 523.3f, 0.50f, 1.0f, 72 },
+		spectroscope::TrackedPitch { 659.3f, 0.90f, -2.0f, 76 }
+	};
+	history.update(notes.data(), static_cast<int>(notes.size()), 100);
+	const auto firstRevision = history.revision();
+	history.update(notes.data(), static_cast<int>(notes.size()), 105);
+	if (!expect(history.revision() == firstRevision,
+		"continuing notes should not change the anchored cards")) {
+		return false;
+	}
+
+	history.update(notes.data() + 1, 2, 110);
+	if (!expect(history.revision() != firstRevision,
+		"a released note should change the anchored cards")) {
+		return false;
+	}
+
+	std::array<spectroscope::TrackedNoteHistory::AnchoredEntry,
+		spectroscope::TrackedNoteHistory::capacity> anchored {};
+	std::array<spectroscope::TrackedNoteHistory::Entry,
+		spectroscope::TrackedNoteHistory::capacity> entries {};
+	const auto anchoredCount = history.anchoredEntries(anchored.data(),
+		static_cast<int>(anchored.size()));
+	const auto visibleCount = history.visibleEntries(120, 512,
+		entries.data(), static_cast<int>(entries.size()));
+	if (!expect(anchoredCount == 3 && visibleCount == 3,
+		"every visible card should have an anchor")
+		|| !expect(!anchored[0].tracking && anchored[0].anchorSequence == 110,
+			"a released card should stay anchored to its release row")) {
+		return false;
+	}
+
+	for (int index = 0; index < anchoredCount; ++index) {
+		const auto& anchor = anchored[static_cast<std::size_t>(index)];
+		const auto ageRows = anchor.tracking ? 0.0f
+			: static_cast<float>(120 - anchor.anchorSequence);
+		if (!expect(anchor.slotIndex == entries[static_cast<std::size_t>(index)].slotIndex
+				&& approximatelyEqual(1.0f - ageRows / 511.0f,
+					entries[static_cast<std::size_t>(index)].historyPosition),
+			"anchored cards should paint in the same order and place as visible ones")) {
+			return false;
+		}
+	}
+	return true;
+}
+
 bool testPitchTrackerChordAndRelease()
 {
 	constexpr double concertA = 440.0;
@@ -381,7 +593,7 @@ bool testPitchTrackerChordAndRelease()
 	};
 	PitchTracker tracker;
 	tracker.prepare(48000.0, static_cast<float>(concertA));
-	std::vector<float> field(PitchTracker::outputBinCount);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 	processPitchSignal(tracker,
 		{ frequencyForSemitones(3.0), frequencyForSemitones(7.0), frequencyForSemitones(10.0) },
 		100, field);
@@ -418,7 +630,7 @@ bool testPitchTrackerHarmonicMusicalTone()
 	const auto a3 = concertA * 0.5;
 	PitchTracker tracker;
 	tracker.prepare(48000.0, static_cast<float>(concertA));
-	std::vector<float> field(PitchTracker::outputBinCount);
+	std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 	processHarmonicPitchSignal(tracker, a3, 24, field);
 
 	const auto fundamentalStrength = pitchFieldAtFrequency(field, a3, concertA);
@@ -437,7 +649,7 @@ bool testPitchTrackerRejectsBroadbandNoise()
 		PitchTracker tracker;
 		tracker.setPreset(preset);
 		tracker.prepare(48000.0, 440.0f);
-		std::vector<float> field(PitchTracker::outputBinCount);
+		std::vector<float> field(static_cast<std::size_t>(tracker.outputBinCount()));
 		std::vector<float> noise(512);
 		std::uint32_t randomState = 0x12345678u;
 		for (int block = 0; block < 150; ++block) {
@@ -487,6 +699,185 @@ bool testSpectrogramPublishesTrackedPitch()
 			"spectrogram should feed audio and its A4 reference into the pitch tracker");
 }
 
+bool testSpectrogramPublishesNoteEvents()
+{
+	constexpr double sampleRate = 48000.0;
+	const std::array<double, 2> fifth { 130.81, 196.0 };
+	Spectrogram analyzer;
+	analyzer.prepare(sampleRate);
+	juce::AudioBuffer<float> block(1, analyzer.hopSize());
+	std::array<double, 2> phases {};
+	for (int iteration = 0; iteration < 100; ++iteration) {
+		for (int sample = 0; sample < block.getNumSamples(); ++sample) {
+			auto value = 0.0;
+			for (std::size_t note = 0; note < fifth.size(); ++note) {
+				value += std::sin(phases[note]);
+				phases[note] += juce::MathConstants<double>::twoPi * fifth[note] / sampleRate;
+			}
+			block.setSample(0, sample, static_cast<float>(0.3 * value));
+		}
+		analyzer.process({ &block, 0, block.getNumSamples() });
+	}
+
+	std::array<spectroscope::TrackedPitch, 8> notes {};
+	std::uint64_t notesSequence = 0;
+	const auto noteCount = analyzer.copyLatestTrackedNotes(notes.data(), static_cast<int>(notes.size()),
+		&notesSequence);
+	if (!expect(noteCount == 2 && notesSequence == analyzer.sequence(),
+			"the newest row should list both notes of a fifth (" + std::to_string(noteCount) + ")")) {
+		return false;
+	}
+	for (std::size_t note = 0; note < fifth.size(); ++note) {
+		const auto cents = 1200.0 * std::log2(static_cast<double>(notes[note].frequencyHz) / fifth[note]);
+		if (!expect(std::abs(cents) < 15.0 && notes[note].id != 0
+				&& notes[note].midiNote == 48 + 7 * static_cast<int>(note),
+				"listed notes should be ordered by frequency and carry ids and note numbers")) {
+			return false;
+		}
+	}
+	std::array<spectroscope::TrackedPitch, 1> strongest {};
+	if (!expect(analyzer.copyLatestTrackedNotes(strongest.data(), 1) == 1
+			&& strongest[0].confidence >= std::min(notes[0].confidence, notes[1].confidence),
+			"a small destination should receive the strongest notes")) {
+		return false;
+	}
+
+	std::array<spectroscope::TrackedNoteEvent, 16> events {};
+	std::uint64_t eventSequence = 0;
+	auto eventCount = analyzer.copyNoteEventsAfter(0, events.data(), static_cast<int>(events.size()),
+		&eventSequence);
+	const auto onsetsMatchList = eventCount == 2
+		&& events[0].type == spectroscope::TrackedNoteEvent::Type::noteOn
+		&& events[1].type == spectroscope::TrackedNoteEvent::Type::noteOn
+		&& std::min(events[0].note.id, events[1].note.id) == std::min(notes[0].id, notes[1].id)
+		&& std::max(events[0].note.id, events[1].note.id) == std::max(notes[0].id, notes[1].id)
+		&& events[0].rowSequence > 0 && events[0].rowSequence <= notesSequence;
+	if (!expect(onsetsMatchList, "each listed note should have one note-on event with its id ("
+			+ std::to_string(eventCount) + " events)")) {
+		return false;
+	}
+
+	block.clear();
+	for (int iteration = 0; iteration < 100; ++iteration)
+		analyzer.process({ &block, 0, block.getNumSamples() });
+	eventCount = analyzer.copyNoteEventsAfter(eventSequence, events.data(), static_cast<int>(events.size()));
+	const auto releasesMatchList = eventCount == 2
+		&& events[0].type == spectroscope::TrackedNoteEvent::Type::noteOff
+		&& events[1].type == spectroscope::TrackedNoteEvent::Type::noteOff
+		&& std::min(events[0].note.id, events[1].note.id) == std::min(notes[0].id, notes[1].id)
+		&& std::max(events[0].note.id, events[1].note.id) == std::max(notes[0].id, notes[1].id)
+		&& events[0].samplePosition > events[0].rowSequence;
+	return expect(releasesMatchList, "silence should end both notes with note-off events ("
+			+ std::to_string(eventCount) + " events)")
+		&& expect(analyzer.copyLatestTrackedNotes(notes.data(), static_cast<int>(notes.size())) == 0,
+			"the note list should be empty after the release");
+}
+
+bool testSpectrogramPublishesFieldNotes()
+{
+	constexpr double sampleRate = 48000.0;
+	const std::array<double, 2> fifth { 130.81, 196.0 };
+	Spectrogram analyzer;
+	analyzer.prepare(sampleRate);
+	juce::AudioBuffer<float> block(1, analyzer.hopSize());
+	std::array<double, 2> phases {};
+	const auto processFifth = [&](int hops) {
+		for (int iteration = 0; iteration < hops; ++iteration) {
+			for (int sample = 0; sample < block.getNumSamples(); ++sample) {
+				auto value = 0.0;
+				for (std::size_t note = 0; note < fifth.size(); ++note) {
+					value += std::sin(phases[note]);
+					phases[note] += juce::MathConstants<double>::twoPi * fifth[note] / sampleRate;
+				}
+				block.setSample(0, sample, static_cast<float>(0.3 * value));
+			}
+			analyzer.process({ &block, 0, block.getNumSamples() });
+		}
+	};
+	processFifth(100);
+
+	std::vector<float> spectrum(static_cast<size_t>(analyzer.spectrumSize()));
+	std::vector<float> field(static_cast<size_t>(analyzer.pitchClassSize()));
+	std::vector<float> fieldNotes(static_cast<size_t>(analyzer.fieldNoteRowSize()));
+	analyzer.copyAnalysisFramesAfter(analyzer.sequence() - 1, spectrum.data(),
+		static_cast<int>(spectrum.size()), field.data(), static_cast<int>(field.size()));
+	std::uint64_t fieldNoteSequence = 0;
+	const auto rows = analyzer.copyFieldNoteFramesAfter(analyzer.sequence() - 1, spectrum.data(),
+		static_cast<int>(spectrum.size()), fieldNotes.data(), static_cast<int>(fieldNotes.size()),
+		&fieldNoteSequence);
+	const auto noteCount = static_cast<int>(fieldNotes[0]);
+	if (!expect(rows == 1 && fieldNoteSequence == analyzer.sequence()
+			&& analyzer.fieldNoteRowSize() == 2 + 2 * analyzer.pitchLayout().polyphony && noteCount == 2,
+			"each row should carry the field notes of a fifth (" + std::to_string(noteCount) + ")")) {
+		return false;
+	}
+
+	// The notes must reproduce the dense field exactly, as the shader relies on.
+	std::vector<PitchTracker::FieldNote> notes(static_cast<size_t>(noteCount));
+	for (std::size_t note = 0; note < notes.size(); ++note)
+		notes[note] = { fieldNotes[2 + 2 * note], fieldNotes[3 + 2 * note] };
+	std::vector<float> rendered(field.size());
+	PitchTrackerTestAccess::renderField(PitchTracker(analyzer.pitchLayout()), notes.data(), noteCount,
+		fieldNotes[1], rendered.data());
+	auto worstError = 0.0f;
+	for (std::size_t bin = 0; bin < field.size(); ++bin)
+		worstError = std::max(worstError, std::abs(rendered[bin] - field[bin]));
+	if (!expect(worstError < 0.00001f, "field notes should render the published field ("
+			+ std::to_string(worstError) + ")")) {
+		return false;
+	}
+
+	analyzer.setPitchFieldEnabled(false);
+	processFifth(4);
+	analyzer.copyAnalysisFramesAfter(analyzer.sequence() - 1, spectrum.data(),
+		static_cast<int>(spectrum.size()), field.data(), static_cast<int>(field.size()));
+	analyzer.copyFieldNoteFramesAfter(analyzer.sequence() - 1, spectrum.data(),
+		static_cast<int>(spectrum.size()), fieldNotes.data(), static_cast<int>(fieldNotes.size()));
+	return expect(!analyzer.isPitchFieldEnabled()
+			&& std::all_of(field.begin(), field.end(), [](float value) { return approximatelyEqual(value, 0.0f); })
+			&& static_cast<int>(fieldNotes[0]) == 2,
+		"without the dense field, rows should still carry the field notes");
+}
+
+bool testPublishListeners()
+{
+	struct CountingListener final : Spectrogram::PublishListener {
+		void rowsPublished(std::uint64_t newestSequence) noexcept override
+		{
+			++notifications;
+			lastSequence = newestSequence;
+		}
+
+		int notifications { 0 };
+		std::uint64_t lastSequence { 0 };
+	};
+
+	Spectrogram analyzer;
+	analyzer.prepare(48000.0);
+	juce::AudioBuffer<float> block(1, analyzer.fftSize());
+	block.clear();
+	CountingListener listener;
+	std::array<CountingListener, Spectrogram::maximumPublishListeners> others {};
+	auto allAdded = analyzer.addPublishListener(&listener);
+	for (int other = 0; other + 1 < Spectrogram::maximumPublishListeners; ++other)
+		allAdded = allAdded && analyzer.addPublishListener(&others[static_cast<size_t>(other)]);
+	const auto overflowRejected = !analyzer.addPublishListener(&others.back());
+
+	analyzer.process({ &block, 0, analyzer.hopSize() / 2 });
+	const auto quietWithoutRows = listener.notifications == 0;
+	analyzer.process({ &block, 0, block.getNumSamples() });
+	const auto notifiedOnce = listener.notifications == 1 && listener.lastSequence == analyzer.sequence()
+		&& others.front().notifications == 1;
+
+	analyzer.removePublishListener(&listener);
+	analyzer.process({ &block, 0, block.getNumSamples() });
+	return expect(allAdded && overflowRejected, "listener slots should be limited")
+		&& expect(quietWithoutRows, "a call that publishes no row should not notify")
+		&& expect(notifiedOnce, "each publishing call should notify once with its newest row")
+		&& expect(listener.notifications == 1 && others.front().notifications == 2,
+			"a removed listener should not be notified again");
+}
+
 bool testSilence()
 {
 	Spectrogram analyzer;
@@ -507,6 +898,345 @@ bool testSilence()
 	}), "silence should remain at the configured finite floor");
 }
 
+bool testSilenceGate()
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr double frequency = 220.0;
+	Spectrogram gated;
+	Spectrogram ungated;
+	ungated.setSilenceThresholdDb(-std::numeric_limits<float>::infinity());
+	gated.prepare(sampleRate);
+	ungated.prepare(sampleRate);
+
+	juce::AudioBuffer<float> block(1, gated.hopSize());
+	const auto spectrumSize = static_cast<size_t>(gated.spectrumSize());
+	const auto pitchSize = static_cast<size_t>(gated.pitchClassSize());
+	std::vector<float> gatedSpectrum(spectrumSize);
+	std::vector<float> ungatedSpectrum(spectrumSize);
+	std::vector<float> gatedPitch(pitchSize);
+	std::vector<float> ungatedPitch(pitchSize);
+	auto phase = 0.0;
+	auto maximumPitchDifference = 0.0f;
+	auto spectraMatch = true;
+	for (int hop = 0; hop < 200; ++hop) {
+		if (hop < 40 || hop >= 140)
+			fillSine(block, frequency, sampleRate, phase);
+		else
+			block.clear();
+
+		const auto gatedRows = gated.process({ &block, 0, block.getNumSamples() });
+		const auto ungatedRows = ungated.process({ &block, 0, block.getNumSamples() });
+		if (gatedRows != ungatedRows)
+			return expect(false, "the silence gate should not change the number of published rows");
+		if (gatedRows == 0)
+			continue;
+
+		gated.copyAnalysisFramesAfter(gated.sequence() - 1, gatedSpectrum.data(),
+			static_cast<int>(spectrumSize), gatedPitch.data(), static_cast<int>(pitchSize));
+		ungated.copyAnalysisFramesAfter(ungated.sequence() - 1, ungatedSpectrum.data(),
+			static_cast<int>(spectrumSize), ungatedPitch.data(), static_cast<int>(pitchSize));
+		spectraMatch = spectraMatch && gatedSpectrum == ungatedSpectrum;
+		for (size_t bin = 0; bin < pitchSize; ++bin)
+			maximumPitchDifference = std::max(maximumPitchDifference, std::abs(gatedPitch[bin] - ungatedPitch[bin]));
+	}
+
+	return expect(gated.gatedRows() > 50, "rows of a silent frame should skip the FFT")
+		&& expect(ungated.gatedRows() == 0, "-infinity should disable the silence gate")
+		&& expect(spectraMatch, "gated rows should equal the floor the FFT would have produced")
+		&& expect(maximumPitchDifference < 0.01f,
+			"skipping silent hops should leave the pitch tracker in the state it would have reached ("
+			+ std::to_string(maximumPitchDifference) + ")")
+		&& expect(pitchFieldAtFrequency(gatedPitch, frequency, 440.0) > 0.5f,
+			"pitch tracking should resume when the signal returns");
+}
+
+bool testAnalysisStages()
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr double firstFrequency = 220.0;
+	constexpr double secondFrequency = 330.0;
+	Spectrogram both;
+	Spectrogram spectrumOnly;
+	Spectrogram pitchOnly;
+	spectrumOnly.setPitchTrackingEnabled(false);
+	pitchOnly.setSpectrumEnabled(false);
+	for (auto* analyzer : { &both, &spectrumOnly, &pitchOnly })
+		analyzer->prepare(sampleRate);
+
+	juce::AudioBuffer<float> block(1, both.hopSize());
+	const auto spectrumSize = static_cast<size_t>(both.spectrumSize());
+	const auto pitchSize = static_cast<size_t>(both.pitchClassSize());
+	std::vector<float> referenceSpectrum(spectrumSize);
+	std::vector<float> referencePitch(pitchSize);
+	std::vector<float> spectrum(spectrumSize);
+	std::vector<float> pitch(pitchSize);
+	auto phase = 0.0;
+	auto stagesMatch = true;
+	for (int hop = 0; hop < 60; ++hop) {
+		fillSine(block, firstFrequency, sampleRate, phase);
+		for (auto* analyzer : { &both, &spectrumOnly, &pitchOnly })
+			analyzer->process({ &block, 0, block.getNumSamples() });
+		if (both.sequence() == 0)
+			continue;
+
+		both.copyAnalysisFramesAfter(both.sequence() - 1, referenceSpectrum.data(),
+			static_cast<int>(spectrumSize), referencePitch.data(), static_cast<int>(pitchSize));
+		spectrumOnly.copyAnalysisFramesAfter(spectrumOnly.sequence() - 1, spectrum.data(),
+			static_cast<int>(spectrumSize), pitch.data(), static_cast<int>(pitchSize));
+		stagesMatch = stagesMatch && spectrum == referenceSpectrum
+			&& std::all_of(pitch.begin(), pitch.end(), [](float value) { return approximatelyEqual(value, 0.0f); });
+		pitchOnly.copyAnalysisFramesAfter(pitchOnly.sequence() - 1, spectrum.data(),
+			static_cast<int>(spectrumSize), pitch.data(), static_cast<int>(pitchSize));
+		stagesMatch = stagesMatch && pitch == referencePitch
+			&& std::all_of(spectrum.begin(), spectrum.end(), [&](float value) {
+				return approximatelyEqual(value, pitchOnly.floorDb());
+			});
+	}
+	if (!expect(stagesMatch, "a disabled stage should publish empty rows without changing the other stage")
+		|| !expect(spectrumOnly.sequence() == both.sequence() && pitchOnly.sequence() == both.sequence(),
+			"disabled stages should keep publishing rows")) {
+		return false;
+	}
+
+	// A tracker that merely paused would still hold the first note at full
+	// strength when it resumes.
+	both.setPitchTrackingEnabled(false);
+	for (int hop = 0; hop < 20; ++hop) {
+		fillSine(block, secondFrequency, sampleRate, phase);
+		both.process({ &block, 0, block.getNumSamples() });
+	}
+	both.setPitchTrackingEnabled(true);
+	fillSine(block, secondFrequency, sampleRate, phase);
+	both.process({ &block, 0, block.getNumSamples() });
+	both.copyLatestPitchClass(pitch.data(), static_cast<int>(pitchSize));
+	return expect(pitchFieldAtFrequency(referencePitch, firstFrequency, 440.0) > 0.5f,
+			"the first note should have been tracked before pitch tracking was disabled")
+		&& expect(pitchFieldAtFrequency(pitch, firstFrequency, 440.0) < 0.05f,
+			"re-enabling pitch tracking should start from a reset tracker");
+}
+
+bool testPitchUpdateInterval()
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr double frequency = 440.0;
+	constexpr int updateInterval = 96;
+	constexpr int hops = 40;
+	Spectrogram rowRate;
+	Spectrogram frequent;
+	frequent.setPitchUpdateInterval(3);
+	if (!expect(frequent.pitchUpdateInterval() == Spectrogram::minimumPitchUpdateInterval,
+			"short pitch update intervals should be raised to the minimum")) {
+		return false;
+	}
+	frequent.setPitchUpdateInterval(updateInterval);
+	rowRate.prepare(sampleRate);
+	frequent.prepare(sampleRate);
+
+	juce::AudioBuffer<float> block(1, frequent.hopSize());
+	auto rowRatePhase = 0.0;
+	auto frequentPhase = 0.0;
+	for (int hop = 0; hop < hops; ++hop) {
+		fillSine(block, frequency, sampleRate, rowRatePhase);
+		rowRate.process({ &block, 0, block.getNumSamples() });
+		fillSine(block, frequency, sampleRate, frequentPhase);
+		frequent.process({ &block, 0, block.getNumSamples() });
+	}
+
+	const auto pitchSize = frequent.pitchClassSize();
+	const auto expectedUpdates = hops * frequent.hopSize() / updateInterval;
+	std::vector<float> updates(static_cast<size_t>(pitchSize * Spectrogram::pitchUpdateHistoryCapacity));
+	std::vector<std::uint64_t> positions(static_cast<size_t>(Spectrogram::pitchUpdateHistoryCapacity));
+	std::uint64_t copiedThrough = 0;
+	const auto copied = frequent.copyPitchUpdatesAfter(0, updates.data(), static_cast<int>(updates.size()),
+		positions.data(), &copiedThrough);
+	auto evenlySpaced = true;
+	for (int update = 0; update < copied; ++update) {
+		evenlySpaced = evenlySpaced
+			&& positions[static_cast<size_t>(update)] == static_cast<std::uint64_t>((update + 1) * updateInterval);
+	}
+	if (!expect(rowRate.pitchUpdateSequence() == rowRate.sequence(),
+			"without an interval every row should publish one pitch update")
+		|| !expect(copied == expectedUpdates && copiedThrough == static_cast<std::uint64_t>(expectedUpdates),
+			"pitch updates should follow their interval rather than the hop")
+		|| !expect(evenlySpaced, "pitch updates should report the input position they were calculated at")) {
+		return false;
+	}
+
+	const auto latestUpdateBegin = updates.begin() + (copied - 1) * pitchSize;
+	const std::vector<float> latestUpdate(latestUpdateBegin, latestUpdateBegin + pitchSize);
+	std::vector<float> rowPitch(static_cast<size_t>(pitchSize));
+	frequent.copyLatestPitchClass(rowPitch.data(), pitchSize);
+	return expect(pitchFieldPeak(latestUpdate) == pitchFieldBinForFrequency(frequency, 440.0),
+			"the newest pitch update should track the tone")
+		&& expect(rowPitch == latestUpdate, "rows should carry the newest pitch update");
+}
+
+// The governor's test clock. Every reading advances it by testClockStep, so
+// each process() call, which reads it twice, appears to take one step.
+double testClockSeconds = 0.0;
+double testClockStep = 0.0;
+
+double readTestClock() noexcept
+{
+	testClockSeconds += testClockStep;
+	return testClockSeconds;
+}
+
+bool testQualityGovernor()
+{
+	constexpr double sampleRate = 48000.0;
+	constexpr double frequency = 220.0;
+	// A stopped clock measures no load, so only dropped samples overload
+	// the analyzer and it recovers however slow the test machine is.
+	testClockStep = 0.0;
+	Spectrogram analyzer;
+	SpectrogramTestAccess::setGovernorClock(analyzer, readTestClock);
+	analyzer.setQualityGovernorEnabled(true);
+	analyzer.prepare(sampleRate);
+	juce::AudioBuffer<float> burst(1, analyzer.fftSize() * 10);
+	juce::AudioBuffer<float> block(1, analyzer.hopSize());
+	auto phase = 0.0;
+	// Bursts larger than the input FIFO drop samples, which the governor
+	// treats as overload; two bursts last longer than its step-down delay.
+	const auto feedOverload = [&](int steps) {
+		for (int call = 0; call < steps * 2; ++call) {
+			fillSine(burst, frequency, sampleRate, phase);
+			analyzer.process({ &burst, 0, burst.getNumSamples() });
+		}
+	};
+	const auto feedBlocks = [&](int hops) {
+		for (int hop = 0; hop < hops; ++hop) {
+			fillSine(block, frequency, sampleRate, phase);
+			analyzer.process({ &block, 0, block.getNumSamples() });
+		}
+	};
+
+	const auto heldNoteId = [&analyzer]() -> std::uint32_t {
+		std::array<spectroscope::TrackedPitch, 4> notes {};
+		const auto count = analyzer.copyLatestTrackedNotes(notes.data(), static_cast<int>(notes.size()));
+		const auto held = std::find_if(notes.begin(), notes.begin() + count,
+			[](const spectroscope::TrackedPitch& note) {
+				return std::abs(1200.0 * std::log2(note.frequencyHz / frequency)) < 50.0;
+			});
+		return held != notes.begin() + count ? held->id : 0;
+	};
+
+	// Entering and leaving decimated pitch tracking changes the tracker's
+	// rate without restarting a held note. Load alone steps quality down,
+	// so the tone reaches the analyzer without gaps.
+	feedBlocks(60);
+	const auto fullQualityId = heldNoteId();
+	testClockStep = 2.0 * analyzer.hopSize() / sampleRate;
+	for (int hop = 0; hop < 400 && analyzer.qualityLevel() == Spectrogram::QualityLevel::full; ++hop)
+		feedBlocks(1);
+	for (int hop = 0; hop < 400 && analyzer.qualityLevel() != Spectrogram::QualityLevel::reducedPitchTracking;
+		 ++hop) {
+		feedBlocks(1);
+	}
+	testClockStep = 0.0;
+	feedBlocks(20);
+	const auto decimatedId = heldNoteId();
+	feedBlocks(static_cast<int>(7.0 * sampleRate) / analyzer.hopSize());
+	const auto recoveredQuality = analyzer.qualityLevel();
+	if (!expect(fullQualityId != 0 && decimatedId == fullQualityId,
+			"a held note should keep its id when pitch tracking is decimated")
+		|| !expect(recoveredQuality == Spectrogram::QualityLevel::full && heldNoteId() == fullQualityId,
+			"a held note should keep its id when quality recovers")) {
+		return false;
+	}
+
+	feedOverload(2);
+	feedBlocks(150);
+	std::vector<float> pitch(static_cast<size_t>(analyzer.pitchClassSize()));
+	analyzer.copyLatestPitchClass(pitch.data(), static_cast<int>(pitch.size()));
+	if (!expect(analyzer.qualityLevel() == Spectrogram::QualityLevel::reducedPitchTracking,
+			"sustained overload should step quality down one level at a time")
+		|| !expect(pitchFieldAtFrequency(pitch, frequency, 440.0) > 0.5f,
+			"decimated pitch tracking should still find the note")) {
+		return false;
+	}
+
+	feedOverload(2);
+	feedBlocks(4);
+	constexpr int rowCount = 4;
+	const auto spectrumSize = analyzer.spectrumSize();
+	std::vector<float> spectra(static_cast<size_t>(spectrumSize * rowCount));
+	std::vector<float> pitches(static_cast<size_t>(analyzer.pitchClassSize() * rowCount));
+	const auto firstSequence = analyzer.sequence() - rowCount + 1;
+	analyzer.copyAnalysisFramesAfter(firstSequence - 1, spectra.data(), static_cast<int>(spectra.size()),
+		pitches.data(), static_cast<int>(pitches.size()));
+	// Rows with an even sequence number are the held ones.
+	const auto computedRow = static_cast<int>(firstSequence % 2 == 1 ? 0 : 1);
+	const auto row = [&](int index) { return spectra.begin() + index * spectrumSize; };
+	const auto expectedBin = frequency * analyzer.fftSize() / sampleRate;
+	const auto reducedPeak = peakBin(spectra.data() + computedRow * spectrumSize, spectrumSize);
+	if (!expect(analyzer.qualityLevel() == Spectrogram::QualityLevel::reducedFftSize,
+			"continued overload should reach the lowest quality level")
+		|| !expect(std::equal(row(computedRow), row(computedRow + 1), row(computedRow + 1)),
+			"every second row should repeat its predecessor at reduced row rate")
+		|| !expect(std::none_of(pitches.begin(), pitches.end(), [](float value) { return value > 0.0f; }),
+			"pitch tracking should be off at the lowest quality levels")
+		|| !expect(std::abs(static_cast<double>(reducedPeak) - expectedBin) < 1.5,
+			"the half-size FFT should keep peaks at their frequency")) {
+		return false;
+	}
+
+	feedBlocks(static_cast<int>(14.0 * sampleRate) / analyzer.hopSize());
+	if (!expect(analyzer.qualityLevel() == Spectrogram::QualityLevel::full,
+			"quality should recover step by step once the load is low")) {
+		return false;
+	}
+
+	// Analysis taking twice as long as the audio it covers overloads the
+	// analyzer without any dropped samples.
+	const auto droppedBefore = analyzer.droppedSamples();
+	testClockStep = 2.0 * analyzer.hopSize() / sampleRate;
+	feedBlocks(static_cast<int>(sampleRate) / analyzer.hopSize());
+	testClockStep = 0.0;
+	if (!expect(analyzer.qualityLevel() != Spectrogram::QualityLevel::full
+				&& analyzer.droppedSamples() == droppedBefore,
+			"a measured load above one should step quality down")) {
+		return false;
+	}
+	feedBlocks(static_cast<int>(14.0 * sampleRate) / analyzer.hopSize());
+	return expect(analyzer.qualityLevel() == Spectrogram::QualityLevel::full,
+		"quality should recover once the measured load drops");
+}
+
+// The FIFO backlog signal only sees blocks larger than half the input FIFO,
+// 4 * fftSize() samples, since every process() call drains it.
+bool testQualityGovernorBacklog()
+{
+	constexpr double sampleRate = 48000.0;
+	testClockStep = 0.0;
+	const auto feed = [sampleRate](Spectrogram& analyzer, int blockSize, int calls) {
+		juce::AudioBuffer<float> block(1, blockSize);
+		auto phase = 0.0;
+		for (int call = 0; call < calls; ++call) {
+			fillSine(block, 220.0, sampleRate, phase);
+			analyzer.process({ &block, 0, blockSize });
+		}
+	};
+
+	Spectrogram belowHalf;
+	SpectrogramTestAccess::setGovernorClock(belowHalf, readTestClock);
+	belowHalf.setQualityGovernorEnabled(true);
+	belowHalf.prepare(sampleRate);
+	feed(belowHalf, belowHalf.fftSize() * 3, 10);
+
+	Spectrogram aboveHalf;
+	SpectrogramTestAccess::setGovernorClock(aboveHalf, readTestClock);
+	aboveHalf.setQualityGovernorEnabled(true);
+	aboveHalf.prepare(sampleRate);
+	feed(aboveHalf, aboveHalf.fftSize() * 5, 10);
+
+	return expect(belowHalf.qualityLevel() == Spectrogram::QualityLevel::full,
+			"blocks below half the FIFO should not count as a backlog")
+		&& expect(aboveHalf.qualityLevel() != Spectrogram::QualityLevel::full
+				&& aboveHalf.droppedSamples() == 0,
+			"blocks above half the FIFO should count as a backlog without dropping samples");
+}
+
 bool testBinCentredSine()
 {
 	Spectrogram analyzer;
@@ -636,6 +1366,153 @@ bool testSpectrumFrameHistoryOrderAndWraparound()
 			"already consumed spectrum frames should not be copied again");
 }
 
+struct ResonatorBankState {
+	std::vector<float> cosineStep;
+	std::vector<float> sineStep;
+	std::vector<float> decay;
+	std::vector<float> cosinePhase;
+	std::vector<float> sinePhase;
+	std::vector<float> inPhase;
+	std::vector<float> quadrature;
+
+	spectroscope::simd::ResonatorBank bank()
+	{
+		return { cosineStep.data(), sineStep.data(), decay.data(), cosinePhase.data(),
+			sinePhase.data(), inPhase.data(), quadrature.data(), static_cast<int>(decay.size()) };
+	}
+};
+
+bool closeRelative(const std::vector<float>& expected, const std::vector<float>& actual, float tolerance)
+{
+	for (std::size_t index = 0; index < expected.size(); ++index) {
+		if (std::abs(expected[index] - actual[index]) > tolerance * std::max(1.0f, std::abs(expected[index])))
+			return false;
+	}
+	return true;
+}
+
+// Every vector variant the CPU can run must match the scalar reference. The
+// odd sizes leave remainders for the scalar tails of each variant.
+bool testSimdKernelVariantsAgree()
+{
+	namespace simd = spectroscope::simd;
+	constexpr int resonatorCount = 37;
+	constexpr int sampleCount = 301;
+	constexpr int magnitudeCount = 45;
+	std::uint32_t randomState = 0x13572468u;
+	const auto nextRandom = [&randomState] {
+		randomState = randomState * 1664525u + 1013904223u;
+		return static_cast<float>((randomState >> 8) & 0x00ffffffu) / static_cast<float>(0x00ffffffu);
+	};
+
+	ResonatorBankState initial;
+	for (int resonator = 0; resonator < resonatorCount; ++resonator) {
+		const auto radians = 0.001f + 0.5f * nextRandom();
+		const auto phase = 6.2831853f * nextRandom();
+		initial.cosineStep.push_back(std::cos(radians));
+		initial.sineStep.push_back(std::sin(radians));
+		initial.decay.push_back(0.99f + 0.0099f * nextRandom());
+		initial.cosinePhase.push_back(std::cos(phase));
+		initial.sinePhase.push_back(std::sin(phase));
+		initial.inPhase.push_back(20.0f * nextRandom() - 10.0f);
+		initial.quadrature.push_back(20.0f * nextRandom() - 10.0f);
+	}
+	std::vector<float> input;
+	for (int sample = 0; sample < sampleCount; ++sample)
+		input.push_back(2.0f * nextRandom() - 1.0f);
+	std::vector<float> magnitudes { 0.0f, -1.0f, 1.0e-30f, 1.0e-6f, 1.0f, 4.0f };
+	while (static_cast<int>(magnitudes.size()) < magnitudeCount)
+		magnitudes.push_back(std::pow(10.0f, -6.0f * nextRandom()));
+
+	const auto run = [&](const simd::Kernels& kernels, ResonatorBankState& state,
+		std::vector<float>& bankMagnitudes, std::vector<float>& decibels) {
+		state = initial;
+		kernels.updateResonators(state.bank(), input.data(), sampleCount);
+		bankMagnitudes.assign(static_cast<std::size_t>(resonatorCount), 0.0f);
+		kernels.resonatorMagnitudes(state.bank(), bankMagnitudes.data());
+		decibels.assign(static_cast<std::size_t>(magnitudeCount), 0.0f);
+		kernels.magnitudesToDecibels(magnitudes.data(), 0.5f, -100.0f, decibels.data(), magnitudeCount);
+	};
+
+	ResonatorBankState reference;
+	std::vector<float> referenceMagnitudes;
+	std::vector<float> referenceDecibels;
+	run(*simd::kernelsFor(simd::InstructionSet::scalar), reference, referenceMagnitudes, referenceDecibels);
+
+	auto passed = true;
+	for (const auto instructionSet : { simd::InstructionSet::sse2, simd::InstructionSet::avx2,
+			 simd::InstructionSet::avx512, simd::InstructionSet::neon }) {
+		const auto* kernels = simd::kernelsFor(instructionSet);
+		if (kernels == nullptr)
+			continue;
+
+		ResonatorBankState state;
+		std::vector<float> bankMagnitudes;
+		std::vector<float> decibels;
+		run(*kernels, state, bankMagnitudes, decibels);
+		const std::string name = simd::instructionSetName(instructionSet);
+		passed = expect(kernels->instructionSet == instructionSet,
+				name + " kernels should report their instruction set")
+			&& expect(closeRelative(reference.cosinePhase, state.cosinePhase, 1.0e-4f)
+				&& closeRelative(reference.sinePhase, state.sinePhase, 1.0e-4f),
+				name + " resonator phases should match the scalar reference")
+			&& expect(closeRelative(reference.inPhase, state.inPhase, 1.0e-4f)
+				&& closeRelative(reference.quadrature, state.quadrature, 1.0e-4f),
+				name + " resonator states should match the scalar reference")
+			&& expect(closeRelative(referenceMagnitudes, bankMagnitudes, 1.0e-4f),
+				name + " resonator magnitudes should match the scalar reference")
+			&& expect(closeRelative(referenceDecibels, decibels, 1.0e-5f),
+				name + " decibel levels should match the scalar reference within 0.001 dB")
+			&& passed;
+	}
+
+	const auto forcedScalar = simd::forceInstructionSet(simd::InstructionSet::scalar)
+		&& simd::kernels().instructionSet == simd::InstructionSet::scalar;
+	simd::clearForcedInstructionSet();
+	const auto& automatic = simd::kernels();
+	return passed
+		&& expect(forcedScalar, "the scalar kernels should be selectable for testing")
+		&& expect(&automatic == simd::kernelsFor(automatic.instructionSet),
+			"automatic selection should return a supported kernel table");
+}
+
+bool testTraceExport()
+{
+	namespace trace = spectroscope::trace;
+	trace::clear();
+	std::thread worker([] {
+		trace::setCurrentThreadName("Trace test worker");
+		const auto start = trace::nowNanoseconds();
+		{
+			const trace::ScopedEvent inner("inner scope");
+		}
+		trace::recordComplete("outer scope", start, trace::nowNanoseconds());
+		trace::recordInstant("marker");
+	});
+	worker.join();
+
+	std::ostringstream chrome;
+	std::ostringstream perfetto;
+	if (!expect(trace::writeChromeJson(chrome) && trace::writePerfettoProtobuf(perfetto),
+		"trace snapshots should be written to streams")) {
+		return false;
+	}
+
+	const auto json = chrome.str();
+	const auto protobuf = perfetto.str();
+	return expect(json.find("\"traceEvents\"") != std::string::npos
+		&& json.find("\"Trace test worker\"") != std::string::npos,
+		"Chrome trace should contain its event array and the named thread")
+		&& expect(json.find("\"inner scope\"") != std::string::npos
+			&& json.find("\"outer scope\"") != std::string::npos
+			&& json.find("\"ph\":\"i\"") != std::string::npos,
+			"Chrome trace should contain complete and instant events")
+		&& expect(!protobuf.empty() && protobuf.front() == '\x0a'
+			&& protobuf.find("inner scope") != std::string::npos
+			&& protobuf.find("Trace test worker") != std::string::npos,
+			"Perfetto trace should be a sequence of named TracePacket records");
+}
+
 bool testWaterfallTimelineMapping()
 {
 	constexpr int rowCount = 8;
@@ -699,6 +1576,92 @@ bool testFrequencyAxisMapping()
 			"horizontal mode should place Nyquist at the screen top");
 }
 
+bool testTexelPacking()
+{
+	namespace packing = spectroscope::texel_packing;
+	const auto infinity = std::numeric_limits<float>::infinity();
+	// The largest half float, 65504, plus half a step rounds to even, which
+	// is infinity.
+	const auto halfOverflow = std::ldexp(1.0f, 15) * (2.0f - std::ldexp(1.0f, -11));
+	const std::array<std::pair<float, std::uint16_t>, 15> halves { {
+		{ 0.0f, 0x0000u },
+		{ -0.0f, 0x8000u },
+		{ 1.0f, 0x3c00u },
+		{ -2.0f, 0xc000u },
+		// Subnormals: the smallest, half of it rounding down to even zero, and
+		// one and a half of it rounding up to even two.
+		{ std::ldexp(1.0f, -24), 0x0001u },
+		{ std::ldexp(1.0f, -25), 0x0000u },
+		{ std::ldexp(3.0f, -25), 0x0002u },
+		{ std::ldexp(1.0f, -14) - std::ldexp(1.0f, -24), 0x03ffu },
+		// Ties between normal neighbours go to the even mantissa.
+		{ 1.0f + std::ldexp(1.0f, -11), 0x3c00u },
+		{ 1.0f + std::ldexp(3.0f, -11), 0x3c02u },
+		{ 65504.0f, 0x7bffu },
+		{ halfOverflow, 0x7c00u },
+		{ 1.0e6f, 0x7c00u },
+		{ infinity, 0x7c00u },
+		{ -infinity, 0xfc00u },
+	} };
+	for (const auto& [value, expected] : halves) {
+		const auto half = packing::toHalf(value);
+		if (!expect(half == expected, "toHalf(" + std::to_string(value) + ") should be "
+				+ std::to_string(expected) + ", not " + std::to_string(half))) {
+			return false;
+		}
+	}
+	const auto nan = packing::toHalf(std::numeric_limits<float>::quiet_NaN());
+	if (!expect((nan & 0x7c00u) == 0x7c00u && (nan & 0x03ffu) != 0, "toHalf should keep NaN a NaN"))
+		return false;
+
+	constexpr float floorDb = -100.0f;
+	const packing::UnormRange range(floorDb, 0.0f);
+	return expect(range.toUnorm16(floorDb) == 0 && range.toUnorm8(floorDb) == 0,
+			"the floor should pack to zero")
+		&& expect(range.toUnorm16(0.0f) == 65535 && range.toUnorm8(0.0f) == 255,
+			"0 dB should pack to the largest normalized value")
+		&& expect(range.toUnorm16(-150.0f) == 0 && range.toUnorm8(-150.0f) == 0,
+			"values below the floor should clamp to zero")
+		&& expect(range.toUnorm16(12.0f) == 65535 && range.toUnorm8(12.0f) == 255,
+			"values above 0 dB should clamp to the largest normalized value")
+		&& expect(range.toUnorm16(-50.0f) == 32768 && range.toUnorm8(-50.0f) == 128,
+			"the middle of the range should round to the nearest step");
+}
+
+bool testColumnMapping()
+{
+	using namespace spectroscope::frequency_axis;
+	ColumnParameters parameters;
+	parameters.sampleRate = 48000.0;
+	parameters.minimumFrequencyHz = parameters.sampleRate / 2048.0;
+	const auto a4Position = normalisedPosition(440.0, parameters.sampleRate, parameters.minimumFrequencyHz, true);
+	const auto a4 = columnMapping(a4Position, parameters);
+	const auto quarterTone = columnMapping(normalisedPosition(440.0 * std::exp2(1.0 / 24.0),
+		parameters.sampleRate, parameters.minimumFrequencyHz, true), parameters);
+	const auto e5 = columnMapping(normalisedPosition(440.0 * std::exp2(7.0 / 12.0),
+		parameters.sampleRate, parameters.minimumFrequencyHz, true), parameters);
+
+	std::array<ColumnMapping, 64> columns {};
+	fillColumnMappings(columns.data(), static_cast<int>(columns.size()), parameters);
+	auto ascending = true;
+	for (size_t column = 1; column < columns.size(); ++column)
+		ascending = ascending && columns[column].frequencyPosition > columns[column - 1].frequencyPosition;
+
+	return expect(std::abs(a4.frequencyPosition - 440.0f / 24000.0f) < 1.0e-5f,
+			"a column mapping should invert the logarithmic axis position")
+		&& expect(std::abs(a4.trackedPosition - 3.0f / 6.0f) < 1.0e-4f,
+			"concert A should sit three of six octaves into the tracked field")
+		&& expect(std::abs(a4.hue - 3.0f / 12.0f) < 1.0e-5f && a4.tuningSaturation > 0.99f,
+			"A should take the fourth circle-of-fifths hue at full tuning saturation")
+		&& expect(std::abs(e5.hue - 4.0f / 12.0f) < 1.0e-5f,
+			"a fifth above A should take the next circle-of-fifths hue")
+		&& expect(quarterTone.tuningSaturation < 0.01f,
+			"a quarter tone between notes should have no tuning saturation")
+		&& expect(ascending && columns.front().frequencyPosition > 0.0f
+			&& columns.back().frequencyPosition < 1.0f,
+			"pixel centres should map to rising frequencies strictly inside the axis");
+}
+
 bool testNoteAtlasLayout()
 {
 	using namespace spectroscope::note_atlas;
@@ -725,22 +1688,64 @@ bool testNoteAtlasLayout()
 		&& expect(aboveRange.x == last.x && aboveRange.y == last.y,
 			"out-of-range high notes should clamp to the final atlas cell");
 }
+
+bool testFrameTimingWindow()
+{
+	using spectroscope::frame_timing::RollingWindow;
+	RollingWindow window;
+	if (!expect(window.summary().sampleCount == 0 && window.missedFrames() == 0,
+		"an empty timing window should report nothing")) {
+		return false;
+	}
+
+	// Continuous redrawing at 60 Hz with one frame that missed a vertical blank.
+	for (int frame = 0; frame < RollingWindow::windowSize + 10; ++frame)
+		window.add(frame == RollingWindow::windowSize ? 33.3f : 16.7f);
+	const auto summary = window.summary();
+	const auto expectedMean = (16.7f * static_cast<float>(RollingWindow::windowSize - 1) + 33.3f)
+		/ static_cast<float>(RollingWindow::windowSize);
+	if (!expect(summary.sampleCount == RollingWindow::windowSize,
+		"the timing window should keep only its most recent samples")
+		|| !expect(approximatelyEqual(summary.latestMs, 16.7f),
+			"the latest timing should be the last sample added")
+		|| !expect(approximatelyEqual(summary.maximumMs, 33.3f),
+			"the largest timing in the window should be reported")
+		|| !expect(std::abs(summary.meanMs - expectedMean) < 0.001f,
+			"the mean should cover the whole window")
+		|| !expect(window.missedFrames() == 1,
+			"one doubled frame interval should count as one missed frame")) {
+		return false;
+	}
+
+	for (int frame = 0; frame < RollingWindow::windowSize; ++frame)
+		window.add(16.7f);
+	window.add(-1.0f);
+	return expect(window.missedFrames() == 0 && approximatelyEqual(window.summary().latestMs, 0.0f),
+		"missed frames should leave the window and negative timings clamp to zero");
+}
 }
 
 int main()
 {
 	const auto passed = testPitchTrackerStablePitchAndDetuning() && testPitchTrackerDetectionLatency()
-		&& testPitchTrackerPresets()
+		&& testPitchTrackerPresets() && testPitchTrackerRetuneKeepsNotes() && testPitchTrackerLayouts()
+		&& testPitchTrackerAboveNyquist() && testPitchTrackerPolyphony()
 		&& testTrackedPitchMusicalValues()
 		&& testTrackedNoteDisplayFadeAndPaintOrder()
 		&& testTrackedNoteHorizontalHistory()
+		&& testTrackedNoteHistoryAnchors()
 		&& testPitchTrackerChordAndRelease()
 		&& testPitchTrackerHarmonicMusicalTone()
 		&& testPitchTrackerRejectsBroadbandNoise()
-		&& testSpectrogramPublishesTrackedPitch()
-		&& testSilence() && testBinCentredSine() && testResetAndOverflow()
-		&& testSpectrumFrameHistoryOrderAndWraparound() && testWaterfallTimelineMapping()
-		&& testFrequencyAxisMapping() && testNoteAtlasLayout();
+		&& testSpectrogramPublishesTrackedPitch() && testSpectrogramPublishesNoteEvents()
+		&& testSpectrogramPublishesFieldNotes() && testPublishListeners()
+		&& testSilence() && testSilenceGate() && testAnalysisStages() && testPitchUpdateInterval()
+		&& testQualityGovernor() && testQualityGovernorBacklog() && testBinCentredSine() && testResetAndOverflow()
+		&& testSpectrumFrameHistoryOrderAndWraparound() && testSimdKernelVariantsAgree()
+		&& testTraceExport()
+		&& testWaterfallTimelineMapping()
+		&& testFrequencyAxisMapping() && testTexelPacking() && testColumnMapping() && testNoteAtlasLayout()
+		&& testFrameTimingWindow();
 	if (passed)
 		std::cout << "All spectrogram analyzer tests passed\n";
 	return passed ? EXIT_SUCCESS : EXIT_FAILURE;